@@ -42,12 +42,12 @@ function generateCode(field_name, is_script) {
       });
 
       const merged_contents = [];
-      const marker_start = `//region_start ${field_name}`;
-      const marker_end = `//region_end ${field_name}`;
+      const marker_start = `// region_start ${field_name}`;
+      const marker_end = `// region_end ${field_name}`;
       let region_state = 0;
 
       rl.on("line", (line) => {
-        if (line.trim() === marker_start) {
+        if (line.trim().replace(/^\/\/\s*/, "// ") === marker_start) {
           region_state = 1;
           merged_contents.push(marker_start);
           merged_contents.push(output);
@@ -55,7 +55,7 @@ function generateCode(field_name, is_script) {
         } else {
           //Skip all existing content lines till region ends
           if (region_state === 1) {
-            if (line.trim() === marker_end) {
+            if (line.trim().replace(/^\/\/\s*/, "// ") === marker_end) {
               region_state = 2;
             }
           } else {
@@ -119,4 +119,10 @@ function minifyCss() {
     .pipe(generateCode("htmlHeadStyle", false));
 }
 
-exports.default = gulp.series(minifyJs, minifyHassDiscoveryJs, minifyCss);
+// gzipped copies of page CSS/JS, served by http_static.c
+function staticAssets(cb) {
+  require("./scripts/gen_static_assets.js");
+  cb();
+}
+
+exports.default = gulp.series(minifyJs, minifyHassDiscoveryJs, minifyCss, staticAssets);
@@ -50,7 +50,8 @@
 
 #define MQTT_OUTPUT_RINGBUF_SIZE 2048
 #define MQTT_VAR_HEADER_BUFFER_LEN 256
-#define MQTT_REQ_MAX_IN_FLIGHT 16
+#include "mqtt_patched.h"
+#define MQTT_REQ_MAX_IN_FLIGHT MQTT_PATCHED_REQ_MAX_IN_FLIGHT
 
 #include "lwip/apps/mqtt.h"
 #include "lwip/apps/mqtt_priv.h"
@@ -0,0 +1,9 @@
+#ifndef __MQTT_PATCHED_H__
+#define __MQTT_PATCHED_H__
+
+// Options of the lwIP MQTT client copy in mqtt_patched.c.
+// new_mqtt.c includes this on platforms that link mqtt_patched.c,
+// so its publish window matches the request slots really available.
+#define MQTT_PATCHED_REQ_MAX_IN_FLIGHT 16
+
+#endif // __MQTT_PATCHED_H__
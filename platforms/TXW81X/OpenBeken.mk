@@ -1,6 +1,8 @@
 OBK_DIR = ../../..
 
 CFLAGS +=  -DPLATFORM_TXW81X
+# libraries/mqtt_patched.c is built below
+CFLAGS +=  -DOBK_MQTT_PATCHED=1
 
 INCLUDES += -I$(OBK_DIR)/libraries/easyflash/inc
 
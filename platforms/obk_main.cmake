@@ -27,6 +27,7 @@ set(OBKM_SRC
 	${OBK_SRCS}hal/generic/hal_bt_proxy_generic.c
 	${OBK_SRCS}hal/generic/hal_flashConfig_generic.c
 	${OBK_SRCS}hal/generic/hal_flashVars_generic.c
+	${OBK_SRCS}hal/generic/hal_flashVars_journal.c
 	${OBK_SRCS}hal/generic/hal_generic.c
 	${OBK_SRCS}hal/generic/hal_hwtimer_generic.c
 	${OBK_SRCS}hal/generic/hal_main_generic.c
@@ -37,12 +38,16 @@ set(OBKM_SRC
 	${OBK_SRCS}httpserver/hass.c
 	${OBK_SRCS}httpserver/http_basic_auth.c
 	${OBK_SRCS}httpserver/http_fns.c
+	${OBK_SRCS}httpserver/http_tcp_select.c
+	${OBK_SRCS}httpserver/http_events.c
+	${OBK_SRCS}httpserver/http_static.c
 	${OBK_SRCS}httpserver/http_tcp_server.c
 	${OBK_SRCS}httpserver/new_tcp_server.c
 	${OBK_SRCS}httpserver/json_interface.c
 	${OBK_SRCS}httpserver/new_http.c
 	${OBK_SRCS}httpserver/rest_interface.c
 	${OBK_SRCS}mqtt/new_mqtt_deduper.c
+	${OBK_SRCS}mqtt/new_mqtt_topicTrie.c
 	${OBK_SRCS}jsmn/jsmn.c
 	${OBK_SRCS}logging/logging.c
 	${OBK_SRCS}mqtt/new_mqtt.c
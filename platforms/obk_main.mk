@@ -42,6 +42,7 @@ OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_adc_generic.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_bt_proxy_generic.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_flashConfig_generic.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_flashVars_generic.c
+OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_flashVars_journal.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_generic.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_hwtimer_generic.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_main_generic.c
@@ -52,12 +53,16 @@ OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_uart_generic.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/hass.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/http_basic_auth.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/http_fns.c
+OBKM_SRC  += $(OBK_SRCS)httpserver/http_tcp_select.c
+OBKM_SRC  += $(OBK_SRCS)httpserver/http_events.c
+OBKM_SRC  += $(OBK_SRCS)httpserver/http_static.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/http_tcp_server.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/new_tcp_server.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/json_interface.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/new_http.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/rest_interface.c
 OBKM_SRC  += $(OBK_SRCS)mqtt/new_mqtt_deduper.c
+OBKM_SRC  += $(OBK_SRCS)mqtt/new_mqtt_topicTrie.c
 OBKM_SRC  += $(OBK_SRCS)jsmn/jsmn.c
 OBKM_SRC  += $(OBK_SRCS)logging/logging.c
 OBKM_SRC  += $(OBK_SRCS)mqtt/new_mqtt.c
@@ -0,0 +1,66 @@
+// Generates src/httpserver/http_static_assets.h with gzipped page CSS/JS.
+// Input are the minified strings in new_http.c (regions written by gulp),
+// so run this after gulp or after editing these strings by hand:
+//   node scripts/gen_static_assets.js
+const fs = require("fs");
+const path = require("path");
+const zlib = require("zlib");
+const crypto = require("crypto");
+
+const srcDir = path.join(__dirname, "..", "src", "httpserver");
+const source = path.join(srcDir, "new_http.c");
+const target = path.join(srcDir, "http_static_assets.h");
+
+const assets = [
+	{ name: "obk.css", field: "htmlHeadStyle", mime: "httpMimeTypeCSS", prefix: "<style>", suffix: "</style>" },
+	{ name: "obk.js", field: "pageScript", mime: "httpMimeTypeJavascript", prefix: "<script type='text/javascript'>", suffix: "</script>" },
+];
+
+function readField(text, field) {
+	const re = new RegExp("const char " + field + "\\[\\] = \"((?:[^\"\\\\]|\\\\.)*)\";");
+	const m = text.match(re);
+	if (!m) {
+		throw new Error(`${field} not found in ${source}`);
+	}
+	return m[1].replace(/\\(.)/g, (all, c) => (c === "n" ? "\n" : c));
+}
+
+function toCArray(buf) {
+	const lines = [];
+	for (let i = 0; i < buf.length; i += 16) {
+		const row = [];
+		for (let j = i; j < Math.min(i + 16, buf.length); j++) {
+			row.push("0x" + buf[j].toString(16).padStart(2, "0"));
+		}
+		lines.push("\t" + row.join(","));
+	}
+	return lines.join(",\n");
+}
+
+const text = fs.readFileSync(source, "utf8");
+const out = [];
+out.push("// generated by scripts/gen_static_assets.js from new_http.c, do not edit");
+out.push("");
+const entries = [];
+for (const a of assets) {
+	let content = readField(text, a.field);
+	if (!content.startsWith(a.prefix) || !content.endsWith(a.suffix)) {
+		throw new Error(`${a.field} does not start with ${a.prefix}`);
+	}
+	content = Buffer.from(content.slice(a.prefix.length, content.length - a.suffix.length), "utf8");
+	const gz = zlib.gzipSync(content, { level: 9 });
+	const hash = crypto.createHash("sha1").update(content).digest("hex").slice(0, 8);
+	const id = a.name.replace(/\W/g, "_");
+	console.log(`${a.name}: ${content.length} bytes, gzipped ${gz.length}, hash ${hash}`);
+	out.push(`// ${a.name}, ${content.length} bytes before compression`);
+	out.push(`static const unsigned char ${id}_gz[] = {`);
+	out.push(toCArray(gz));
+	out.push("};");
+	out.push("");
+	entries.push(`\t{ "${a.name}", ${a.mime}, "${hash}", ${id}_gz, sizeof(${id}_gz), ${content.length} },`);
+}
+out.push("static const httpStaticAsset_t g_staticAssets[] = {");
+out.push(...entries);
+out.push("};");
+out.push("");
+fs.writeFileSync(target, out.join("\n"));
@@ -515,6 +515,16 @@ static commandResult_t CMD_FullBootTime(const void *context, const char *cmd, co
 	return CMD_RES_OK;
 }
 
+static commandResult_t CMD_FlashChannelStats(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	int writes, avoided, pending;
+
+	Channel_GetSaveStats(&writes, &avoided, &pending);
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Remembered channels: %i flash writes, %i writes avoided, pending %i",
+		writes, avoided, pending);
+
+	return CMD_RES_OK;
+}
+
 // cmd_enums.c
 commandResult_t CMD_SetChannelEnum(const void *context, const char *cmd,
 	const char *args, int cmdFlags);
@@ -598,6 +608,11 @@ void CMD_InitChannelCommands(){
 	//cmddetail:"fn":"CMD_FullBootTime","file":"cmnds/cmd_channels.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("FullBootTime", CMD_FullBootTime, NULL);
+	//cmddetail:{"name":"FlashChannelStats","args":"",
+	//cmddetail:"descr":"Prints how many flash writes were done for remembered channels (start value -1) and how many were avoided. Changes are written together, a few seconds after last one.",
+	//cmddetail:"fn":"CMD_FlashChannelStats","file":"cmnds/cmd_channels.c","requires":"",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("FlashChannelStats", CMD_FlashChannelStats, NULL);
 	//cmddetail:{"name":"SetChannelEnum","args":"[ChannelIndex][Value:Title][Value:Title]",
 	//cmddetail:"descr":"Creates a channel enumeration type.  Channel type must be set to Enum or ReadOnlyEnum. e.g. SetChannelEnum 1:One \"2:Enum Two\" 5:Five",
 	//cmddetail:"fn":"CMD_SetChannelEnum","file":"cmnds/cmd_channels.c","requires":"",
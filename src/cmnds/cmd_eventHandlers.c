@@ -309,16 +309,63 @@ typedef struct eventHandler_s {
 	// for UART event handlers?
 	char *requiredArgumentText;
 
+	// list of all handlers, for listing and freeing
 	struct eventHandler_s *next;
+	// next handler in the same eventCode bucket
+	struct eventHandler_s *nextInCode;
+	// next handler in the same eventCode+requiredArgument bucket
+	struct eventHandler_s *nextInArg;
 } eventHandler_t;
 
+// Handlers are kept in two hash tables, so dispatching an event only
+// visits handlers that can match it (instead of all handlers).
+// Both are chained with newest handler first, just like the main list,
+// so the execution order is the same as in a single list.
+// Change handlers need all handlers with given code
+#define EVENT_CODE_BUCKETS 16
+// Fire events need only handlers with given code and first argument
+#define EVENT_ARG_BUCKETS 32
+
 static eventHandler_t *g_eventHandlers = 0;
+static eventHandler_t *g_eventHandlersByCode[EVENT_CODE_BUCKETS];
+static eventHandler_t *g_eventHandlersByArg[EVENT_ARG_BUCKETS];
+
+#define EVENT_CODE_BUCKET(eventCode) ((eventCode) & (EVENT_CODE_BUCKETS - 1))
+
+static int EVENT_ArgBucket(byte eventCode, int argument) {
+	unsigned int h;
+
+	h = eventCode * 31 + (unsigned int)argument;
+	h ^= h >> 5;
+	return h & (EVENT_ARG_BUCKETS - 1);
+}
+static eventHandler_t *EVENT_AllocHandler(byte eventCode, int requiredArgument) {
+	eventHandler_t *ev = malloc(sizeof(eventHandler_t));
+	int b;
+
+	memset(ev, 0, sizeof(eventHandler_t));
+
+	ev->next = g_eventHandlers;
+	g_eventHandlers = ev;
+
+	b = EVENT_CODE_BUCKET(eventCode);
+	ev->nextInCode = g_eventHandlersByCode[b];
+	g_eventHandlersByCode[b] = ev;
+
+	b = EVENT_ArgBucket(eventCode, requiredArgument);
+	ev->nextInArg = g_eventHandlersByArg[b];
+	g_eventHandlersByArg[b] = ev;
+
+	ev->eventCode = eventCode;
+	ev->requiredArgument = requiredArgument;
+	return ev;
+}
 
 
 void EventHandlers_ProcessVariableChange_Integer(byte eventCode, int oldValue, int newValue) {
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByCode[EVENT_CODE_BUCKET(eventCode)];
 
 	while(ev) {
 		if(eventCode==ev->eventCode) {
@@ -327,7 +374,7 @@ void EventHandlers_ProcessVariableChange_Integer(byte eventCode, int oldValue, i
 				CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextInCode;
 	}
 
 #if ENABLE_OBK_SCRIPTING
@@ -337,40 +384,28 @@ void EventHandlers_ProcessVariableChange_Integer(byte eventCode, int oldValue, i
 
 void EventHandlers_AddEventHandler_Integer(byte eventCode, int type, int requiredArgument, int requiredArgument2, int requiredArgument3, const char *commandToRun)
 {
-	eventHandler_t *ev = malloc(sizeof(eventHandler_t));
-	memset(ev,0,sizeof(eventHandler_t));
-
-	ev->next = g_eventHandlers;
-	g_eventHandlers = ev;
+	eventHandler_t *ev = EVENT_AllocHandler(eventCode, requiredArgument);
 
 	ev->requiredArgumentText = NULL;
 	ev->eventType = type;
 	ev->command = strdup(commandToRun);
-	ev->eventCode = eventCode;
-	ev->requiredArgument = requiredArgument;
 	ev->requiredArgument2 = requiredArgument2;
 	ev->requiredArgument3 = requiredArgument3;
 }
 
 void EventHandlers_AddEventHandler_String(byte eventCode, int type, const char *requiredArgument, const char *commandToRun)
 {
-	eventHandler_t *ev = malloc(sizeof(eventHandler_t));
-	memset(ev,0,sizeof(eventHandler_t));
-
-	ev->next = g_eventHandlers;
-	g_eventHandlers = ev;
+	eventHandler_t *ev = EVENT_AllocHandler(eventCode, 0);
 
 	ev->requiredArgumentText = strdup(requiredArgument);
 	ev->eventType = type;
 	ev->command = strdup(commandToRun);
-	ev->eventCode = eventCode;
-	ev->requiredArgument = 0;
 	ev->requiredArgument2 = 0;
 }
 int EventHandlers_FireEvent3(byte eventCode, int argument, int argument2, int argument3) {
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByArg[EVENT_ArgBucket(eventCode, argument)];
 	int ran = 0;
 	while (ev) {
 		if (eventCode == ev->eventCode) {
@@ -380,7 +415,7 @@ int EventHandlers_FireEvent3(byte eventCode, int argument, int argument2, int ar
 				ran++;
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextInArg;
 	}
 	return ran;
 }
@@ -388,7 +423,7 @@ int EventHandlers_FireEvent2(byte eventCode, int argument, int argument2) {
 	struct eventHandler_s *ev;
 	int ret = 0;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByArg[EVENT_ArgBucket(eventCode, argument)];
 
 	while(ev) {
 		if(eventCode==ev->eventCode) {
@@ -398,7 +433,7 @@ int EventHandlers_FireEvent2(byte eventCode, int argument, int argument2) {
 				ret++;
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextInArg;
 	}
 	return ret;
 }
@@ -407,7 +442,7 @@ const char *EventHandlers_GetHandlerCommand2(byte eventCode, int argument, int a
 
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByArg[EVENT_ArgBucket(eventCode, argument)];
 
 	while (ev) {
 		if (eventCode == ev->eventCode) {
@@ -415,7 +450,7 @@ const char *EventHandlers_GetHandlerCommand2(byte eventCode, int argument, int a
 				return ev->command;
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextInArg;
 	}
 	return NULL;
 }
@@ -424,7 +459,7 @@ const char *EventHandlers_GetHandlerCommand2(byte eventCode, int argument, int a
 void EventHandlers_FireEvent(byte eventCode, int argument) {
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByArg[EVENT_ArgBucket(eventCode, argument)];
 
 	while(ev) {
 		if(eventCode==ev->eventCode) {
@@ -433,7 +468,7 @@ void EventHandlers_FireEvent(byte eventCode, int argument) {
 				CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextInArg;
 	}
 
 #if ENABLE_OBK_SCRIPTING
@@ -443,7 +478,7 @@ void EventHandlers_FireEvent(byte eventCode, int argument) {
 void EventHandlers_FireEvent_String(byte eventCode, const char *argument) {
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByCode[EVENT_CODE_BUCKET(eventCode)];
 
 	while(ev) {
 		if(eventCode==ev->eventCode) {
@@ -454,7 +489,7 @@ void EventHandlers_FireEvent_String(byte eventCode, const char *argument) {
 				}
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextInCode;
 	}
 
 }
@@ -534,6 +569,9 @@ commandResult_t CMD_ClearAllHandlers(const void *context, const char *cmd, const
 		next = ev->next;
 
 		free(ev->command);
+		if (ev->requiredArgumentText) {
+			free(ev->requiredArgumentText);
+		}
 		free(ev);
 
 		ev = next;
@@ -542,6 +580,8 @@ commandResult_t CMD_ClearAllHandlers(const void *context, const char *cmd, const
 
 	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "Fried %i handlers", c);
 	g_eventHandlers = 0;
+	memset(g_eventHandlersByCode, 0, sizeof(g_eventHandlersByCode));
+	memset(g_eventHandlersByArg, 0, sizeof(g_eventHandlersByArg));
 
 	return CMD_RES_OK;
 }
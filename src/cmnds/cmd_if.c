@@ -571,7 +571,46 @@ const constant_t g_constants[] = {
 #endif
 };
 
-static int g_totalConstants = sizeof(g_constants) / sizeof(g_constants[0]);
+#define TOTAL_CONSTANTS (sizeof(g_constants) / sizeof(g_constants[0]))
+static int g_totalConstants = TOTAL_CONSTANTS;
+
+#if ENABLE_EXPAND_CONSTANT
+// Lookup index for g_constants, built on first use.
+// Constants are chained in buckets by their first letter after optional '$',
+// keeping table order inside the bucket, because order matters
+// ($CH*** must be tried before $CH*, $rand01 before $rand).
+#define CONSTANT_BUCKETS 32
+// index + 1 of first constant in bucket, [0] - without $, [1] - with $ prefix
+static byte g_constantBuckets[2][CONSTANT_BUCKETS];
+// index + 1 of next constant in the same bucket
+static byte g_constantNext[TOTAL_CONSTANTS];
+static byte g_constantWildCard[TOTAL_CONSTANTS];
+static bool g_bConstantIndexBuilt = false;
+
+static int CMD_GetConstantBucket(const char *s, int *group) {
+	if (*s == '$') {
+		*group = 1;
+		s++;
+	}
+	else {
+		*group = 0;
+	}
+	return tolower((unsigned char)*s) & (CONSTANT_BUCKETS - 1);
+}
+static void CMD_BuildConstantIndex() {
+	int i, b, group;
+
+	memset(g_constantBuckets, 0, sizeof(g_constantBuckets));
+	// walk backwards, so chains keep the table order
+	for (i = g_totalConstants - 1; i >= 0; i--) {
+		b = CMD_GetConstantBucket(g_constants[i].constantName, &group);
+		g_constantNext[i] = g_constantBuckets[group][b];
+		g_constantBuckets[group][b] = i + 1;
+		g_constantWildCard[i] = strchr(g_constants[i].constantName, '*') != 0;
+	}
+	g_bConstantIndexBuilt = true;
+}
+#endif
 
 // tries to expand a given string into a constant
 // So, for $CH1 it will set out to given channel value
@@ -579,21 +618,37 @@ static int g_totalConstants = sizeof(g_constants) / sizeof(g_constants[0]);
 // Etc etc
 // Returns true if constant matches
 // Returns false if no constants found
-const char *CMD_ExpandConstantFloat(const char *s, const char *stop, float *out) {
+static const constant_t *CMD_FindConstant(const char *s, const char *stop, const char **after) {
 #if ENABLE_EXPAND_CONSTANT
 	const constant_t *var;
-	int i;
-	var = g_constants;
-	for (i = 0; i < g_totalConstants; i++, var++) {
-		bool bAllowWildCard = strstr(var->constantName, "*") != 0;
-		const char *ret = strCompareBound(s, var->constantName, stop, bAllowWildCard);
+	const char *ret;
+	int i, group;
+
+	if (g_bConstantIndexBuilt == false) {
+		CMD_BuildConstantIndex();
+	}
+	i = CMD_GetConstantBucket(s, &group);
+	for (i = g_constantBuckets[group][i]; i; i = g_constantNext[i - 1]) {
+		var = &g_constants[i - 1];
+		ret = strCompareBound(s, var->constantName, stop, g_constantWildCard[i - 1]);
 		if (ret) {
-			*out = var->getValue(s);
-			ADDLOG_IF_MATHEXP_DBG(LOG_FEATURE_EVENT, "CMD_ExpandConstantFloat: %s", var->name);
-			return ret;
+			*after = ret;
+			return var;
 		}
 	}
 #endif
+	return 0;
+}
+const char *CMD_ExpandConstantFloat(const char *s, const char *stop, float *out) {
+	const constant_t *var;
+	const char *ret;
+
+	var = CMD_FindConstant(s, stop, &ret);
+	if (var) {
+		*out = var->getValue(s);
+		ADDLOG_IF_MATHEXP_DBG(LOG_FEATURE_EVENT, "CMD_ExpandConstantFloat: %s", var->constantName);
+		return ret;
+	}
 	return false;
 }
 
@@ -873,16 +928,65 @@ const char *CMD_FindMatchingBrace(const char *s) {
 	return s;
 
 }
-float CMD_EvaluateExpression(const char *s, const char *stop) {
-	byte opCode;
-	const char *op;
-	float a, b, c;
-	int idx;
+static float CMD_ApplyOperator(byte opCode, float a, float b) {
+	float c;
 
-	if (s == 0)
-		return 0;
-	if (*s == 0)
-		return 0;
+	switch (opCode)
+	{
+	case OP_EQUAL:
+		c = a == b;
+		break;
+	case OP_EQUAL_OR_GREATER:
+		c = a >= b;
+		break;
+	case OP_EQUAL_OR_LESS:
+		c = a <= b;
+		break;
+	case OP_NOT_EQUAL:
+		c = a != b;
+		break;
+	case OP_GREATER:
+		c = a > b;
+		break;
+	case OP_LESS:
+		c = a < b;
+		break;
+	case OP_AND:
+		c = ((int)a) && ((int)b);
+		break;
+	case OP_OR:
+		c = ((int)a) || ((int)b);
+		break;
+	case OP_ADD:
+		c = a + b;
+		break;
+	case OP_SUB:
+		c = a - b;
+		break;
+	case OP_MUL:
+		c = a * b;
+		break;
+	case OP_DIV:
+		c = a / b;
+		break;
+	case OP_MODULO:
+		if (b == 0) {
+			c = 0;
+		}
+		else {
+			c = ((int)a) % ((int)b);
+		}
+		break;
+	default:
+		c = 0;
+		break;
+	}
+	return c;
+}
+// trims whitespaces and redundant outer braces, returns false for empty expression
+static bool CMD_TrimExpression(const char **ps, const char **pstop) {
+	const char *s = *ps;
+	const char *stop = *pstop;
 
 	// cull whitespaces at the end of expression
 	if (stop == 0) {
@@ -895,22 +999,37 @@ float CMD_EvaluateExpression(const char *s, const char *stop) {
 	while (isspace(((int)*s))) {
 		s++;
 		if (s >= stop) {
-			return 0;
+			return false;
 		}
 	}
 	while (*s == '(' && stop[-1] == ')' && CMD_FindMatchingBrace(s) == (stop-1)) {
 		s++;
 		stop--;
 	}
+	*ps = s;
+	*pstop = stop;
+	return true;
+}
+// Recursive evaluator. It re-parses the text on every call, but needs no
+// memory, so it is used for tokenizer arguments, which are mostly one-off
+// literals, and for expressions that can't be compiled.
+float CMD_EvaluateExpression(const char *s, const char *stop) {
+	byte opCode;
+	const char *op;
+	float a, b, c;
+	int idx;
+
+	if (s == 0)
+		return 0;
+	if (*s == 0)
+		return 0;
+
+	if (CMD_TrimExpression(&s, &stop) == false) {
+		return 0;
+	}
 	if (g_expDebugBuffer == 0) {
 		g_expDebugBuffer = malloc(EXPRESSION_DEBUG_BUFFER_SIZE);
 	}
-	if (1) {
-		idx = stop - s;
-		memcpy(g_expDebugBuffer, s, idx);
-		g_expDebugBuffer[idx] = 0;
-		ADDLOG_IF_MATHEXP_DBG(LOG_FEATURE_EVENT, "CMD_EvaluateExpression: will run '%s'", g_expDebugBuffer);
-	}
 	op = CMD_FindOperator(s, stop, &opCode);
 	if (op) {
 		const char *p2;
@@ -924,63 +1043,7 @@ float CMD_EvaluateExpression(const char *s, const char *stop) {
 		a = CMD_EvaluateExpression(s, op);
 		b = CMD_EvaluateExpression(p2, stop);
 
-		// Why, again, %f crashes?
-		//ADDLOG_INFO(LOG_FEATURE_EVENT, "CMD_EvaluateExpression: a = %f, b = %f", a, b);
-		// It crashes even on sprintf.
-		//sprintf(g_expDebugBuffer,"CMD_EvaluateExpression: a = %f, b = %f", a, b);
-		//ADDLOG_INFO(LOG_FEATURE_EVENT, g_expDebugBuffer);
-
-		switch (opCode)
-		{
-		case OP_EQUAL:
-			c = a == b;
-			break;
-		case OP_EQUAL_OR_GREATER:
-			c = a >= b;
-			break;
-		case OP_EQUAL_OR_LESS:
-			c = a <= b;
-			break;
-		case OP_NOT_EQUAL:
-			c = a != b;
-			break;
-		case OP_GREATER:
-			c = a > b;
-			break;
-		case OP_LESS:
-			c = a < b;
-			break;
-		case OP_AND:
-			c = ((int)a) && ((int)b);
-			break;
-		case OP_OR:
-			c = ((int)a) || ((int)b);
-			break;
-		case OP_ADD:
-			c = a + b;
-			break;
-		case OP_SUB:
-			c = a - b;
-			break;
-		case OP_MUL:
-			c = a * b;
-			break;
-		case OP_DIV:
-			c = a / b;
-			break;
-		case OP_MODULO:
-			if (b == 0) {
-				c = 0;
-			}
-			else {
-				c = ((int)a) % ((int)b);
-			}
-			break;
-		default:
-			c = 0;
-			break;
-		}
-		return c;
+		return CMD_ApplyOperator(opCode, a, b);
 	}
 	if (s[0] == '!') {
 		return !CMD_EvaluateExpression(s + 1, stop);
@@ -989,15 +1052,277 @@ float CMD_EvaluateExpression(const char *s, const char *stop) {
 		return c;
 	}
 
-	if (1) {
-		idx = stop - s;
-		memcpy(g_expDebugBuffer, s, idx);
-		g_expDebugBuffer[idx] = 0;
+	idx = stop - s;
+	if (idx >= EXPRESSION_DEBUG_BUFFER_SIZE) {
+		idx = EXPRESSION_DEBUG_BUFFER_SIZE - 1;
 	}
+	memcpy(g_expDebugBuffer, s, idx);
+	g_expDebugBuffer[idx] = 0;
 	ADDLOG_IF_MATHEXP_DBG(LOG_FEATURE_EVENT, "CMD_EvaluateExpression: will call atof for %s", g_expDebugBuffer);
 	return atof(g_expDebugBuffer);
 }
 
+// Compiled expressions.
+// Expression text is translated once, with the same rules as
+// CMD_EvaluateExpression, into a RPN program which is cached by text.
+// Only for call sites that evaluate the same text again and again (if).
+// Constant subexpressions are folded and $CHx is resolved to channel index.
+#define EXPRESSION_CACHE_SIZE	8
+#define EXPRESSION_MAX_OPS		32
+#define EXPRESSION_MAX_STACK	16
+#define EXPRESSION_MAX_SOURCE	96
+
+typedef enum {
+	EXPR_CONST,
+	EXPR_CHANNEL,
+	EXPR_GETTER,
+	EXPR_NOT,
+	EXPR_BINARY,
+} exprOpType_t;
+
+typedef struct exprOp_s {
+	byte type;
+	byte opCode;
+	short channel;
+	float value;
+	float(*getValue)(const char *s);
+	// constant name, points into exprCacheEntry_t src
+	const char *arg;
+} exprOp_t;
+
+typedef struct exprCacheEntry_s {
+	char *src;
+	int hash;
+	// NULL if expression is too complex and must be evaluated by recursive parser
+	exprOp_t *ops;
+	int numOps;
+	unsigned int lastUsed;
+} exprCacheEntry_t;
+
+typedef struct exprCompiler_s {
+	exprOp_t ops[EXPRESSION_MAX_OPS];
+	int numOps;
+	int depth;
+	bool bFailed;
+} exprCompiler_t;
+
+static exprCacheEntry_t g_exprCache[EXPRESSION_CACHE_SIZE];
+static unsigned int g_exprCacheTick = 0;
+// cache is shared by main and HTTP threads
+static SemaphoreHandle_t g_exprMutex = 0;
+
+static exprOp_t *EXP_Emit(exprCompiler_t *c, byte type, int stackChange) {
+	exprOp_t *o;
+
+	if (c->numOps >= EXPRESSION_MAX_OPS) {
+		c->bFailed = true;
+		return 0;
+	}
+	c->depth += stackChange;
+	if (c->depth > EXPRESSION_MAX_STACK) {
+		c->bFailed = true;
+		return 0;
+	}
+	o = &c->ops[c->numOps++];
+	memset(o, 0, sizeof(*o));
+	o->type = type;
+	return o;
+}
+static void EXP_EmitConst(exprCompiler_t *c, float value) {
+	exprOp_t *o = EXP_Emit(c, EXPR_CONST, 1);
+	if (o) {
+		o->value = value;
+	}
+}
+static void EXP_CompileRange(exprCompiler_t *c, const char *s, const char *stop) {
+	byte opCode;
+	const char *op, *after;
+	const constant_t *var;
+	exprOp_t *o, *prev;
+	char tmp[32];
+	int idx;
+
+	if (c->bFailed)
+		return;
+	if (*s == 0 || CMD_TrimExpression(&s, &stop) == false) {
+		EXP_EmitConst(c, 0);
+		return;
+	}
+	op = CMD_FindOperator(s, stop, &opCode);
+	if (op) {
+		EXP_CompileRange(c, s, op);
+		EXP_CompileRange(c, op + g_operators[opCode].len, stop);
+		if (c->bFailed)
+			return;
+		prev = &c->ops[c->numOps - 2];
+		if (prev[0].type == EXPR_CONST && prev[1].type == EXPR_CONST) {
+			prev[0].value = CMD_ApplyOperator(opCode, prev[0].value, prev[1].value);
+			c->numOps--;
+			c->depth--;
+			return;
+		}
+		o = EXP_Emit(c, EXPR_BINARY, -1);
+		if (o) {
+			o->opCode = opCode;
+		}
+		return;
+	}
+	if (s[0] == '!') {
+		EXP_CompileRange(c, s + 1, stop);
+		if (c->bFailed)
+			return;
+		prev = &c->ops[c->numOps - 1];
+		if (prev->type == EXPR_CONST) {
+			prev->value = !prev->value;
+			return;
+		}
+		EXP_Emit(c, EXPR_NOT, 0);
+		return;
+	}
+	var = CMD_FindConstant(s, stop, &after);
+	if (var) {
+		if (var->getValue == getChannelValue) {
+			o = EXP_Emit(c, EXPR_CHANNEL, 1);
+			if (o) {
+				o->channel = atoi(s + 3);
+			}
+		}
+		else {
+			o = EXP_Emit(c, EXPR_GETTER, 1);
+			if (o) {
+				o->getValue = var->getValue;
+				o->arg = s;
+			}
+		}
+		return;
+	}
+	idx = stop - s;
+	if (idx >= (int)sizeof(tmp)) {
+		c->bFailed = true;
+		return;
+	}
+	memcpy(tmp, s, idx);
+	tmp[idx] = 0;
+	EXP_EmitConst(c, atof(tmp));
+}
+static int EXP_HashString(const char *s) {
+	int hash = 0;
+	while (*s) {
+		hash = hash * 31 + (unsigned char)*s;
+		s++;
+	}
+	return hash;
+}
+static exprCacheEntry_t *EXP_GetCompiled(const char *s) {
+	exprCacheEntry_t *e, *oldest;
+	exprCompiler_t *c;
+	int hash, i;
+
+	hash = EXP_HashString(s);
+	oldest = &g_exprCache[0];
+	for (i = 0; i < EXPRESSION_CACHE_SIZE; i++) {
+		e = &g_exprCache[i];
+		if (e->src && e->hash == hash && !strcmp(e->src, s)) {
+			e->lastUsed = ++g_exprCacheTick;
+			return e;
+		}
+		if (e->lastUsed < oldest->lastUsed) {
+			oldest = e;
+		}
+	}
+	if (strlen(s) >= EXPRESSION_MAX_SOURCE) {
+		return 0;
+	}
+	c = malloc(sizeof(exprCompiler_t));
+	if (c == 0) {
+		return 0;
+	}
+	e = oldest;
+	free(e->src);
+	free(e->ops);
+	memset(e, 0, sizeof(*e));
+	e->src = strdup(s);
+	if (e->src == 0) {
+		free(c);
+		return 0;
+	}
+	e->hash = hash;
+	e->lastUsed = ++g_exprCacheTick;
+	memset(c, 0, sizeof(*c));
+	// compile the copy, so getter arguments can point into it
+	EXP_CompileRange(c, e->src, 0);
+	if (c->bFailed == false && c->depth == 1) {
+		e->ops = malloc(sizeof(exprOp_t) * c->numOps);
+		if (e->ops) {
+			memcpy(e->ops, c->ops, sizeof(exprOp_t) * c->numOps);
+			e->numOps = c->numOps;
+		}
+	}
+	free(c);
+	return e;
+}
+static float EXP_Run(const exprCacheEntry_t *e) {
+	float stack[EXPRESSION_MAX_STACK];
+	const exprOp_t *o;
+	int sp, i;
+
+	sp = 0;
+	for (i = 0; i < e->numOps; i++) {
+		o = &e->ops[i];
+		switch (o->type) {
+		case EXPR_CONST:
+			stack[sp++] = o->value;
+			break;
+		case EXPR_CHANNEL:
+			stack[sp++] = CHANNEL_Get(o->channel);
+			break;
+		case EXPR_GETTER:
+			stack[sp++] = o->getValue(o->arg);
+			break;
+		case EXPR_NOT:
+			stack[sp - 1] = !stack[sp - 1];
+			break;
+		case EXPR_BINARY:
+			sp--;
+			stack[sp - 1] = CMD_ApplyOperator(o->opCode, stack[sp - 1], stack[sp]);
+			break;
+		}
+	}
+	return stack[0];
+}
+static bool EXP_IsNumber(const char *s) {
+	char *end;
+
+	strtod(s, &end);
+	return end != s && *end == 0;
+}
+float CMD_EvaluateCachedExpression(const char *s) {
+	exprCacheEntry_t *e;
+	float ret;
+
+	if (s == 0)
+		return 0;
+	// nothing to gain from caching a literal
+	if (EXP_IsNumber(s)) {
+		return atof(s);
+	}
+	if (g_exprMutex == 0) {
+		g_exprMutex = xSemaphoreCreateMutex();
+	}
+	if (xSemaphoreTake(g_exprMutex, 10) != pdTRUE) {
+		return CMD_EvaluateExpression(s, 0);
+	}
+	e = EXP_GetCompiled(s);
+	if (e && e->ops) {
+		ret = EXP_Run(e);
+	}
+	else {
+		ret = CMD_EvaluateExpression(s, 0);
+	}
+	xSemaphoreGive(g_exprMutex);
+	return ret;
+}
+
 // if MQTTOnline then "qq" else "qq"
 commandResult_t CMD_If(const void *context, const char *cmd, const char *args, int cmdFlags) {
 	const char *cmdA;
@@ -1048,7 +1373,7 @@ commandResult_t CMD_If(const void *context, const char *cmd, const char *args, i
 	ADDLOG_IF_MATHEXP_DBG(LOG_FEATURE_EVENT, "CMD_If: condition is '%s'", condition);
 #endif
 
-	value = CMD_EvaluateExpression(condition, 0);
+	value = CMD_EvaluateCachedExpression(condition);
 
 	// This buffer is here because we may need to exec commands recursively
 	// and the Tokenizer_ etc is global?
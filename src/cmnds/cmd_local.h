@@ -15,12 +15,15 @@ typedef struct command_s {
 } command_t;
 
 command_t *CMD_Find(const char *name);
+command_t *CMD_Lookup(const char *cmd);
+int CMD_GetCommandsVersion();
 // for autocompletion?
 void CMD_ListAllCommands(void *userData, void (*callback)(command_t *cmd, void *userData));
 int get_cmd(const char *s, char *dest, int maxlen, int stripnum);
 
 
 float CMD_EvaluateExpression(const char *s, const char *stop);
+float CMD_EvaluateCachedExpression(const char *s);
 commandResult_t CMD_If(const void *context, const char *cmd, const char *args, int cmdFlags);
 void CMD_ExpandConstantsWithinString(const char *in, char *out, int outLen);
 void CMD_Script_ProcessWaitersForEvent(byte eventCode, int argument);
@@ -12,6 +12,7 @@
 #include "../driver/drv_public.h"
 #include "../hal/hal_adc.h"
 #include "../hal/hal_flashVars.h"
+#include "../mqtt/new_mqtt.h"
 #include "../httpserver/http_tcp_server.h"
 #include "../hal/hal_generic.h"
 
@@ -99,6 +100,8 @@ static int generateHashValue(const char* fname) {
 }
 
 command_t* g_commands[HASH_SIZE] = { NULL };
+// bumped whenever commands are freed, so cached command_t pointers can be revalidated
+int g_commandsVersion = 0;
 bool g_powersave;
 
 #if defined(PLATFORM_LN882H) || PLATFORM_LN8825
@@ -363,6 +366,10 @@ static commandResult_t CMD_DeepSleep(const void* context, const char* cmd, const
 	}
 
 	timeMS = Tokenizer_GetArgInteger(0);
+	Channel_FlushPendingSaves();
+#if ENABLE_MQTT
+	MQTT_FlushChannelPublishes();
+#endif
 	HAL_DisconnectFromWifi();
 #if defined(PLATFORM_BEKEN) && !defined(PLATFORM_BEKEN_NEW)
 	// It requires a define in SDK file:
@@ -999,6 +1006,10 @@ static commandResult_t CMD_WebServer(const void* context, const char* cmd, const
 			ADDLOG_INFO(LOG_FEATURE_CMD, "Enable WebServer and restart");
 			CFG_SetDisableWebServer(false);
 			CFG_Save_IfThereArePendingChanges();
+			Channel_FlushPendingSaves();
+#if ENABLE_MQTT
+			MQTT_FlushChannelPublishes();
+#endif
 			HAL_RebootModule();
 			return CMD_RES_OK;
 		}
@@ -1218,7 +1229,10 @@ void CMD_FreeAllCommands() {
 		}
 		g_commands[i] = 0;
 	}
-
+	g_commandsVersion++;
+}
+int CMD_GetCommandsVersion() {
+	return g_commandsVersion;
 }
 command_t *CMD_RegisterCommand(const char* name, commandHandler_t handler, void* context) {
 	int hash;
@@ -1262,6 +1276,21 @@ command_t* CMD_Find(const char* name) {
 	return 0;
 }
 
+// like CMD_Find, but if there is no exact match, tries again
+// with trailing numbers stripped (so POWER1 will find POWER)
+command_t* CMD_Lookup(const char* cmd) {
+	command_t* newCmd;
+	char nonums[32];
+
+	newCmd = CMD_Find(cmd);
+	if (newCmd) {
+		return newCmd;
+	}
+	// get the complete string up to numbers.
+	get_cmd(cmd, nonums, 32, 1);
+	return CMD_Find(nonums);
+}
+
 // get a string up to whitespace.
 // if stripnum is set, stop at numbers.
 int get_cmd(const char* s, char* dest, int maxlen, int stripnum) {
@@ -1290,38 +1319,31 @@ commandResult_t CMD_ExecuteCommandArgs(const char* cmd, const char* args, int cm
 	command_t* newCmd;
 	//int len;
 
-	// look for complete commmand
-	newCmd = CMD_Find(cmd);
+	// look for complete commmand, or for command without numbers
+	newCmd = CMD_Lookup(cmd);
 	if (!newCmd) {
-		// not found, so...
-		char nonums[32];
-		// get the complete string up to numbers.
-		//len =
-		get_cmd(cmd, nonums, 32, 1);
-		newCmd = CMD_Find(nonums);
-		if (!newCmd) {
 #if ENABLE_OBK_BERRY
-			static int g_guard = 0;
-			if (g_guard == 0) {
-				g_guard = 1;
-				int c_run = CMD_Berry_RunEventHandlers_Str(CMD_EVENT_ON_CMD, cmd, args);
-				g_guard = 0;
-				if (c_run > 0) {
-					return CMD_RES_OK;
-				}
+		static int g_guard = 0;
+		if (g_guard == 0) {
+			g_guard = 1;
+			int c_run = CMD_Berry_RunEventHandlers_Str(CMD_EVENT_ON_CMD, cmd, args);
+			g_guard = 0;
+			if (c_run > 0) {
+				return CMD_RES_OK;
 			}
-#endif
-			// if still not found, then error
-			ADDLOG_ERROR(LOG_FEATURE_CMD, "cmd %s NOT found (args %s)", cmd, args);
-			return CMD_RES_UNKNOWN_COMMAND;
 		}
-	}
-	else {
+#endif
+		// if still not found, then error
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "cmd %s NOT found (args %s)", cmd, args);
+		return CMD_RES_UNKNOWN_COMMAND;
 	}
 
 	if (newCmd->handler) {
 		commandResult_t res;
+		// nested commands get their own tokenizer context
+		Tokenizer_PushContext();
 		res = newCmd->handler(newCmd->context, cmd, args, cmdFlags);
+		Tokenizer_PopContext();
 		return res;
 	}
 	return CMD_RES_UNKNOWN_COMMAND;
@@ -13,10 +13,40 @@ typedef enum commandResult_e {
 
 } commandResult_t;
 
+// single precompiled script line - command name and arguments
+// are pre-split (in place, inside scriptFile_t data) and the
+// handler is resolved once, so the VM does not have to re-scan text
+typedef struct svmInstruction_s
+{
+	struct command_s* cmd;
+	const char* name;
+	const char* args;
+} svmInstruction_t;
+
+typedef struct svmLabel_s
+{
+	const char* name;
+	unsigned short nameLen;
+	// index of first instruction after label
+	unsigned short instruction;
+} svmLabel_t;
+
 typedef struct scriptFile_s
 {
 	char* fname;
 	char* data;
+	// compiled form of data, see SVM_CompileFile
+	svmInstruction_t* code;
+	int numInstructions;
+	svmLabel_t* labels;
+	int numLabels;
+	// open addressing table of (label index + 1), so goto is a single probe
+	unsigned short* labelHash;
+	int labelHashSize;
+	// set when file was rewritten while some thread was still running it
+	bool bStale;
+	// CMD_GetCommandsVersion at the time of resolving code[].cmd
+	int commandsVersion;
 
 	struct scriptFile_s* next;
 } scriptFile_t;
@@ -32,7 +62,8 @@ typedef struct scriptInstance_s
 {
 	scriptFile_t* curFile;
 	int uniqueID;
-	const char* curLine;
+	// index into curFile->code, curFile is 0 for free thread
+	int curInstruction;
 	int totalDelayMS;
 	int currentDelayMS;
 	eventWait_t wait;
@@ -213,7 +244,40 @@ enum LightMode {
 #define TOKENIZER_ALLOW_ESCAPING_QUOTATIONS		16
 #define TOKENIZER_EXPAND_EARLY					32
 
+#define TOKENIZER_MAX_CMD_LEN 512
+#define TOKENIZER_MAX_ARGS 32
+
+// Tokenizer state. Can be placed on stack (it's about 2KB) or in a pool
+// and used with TokenizerCtx_* functions, independently of the global one.
+typedef struct tokenizer_s {
+	// backing buffer, spaces on arg boundaries are set to null char
+	char buffer[TOKENIZER_MAX_CMD_LEN];
+	char *args[TOKENIZER_MAX_ARGS];
+	char argsExpanded[TOKENIZER_MAX_ARGS][40];
+	// pointers into original, unmutated string
+	const char *argsFrom[TOKENIZER_MAX_ARGS];
+	int numArgs;
+	int flags;
+} tokenizer_t;
+
 // cmd_tokenizer.c
+void TokenizerCtx_TokenizeString(tokenizer_t *t, const char* s, int flags);
+int TokenizerCtx_GetArgsCount(tokenizer_t *t);
+bool TokenizerCtx_CheckArgsCountAndPrintWarning(tokenizer_t *t, const char* cmdStr, int reqCount);
+const char* TokenizerCtx_GetArg(tokenizer_t *t, int i);
+const char* TokenizerCtx_GetArgFrom(tokenizer_t *t, int i);
+const char* TokenizerCtx_GetArgExpanding(tokenizer_t *t, int i);
+int TokenizerCtx_GetArgInteger(tokenizer_t *t, int i);
+int TokenizerCtx_GetPin(tokenizer_t *t, int i, int def);
+int TokenizerCtx_GetArgIntegerDefault(tokenizer_t *t, int i, int def);
+float TokenizerCtx_GetArgFloatDefault(tokenizer_t *t, int i, float def);
+bool TokenizerCtx_IsArgInteger(tokenizer_t *t, int i);
+float TokenizerCtx_GetArgFloat(tokenizer_t *t, int i);
+int TokenizerCtx_GetArgIntegerRange(tokenizer_t *t, int i, int rangeMin, int rangeMax);
+// old API, works on the context of the calling thread and its command nesting level
+void Tokenizer_PushContext();
+void Tokenizer_PopContext();
+tokenizer_t *Tokenizer_GetCurrentContext();
 int Tokenizer_GetArgsCount();
 bool Tokenizer_CheckArgsCountAndPrintWarning(const char* cmdStr, int reqCount);
 const char* Tokenizer_GetArg(int i);
@@ -332,6 +396,9 @@ void SVM_StartBacklog(const char *command);
 void SVM_RunThreads(int deltaMS);
 void CMD_InitScripting();
 void SVM_RunStartupCommandAsScript();
+// call after file is written or removed, so scripts will reload it
+void SVM_InvalidateFile(const char *fname);
+int SVM_GetLabelBytesScanned();
 byte* LFS_ReadFile(const char* fname);
 byte* LFS_ReadFileExpanding(const char* fname);
 int LFS_WriteFile(const char *fname, const byte *data, int len, bool bAppend);
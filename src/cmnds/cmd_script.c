@@ -225,10 +225,16 @@ addEventHandler OnHold 20 backlog AddChannel 10 2 0 255; DGR_SendBrightness room
 
 */
 
-int g_scrBufferSize = 0;
-char *g_scrBuffer = NULL;
 int svm_deltaMS;
+// total bytes compared while looking up labels, for selftests
+int g_svmLabelBytesScanned = 0;
+static bool g_bHasStaleFiles = false;
+
+static void SVM_FreeStaleFiles();
 scriptFile_t *g_scriptFiles = 0;
+// guards g_scriptFiles list, files are registered and invalidated
+// from HTTP/LFS threads too, while main thread frees stale ones
+static SemaphoreHandle_t g_scriptFilesMutex = 0;
 scriptInstance_t *g_scriptThreads = 0;
 scriptInstance_t *g_activeThread = 0;
 
@@ -239,7 +245,7 @@ scriptInstance_t *SVM_RegisterThread() {
 	r = g_scriptThreads;
 
 	while(r) {
-		if(r->curLine == 0) {
+		if(r->curFile == 0) {
 			break;
 		}
 		r = r->next;
@@ -251,11 +257,206 @@ scriptInstance_t *SVM_RegisterThread() {
 		g_scriptThreads = r;
 	}
 	r->uniqueID = 0;
-	r->curLine = 0;
+	r->curInstruction = 0;
 	r->curFile = 0;
 	r->currentDelayMS = 0;
 	return r;
 }
+const char *SVM_SkipWS(const char *p) {
+	if(p==0)
+		return 0;
+	// skip also whitespaces
+	while(*p == ' ' || *p == '\r' || *p == '\t') {
+		p++;
+	}
+	return p;
+}
+const char *SVM_SkipLine(const char *p) {
+	if(p==0)
+		return 0;
+	while(*p) {
+		if(*p == '\n') {
+			p++;
+			return p;
+		}
+		p++;
+	}
+	return p;
+}
+static void SVM_FreeCode(scriptFile_t *f) {
+	free(f->code);
+	free(f->labels);
+	free(f->labelHash);
+	f->code = 0;
+	f->labels = 0;
+	f->labelHash = 0;
+	f->numInstructions = 0;
+	f->numLabels = 0;
+	f->labelHashSize = 0;
+}
+static int SVM_HashLabel(const char *s, int len) {
+	int i;
+	int hash;
+
+	hash = 0;
+	for (i = 0; i < len; i++) {
+		hash += ((unsigned char)s[i]) * (i + 119);
+	}
+	hash = (hash ^ (hash >> 10) ^ (hash >> 20));
+	return hash;
+}
+static bool SVM_BuildLabelHash(scriptFile_t *f) {
+	int i, h;
+	unsigned short idx;
+	svmLabel_t *lab;
+
+	if (f->numLabels == 0) {
+		return true;
+	}
+	// power of two, at most half full
+	f->labelHashSize = 4;
+	while (f->labelHashSize < f->numLabels * 2) {
+		f->labelHashSize *= 2;
+	}
+	f->labelHash = malloc(sizeof(unsigned short) * f->labelHashSize);
+	if (f->labelHash == 0) {
+		return false;
+	}
+	memset(f->labelHash, 0, sizeof(unsigned short) * f->labelHashSize);
+	for (i = 0; i < f->numLabels; i++) {
+		lab = &f->labels[i];
+		h = SVM_HashLabel(lab->name, lab->nameLen) & (f->labelHashSize - 1);
+		while ((idx = f->labelHash[h]) != 0) {
+			// duplicated label - first one wins, like in the old text scan
+			if (f->labels[idx - 1].nameLen == lab->nameLen
+				&& !strncmp(f->labels[idx - 1].name, lab->name, lab->nameLen)) {
+				break;
+			}
+			h = (h + 1) & (f->labelHashSize - 1);
+		}
+		if (idx == 0) {
+			f->labelHash[h] = i + 1;
+		}
+	}
+	return true;
+}
+static void SVM_ResolveCommands(scriptFile_t *f) {
+	int i;
+
+	for (i = 0; i < f->numInstructions; i++) {
+		// might be still 0 if command is registered later, for example by startDriver
+		f->code[i].cmd = CMD_Lookup(f->code[i].name);
+	}
+	f->commandsVersion = CMD_GetCommandsVersion();
+}
+// Turns script text into instruction and label arrays.
+// Lines are split in place, so data can't be used as plain text afterwards.
+static bool SVM_CompileFile(scriptFile_t *f) {
+	char *p, *start, *end, *next, *q;
+	int maxLines;
+	svmInstruction_t *in;
+	svmLabel_t *lab;
+
+	SVM_FreeCode(f);
+
+	maxLines = 1;
+	for (p = f->data; *p; p++) {
+		if (*p == '\n') {
+			maxLines++;
+		}
+	}
+	f->code = malloc(sizeof(svmInstruction_t) * maxLines);
+	f->labels = malloc(sizeof(svmLabel_t) * maxLines);
+	if (f->code == 0 || f->labels == 0) {
+		SVM_FreeCode(f);
+		return false;
+	}
+
+	p = f->data;
+	while (*p) {
+		start = (char*)SVM_SkipWS(p);
+		next = (char*)SVM_SkipLine(start);
+		end = next;
+		while (end > start && (end[-1] == ' ' || end[-1] == '\r' || end[-1] == '\n' || end[-1] == '\t')) {
+			end--;
+		}
+		p = next;
+		if (end == start) {
+			continue;
+		}
+		// "label:" at the start of line, label jumps to the first instruction below
+		for (q = start; q < end && *q != ':' && isWhiteSpace(*q) == false; q++) {
+		}
+		if (q != start && q < end && *q == ':') {
+			lab = &f->labels[f->numLabels++];
+			lab->name = start;
+			lab->nameLen = q - start;
+			lab->instruction = f->numInstructions;
+		}
+		// skip comments and lines with labels only
+		if ((start[0] == '/' && start[1] == '/') || end[-1] == ':') {
+			continue;
+		}
+		*end = 0;
+		in = &f->code[f->numInstructions++];
+		in->name = start;
+		for (q = start; *q && isWhiteSpace(*q) == false; q++) {
+		}
+		if (*q) {
+			*q = 0;
+			q++;
+			while (isWhiteSpace(*q)) {
+				q++;
+			}
+		}
+		in->args = q;
+	}
+	SVM_ResolveCommands(f);
+	if (SVM_BuildLabelHash(f) == false) {
+		SVM_FreeCode(f);
+		return false;
+	}
+	return true;
+}
+static bool SVM_Files_Lock() {
+	if (xSemaphoreTake(g_scriptFilesMutex, 1000) != pdTRUE) {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "Script files mutex timeout");
+		return false;
+	}
+	return true;
+}
+static void SVM_Files_Unlock() {
+	xSemaphoreGive(g_scriptFilesMutex);
+}
+// adds fully loaded file to the list
+static void SVM_LinkFile(scriptFile_t *r) {
+	if (SVM_Files_Lock() == false) {
+		// rather leak it than corrupt the list
+		return;
+	}
+	r->next = g_scriptFiles;
+	g_scriptFiles = r;
+	SVM_Files_Unlock();
+}
+// returns file that is not stale, with given name (case insensitive, for
+// file names) or given text
+static scriptFile_t *SVM_FindFile(const char *fname, bool bIgnoreCase) {
+	scriptFile_t *r;
+
+	if (SVM_Files_Lock() == false) {
+		return 0;
+	}
+	for (r = g_scriptFiles; r; r = r->next) {
+		if (r->bStale) {
+			continue;
+		}
+		if (bIgnoreCase ? !stricmp(fname, r->fname) : !strcmp(fname, r->fname)) {
+			break;
+		}
+	}
+	SVM_Files_Unlock();
+	return r;
+}
 scriptFile_t *SVM_RegisterFile(const char *fname) {
 	scriptFile_t *r;
 
@@ -265,15 +466,11 @@ scriptFile_t *SVM_RegisterFile(const char *fname) {
 		return 0;
 	}
 
-	r = g_scriptFiles;
-
-	while(r) {
-		if(!stricmp(fname,r->fname)) {
-			if(r->data == 0)
-				return 0;
-			return r;
-		}
-		r = r->next;
+	r = SVM_FindFile(fname, true);
+	if (r) {
+		if(r->data == 0)
+			return 0;
+		return r;
 	}
 	r = malloc(sizeof(scriptFile_t));
 	memset(r,0,sizeof(scriptFile_t));
@@ -285,22 +482,22 @@ scriptFile_t *SVM_RegisterFile(const char *fname) {
 	else {
 		r->data = (char*)LFS_ReadFile(fname);
 	}
-	r->next = g_scriptFiles;
-	g_scriptFiles = r;
-	if(r->data == 0)
+	// compiled before linking, so other threads never see it half done
+	if (r->data && SVM_CompileFile(r) == false) {
+		free(r->data);
+		r->data = 0;
+	}
+	SVM_LinkFile(r);
+	if (r->data == 0)
 		return 0;
 	return r;
 }
 scriptFile_t *SVM_RegisterFileForText(const char *txt) {
 	scriptFile_t *r;
 
-	r = g_scriptFiles;
-
-	while (r) {
-		if (!strcmp(txt, r->fname)) {
-			return r;
-		}
-		r = r->next;
+	r = SVM_FindFile(txt, false);
+	if (r) {
+		return r;
 	}
 	r = malloc(sizeof(scriptFile_t));
 	memset(r, 0, sizeof(scriptFile_t));
@@ -314,72 +511,72 @@ scriptFile_t *SVM_RegisterFileForText(const char *txt) {
 		}
 		p++;
 	}
-	r->next = g_scriptFiles;
-	g_scriptFiles = r;
+	if (r->data && SVM_CompileFile(r) == false) {
+		free(r->data);
+		r->data = 0;
+	}
+	SVM_LinkFile(r);
 	if (r->data == 0)
 		return 0;
 	return r;
 }
-const char *SVM_SkipWS(const char *p) {
-	if(p==0)
-		return 0;
-	// skip also whitespaces
-	while(*p == ' ' || *p == '\r' || *p == '\t') {
-		p++;
-	}
-	return p;
-}
-const char *SVM_SkipLine(const char *p) {
-	if(p==0)
-		return 0;
-	while(*p) {
-		if(*p == '\n') {
-			p++;
-			return p;
-		}
-		p++;
-	}
-	return p;
-}
 
-const char *SVM_FindLabel(const char *text, const char *label, const char *fname) {
+int SVM_FindLabel(scriptFile_t *f, const char *label) {
 	int labLen;
+	int h;
+	unsigned short idx;
+	svmLabel_t *lab;
 
 	if(label == 0)
-		return text;
+		return 0;
 	if (!strcmp(label, "*"))
-		return text;
+		return 0;
 	if (*label == 0)
-		return text;
+		return 0;
 
 	labLen = strlen(label);
 
-	while(*text) {
-		text = SVM_SkipWS(text); 
-		if(strncmp(text,label,labLen) == 0 && text[labLen] == ':') {
-			return text;
+	if (f->labelHashSize) {
+		h = SVM_HashLabel(label, labLen) & (f->labelHashSize - 1);
+		while ((idx = f->labelHash[h]) != 0) {
+			lab = &f->labels[idx - 1];
+			if (lab->nameLen == labLen) {
+				g_svmLabelBytesScanned += labLen;
+				if (!strncmp(lab->name, label, labLen)) {
+					return lab->instruction;
+				}
+			}
+			h = (h + 1) & (f->labelHashSize - 1);
 		}
-		if(text[0] == '/' && text[1] == '/') {
-			text = SVM_SkipLine(text); 
-			text = SVM_SkipWS(text); 
-		} else {
-			text = SVM_SkipLine(text); 
-			text = SVM_SkipWS(text); 
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Label %s not found in %s - will go to the start of file",label,f->fname);
+	return f->numInstructions;
+}
+static void SVM_ExecuteInstruction(scriptFile_t *f, svmInstruction_t *in) {
+	command_t *cmd;
+
+	if (f->commandsVersion != CMD_GetCommandsVersion()) {
+		SVM_ResolveCommands(f);
+	}
+	cmd = in->cmd;
+	if (cmd == 0) {
+		cmd = in->cmd = CMD_Lookup(in->name);
+		if (cmd == 0) {
+			// will report error (or let Berry handle it)
+			CMD_ExecuteCommandArgs(in->name, in->args, 0);
+			return;
 		}
 	}
-	ADDLOG_INFO(LOG_FEATURE_CMD, "Label %s not found in %s - will go to the start of file",label,fname);
-	return text;
+	ADDLOG_DEBUG(LOG_FEATURE_CMD, "cmd [%s %s]", in->name, in->args);
+	if (cmd->handler) {
+		Tokenizer_PushContext();
+		cmd->handler(cmd->context, in->name, in->args, 0);
+		Tokenizer_PopContext();
+	}
 }
 void SVM_RunThread(scriptInstance_t *t, int maxLoops) {
 	int loop = 0;
-	const char *start, *end;
-	int len, p;
-	
-	if(g_scrBuffer == NULL) {
-		g_scrBufferSize = 256;
-		g_scrBuffer = malloc(g_scrBufferSize + 1);
-	}
-
+	scriptFile_t *f;
 
 	while(1) {
 		loop++;
@@ -387,55 +584,25 @@ void SVM_RunThread(scriptInstance_t *t, int maxLoops) {
 		if (t->wait.waitingForEvent) {
 			return;
 		}
-		if(t->curLine == 0) {
-			t->curLine = 0;
-			t->curFile = 0;
+		f = t->curFile;
+		if(f == 0) {
 			return;
 		}
 		if (loop > maxLoops) {
 			return;
 		}
-		t->curLine = SVM_SkipWS(t->curLine); 
-		if(t->curLine[0] == 0) {
-			t->curLine = 0;
+		if(t->curInstruction >= f->numInstructions) {
+			t->curInstruction = 0;
 			t->curFile = 0;
 			return;
 		}
-		if(t->curLine[0] == '/' && t->curLine[1] == '/') {
-			t->curLine = SVM_SkipLine(t->curLine); 
-			t->curLine = SVM_SkipWS(t->curLine); 
-		} else {
-			start = t->curLine;
-			end = SVM_SkipLine(start);
-			t->curLine = SVM_SkipWS(end); 
-
-			while(end > start && (end[-1]==' '||end[-1]=='\r'||end[-1]=='\n'||end[-1]=='\t')) {
-				end--;
-			}
-			len = (end - start);
-			//ADDLOG_EXTRADEBUG(LOG_FEATURE_CMD, "Script len: %i",len);
-
-			// skip empty lines and skip labels
-			if(len > 0 && start[len-1] != ':') {
-				if(len >= g_scrBufferSize) {
-					g_scrBufferSize = len + 256;
-					g_scrBuffer = (char*)realloc(g_scrBuffer, g_scrBufferSize+1);
-				}
-				if (g_scrBuffer == NULL) {
-					return;
-				}
-				memcpy(g_scrBuffer,start,len);
-				g_scrBuffer[len] = 0;
+		// advance first, so command can do goto
+		t->curInstruction++;
+		SVM_ExecuteInstruction(f, &f->code[t->curInstruction - 1]);
 
-				p = start-t->curFile->data;
-				///ADDLOG_EXTRADEBUG(LOG_FEATURE_CMD, "[Loop %i] Script line: %s, char index %i",loop,g_scrBuffer,p);
-				CMD_ExecuteCommand(g_scrBuffer,0);
-
-				// did we get a sleep?
-				if(t->currentDelayMS > 0) {
-					return;
-				}	
-			}
+		// did we get a sleep?
+		if(t->currentDelayMS > 0) {
+			return;
 		}
 	}
 }
@@ -471,6 +638,9 @@ void SVM_RunThreads(int deltaMS) {
 		}
 		g_activeThread = g_activeThread->next;
 	}
+	if (g_bHasStaleFiles) {
+		SVM_FreeStaleFiles();
+	}
 
 	//ADDLOG_INFO(LOG_FEATURE_CMD, "SCR sleep %i, ran %i",c_sleep,c_run);
 }
@@ -546,33 +716,98 @@ void SVM_GoTo(scriptInstance_t *th, const char *fname, const char *label) {
 		return;
 	}
 	th->curFile = f;
-	th->curLine = SVM_FindLabel(f->data,label,f->fname);
+	th->curInstruction = SVM_FindLabel(f,label);
 
 	return;
 }
+int SVM_GetLabelBytesScanned() {
+	return g_svmLabelBytesScanned;
+}
+static bool SVM_IsFileUsed(scriptFile_t *f) {
+	scriptInstance_t *t;
+
+	for (t = g_scriptThreads; t; t = t->next) {
+		if (t->curFile == f) {
+			return true;
+		}
+	}
+	return false;
+}
+static void SVM_FreeFile(scriptFile_t *f) {
+	SVM_FreeCode(f);
+	free(f->data);
+	free(f->fname);
+	free(f);
+}
+// frees stale files that are no longer used by any thread
+static void SVM_FreeStaleFiles() {
+	scriptFile_t **pp, *f;
+
+	if (SVM_Files_Lock() == false) {
+		return;
+	}
+	g_bHasStaleFiles = false;
+	pp = &g_scriptFiles;
+	while (*pp) {
+		f = *pp;
+		if (f->bStale && SVM_IsFileUsed(f) == false) {
+			*pp = f->next;
+			SVM_FreeFile(f);
+		}
+		else {
+			if (f->bStale) {
+				g_bHasStaleFiles = true;
+			}
+			pp = &f->next;
+		}
+	}
+	SVM_Files_Unlock();
+}
+// Forget compiled copy of given file (or all files, if fname is NULL),
+// so next startScript/goto will read it again from LFS.
+// Threads that are still running old copy keep it until they finish.
+// May be called from HTTP/LFS context while main thread runs the file,
+// so it only marks it, memory is freed at the end of SVM_RunThreads.
+void SVM_InvalidateFile(const char *fname) {
+	scriptFile_t *f;
+
+	if (SVM_Files_Lock() == false) {
+		return;
+	}
+	for (f = g_scriptFiles; f; f = f->next) {
+		if (fname == 0 || !stricmp(fname, f->fname)) {
+			f->bStale = true;
+			g_bHasStaleFiles = true;
+		}
+	}
+	SVM_Files_Unlock();
+}
 void SVM_FreeAllFiles() {
 	scriptFile_t *f; 
 
+	if (SVM_Files_Lock() == false) {
+		return;
+	}
 	f = g_scriptFiles;
 	while(f) {
 		scriptFile_t *n;
 
 		n = f->next;
 
-		free(f->data);
-		free(f->fname);
-		free(f);
+		SVM_FreeFile(f);
 
 		f = n;
 	}
 	g_scriptFiles = 0;
+	g_bHasStaleFiles = false;
+	SVM_Files_Unlock();
 }
 void SVM_StopAllScripts() {
 	scriptInstance_t *t;
 
 	t = g_scriptThreads;
 	while(t) {
-		t->curLine = 0;
+		t->curInstruction = 0;
 		t->curFile = 0;
 		t->uniqueID = 0;
 		t->currentDelayMS = 0;
@@ -589,7 +824,7 @@ void SVM_StopScripts(int id, int bExcludeSelf) {
 			// excluded
 		} else {
 			if(t->uniqueID == id) {
-				t->curLine = 0;
+				t->curInstruction = 0;
 				t->curFile = 0;
 				t->uniqueID = 0;
 				t->currentDelayMS = 0;
@@ -604,7 +839,7 @@ void SVM_GoToLocal(scriptInstance_t *th, const char *label) {
 
 		return;
 	}
-	th->curLine = SVM_FindLabel(th->curFile->data,label,th->curFile->fname);
+	th->curInstruction = SVM_FindLabel(th->curFile,label);
 
 	return;
 }
@@ -633,7 +868,7 @@ void SVM_StartBacklog(const char *command) {
 	}
 	th->uniqueID = 0;
 	th->curFile = f;
-	th->curLine = f->data;
+	th->curInstruction = 0;
 	//return th;
 }
 scriptInstance_t *SVM_StartScript(const char *fname, const char *label, int uniqueID) {
@@ -678,7 +913,7 @@ scriptInstance_t *SVM_StartScript(const char *fname, const char *label, int uniq
 	}
 	th->uniqueID = uniqueID;
 	th->curFile = f;
-	th->curLine = SVM_FindLabel(f->data,label,f->fname);
+	th->curInstruction = SVM_FindLabel(f,label);
 
 	if(label==0) {
 		ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_StartScript: started %s at the beginning",fname);
@@ -815,7 +1050,7 @@ static commandResult_t CMD_Return(const void *context, const char *cmd, const ch
 
 	ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_Return: thread will return");
 	g_activeThread->curFile = 0;
-	g_activeThread->curLine = 0;
+	g_activeThread->curInstruction = 0;
 
 
 	return CMD_RES_OK;
@@ -947,6 +1182,9 @@ commandResult_t CMD_waitFor(const void *context, const char *cmd, const char *ar
 }
 
 void CMD_InitScripting(){
+	if (g_scriptFilesMutex == 0) {
+		g_scriptFilesMutex = xSemaphoreCreateMutex();
+	}
 	//cmddetail:{"name":"startScript","args":"[FileName][Label][UniqueID]",
 	//cmddetail:"descr":"Starts a script thread from given file, at given label - can be * for whole file, with given unique ID",
 	//cmddetail:"fn":"CMD_StartScript","file":"cmnds/cmd_script.c","requires":"",
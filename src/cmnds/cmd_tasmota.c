@@ -304,6 +304,9 @@ int LFS_WriteFile(const char *fname, const byte *data, int len, bool bAppend) {
 
 			lfsres = lfs_file_write(&lfs, &file, data, len);
 			lfs_file_close(&lfs, &file);
+#if ENABLE_OBK_SCRIPTING
+			SVM_InvalidateFile(fname);
+#endif
 			ADDLOG_DEBUG(LOG_FEATURE_CMD, "LFS_ReadFile: closed file %s", fname);
 			return lfsres;
 		}
@@ -8,18 +8,43 @@
 #include "../logging/logging.h"
 #include "../hal/hal_pins.h"
 
-#define MAX_CMD_LEN 512
-#define MAX_ARGS 32
-
-static char g_buffer[MAX_CMD_LEN];
-static char *g_args[MAX_ARGS];
-static char g_argsExpanded[MAX_ARGS][40];
-static const char *g_argsFrom[MAX_ARGS];
-static int g_numArgs = 0;
-static int tok_flags = 0;
+#if WINDOWS && LINUX
+#include <pthread.h>
+#endif
 
-#define g_bAllowQuotes (tok_flags&TOKENIZER_ALLOW_QUOTES)
-#define g_bAllowExpand (!(tok_flags&TOKENIZER_DONT_EXPAND))
+// Contexts used by the old, implicit Tokenizer_* API.
+// Each thread that runs commands gets a slot, and each nesting level of
+// command execution in that thread gets its own context, so neither a
+// nested command nor other thread clobbers the arguments of the caller.
+// Slot stays with its thread after the command is done, together with
+// contexts allocated for it, so running a command normally costs no lock
+// and no malloc - only the first command of a thread, or the first one
+// nested that deep, does. Slot idle for TOKENIZER_STEAL_SECONDS may be
+// taken by other thread (HTTP may use a new thread per connection). Owner
+// takes the lock itself once idle for TOKENIZER_KEEP_SECONDS, so the only
+// race left is an owner suspended for the difference between them.
+// Without a slot (no command running, or all slots busy) the shared static
+// context is used, like before.
+#define TOKENIZER_MAX_DEPTH 8
+#define TOKENIZER_MAX_THREADS 4
+#define TOKENIZER_KEEP_SECONDS 10
+#define TOKENIZER_STEAL_SECONDS 20
+
+typedef struct tokenizerThread_s {
+	// 0 if slot was never used
+	void *thread;
+	int depth;
+	// g_secondsElapsed when a command started or ended
+	int lastUse;
+	tokenizer_t *levels[TOKENIZER_MAX_DEPTH];
+} tokenizerThread_t;
+
+static tokenizer_t g_defaultTokenizer;
+static tokenizerThread_t g_tokenizerThreads[TOKENIZER_MAX_THREADS];
+static SemaphoreHandle_t g_tokenizerMutex = 0;
+
+#define g_bAllowQuotes (t->flags&TOKENIZER_ALLOW_QUOTES)
+#define g_bAllowExpand (!(t->flags&TOKENIZER_DONT_EXPAND))
 
 int str_to_ip(const char *s, byte *ip) {
 #if PLATFORM_W600 || PLATFORM_LN882H || PLATFORM_REALTEK || PLATFORM_ECR6600 || PLATFORM_TR6260 \
@@ -54,33 +79,33 @@ bool isWhiteSpace(char ch) {
 		return true;
 	return false;
 }
-bool Tokenizer_CheckArgsCountAndPrintWarning(const char *cmdString, int reqCount) {
-	if (g_numArgs >= reqCount)
+bool TokenizerCtx_CheckArgsCountAndPrintWarning(tokenizer_t *t, const char *cmdString, int reqCount) {
+	if (t->numArgs >= reqCount)
 		return false;
-	ADDLOG_ERROR(LOG_FEATURE_CMD, "Cant run '%s', expected at least %i args (given %i)", cmdString, reqCount, g_numArgs);
+	ADDLOG_ERROR(LOG_FEATURE_CMD, "Cant run '%s', expected at least %i args (given %i)", cmdString, reqCount, t->numArgs);
 	return true;
 }
-int Tokenizer_GetArgsCount() {
-	return g_numArgs;
+int TokenizerCtx_GetArgsCount(tokenizer_t *t) {
+	return t->numArgs;
 }
-bool Tokenizer_IsArgInteger(int i) {
-	if(i >= g_numArgs)
+bool TokenizerCtx_IsArgInteger(tokenizer_t *t, int i) {
+	if(i >= t->numArgs)
 		return false;
-	if (*g_args[i] == '$') {
+	if (*t->args[i] == '$') {
 		return true;
 	}
-	return strIsInteger(g_args[i]);
+	return strIsInteger(t->args[i]);
 }
-const char *Tokenizer_GetArgExpanding(int i) {
+const char *TokenizerCtx_GetArgExpanding(tokenizer_t *t, int i) {
 	const char *s;
-	char tokLine[sizeof(g_argsExpanded[i])];
-	char Templine[sizeof(g_argsExpanded[i])];
+	char tokLine[sizeof(t->argsExpanded[i])];
+	char Templine[sizeof(t->argsExpanded[i])];
 	char convert[10];
 
-	if (i >= g_numArgs)
+	if (i >= t->numArgs)
 		return 0;
 
-	s = g_args[i];
+	s = t->args[i];
 
 	//séparators for strtok to detect constants
 	const char * separators = "${}";
@@ -88,7 +113,7 @@ const char *Tokenizer_GetArgExpanding(int i) {
 	char *ptrConst;
 
 	//copy input string before manipulations
-	strcpy_safe(g_argsExpanded[i], s, sizeof(g_argsExpanded[i]));
+	strcpy_safe(t->argsExpanded[i], s, sizeof(t->argsExpanded[i]));
 	strcpy_safe(tokLine, s, sizeof(tokLine));
 
 	//start strtok
@@ -98,18 +123,18 @@ const char *Tokenizer_GetArgExpanding(int i) {
 		char tconst[20] = "${";
 		strcat(tconst, strToken);
 		strcat(tconst, "}");
-		ptrConst = strstr(g_argsExpanded[i], tconst);
+		ptrConst = strstr(t->argsExpanded[i], tconst);
 		if (ptrConst == NULL) {
 			// we didn't find ${<token>} so we try with $<token>
 			strcpy(tconst, "$");
 			strcat(tconst, strToken);
-			ptrConst = strstr(g_argsExpanded[i], tconst);
+			ptrConst = strstr(t->argsExpanded[i], tconst);
 		}
 		// if we found ${<token>} or $<token> it means we found a constant
 		if (ptrConst != NULL) {
 			//put 0 on the start of the constant to copy the left part of the input string
 			ptrConst[0] = 0;
-			strcpy_safe(Templine, g_argsExpanded[i], sizeof(Templine));
+			strcpy_safe(Templine, t->argsExpanded[i], sizeof(Templine));
 			//analyse the constant found to replace it with it's value/string and concat it with the left part of the input string
 			if (!strcmp(tconst, "${IP}") || !strcmp(tconst, "$IP")) {
 				strcat_safe(Templine, HAL_GetMyIPString(), sizeof(Templine));
@@ -131,28 +156,28 @@ const char *Tokenizer_GetArgExpanding(int i) {
 			//concat with the right part, after the constant
 			strcat_safe(Templine, ptrConst + strlen(tconst), sizeof(Templine));
 			//update the input string with the replaced constant
-			strcpy_safe(g_argsExpanded[i], Templine, sizeof(g_argsExpanded[i]));
+			strcpy_safe(t->argsExpanded[i], Templine, sizeof(t->argsExpanded[i]));
 		}
 		//look for next token
 		strToken = strtok(NULL, separators);
 
 	}
 
-	return g_argsExpanded[i];
+	return t->argsExpanded[i];
 
 }
-const char *Tokenizer_GetArg(int i) {
+const char *TokenizerCtx_GetArg(tokenizer_t *t, int i) {
 	const char *s;
 
-	if (i < 0 || g_numArgs <= i) {
+	if (i < 0 || t->numArgs <= i) {
 		return 0;
 	}
 
-	if (g_argsExpanded[i][0] != 0) {
-		return g_argsExpanded[i];
+	if (t->argsExpanded[i][0] != 0) {
+		return t->argsExpanded[i];
 	}
 
-	s = g_args[i];
+	s = t->args[i];
 
 #if 0
 	if (g_bAllowExpand && s[0] == '$' && s[1] == 'C' && s[2] == 'H') {
@@ -162,50 +187,50 @@ const char *Tokenizer_GetArg(int i) {
 		channelIndex = atoi(s + 3);
 		value = CHANNEL_Get(channelIndex);
 
-		sprintf(g_argsExpanded[i], "%i", value);
+		sprintf(t->argsExpanded[i], "%i", value);
 
-		return g_argsExpanded[i];
+		return t->argsExpanded[i];
 	}
 #else
-	if (g_bAllowExpand && (tok_flags & TOKENIZER_ALTERNATE_EXPAND_AT_START)) {
-		CMD_ExpandConstantsWithinString(s, g_argsExpanded[i], sizeof(g_argsExpanded[i]));
-		return g_argsExpanded[i];
+	if (g_bAllowExpand && (t->flags & TOKENIZER_ALTERNATE_EXPAND_AT_START)) {
+		CMD_ExpandConstantsWithinString(s, t->argsExpanded[i], sizeof(t->argsExpanded[i]));
+		return t->argsExpanded[i];
 	}
 	else if (g_bAllowExpand && s[0] == '$') {
 		// quick hack for str expansion here, may do it in a better way later
 		if (!strcmp(s + 1, "IP")) {
-			strcpy_safe(g_argsExpanded[i], HAL_GetMyIPString(), sizeof(g_argsExpanded[i]));
+			strcpy_safe(t->argsExpanded[i], HAL_GetMyIPString(), sizeof(t->argsExpanded[i]));
 		}
 		else if (!strcmp(s + 1, "ShortName")) {
-			strcpy_safe(g_argsExpanded[i], CFG_GetShortDeviceName(), sizeof(g_argsExpanded[i]));
+			strcpy_safe(t->argsExpanded[i], CFG_GetShortDeviceName(), sizeof(t->argsExpanded[i]));
 		}
 		else if (!strcmp(s + 1, "Name")) {
-			strcpy_safe(g_argsExpanded[i], CFG_GetDeviceName(), sizeof(g_argsExpanded[i]));
+			strcpy_safe(t->argsExpanded[i], CFG_GetDeviceName(), sizeof(t->argsExpanded[i]));
 		}
 		else {
 			float f;
 			int iValue;
 			CMD_ExpandConstantFloat(s, 0, &f);
 			iValue = f;
-			sprintf(g_argsExpanded[i], "%i", iValue);
+			sprintf(t->argsExpanded[i], "%i", iValue);
 		}
-		return g_argsExpanded[i];
+		return t->argsExpanded[i];
 	}
 
 #endif
 
-	return g_args[i];
+	return t->args[i];
 }
-const char *Tokenizer_GetArgFrom(int i) {
-	return g_argsFrom[i];
+const char *TokenizerCtx_GetArgFrom(tokenizer_t *t, int i) {
+	return t->argsFrom[i];
 }
-int Tokenizer_GetArgIntegerRange(int i, int rangeMin, int rangeMax) {
-	int ret = Tokenizer_GetArgInteger(i);
+int TokenizerCtx_GetArgIntegerRange(tokenizer_t *t, int i, int rangeMin, int rangeMax) {
+	int ret = TokenizerCtx_GetArgInteger(t, i);
 
 //
 // to be discussed: What to return in case of an invalid index? min or max or ???
 //
-	if (i < 0 || g_numArgs <= i) {
+	if (i < 0 || t->numArgs <= i) {
 		ADDLOG_ERROR(LOG_FEATURE_CMD, "Invalid argument index %i! Using minumum value %i!",i,rangeMin);
 		return rangeMin;
 	}
@@ -221,47 +246,47 @@ int Tokenizer_GetArgIntegerRange(int i, int rangeMin, int rangeMax) {
 	return ret;
 }
 
-int Tokenizer_GetPin(int i, int def) {
+int TokenizerCtx_GetPin(tokenizer_t *t, int i, int def) {
 	int r;
 
-	if (g_numArgs <= i) {
+	if (t->numArgs <= i) {
 //		ADDLOG_DEBUG(LOG_FEATURE_CMD, "Tokenizer_GetPin: Argument %i not present - Returning default index %i",i,def);
 		return def;
 	}
-	return Tokenizer_IsArgInteger(i) ? Tokenizer_GetArgInteger(i) : PIN_FindIndexFromString(g_args[i]);
-//	r = Tokenizer_IsArgInteger(i) ? Tokenizer_GetArgInteger(i) : PIN_FindIndexFromString(g_args[i]);
-//	ADDLOG_DEBUG(LOG_FEATURE_CMD, "Tokenizer_GetPin: Argument %i (%s) - Returning index %i",i,g_args[i],r);
+	return TokenizerCtx_IsArgInteger(t, i) ? TokenizerCtx_GetArgInteger(t, i) : PIN_FindIndexFromString(t->args[i]);
+//	r = TokenizerCtx_IsArgInteger(t, i) ? TokenizerCtx_GetArgInteger(t, i) : PIN_FindIndexFromString(t->args[i]);
+//	ADDLOG_DEBUG(LOG_FEATURE_CMD, "Tokenizer_GetPin: Argument %i (%s) - Returning index %i",i,t->args[i],r);
 	return r;
 }
 
-int Tokenizer_GetArgIntegerDefault(int i, int def) {
+int TokenizerCtx_GetArgIntegerDefault(tokenizer_t *t, int i, int def) {
 	int r;
 
-	if (i < 0 || g_numArgs <= i) {
+	if (i < 0 || t->numArgs <= i) {
 		return def;
 	}
-	r = Tokenizer_GetArgInteger(i);
+	r = TokenizerCtx_GetArgInteger(t, i);
 
 	return r;
 }
-float Tokenizer_GetArgFloatDefault(int i, float def) {
+float TokenizerCtx_GetArgFloatDefault(tokenizer_t *t, int i, float def) {
 	float r;
 
-	if (i < 0 || g_numArgs <= i) {
+	if (i < 0 || t->numArgs <= i) {
 		return def;
 	}
-	r = Tokenizer_GetArgFloat(i);
+	r = TokenizerCtx_GetArgFloat(t, i);
 
 	return r;
 }
-int Tokenizer_GetArgInteger(int i) {
+int TokenizerCtx_GetArgInteger(tokenizer_t *t, int i) {
 	const char *s;
 	int ret;
-	if (i < 0 || g_numArgs <= i) {
+	if (i < 0 || t->numArgs <= i) {
 		return 0;
 	}
 
-	s = g_args[i];
+	s = t->args[i];
 	if (s == 0)
 		return 0;
 	if(s[0] == '0' && s[1] == 'x') {
@@ -290,15 +315,15 @@ int Tokenizer_GetArgInteger(int i) {
 #endif
 	return atoi(s);
 }
-float Tokenizer_GetArgFloat(int i) {
-	if (i < 0 || g_numArgs <= i) {
+float TokenizerCtx_GetArgFloat(tokenizer_t *t, int i) {
+	if (i < 0 || t->numArgs <= i) {
 		return 0.0f;
 	}
 #if !ENABLE_EXPAND_CONSTANT
 	int channelIndex;
 #endif
 	const char *s;
-	s = g_args[i];
+	s = t->args[i];
 #if !ENABLE_EXPAND_CONSTANT
 	if(g_bAllowExpand && s[0] == '$') {
 		// constant
@@ -339,11 +364,11 @@ void expandQuotes(char* str) {
 	str[writeIndex] = 0;
 }
 
-void Tokenizer_TokenizeString(const char *s, int flags) {
+void TokenizerCtx_TokenizeString(tokenizer_t *t, const char *s, int flags) {
 	char *p;
 
-	tok_flags = flags;
-	g_numArgs = 0;
+	t->flags = flags;
+	t->numArgs = 0;
 
 	if(s == 0) {
 		return;
@@ -358,34 +383,34 @@ void Tokenizer_TokenizeString(const char *s, int flags) {
 	}
 
 	// not really needed, but nice for testing
-	memset(g_args, 0, sizeof(g_args)); // backing buffer is g_buffer, which is mutated where spaces on arg boundaries are set to null char
-	memset(g_argsFrom, 0, sizeof(g_argsFrom)); // backing buffer is s, original unmutated string
-	memset(g_argsExpanded, 0, sizeof(g_argsExpanded));
+	memset(t->args, 0, sizeof(t->args)); // backing buffer is t->buffer, which is mutated where spaces on arg boundaries are set to null char
+	memset(t->argsFrom, 0, sizeof(t->argsFrom)); // backing buffer is s, original unmutated string
+	memset(t->argsExpanded, 0, sizeof(t->argsExpanded));
 
 	if (flags & TOKENIZER_EXPAND_EARLY) {
-		CMD_ExpandConstantsWithinString(s, g_buffer, sizeof(g_buffer) - 1);
+		CMD_ExpandConstantsWithinString(s, t->buffer, sizeof(t->buffer) - 1);
 	}
 	else {
-		strcpy_safe(g_buffer, s, sizeof(g_buffer));
+		strcpy_safe(t->buffer, s, sizeof(t->buffer));
 	}
 
 	if (flags & TOKENIZER_FORCE_SINGLE_ARGUMENT_MODE) {
-		g_args[g_numArgs] = g_buffer;
-		g_argsFrom[g_numArgs] = g_buffer;
+		t->args[t->numArgs] = t->buffer;
+		t->argsFrom[t->numArgs] = t->buffer;
 		// some hack, but we fored to have only have one arg, so we can extend the string over array bondaries.
-		// probably better: introducing an union containing g_argsExpanded[][] and one sole string in the same memory area ...
-		CMD_ExpandConstantsWithinString(g_buffer,(char*)g_argsExpanded,sizeof(g_argsExpanded)-1);
-		g_numArgs = 1;
+		// probably better: introducing an union containing t->argsExpanded[][] and one sole string in the same memory area ...
+		CMD_ExpandConstantsWithinString(t->buffer,(char*)t->argsExpanded,sizeof(t->argsExpanded)-1);
+		t->numArgs = 1;
 		return;
 	}
-	p = g_buffer;
+	p = t->buffer;
 	// we need to rewrite this function and check it well with unit tests
 	if (*p == '"') {
 		goto quote;
 	}
-	g_args[g_numArgs] = p;
-	g_argsFrom[g_numArgs] = (s+(p-g_buffer));
-	g_numArgs++;
+	t->args[t->numArgs] = p;
+	t->argsFrom[t->numArgs] = (s+(p-t->buffer));
+	t->numArgs++;
 	while(*p != 0) {
 		if(isWhiteSpace(*p)) {
 			*p = 0;
@@ -395,24 +420,24 @@ void Tokenizer_TokenizeString(const char *s, int flags) {
 					p++;
 					goto quote;
 				}
-				g_args[g_numArgs] = p+1;
-				g_argsFrom[g_numArgs] = (s+((p+1)-g_buffer));
-				g_numArgs++;
+				t->args[t->numArgs] = p+1;
+				t->argsFrom[t->numArgs] = (s+((p+1)-t->buffer));
+				t->numArgs++;
 			}
 		}
 		//if(*p == ',') {
 		//	*p = 0;
-		//	g_args[g_numArgs] = p+1;
-		//	g_argsFrom[g_numArgs] = (s+((p+1)-g_buffer));
-		//	g_numArgs++;
+		//	t->args[t->numArgs] = p+1;
+		//	t->argsFrom[t->numArgs] = (s+((p+1)-t->buffer));
+		//	t->numArgs++;
 		//}
-		if(g_bAllowQuotes && *p == '"' && ((p <= g_buffer) || isWhiteSpace(p[-1]))) {
+		if(g_bAllowQuotes && *p == '"' && ((p <= t->buffer) || isWhiteSpace(p[-1]))) {
 quote:
 			*p = 0;
-			g_argsFrom[g_numArgs] = (s+((p+1)-g_buffer));
+			t->argsFrom[t->numArgs] = (s+((p+1)-t->buffer));
 			p++;
-			g_args[g_numArgs] = p;
-			g_numArgs++;
+			t->args[t->numArgs] = p;
+			t->numArgs++;
 			while(*p != 0) {
 				if (flags & TOKENIZER_ALLOW_ESCAPING_QUOTATIONS) {
 					if (*p == '"' && p[-1] != '\\') {
@@ -429,10 +454,10 @@ quote:
 				p++;
 			}
 			if (flags & TOKENIZER_ALLOW_ESCAPING_QUOTATIONS) {
-				expandQuotes(g_args[g_numArgs - 1]);
+				expandQuotes(t->args[t->numArgs - 1]);
 			}
 		}
-		if(g_numArgs>=MAX_ARGS) {
+		if(t->numArgs>=TOKENIZER_MAX_ARGS) {
 			ADDLOG_ERROR(LOG_FEATURE_CMD, "Too many args, skipped all after 32nd.");
 			break;
 		}
@@ -441,3 +466,164 @@ quote:
 
 
 }
+
+static void *Tokenizer_GetThreadID() {
+#if WINDOWS && LINUX
+	return (void*)(size_t)pthread_self();
+#elif WINDOWS
+	return (void*)(size_t)GetCurrentThreadId();
+#elif PLATFORM_RDA5981
+	return osThreadGetId();
+#elif PLATFORM_TXW81X
+	return csi_kernel_task_get_cur();
+#else
+	return xTaskGetCurrentTaskHandle();
+#endif
+}
+static tokenizerThread_t *Tokenizer_FindThread(void *thread) {
+	int i;
+
+	for (i = 0; i < TOKENIZER_MAX_THREADS; i++) {
+		if (g_tokenizerThreads[i].thread == thread) {
+			return &g_tokenizerThreads[i];
+		}
+	}
+	return 0;
+}
+static bool Tokenizer_Lock() {
+	if (g_tokenizerMutex == 0) {
+		g_tokenizerMutex = xSemaphoreCreateMutex();
+	}
+	return xSemaphoreTake(g_tokenizerMutex, 100) == pdTRUE;
+}
+// finds slot for thread that has none, or whose slot was idle for long
+static tokenizerThread_t *Tokenizer_ClaimThread(void *thread) {
+	tokenizerThread_t *th;
+	int i;
+
+	if (Tokenizer_Lock() == false) {
+		return 0;
+	}
+	th = Tokenizer_FindThread(thread);
+	for (i = 0; th == 0 && i < TOKENIZER_MAX_THREADS; i++) {
+		if (g_tokenizerThreads[i].thread == 0) {
+			th = &g_tokenizerThreads[i];
+		}
+	}
+	for (i = 0; th == 0 && i < TOKENIZER_MAX_THREADS; i++) {
+		if (g_tokenizerThreads[i].depth == 0
+			&& g_secondsElapsed - g_tokenizerThreads[i].lastUse >= TOKENIZER_STEAL_SECONDS) {
+			th = &g_tokenizerThreads[i];
+		}
+	}
+	if (th) {
+		th->thread = thread;
+		th->lastUse = g_secondsElapsed;
+	}
+	xSemaphoreGive(g_tokenizerMutex);
+	return th;
+}
+static tokenizer_t *Tokenizer_GetContextForLevel(tokenizerThread_t *th, int level) {
+	if (level >= TOKENIZER_MAX_DEPTH) {
+		level = TOKENIZER_MAX_DEPTH - 1;
+	}
+	// levels that failed to allocate share the context of the caller
+	while (level >= 0 && th->levels[level] == 0) {
+		level--;
+	}
+	if (level < 0) {
+		return &g_defaultTokenizer;
+	}
+	return th->levels[level];
+}
+// called before running a command handler, so the handler and
+// everything it runs has its own context.
+void Tokenizer_PushContext() {
+	void *thread = Tokenizer_GetThreadID();
+	tokenizerThread_t *th;
+	tokenizer_t *t;
+	int level;
+
+	th = Tokenizer_FindThread(thread);
+	if (th == 0 || (th->depth == 0 && g_secondsElapsed - th->lastUse >= TOKENIZER_KEEP_SECONDS)) {
+		th = Tokenizer_ClaimThread(thread);
+		if (th == 0) {
+			return;
+		}
+	}
+	th->lastUse = g_secondsElapsed;
+	level = th->depth++;
+	if (level >= TOKENIZER_MAX_DEPTH) {
+		return;
+	}
+	t = th->levels[level];
+	if (t == 0) {
+		t = th->levels[level] = malloc(sizeof(tokenizer_t));
+		if (t == 0) {
+			return;
+		}
+	}
+	// TokenizeString sets the rest
+	t->numArgs = 0;
+	t->flags = 0;
+}
+void Tokenizer_PopContext() {
+	tokenizerThread_t *th;
+
+	th = Tokenizer_FindThread(Tokenizer_GetThreadID());
+	if (th == 0 || th->depth <= 0) {
+		return;
+	}
+	th->depth--;
+	th->lastUse = g_secondsElapsed;
+}
+tokenizer_t *Tokenizer_GetCurrentContext() {
+	tokenizerThread_t *th;
+
+	th = Tokenizer_FindThread(Tokenizer_GetThreadID());
+	if (th == 0) {
+		return &g_defaultTokenizer;
+	}
+	return Tokenizer_GetContextForLevel(th, th->depth - 1);
+}
+
+// old API, working on the current context
+bool Tokenizer_CheckArgsCountAndPrintWarning(const char *cmdString, int reqCount) {
+	return TokenizerCtx_CheckArgsCountAndPrintWarning(Tokenizer_GetCurrentContext(), cmdString, reqCount);
+}
+int Tokenizer_GetArgsCount() {
+	return TokenizerCtx_GetArgsCount(Tokenizer_GetCurrentContext());
+}
+bool Tokenizer_IsArgInteger(int i) {
+	return TokenizerCtx_IsArgInteger(Tokenizer_GetCurrentContext(), i);
+}
+const char *Tokenizer_GetArgExpanding(int i) {
+	return TokenizerCtx_GetArgExpanding(Tokenizer_GetCurrentContext(), i);
+}
+const char *Tokenizer_GetArg(int i) {
+	return TokenizerCtx_GetArg(Tokenizer_GetCurrentContext(), i);
+}
+const char *Tokenizer_GetArgFrom(int i) {
+	return TokenizerCtx_GetArgFrom(Tokenizer_GetCurrentContext(), i);
+}
+int Tokenizer_GetArgIntegerRange(int i, int rangeMin, int rangeMax) {
+	return TokenizerCtx_GetArgIntegerRange(Tokenizer_GetCurrentContext(), i, rangeMin, rangeMax);
+}
+int Tokenizer_GetPin(int i, int def) {
+	return TokenizerCtx_GetPin(Tokenizer_GetCurrentContext(), i, def);
+}
+int Tokenizer_GetArgIntegerDefault(int i, int def) {
+	return TokenizerCtx_GetArgIntegerDefault(Tokenizer_GetCurrentContext(), i, def);
+}
+float Tokenizer_GetArgFloatDefault(int i, float def) {
+	return TokenizerCtx_GetArgFloatDefault(Tokenizer_GetCurrentContext(), i, def);
+}
+int Tokenizer_GetArgInteger(int i) {
+	return TokenizerCtx_GetArgInteger(Tokenizer_GetCurrentContext(), i);
+}
+float Tokenizer_GetArgFloat(int i) {
+	return TokenizerCtx_GetArgFloat(Tokenizer_GetCurrentContext(), i);
+}
+void Tokenizer_TokenizeString(const char *s, int flags) {
+	TokenizerCtx_TokenizeString(Tokenizer_GetCurrentContext(), s, flags);
+}
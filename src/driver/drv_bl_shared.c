@@ -185,8 +185,15 @@ void BL09XX_AppendInformationToHTTPIndexPage(http_request_t * request, int bPreS
 			poststr(request, "<tr><td><b>");
 			poststr(request, sensdataset->sensors[i].names.name_friendly);
 			poststr(request, "</b></td><td style='text-align: right;'>");
-			hprintf255(request, "%.*f</td><td>%s</td>", sensdataset->sensors[i].rounding_decimals,
-					(i == OBK_CONSUMPTION_TOTAL ? 0.001 : 1) * sensdataset->sensors[i].lastReading, //always display OBK_CONSUMPTION_TOTAL in kwh
+			// voltage, current and power are updated by pushed events, see http_events.c
+			int bPushed = i <= OBK_POWER && asensdatasetix == BL_SENSORS_IX_0;
+			if (bPushed) {
+				hprintf255(request, "<span data-en='%c' data-dp='%i'>", "vcp"[i - OBK_VOLTAGE],
+					sensdataset->sensors[i].rounding_decimals);
+			}
+			hprintf255(request, "%.*f", sensdataset->sensors[i].rounding_decimals,
+					(i == OBK_CONSUMPTION_TOTAL ? 0.001 : 1) * sensdataset->sensors[i].lastReading); //always display OBK_CONSUMPTION_TOTAL in kwh
+			hprintf255(request, "%s</td><td>%s</td>", bPushed ? "</span>" : "",
 					i == OBK_CONSUMPTION_TOTAL ? "kWh": sensdataset->sensors[i].names.units);
 		}
 	};
@@ -120,41 +120,101 @@ void DRV_DDP_CreateSocket_Receive() {
 
 	addLogAdv(LOG_INFO, LOG_FEATURE_DDP,"Waiting for packets");
 }
+// DDP header, see http://www.3waylabs.com/ddp/
+#define DDP_HEADER_LEN			10
+// header has 4 bytes of timecode after length
+#define DDP_HEADER_LEN_TIME		14
+#define DDP_FLAGS1_PUSH			0x01
+#define DDP_FLAGS1_TIME			0x10
+
+// byte offset where the next fragment of current frame should start
+static int g_ddp_nextOffset = 0;
+static int stat_ddpFrames = 0;
+static int stat_ddpDroppedFragments = 0;
+static int g_ddp_framesLastSecond = 0;
+static int g_ddp_fps = 0;
+
+void DDP_GetStats(int *frames, int *dropped, int *fps) {
+	*frames = stat_ddpFrames;
+	*dropped = stat_ddpDroppedFragments;
+	*fps = g_ddp_fps;
+}
 void DDP_Parse(byte *data, int len) {
 	if(len > 12) {
 		byte r, g, b;
+		int headerLen = (data[0] & DDP_FLAGS1_TIME) ? DDP_HEADER_LEN_TIME : DDP_HEADER_LEN;
+		// offset is in bytes, from the start of the frame
+		int offset = (data[4] << 24) | (data[5] << 16) | (data[6] << 8) | data[7];
+		int dataLen = (data[8] << 8) | data[9];
+		bool bPush = (data[0] & DDP_FLAGS1_PUSH) != 0;
 
 		// This is done by WLED, but not checked in Tasmota
 		// data type 0x1B (formerly 0x1A) is RGBW (type 3, 8 bit/channel)
 		byte bytesPerPixel = ((data[2] & 0b00111000) >> 3 == 0b011) ? 4 : 3;
 
+		if (len <= headerLen || offset < 0) {
+			return;
+		}
+		// some senders leave length at 0, then use whole packet
+		if (dataLen == 0 || dataLen > len - headerLen) {
+			dataLen = len - headerLen;
+		}
+		if (offset > g_ddp_nextOffset) {
+			// fragment(s) in between were lost
+			stat_ddpDroppedFragments++;
+		}
+		g_ddp_nextOffset = offset + dataLen;
+
 #if ENABLE_DRIVER_SM16703P
 		if (Strip_IsActive()) {
-			// Note that this is limited by DDP msgbuf size
-			uint32_t numPixels = (len - 10) / 3;
+			// pixels are only written into the buffer here, whole frame
+			// goes to the strip at once when fragment with PUSH comes
+			uint32_t firstPixel = offset / bytesPerPixel;
+			uint32_t numPixels = dataLen / bytesPerPixel;
+			uint32_t i;
+			byte *p = &data[headerLen];
+
 			// debug
-			//addLogAdv(LOG_INFO, LOG_FEATURE_DDP, "DDP_Parse: STRIP path: %i pixels", numPixels);
-			// This immediately activates the pixels, maybe we should read the PUSH flag
-			Strip_setMultiplePixel(numPixels, &data[10], true);
+			//addLogAdv(LOG_INFO, LOG_FEATURE_DDP, "DDP_Parse: STRIP path: %i pixels at %i", numPixels, firstPixel);
+			if (firstPixel + numPixels > pixel_count) {
+				numPixels = firstPixel < pixel_count ? pixel_count - firstPixel : 0;
+			}
+			if (bytesPerPixel == 3) {
+				Strip_setMultiplePixelAt(firstPixel, numPixels, p, bPush);
+			}
+			else {
+				for (i = 0; i < numPixels; i++) {
+					Strip_setPixel(firstPixel + i, p[0], p[1], p[2], p[3], p[3]);
+					p += bytesPerPixel;
+				}
+				if (bPush) {
+					Strip_Apply();
+				}
+			}
 		} else
 #endif
+		if (offset == 0)
 		{
-			r = data[10];
-			g = data[11];
-			b = data[12];
+			r = data[headerLen];
+			g = data[headerLen + 1];
+			b = data[headerLen + 2];
 
 			//addLogAdv(LOG_INFO, LOG_FEATURE_DDP, "DDP_Parse: bulb path");
 
 #if ENABLE_LED_BASIC
 			LED_SetDimmerIfChanged(100);
 			if (data[9] == 4) {
-				LED_SetFinalRGBW(r, g, b, data[13]);
+				LED_SetFinalRGBW(r, g, b, data[headerLen + 3]);
 			}
 			else {
 				LED_SetFinalRGB(r, g, b);
 			}
 #endif
 		}
+		if (bPush) {
+			stat_ddpFrames++;
+			g_ddp_nextOffset = 0;
+		}
 	}
 }
 void DRV_DDP_RunFrame() {
@@ -210,7 +270,13 @@ void DRV_DDP_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreS
 	if (bPreState){
 		return;
 	}
-	hprintf255(request, "<h2>DDP received: %i packets, %i bytes</h2>", stat_ddpPacketsReceived, stat_ddpBytesReceived);
+	hprintf255(request, "<h2>DDP received: %i packets, %i bytes, %i frames (%i FPS), %i dropped fragments</h2>",
+		stat_ddpPacketsReceived, stat_ddpBytesReceived, stat_ddpFrames, g_ddp_fps, stat_ddpDroppedFragments);
+}
+void DRV_DDP_RunEverySecond()
+{
+	g_ddp_fps = stat_ddpFrames - g_ddp_framesLastSecond;
+	g_ddp_framesLastSecond = stat_ddpFrames;
 }
 void DRV_DDP_Init()
 {
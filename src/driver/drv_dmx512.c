@@ -108,6 +108,7 @@ void DMX_Init() {
 	ws_export.getByte = DMX_GetByte;
 	ws_export.setByte = DMX_setByte;
 	ws_export.setLEDCount = DMX_SetLEDCount;
+	ws_export.setBytes = 0;
 
 	LEDS_InitShared(&ws_export);
 
@@ -116,24 +116,40 @@ void Strip_setPixel(int pixel, int r, int g, int b, int c, int w) {
 
 	}
 }
-void Strip_setMultiplePixel(uint32_t pixel, uint8_t *data, bool push) {
+// true if RGB data can be copied to backend as it is
+static bool Strip_IsRawRGB() {
+	return pixel_size == 3 && color_channel_order[0] == COLOR_CHANNEL_RED
+		&& color_channel_order[1] == COLOR_CHANNEL_GREEN && color_channel_order[2] == COLOR_CHANNEL_BLUE;
+}
+void Strip_setMultiplePixelAt(uint32_t firstPixel, uint32_t pixel, const uint8_t *data, bool push) {
 	// Check max pixel
-	if (pixel > pixel_count)
-		pixel = pixel_count;
-
-	// Iterate over pixel
-	for (uint32_t i = 0; i < pixel; i++) {
-		uint8_t r, g, b;
-		r = *data++;
-		g = *data++;
-		b = *data++;
-		// TODO: Not sure how this works. Should we add Cold and Warm white here as well?
-		Strip_setPixel((int)i, (int)r, (int)g, (int)b, 0, 0);
+	if (firstPixel >= pixel_count)
+		pixel = 0;
+	else if (pixel > pixel_count - firstPixel)
+		pixel = pixel_count - firstPixel;
+
+	if (led_backend.setBytes && Strip_IsRawRGB()) {
+		// whole range encoded at once
+		led_backend.setBytes(firstPixel * 3, data, pixel * 3);
+	}
+	else {
+		// Iterate over pixel
+		for (uint32_t i = 0; i < pixel; i++) {
+			uint8_t r, g, b;
+			r = *data++;
+			g = *data++;
+			b = *data++;
+			// TODO: Not sure how this works. Should we add Cold and Warm white here as well?
+			Strip_setPixel((int)(firstPixel + i), (int)r, (int)g, (int)b, 0, 0);
+		}
 	}
 	if (push) {
 		Strip_Apply();
 	}
 }
+void Strip_setMultiplePixel(uint32_t pixel, uint8_t *data, bool push) {
+	Strip_setMultiplePixelAt(0, pixel, data, push);
+}
 extern float g_brightness0to100;//TODO
 void Strip_setPixelWithBrig(int pixel, int r, int g, int b, int c, int w) {
 	// scale brightness
@@ -10,6 +10,8 @@ typedef struct ledStrip_s {
 	void (*setByte)(uint32_t idx, byte val);
 	void (*apply)();
 	void (*setLEDCount)(int pixel_count, int pixel_size);
+	// optional, sets many bytes at once
+	void (*setBytes)(uint32_t idx, const byte *data, int count);
 } ledStrip_t;
 
 typedef enum ColorChannel {
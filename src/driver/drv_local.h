@@ -13,6 +13,7 @@ void DRV_DGR_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreS
 void DRV_DDP_Init();
 void DRV_DDP_RunFrame();
 void DRV_DDP_Shutdown();
+void DRV_DDP_RunEverySecond();
 void DRV_DDP_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
 
 void DRV_Shutters_RunQuickTick();
@@ -84,6 +85,8 @@ void Strip_setPixelWithBrig(int pixel, int r, int g, int b, int c, int w);
 void Strip_setAllPixels(int r, int g, int b, int c, int w);
 void Strip_scaleAllPixels(int scale);
 void Strip_setMultiplePixel(uint32_t pixel, uint8_t* data, bool push);
+// sets RGB pixels starting at firstPixel
+void Strip_setMultiplePixelAt(uint32_t firstPixel, uint32_t pixel, const uint8_t* data, bool push);
 void SM16703P_Show();
 void SM15155E_Init();
 void SM15155E_Write(float *rgbcw);
@@ -870,7 +870,7 @@ static driver_t g_drivers[] = {
 	//drvdetail:"requires":""}
 	{ "DDP",                                 // Driver Name
 	DRV_DDP_Init,                            // Init
-	NULL,                                    // onEverySecond
+	DRV_DDP_RunEverySecond,                  // onEverySecond
 	DRV_DDP_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
 	DRV_DDP_RunFrame,                        // runQuickTick
 	DRV_DDP_Shutdown,                        // stopFunction
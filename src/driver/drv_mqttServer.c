@@ -6,6 +6,7 @@ ms_publish cmnd/obk174083A4/POWER TOGGLE
 #include "../cmnds/cmd_public.h"
 #include "../httpserver/new_http.h"
 #include "../logging/logging.h"
+#include "../mqtt/new_mqtt_topicTrie.h"
 #include "../new_common.h"
 #include "../obk_config.h"
 #include "lwip/inet.h"
@@ -57,6 +58,8 @@ typedef struct mqttClient_s {
   char clientID[64];
   char ipAddr[20];
   mqttSubscription_t *subs;
+  // owner index of this client in g_subsTrie
+  int slot;
   int bytesRecv;
   int bytesSent;
   int packetsRecv;
@@ -69,6 +72,9 @@ typedef struct mqttClient_s {
 
 static int g_listenSocket = -1;
 static mqttClient_t *g_clientList = NULL;
+// subscriptions of all clients, owners are client slots
+static mqttTopicTrie_t g_subsTrie;
+static unsigned int g_usedSlots = 0;
 
 // Decode MQTT remaining length (variable-length encoding)
 static int MQTTS_DecodeRemainingLength(const byte *buf, int bufLen,
@@ -176,8 +182,10 @@ static void MQTTS_FreeSubs(mqttClient_t *c) {
   mqttSubscription_t *s = c->subs;
   while (s) {
     mqttSubscription_t *next = s->next;
-    if (s->topic)
+    if (s->topic) {
+      MQTT_TopicTrie_Remove(&g_subsTrie, s->topic, c->slot);
       free(s->topic);
+    }
     free(s);
     s = next;
   }
@@ -199,6 +207,7 @@ static void MQTTS_FreeClient(mqttClient_t *c) {
     close(c->socket);
   }
   MQTTS_FreeSubs(c);
+  g_usedSlots &= ~(1u << c->slot);
   if (c->recvBuf)
     free(c->recvBuf);
   free(c);
@@ -213,6 +222,7 @@ static void MQTTS_AddSub(mqttClient_t *c, const char *topic) {
   s->topic = strdup(topic);
   s->next = c->subs;
   c->subs = s;
+  MQTT_TopicTrie_Add(&g_subsTrie, topic, c->slot);
 }
 
 // Remove a subscription by topic
@@ -224,10 +234,16 @@ static void MQTTS_RemoveSub(mqttClient_t *c, const char *topic) {
       *pp = victim->next;
       free(victim->topic);
       free(victim);
-      return;
+      break;
     }
     pp = &(*pp)->next;
   }
+  // same filter may have been subscribed twice
+  for (pp = &c->subs; *pp; pp = &(*pp)->next) {
+    if ((*pp)->topic && !strcmp((*pp)->topic, topic))
+      return;
+  }
+  MQTT_TopicTrie_Remove(&g_subsTrie, topic, c->slot);
 }
 
 // Count clients in list
@@ -243,27 +259,7 @@ static int MQTTS_ClientCount() {
 
 // Match topic against subscription filter with + and # wildcards
 int MQTTS_TopicMatch(const char *topic, const char *filter) {
-  while (*filter) {
-    if (*filter == '#') {
-      return 1;
-    }
-    if (*filter == '+') {
-      while (*topic && *topic != '/')
-        topic++;
-      filter++;
-      if (*topic == '/' && *filter == '/') {
-        topic++;
-        filter++;
-        continue;
-      }
-      return (*topic == 0 && *filter == 0) ? 1 : 0;
-    }
-    if (*topic != *filter)
-      return 0;
-    topic++;
-    filter++;
-  }
-  return (*topic == 0) ? 1 : 0;
+  return MQTT_TopicMatch(topic, filter);
 }
 
 // Forward a PUBLISH to all subscribed clients
@@ -274,42 +270,38 @@ void MQTTS_ForwardPublish(const byte *topicData, int topicLen,
   memcpy(topicStr, topicData, copyLen);
   topicStr[copyLen] = 0;
 
+  unsigned int owners = MQTT_TopicTrie_Match(&g_subsTrie, topicStr);
   mqttClient_t *c;
   for (c = g_clientList; c; c = c->next) {
     if (!c->bConnected || c == sender)
       continue;
-    mqttSubscription_t *s;
-    for (s = c->subs; s; s = s->next) {
-      if (!s->topic)
-        continue;
-      if (MQTTS_TopicMatch(topicStr, s->topic)) {
-        // Build PUBLISH packet: fixed header + topic + payload
-        byte hdr[5];
-        int totalPayload = 2 + topicLen + payloadLen;
-        int hdrLen = 1;
-        hdr[0] = (MQTT_PUBLISH << 4); // QoS 0, no retain
-        int rl = totalPayload;
-        do {
-          byte eb = rl % 128;
-          rl /= 128;
-          if (rl > 0)
-            eb |= 0x80;
-          hdr[hdrLen++] = eb;
-        } while (rl > 0);
-        MQTTS_SendToClient(c, hdr, hdrLen);
-        byte topicHdr[2];
-        topicHdr[0] = (topicLen >> 8) & 0xFF;
-        topicHdr[1] = topicLen & 0xFF;
-        MQTTS_SendToClient(c, topicHdr, 2);
-        MQTTS_SendToClient(c, topicData, topicLen);
-        if (payloadLen > 0) {
-          MQTTS_SendToClient(c, payload, payloadLen);
-        }
-        c->packetsSent++;
-        g_totalPublishForwarded++;
-        break; // only send once per client
-      }
+    // one copy per client, even if more of its filters match
+    if (!(owners & (1u << c->slot)))
+      continue;
+    // Build PUBLISH packet: fixed header + topic + payload
+    byte hdr[5];
+    int totalPayload = 2 + topicLen + payloadLen;
+    int hdrLen = 1;
+    hdr[0] = (MQTT_PUBLISH << 4); // QoS 0, no retain
+    int rl = totalPayload;
+    do {
+      byte eb = rl % 128;
+      rl /= 128;
+      if (rl > 0)
+        eb |= 0x80;
+      hdr[hdrLen++] = eb;
+    } while (rl > 0);
+    MQTTS_SendToClient(c, hdr, hdrLen);
+    byte topicHdr[2];
+    topicHdr[0] = (topicLen >> 8) & 0xFF;
+    topicHdr[1] = topicLen & 0xFF;
+    MQTTS_SendToClient(c, topicHdr, 2);
+    MQTTS_SendToClient(c, topicData, topicLen);
+    if (payloadLen > 0) {
+      MQTTS_SendToClient(c, payload, payloadLen);
     }
+    c->packetsSent++;
+    g_totalPublishForwarded++;
   }
 }
 
@@ -779,6 +771,9 @@ void DRV_MQTTServer_RunQuickTick() {
         close(newSock);
       } else {
         memset(c, 0, sizeof(mqttClient_t));
+        while (g_usedSlots & (1u << c->slot))
+          c->slot++;
+        g_usedSlots |= 1u << c->slot;
         c->socket = newSock;
         c->recvBuf = (byte *)malloc(MQTT_RECV_BUF_INITIAL);
         c->recvBufCap = c->recvBuf ? MQTT_RECV_BUF_INITIAL : 0;
@@ -412,7 +412,7 @@ void DRV_Shutters_DoDiscovery(const char *topic) {
 	while (s) {
 		HassDeviceInfo* dev_info = NULL;
 		dev_info = hass_createShutter(s->channel);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+		hass_queue_discovery(topic, dev_info);
 		hass_free_device_info(dev_info);
 		s = s->next;
 	}
@@ -55,23 +55,51 @@ byte reverse_translate_byte(uint8_t *input) {
 	dst |= (reverse_translate_2bit(*input++) << 0);
 	return dst;
 }
+// every data bit is sent as 4 SPI bits, so every byte becomes 4 bytes,
+// table has them for all 256 values, in the order they are sent
+#define SPILED_2BIT(v)		((v) == 0 ? 0b10001000 : (v) == 1 ? 0b10001110 : (v) == 2 ? 0b11101000 : 0b11101110)
+#define SPILED_BYTE(v)		{{ SPILED_2BIT(((v) >> 6) & 3), SPILED_2BIT(((v) >> 4) & 3), SPILED_2BIT(((v) >> 2) & 3), SPILED_2BIT((v) & 3) }}
+#define SPILED_BYTE4(v)		SPILED_BYTE(v), SPILED_BYTE((v) + 1), SPILED_BYTE((v) + 2), SPILED_BYTE((v) + 3)
+#define SPILED_BYTE16(v)	SPILED_BYTE4(v), SPILED_BYTE4((v) + 4), SPILED_BYTE4((v) + 8), SPILED_BYTE4((v) + 12)
+#define SPILED_BYTE64(v)	SPILED_BYTE16(v), SPILED_BYTE16((v) + 16), SPILED_BYTE16((v) + 32), SPILED_BYTE16((v) + 48)
+
+typedef union spiLEDCode_u {
+	uint8_t b[4];
+	uint32_t w;
+} spiLEDCode_t;
+
+static const spiLEDCode_t g_spiLEDCodes[256] = {
+	SPILED_BYTE64(0), SPILED_BYTE64(64), SPILED_BYTE64(128), SPILED_BYTE64(192)
+};
+
 void translate_byte(uint8_t input, uint8_t *dst) {
-	// return 0x00000000 |
-	// 	   translate_2bit((input >> 6)) |
-	// 	   translate_2bit((input >> 4)) |
-	// 	   translate_2bit((input >> 2)) |
-	// 	   translate_2bit(input);
-	*dst++ = translate_2bit((input >> 6));
-	*dst++ = translate_2bit((input >> 4));
-	*dst++ = translate_2bit((input >> 2));
-	*dst++ = translate_2bit(input);
-
-#if WINDOWS
-	byte test = reverse_translate_byte(dst - 4);
-	if (input != test) {
-		printf("reverse_translate_byte is brken");
+	memcpy(dst, g_spiLEDCodes[input].b, 4);
+}
+
+// encodes numBytes from src into dst, word stores if dst allows it
+static void SPILED_EncodeBytes(uint8_t *dst, const byte *src, int numBytes) {
+	int i;
+
+	if (((uintptr_t)dst & 3) == 0) {
+		uint32_t *dst32 = (uint32_t*)dst;
+
+		for (i = 0; i + 4 <= numBytes; i += 4) {
+			dst32[0] = g_spiLEDCodes[src[0]].w;
+			dst32[1] = g_spiLEDCodes[src[1]].w;
+			dst32[2] = g_spiLEDCodes[src[2]].w;
+			dst32[3] = g_spiLEDCodes[src[3]].w;
+			dst32 += 4;
+			src += 4;
+		}
+		for (; i < numBytes; i++) {
+			*dst32++ = g_spiLEDCodes[*src++].w;
+		}
+		return;
+	}
+	for (i = 0; i < numBytes; i++) {
+		memcpy(dst, g_spiLEDCodes[*src++].b, 4);
+		dst += 4;
 	}
-#endif
 }
 
 spiLED_t spiLED;
@@ -135,18 +163,11 @@ void SPILED_InitDMA(int numBytes) {
 
 
 
-void SPILED_SetRawBytes(int start_offset, byte *bytes, int numBytes, int push) {
+void SPILED_SetRawBytes(int start_offset, const byte *bytes, int numBytes, int push) {
 	// start offset is in bytes, and we do 2 bits per dst byte, so *4
 	uint8_t *dst = spiLED.buf + spiLED.ofs + start_offset * 4;
 
-	// parse hex string like FFAABB0011 byte by byte
-	for (int i = 0; i < numBytes; i++) {
-		byte b = bytes[i];
-		*dst++ = translate_2bit((b >> 6));
-		*dst++ = translate_2bit((b >> 4));
-		*dst++ = translate_2bit((b >> 2));
-		*dst++ = translate_2bit(b);
-	}
+	SPILED_EncodeBytes(dst, bytes, numBytes);
 	if (push) {
 		SPIDMA_StartTX(spiLED.msg);
 	}
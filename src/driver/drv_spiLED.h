@@ -22,6 +22,6 @@ void translate_byte(uint8_t input, uint8_t *dst);
 void SPILED_InitDMA(int numBytes);
 
 void SPILED_SetRawHexString(int start_offset, const char *s, int push);
-void SPILED_SetRawBytes(int start_offset, byte *bytes, int numBytes, int push);
+void SPILED_SetRawBytes(int start_offset, const byte *bytes, int numBytes, int push);
 void SPILED_Init(int pin);
 void SPILED_Shutdown();
\ No newline at end of file
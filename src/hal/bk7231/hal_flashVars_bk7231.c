@@ -5,6 +5,21 @@
 #include "../../logging/logging.h"
 #include <easyflash.h>
 
+#if PLATFORM_BK7231T
+#include "../hal_flashVars_journal.h"
+#include "../../littlefs/our_lfs.h"
+#include "typedef.h"
+#include "flash_pub.h"
+
+// Flash vars journal sector pair, right after LFS. It is still inside the OTA
+// partition. LFS is placed below LFS_BLOCKS_END and store_sector in
+// hal_ota_bk7231.c refuses to write past it, so no OTA path reaches it.
+// Easyflash copy is refreshed once per boot (HAL_FlashVars_SaveBootComplete),
+// so if journal is ever lost, values from last boot are used.
+#define FLASH_VARS_JOURNAL_START	LFS_BLOCKS_END
+#define FLASH_VARS_JOURNAL_SECTOR	0x1000
+#endif
+
 static int g_easyFlash_Ready = 0;
 void InitEasyFlashIfNeeded()
 {
@@ -27,18 +42,17 @@ static int g_loaded = 0;
 
 extern void InitEasyFlashIfNeeded();
 
-static int ReadFlashVars(void* target, int dataLen)
+static int ReadFlashVarsKV(void* target, int dataLen)
 {
 	InitEasyFlashIfNeeded();
 	int readLen;
 	ADDLOG_DEBUG(LOG_FEATURE_CFG, "%s: to read %d b", __func__, dataLen);
 	readLen = ef_get_env_blob(KV_KEY_FLASH_VARS, target, dataLen, NULL);
 	ADDLOG_DEBUG(LOG_FEATURE_CFG, "%s: read %d b", __func__, readLen);
-	g_loaded = 1;
 	return dataLen;
 }
 
-static int SaveFlashVars(void* src, int dataLen)
+static int SaveFlashVarsKV(void* src, int dataLen)
 {
 	InitEasyFlashIfNeeded();
 	EfErrCode res;
@@ -58,6 +72,92 @@ static int SaveFlashVars(void* src, int dataLen)
 	return dataLen;
 }
 
+#ifdef FLASH_VARS_JOURNAL_START
+
+extern UINT32 flash_read(char *user_buf, UINT32 count, UINT32 address);
+extern UINT32 flash_write(char *user_buf, UINT32 count, UINT32 address);
+extern UINT32 flash_ctrl(UINT32 cmd, void *parm);
+
+static void BK_FlashVars_Read(int sector, int offset, void* data, int len)
+{
+	GLOBAL_INT_DECLARATION();
+
+	GLOBAL_INT_DISABLE();
+	flash_read((char*)data, len, FLASH_VARS_JOURNAL_START + sector * FLASH_VARS_JOURNAL_SECTOR + offset);
+	GLOBAL_INT_RESTORE();
+}
+
+static void BK_FlashVars_Write(int sector, int offset, const void* data, int len)
+{
+	int protect = FLASH_PROTECT_NONE;
+	GLOBAL_INT_DECLARATION();
+
+	GLOBAL_INT_DISABLE();
+	flash_ctrl(CMD_FLASH_SET_PROTECT, &protect);
+	flash_ctrl(CMD_FLASH_WRITE_ENABLE, (void*)0);
+	flash_write((char*)data, len, FLASH_VARS_JOURNAL_START + sector * FLASH_VARS_JOURNAL_SECTOR + offset);
+	protect = FLASH_PROTECT_ALL;
+	flash_ctrl(CMD_FLASH_SET_PROTECT, &protect);
+	GLOBAL_INT_RESTORE();
+}
+
+static void BK_FlashVars_Erase(int sector)
+{
+	int protect = FLASH_PROTECT_NONE;
+	unsigned int addr = FLASH_VARS_JOURNAL_START + sector * FLASH_VARS_JOURNAL_SECTOR;
+	GLOBAL_INT_DECLARATION();
+
+	GLOBAL_INT_DISABLE();
+	flash_ctrl(CMD_FLASH_SET_PROTECT, &protect);
+	flash_ctrl(CMD_FLASH_WRITE_ENABLE, (void*)0);
+	flash_ctrl(CMD_FLASH_ERASE_SECTOR, &addr);
+	protect = FLASH_PROTECT_ALL;
+	flash_ctrl(CMD_FLASH_SET_PROTECT, &protect);
+	GLOBAL_INT_RESTORE();
+}
+
+static const flashVarsJournalOps_t g_bkFlashVarsOps = {
+	FLASH_VARS_JOURNAL_SECTOR,
+	BK_FlashVars_Read,
+	BK_FlashVars_Write,
+	BK_FlashVars_Erase,
+};
+
+static int ReadFlashVars(void* target, int dataLen)
+{
+	// first boot with journal (or journal lost), take vars from easyflash,
+	// first save then writes them to journal
+	if(FlashVarsJournal_Init(&g_bkFlashVarsOps, target, dataLen) == 0)
+	{
+		ADDLOG_WARN(LOG_FEATURE_CFG, "Flash vars journal is empty, using easyflash copy");
+		ReadFlashVarsKV(target, dataLen);
+	}
+	g_loaded = 1;
+	return dataLen;
+}
+
+static int SaveFlashVars(void* src, int dataLen)
+{
+	FlashVarsJournal_Save(src);
+	return dataLen;
+}
+
+#else
+
+static int ReadFlashVars(void* target, int dataLen)
+{
+	ReadFlashVarsKV(target, dataLen);
+	g_loaded = 1;
+	return dataLen;
+}
+
+static int SaveFlashVars(void* src, int dataLen)
+{
+	return SaveFlashVarsKV(src, dataLen);
+}
+
+#endif
+
 // call at startup
 void HAL_FlashVars_IncreaseBootCount()
 {
@@ -83,6 +183,22 @@ void HAL_FlashVars_SaveChannel(int index, int value)
 	SaveFlashVars(&flash_vars, sizeof(flash_vars));
 }
 
+void HAL_FlashVars_SaveChannels(unsigned int mask, const int* values)
+{
+	int i;
+
+	if(g_loaded == 0)
+	{
+		ReadFlashVars(&flash_vars, sizeof(flash_vars));
+	}
+	for(i = 0; i < MAX_RETAIN_CHANNELS; i++)
+	{
+		if(mask & (1 << i))
+			flash_vars.savedValues[i] = values[i];
+	}
+	SaveFlashVars(&flash_vars, sizeof(flash_vars));
+}
+
 void HAL_FlashVars_ReadLED(byte* mode, short* brightness, short* temperature, byte* rgb, byte* bEnableAll)
 {
 	if(g_loaded == 0)
@@ -136,6 +252,10 @@ void HAL_FlashVars_SaveBootComplete()
 {
 	flash_vars.boot_success_count = flash_vars.boot_count;
 	SaveFlashVars(&flash_vars, sizeof(flash_vars));
+#ifdef FLASH_VARS_JOURNAL_START
+	// fallback copy, see FLASH_VARS_JOURNAL_START
+	SaveFlashVarsKV(&flash_vars, sizeof(flash_vars));
+#endif
 }
 
 // call to return the number of boots since a HAL_FlashVars_SaveBootComplete
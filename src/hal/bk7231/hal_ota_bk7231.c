@@ -11,11 +11,19 @@
 #include "../../driver/drv_public.h"
 #include "../../driver/drv_bl_shared.h"
 #include "../../driver/drv_hlw8112.h"
+#include "../../littlefs/our_lfs.h"
 
 static unsigned char *sector = (void *)0;
 int sectorlen = 0;
 unsigned int addr = 0xff000;
 #define SECTOR_SIZE 0x1000
+#if PLATFORM_BK7231T
+// OTA writes must stay below this, flash vars journal follows it,
+// see hal_flashVars_bk7231.c
+#define OTA_WRITE_END LFS_BLOCKS_END
+#endif
+// set when image did not fit, the rest of it was dropped
+static int ota_overflow = 0;
 static void store_sector(unsigned int addr, unsigned char *data);
 extern void flash_protection_op(UINT8 mode,PROTECT_TYPE type);
 
@@ -44,6 +52,7 @@ int init_ota(unsigned int startaddr){
         sector = os_malloc(SECTOR_SIZE);
         sectorlen = 0;
         addr = startaddr;
+        ota_overflow = 0;
         addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"init OTA, startaddr 0x%x", startaddr);
         return 1;
     }
@@ -101,6 +110,15 @@ void add_otadata(unsigned char *data, int len)
 }
 
 static void store_sector(unsigned int addr, unsigned char *data){
+#ifdef OTA_WRITE_END
+    if (addr + SECTOR_SIZE > OTA_WRITE_END){
+        if (!ota_overflow){
+            addLogAdv(LOG_ERROR, LOG_FEATURE_OTA,"OTA image too large, 0x%x is past 0x%x", addr, OTA_WRITE_END);
+        }
+        ota_overflow = 1;
+        return;
+    }
+#endif
     //if (!(addr % 0x4000))
     {
       addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"%x", addr);
@@ -143,6 +161,10 @@ int myhttpclientcallback(httprequest_t* request){
       close_ota();
       OTA_ResetProgress();
       addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"\rmyhttpclientcallback state %d total %d/%d", request->state, OTA_GetTotalBytes(), request->client_data.response_content_len);
+      if (ota_overflow){
+        addLogAdv(LOG_ERROR, LOG_FEATURE_OTA,"OTA image was truncated, not rebooting");
+        break;
+      }
 
       addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"Rebooting in 1 seconds...");
 
@@ -265,6 +287,10 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 		}
 	} while ((towrite > 0) && (writelen >= 0));
 	close_ota();
+	if (ota_overflow)
+	{
+		return http_rest_error(request, -20, "image does not fit");
+	}
 	ADDLOG_DEBUG(LOG_FEATURE_OTA, "%d total bytes written", total);
 	http_setup(request, httpMimeTypeJson);
 	hprintf255(request, "{\"size\":%d}", total);
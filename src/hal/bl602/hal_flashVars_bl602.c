@@ -83,6 +83,22 @@ void HAL_FlashVars_SaveChannel(int index, int value)
 	SaveFlashVars(&flash_vars, sizeof(flash_vars));
 }
 
+void HAL_FlashVars_SaveChannels(unsigned int mask, const int* values)
+{
+	int i;
+
+	if(g_loaded == 0)
+	{
+		ReadFlashVars(&flash_vars, sizeof(flash_vars));
+	}
+	for(i = 0; i < MAX_RETAIN_CHANNELS; i++)
+	{
+		if(mask & (1 << i))
+			flash_vars.savedValues[i] = values[i];
+	}
+	SaveFlashVars(&flash_vars, sizeof(flash_vars));
+}
+
 void HAL_FlashVars_ReadLED(byte* mode, short* brightness, short* temperature, byte* rgb, byte* bEnableAll)
 {
 	if(g_loaded == 0)
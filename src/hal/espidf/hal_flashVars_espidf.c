@@ -46,6 +46,25 @@ void HAL_FlashVars_SaveChannel(int index, int value)
 	nvs_close(handle);
 }
 
+void HAL_FlashVars_SaveChannels(unsigned int mask, const int* values)
+{
+	char channel[6];
+	int i;
+	InitFlashIfNeeded();
+	nvs_handle_t handle = 0;
+	nvs_open("config", NVS_READWRITE, &handle);
+	for(i = 0; i < MAX_RETAIN_CHANNELS; i++)
+	{
+		if(mask & (1 << i))
+		{
+			sprintf(channel, "ch%i", i);
+			nvs_set_i32(handle, channel, values[i]);
+		}
+	}
+	nvs_commit(handle);
+	nvs_close(handle);
+}
+
 void HAL_FlashVars_ReadLED(byte* mode, short* brightness, short* temperature, byte* rgb, byte* bEnableAll)
 {
 	InitFlashIfNeeded();
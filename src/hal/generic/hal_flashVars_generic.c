@@ -13,6 +13,17 @@ void __attribute__((weak)) HAL_FlashVars_SaveChannel(int index, int value)
 
 }
 
+void __attribute__((weak)) HAL_FlashVars_SaveChannels(unsigned int mask, const int* values)
+{
+	int i;
+
+	for(i = 0; i < MAX_RETAIN_CHANNELS; i++)
+	{
+		if(mask & (1 << i))
+			HAL_FlashVars_SaveChannel(i, values[i]);
+	}
+}
+
 void __attribute__((weak)) HAL_FlashVars_ReadLED(byte* mode, short* brightness, short* temperature, byte* rgb, byte* bEnableAll)
 {
 
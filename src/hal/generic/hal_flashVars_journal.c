@@ -0,0 +1,184 @@
+#include "../../new_common.h"
+#include "../hal_flashVars_journal.h"
+
+#define FVJ_MAGIC				"OBKJ"
+#define FVJ_HEADER_SIZE			8
+// len, offset and CRC
+#define FVJ_RECORD_OVERHEAD		3
+// changed spans closer than that are written as one record
+#define FVJ_MERGE_GAP			FVJ_RECORD_OVERHEAD
+#define FVJ_ERASED				0xFF
+
+static const flashVarsJournalOps_t* g_fvjOps = 0;
+// what is in flash now
+static unsigned char g_fvjShadow[FLASH_VARS_JOURNAL_MAX_SIZE];
+static int g_fvjSize = 0;
+// active sector, -1 if none is valid
+static int g_fvjSector = -1;
+static unsigned int g_fvjSequence = 0;
+// offset of free space in active sector
+static int g_fvjPos = 0;
+static int g_fvjBytesWritten = 0;
+static int g_fvjCompactions = 0;
+
+// returns sequence of sector, or 0 if sector has no valid header
+static int FVJ_ReadHeader(int sector, unsigned int* sequence) {
+	unsigned char header[FVJ_HEADER_SIZE];
+
+	g_fvjOps->read(sector, 0, header, FVJ_HEADER_SIZE);
+	if (memcmp(header, FVJ_MAGIC, 4)) {
+		return 0;
+	}
+	memcpy(sequence, header + 4, 4);
+	return 1;
+}
+
+// applies all good records to vars, returns offset of free space,
+// or sector size if sector ends with a broken record and can't be appended
+static int FVJ_Replay(int sector, unsigned char* vars) {
+	unsigned char rec[FVJ_RECORD_OVERHEAD + FLASH_VARS_JOURNAL_MAX_SIZE];
+	int pos = FVJ_HEADER_SIZE;
+	int len, offset;
+
+	while (pos + FVJ_RECORD_OVERHEAD <= g_fvjOps->sectorSize) {
+		g_fvjOps->read(sector, pos, rec, 2);
+		len = rec[0];
+		offset = rec[1];
+		if (len == FVJ_ERASED) {
+			return pos;
+		}
+		if (len == 0 || offset + len > g_fvjSize || pos + FVJ_RECORD_OVERHEAD + len > g_fvjOps->sectorSize) {
+			break;
+		}
+		g_fvjOps->read(sector, pos + 2, rec + 2, len + 1);
+		if ((unsigned char)Tiny_CRC8((const char*)rec, len + 2) != rec[len + 2]) {
+			break;
+		}
+		memcpy(vars + offset, rec + 2, len);
+		pos += FVJ_RECORD_OVERHEAD + len;
+	}
+	return g_fvjOps->sectorSize;
+}
+
+static int FVJ_WriteRecord(int sector, int pos, const unsigned char* vars, int offset, int len) {
+	unsigned char rec[FVJ_RECORD_OVERHEAD + FLASH_VARS_JOURNAL_MAX_SIZE];
+
+	rec[0] = len;
+	rec[1] = offset;
+	memcpy(rec + 2, vars + offset, len);
+	rec[len + 2] = Tiny_CRC8((const char*)rec, len + 2);
+	g_fvjOps->write(sector, pos, rec, len + FVJ_RECORD_OVERHEAD);
+	g_fvjBytesWritten += len + FVJ_RECORD_OVERHEAD;
+	return len + FVJ_RECORD_OVERHEAD;
+}
+
+// whole state goes to the other sector, which becomes active
+static int FVJ_Compact(const unsigned char* vars) {
+	unsigned char header[FVJ_HEADER_SIZE];
+	int sector = g_fvjSector == 0 ? 1 : 0;
+	int written;
+
+	g_fvjOps->erase(sector);
+	written = FVJ_WriteRecord(sector, FVJ_HEADER_SIZE, vars, 0, g_fvjSize);
+	g_fvjSequence++;
+	memcpy(header, FVJ_MAGIC, 4);
+	memcpy(header + 4, &g_fvjSequence, 4);
+	g_fvjOps->write(sector, 0, header, FVJ_HEADER_SIZE);
+	g_fvjBytesWritten += FVJ_HEADER_SIZE;
+	g_fvjSector = sector;
+	g_fvjPos = FVJ_HEADER_SIZE + written;
+	g_fvjCompactions++;
+	return written + FVJ_HEADER_SIZE;
+}
+
+int FlashVarsJournal_Init(const flashVarsJournalOps_t* ops, void* vars, int size) {
+	unsigned int seq[2];
+	int valid[2];
+	int i;
+
+	g_fvjOps = ops;
+	g_fvjSize = size;
+	g_fvjSector = -1;
+	g_fvjSequence = 0;
+	g_fvjPos = 0;
+	memset(vars, 0, size);
+	if (size > FLASH_VARS_JOURNAL_MAX_SIZE) {
+		return 0;
+	}
+	for (i = 0; i < 2; i++) {
+		valid[i] = FVJ_ReadHeader(i, &seq[i]);
+	}
+	if (valid[0] && valid[1]) {
+		// sequence may wrap around
+		g_fvjSector = (int)(seq[1] - seq[0]) > 0 ? 1 : 0;
+	}
+	else if (valid[0] || valid[1]) {
+		g_fvjSector = valid[0] ? 0 : 1;
+	}
+	if (g_fvjSector >= 0) {
+		g_fvjSequence = seq[g_fvjSector];
+		g_fvjPos = FVJ_Replay(g_fvjSector, (unsigned char*)vars);
+	}
+	memcpy(g_fvjShadow, vars, size);
+	return g_fvjSector >= 0;
+}
+
+// finds next changed range at or after *pos, returns its length or 0
+static int FVJ_NextSpan(const unsigned char* v, int* pos) {
+	int i = *pos;
+	int start, gap;
+
+	while (i < g_fvjSize && v[i] == g_fvjShadow[i]) {
+		i++;
+	}
+	start = i;
+	while (i < g_fvjSize) {
+		if (v[i] != g_fvjShadow[i]) {
+			i++;
+			continue;
+		}
+		gap = g_fvjSize - i;
+		if (gap > FVJ_MERGE_GAP) {
+			gap = FVJ_MERGE_GAP;
+		}
+		if (memcmp(v + i, g_fvjShadow + i, gap) == 0) {
+			break;
+		}
+		i++;
+	}
+	*pos = start;
+	return i - start;
+}
+
+int FlashVarsJournal_Save(const void* vars) {
+	const unsigned char* v = (const unsigned char*)vars;
+	int need = 0;
+	int written = 0;
+	int pos, len;
+
+	if (g_fvjOps == 0 || g_fvjSize > FLASH_VARS_JOURNAL_MAX_SIZE) {
+		return 0;
+	}
+	for (pos = 0; (len = FVJ_NextSpan(v, &pos)) > 0; pos += len) {
+		need += len + FVJ_RECORD_OVERHEAD;
+	}
+	if (need == 0 && g_fvjSector >= 0) {
+		return 0;
+	}
+	if (g_fvjSector < 0 || g_fvjPos + need > g_fvjOps->sectorSize) {
+		written = FVJ_Compact(v);
+	}
+	else {
+		for (pos = 0; (len = FVJ_NextSpan(v, &pos)) > 0; pos += len) {
+			written += FVJ_WriteRecord(g_fvjSector, g_fvjPos + written, v, pos, len);
+		}
+		g_fvjPos += written;
+	}
+	memcpy(g_fvjShadow, v, g_fvjSize);
+	return written;
+}
+
+void FlashVarsJournal_GetStats(int* bytesWritten, int* compactions) {
+	*bytesWritten = g_fvjBytesWritten;
+	*compactions = g_fvjCompactions;
+}
@@ -60,6 +60,8 @@ void HAL_FlashVars_SaveBootComplete();
 int HAL_FlashVars_GetBootFailures();
 int HAL_FlashVars_GetBootCount();
 void HAL_FlashVars_SaveChannel(int index, int value);
+// saves values[i] for every bit i set in mask, with one flash write
+void HAL_FlashVars_SaveChannels(unsigned int mask, const int* values);
 void HAL_FlashVars_SaveLED(byte mode, short brightness, short temperature, byte r, byte g, byte b, byte bEnableAll);
 void HAL_FlashVars_ReadLED(byte* mode, short* brightness, short* temperature, byte* rgb, byte* bEnableAll);
 int HAL_FlashVars_GetChannelValue(int ch);
@@ -0,0 +1,30 @@
+#ifndef __HAL_FLASH_VARS_JOURNAL_H__
+#define __HAL_FLASH_VARS_JOURNAL_H__
+
+// Append-only storage for flash vars in a pair of erase sectors.
+// Every save appends only the changed bytes of the structure as a small
+// record, when sector is full the current state is written to the other
+// sector and it becomes the active one. At boot, newest sector is replayed.
+//
+// Sector: "OBKJ" magic, 4 byte sequence, then records until 0xFF:
+// [len][offset][len bytes of data][CRC8 of all before]
+// Header is written after the first record, so sector is only valid when
+// complete state is in it. Torn record at the end is ignored at replay.
+
+#define FLASH_VARS_JOURNAL_MAX_SIZE		128
+
+// access to two sectors of raw flash, erased flash reads as 0xFF
+typedef struct flashVarsJournalOps_s {
+	int sectorSize;
+	void (*read)(int sector, int offset, void* data, int len);
+	void (*write)(int sector, int offset, const void* data, int len);
+	void (*erase)(int sector);
+} flashVarsJournalOps_t;
+
+// replays journal into vars, returns 0 if there was nothing (vars are zeroed)
+int FlashVarsJournal_Init(const flashVarsJournalOps_t* ops, void* vars, int size);
+// appends changes since last save, returns number of bytes written to flash
+int FlashVarsJournal_Save(const void* vars);
+void FlashVarsJournal_GetStats(int* bytesWritten, int* compactions);
+
+#endif
@@ -80,6 +80,19 @@ void HAL_FlashVars_SaveChannel(int index, int value) {
 	}
 #endif
 
+}
+void HAL_FlashVars_SaveChannels(unsigned int mask, const int* values) {
+#ifndef DISABLE_FLASH_VARS_VARS
+	int i;
+
+	if (flash_vars_init()) {
+		for (i = 0; i < MAX_RETAIN_CHANNELS; i++) {
+			if (mask & (1 << i))
+				flash_vars.savedValues[i] = values[i];
+		}
+		flash_vars_store();
+	}
+#endif
 }
 void HAL_FlashVars_ReadLED(byte* mode, short* brightness, short* temperature, byte* rgb, byte* bEnableAll) {
 #ifndef DISABLE_FLASH_VARS_VARS
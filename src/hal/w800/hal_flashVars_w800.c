@@ -59,6 +59,16 @@ void HAL_FlashVars_SaveChannel(int index, int value) {
 	write_flash_boot_content();
 }
 
+void HAL_FlashVars_SaveChannels(unsigned int mask, const int* values) {
+	int i;
+
+	for (i = 0; i < MAX_RETAIN_CHANNELS; i++) {
+		if (mask & (1 << i))
+			flash_vars.savedValues[i] = values[i];
+	}
+	write_flash_boot_content();
+}
+
 // call once started (>30s?)
 void HAL_FlashVars_SaveBootComplete() {
 	ADDLOG_INFO(LOG_FEATURE_CFG, "%s Set Boot Complete %s", extrahdr, extrahdr);
@@ -2,6 +2,7 @@
 
 #include "../hal_flashConfig.h"
 #include "../hal_flashVars.h"
+#include "../hal_flashVars_journal.h"
 #include "../../logging/logging.h"
 
 void HAL_FlashVars_SaveBootComplete(){
@@ -17,11 +18,84 @@ int HAL_FlashVars_GetBootFailures(){
 }
 void HAL_FlashVars_IncreaseBootCount(){
 }
+// simulated NOR flash with two sectors for flash vars journal,
+// so selftests can check what would be written to flash
+#define SIM_FLASH_VARS_SECTOR_SIZE 4096
+
+static unsigned char g_simFlashVarsSectors[2][SIM_FLASH_VARS_SECTOR_SIZE];
+static FLASH_VARS_STRUCTURE flash_vars;
+static int g_loaded = 0;
+static int g_simFlashWrites = 0;
+
+static void SIM_FlashVars_Read(int sector, int offset, void *data, int len) {
+	memcpy(data, g_simFlashVarsSectors[sector] + offset, len);
+}
+static void SIM_FlashVars_Write(int sector, int offset, const void *data, int len) {
+	const unsigned char *src = (const unsigned char*)data;
+	int i;
+
+	// programming can only clear bits
+	for (i = 0; i < len; i++) {
+		g_simFlashVarsSectors[sector][offset + i] &= src[i];
+	}
+}
+static void SIM_FlashVars_Erase(int sector) {
+	memset(g_simFlashVarsSectors[sector], 0xFF, SIM_FLASH_VARS_SECTOR_SIZE);
+}
+static const flashVarsJournalOps_t g_simFlashVarsOps = {
+	SIM_FLASH_VARS_SECTOR_SIZE,
+	SIM_FlashVars_Read,
+	SIM_FlashVars_Write,
+	SIM_FlashVars_Erase,
+};
+
+static void ReadFlashVars() {
+	FlashVarsJournal_Init(&g_simFlashVarsOps, &flash_vars, sizeof(flash_vars));
+	g_loaded = 1;
+}
+static void SaveFlashVars() {
+	if (FlashVarsJournal_Save(&flash_vars) > 0) {
+		g_simFlashWrites++;
+	}
+}
+void SIM_ClearFlashVars() {
+	SIM_FlashVars_Erase(0);
+	SIM_FlashVars_Erase(1);
+	g_loaded = 0;
+	g_simFlashWrites = 0;
+}
+// like after reboot, state is read back from simulated flash
+void SIM_ReloadFlashVars() {
+	g_loaded = 0;
+}
+int SIM_GetFlashVarsWrites() {
+	return g_simFlashWrites;
+}
 void HAL_FlashVars_SaveChannel(int index, int value) {
+	if (index < 0 || index >= MAX_RETAIN_CHANNELS)
+		return;
+	if (g_loaded == 0)
+		ReadFlashVars();
+	flash_vars.savedValues[index] = value;
+	SaveFlashVars();
+}
+void HAL_FlashVars_SaveChannels(unsigned int mask, const int* values) {
+	int i;
 
+	if (g_loaded == 0)
+		ReadFlashVars();
+	for (i = 0; i < MAX_RETAIN_CHANNELS; i++) {
+		if (mask & (1 << i))
+			flash_vars.savedValues[i] = values[i];
+	}
+	SaveFlashVars();
 }
 int HAL_FlashVars_GetChannelValue(int ch) {
-	return 0;
+	if (ch < 0 || ch >= MAX_RETAIN_CHANNELS)
+		return 0;
+	if (g_loaded == 0)
+		ReadFlashVars();
+	return flash_vars.savedValues[ch];
 }
 void HAL_FlashVars_SaveLED(byte mode, short brightness, short temperature, byte r, byte g, byte b, byte bEnableAll) {
 
@@ -11,6 +11,242 @@
 uint32_t flash_read(uint32_t flash, uint32_t addr, void* buf, uint32_t size);
 #define FLASH_INDEX_XR809 0
 
+typedef ota_status_t (*xrOtaGet_t)(uint8_t* buf, uint32_t buf_size, uint32_t* recv_size, uint8_t* eof_flag);
+
+static ota_status_t XR_OTA_Init(void* url)
+{
+	return OTA_STATUS_OK;
+}
+
+// writes image pulled from get callback and verifies it, returns -1 on error
+static int XR_OTA_Update(xrOtaGet_t get)
+{
+	uint32_t* verify_value;
+	ota_verify_t verify_type;
+	ota_verify_data_t verify_data;
+
+	ota_init();
+
+	if (ota_update_image(NULL, XR_OTA_Init, get) != OTA_STATUS_OK)
+	{
+		ADDLOG_ERROR(LOG_FEATURE_OTA, "ota_update_image failed");
+		return -1;
+	}
+
+	if (ota_get_verify_data(&verify_data) != OTA_STATUS_OK)
+	{
+		ADDLOG_INFO(LOG_FEATURE_OTA, "ota_get_verify_data not ok, OTA_VERIFY_NONE");
+		verify_type = OTA_VERIFY_NONE;
+		verify_value = NULL;
+	}
+	else
+	{
+		verify_type = verify_data.ov_type;
+		ADDLOG_INFO(LOG_FEATURE_OTA, "ota_get_verify_data ok");
+		verify_value = (uint32_t*)(verify_data.ov_data);
+	}
+
+	if (ota_verify_image(verify_type, verify_value) != OTA_STATUS_OK)
+	{
+		ADDLOG_ERROR(LOG_FEATURE_OTA, "OTA verify image failed");
+		return -1;
+	}
+	return 0;
+}
+
+static int XR_OTA_Reply(http_request_t* request, int ret, int total)
+{
+	if (ret != -1)
+	{
+		ADDLOG_INFO(LOG_FEATURE_OTA, "OTA is successful");
+	}
+	else
+	{
+		ADDLOG_ERROR(LOG_FEATURE_OTA, "OTA failed.");
+		return http_rest_error(request, ret, "error");
+	}
+	ADDLOG_DEBUG(LOG_FEATURE_OTA, "%d total bytes written", total);
+	http_setup(request, httpMimeTypeJson);
+	hprintf255(request, "{\"size\":%d}", total);
+	poststr(request, NULL);
+	CFG_IncrementOTACount();
+	return 0;
+}
+
+#if ENABLE_HTTP_SELECT_SERVER
+// Select server gives the body in parts as they arrive, but ota_update_image
+// pulls its data and writes flash as it goes, so it runs in its own thread.
+// Each part is copied to the stream buffer. While the thread has not taken
+// the previous one yet, the part is deferred and the server gives it again,
+// so the select loop never waits for flash.
+typedef struct xrOtaStream_s {
+	// update thread waits on it for next part or end of body
+	SemaphoreHandle_t ready;
+	char* buf;
+	int bufSize;
+	// bytes of part not taken by update thread yet, buf is free when 0
+	volatile int len;
+	int pos;
+	// 1 at end of body, -1 if client is gone
+	volatile int eof;
+	int total;
+	int result;
+	volatile int bFinished;
+	// client is gone while update runs, thread frees stream when done
+	int bAbandoned;
+} xrOtaStream_t;
+
+static xrOtaStream_t* g_otaStream = 0;
+
+static void XR_OTA_StreamFree()
+{
+	vSemaphoreDelete(g_otaStream->ready);
+	os_free(g_otaStream->buf);
+	os_free(g_otaStream);
+	g_otaStream = 0;
+}
+
+static ota_status_t XR_OTA_StreamGet(uint8_t* buf, uint32_t buf_size, uint32_t* recv_size, uint8_t* eof_flag)
+{
+	xrOtaStream_t* s = g_otaStream;
+	int len;
+
+	*recv_size = 0;
+	*eof_flag = 0;
+	while (s->len == 0)
+	{
+		if (s->eof)
+		{
+			*eof_flag = 1;
+			return s->eof > 0 ? OTA_STATUS_OK : OTA_STATUS_ERROR;
+		}
+		xSemaphoreTake(s->ready, portMAX_DELAY);
+	}
+	len = s->len;
+	if (len > (int)buf_size)
+	{
+		len = buf_size;
+	}
+	memcpy(buf, s->buf + s->pos, len);
+	s->pos += len;
+	s->total += len;
+	*recv_size = len;
+	// last, buf may be refilled as soon as this is 0
+	s->len -= len;
+	return OTA_STATUS_OK;
+}
+
+static void XR_OTA_StreamThread(beken_thread_arg_t arg)
+{
+	xrOtaStream_t* s = g_otaStream;
+	int bAbandoned;
+
+	s->result = XR_OTA_Update(XR_OTA_StreamGet);
+	taskENTER_CRITICAL();
+	s->bFinished = 1;
+	bAbandoned = s->bAbandoned;
+	taskEXIT_CRITICAL();
+	if (bAbandoned)
+	{
+		XR_OTA_StreamFree();
+	}
+	rtos_delete_thread(NULL);
+}
+
+// never waits: returns 1 to have the part (or end) given again on next loop
+static int XR_OTA_StreamBody(http_request_t* request, const char* data, int len)
+{
+	xrOtaStream_t* s = g_otaStream;
+	int bAbandoned;
+
+	if (s->bFinished)
+	{
+		// update stopped before end of body, or verified image after it
+		if (len >= 0)
+		{
+			XR_OTA_Reply(request, len == 0 ? s->result : -1, s->total);
+		}
+		XR_OTA_StreamFree();
+		return len > 0 ? -1 : 0;
+	}
+	if (len > 0)
+	{
+		if (s->len)
+		{
+			// update thread is still writing previous part
+			return 1;
+		}
+		if (len > s->bufSize)
+		{
+			XR_OTA_Reply(request, -1, s->total);
+			len = -1;
+		}
+		else
+		{
+			memcpy(s->buf, data, len);
+			s->pos = 0;
+			s->len = len;
+			xSemaphoreGive(s->ready);
+			return 0;
+		}
+	}
+	if (len == 0)
+	{
+		if (s->eof == 0)
+		{
+			s->eof = 1;
+			xSemaphoreGive(s->ready);
+		}
+		// reply when image is verified; if that takes longer than keep-alive
+		// timeout, server gives up with len -1 and update still completes
+		return 1;
+	}
+	// client is gone, thread stops at next part and frees stream
+	taskENTER_CRITICAL();
+	bAbandoned = !s->bFinished;
+	s->bAbandoned = bAbandoned;
+	taskEXIT_CRITICAL();
+	if (!bAbandoned)
+	{
+		XR_OTA_StreamFree();
+		return -1;
+	}
+	s->eof = -1;
+	xSemaphoreGive(s->ready);
+	return -1;
+}
+
+static int XR_OTA_StartStream(http_request_t* request)
+{
+	if (g_otaStream)
+	{
+		return http_rest_error(request, -1, "OTA already in progress");
+	}
+	g_otaStream = (xrOtaStream_t*)os_malloc(sizeof(xrOtaStream_t));
+	if (g_otaStream == 0)
+	{
+		return http_rest_error(request, -1, "no memory");
+	}
+	memset(g_otaStream, 0, sizeof(xrOtaStream_t));
+	// server gives at most one receive buffer at once
+	g_otaStream->bufSize = request->receivedLenmax;
+	g_otaStream->buf = (char*)os_malloc(g_otaStream->bufSize);
+	g_otaStream->ready = xSemaphoreCreateBinary();
+	if (g_otaStream->buf == 0 || g_otaStream->ready == 0 ||
+		rtos_create_thread(NULL, BEKEN_APPLICATION_PRIORITY, "OTA",
+			XR_OTA_StreamThread, 0x1000, (beken_thread_arg_t)0) != kNoErr)
+	{
+		if (g_otaStream->ready) vSemaphoreDelete(g_otaStream->ready);
+		if (g_otaStream->buf) os_free(g_otaStream->buf);
+		os_free(g_otaStream);
+		g_otaStream = 0;
+		return http_rest_error(request, -1, "can't start OTA");
+	}
+	request->bodyCallback = XR_OTA_StreamBody;
+	return 0;
+}
+#endif
+
 int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 {
 	int total = 0;
@@ -30,12 +266,15 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 	if(DRV_IsRunning("RC")) DRV_StopDriver("RC");
 #endif
 
-	bool recvfp = true;
-
-	ota_status_t ota_update_rest_init(void* url)
+#if ENABLE_HTTP_SELECT_SERVER
+	if (request->bStreamBody && request->contentLength > 0)
 	{
-		return OTA_STATUS_OK;
+		return XR_OTA_StartStream(request);
 	}
+#endif
+
+	bool recvfp = true;
+
 	ota_status_t ota_update_rest_get(uint8_t* buf, uint32_t buf_size, uint32_t* recv_size, uint8_t* eof_flag)
 	{
 		if (recvfp)
@@ -85,9 +324,6 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 	}
 
 	int ret = 0;
-	uint32_t* verify_value;
-	ota_verify_t verify_type;
-	ota_verify_data_t verify_data;
 
 	if (request->contentLength > 0)
 	{
@@ -100,51 +336,10 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 		goto update_ota_exit;
 	}
 
-	ota_init();
-
-	if (ota_update_image(NULL, ota_update_rest_init, ota_update_rest_get) != OTA_STATUS_OK)
-	{
-		ret = -1;
-		ADDLOG_ERROR(LOG_FEATURE_OTA, "ota_update_image failed");
-		goto update_ota_exit;
-	}
-
-	if (ota_get_verify_data(&verify_data) != OTA_STATUS_OK)
-	{
-		ADDLOG_INFO(LOG_FEATURE_OTA, "ota_get_verify_data not ok, OTA_VERIFY_NONE");
-		verify_type = OTA_VERIFY_NONE;
-		verify_value = NULL;
-	}
-	else
-	{
-		verify_type = verify_data.ov_type;
-		ADDLOG_INFO(LOG_FEATURE_OTA, "ota_get_verify_data ok");
-		verify_value = (uint32_t*)(verify_data.ov_data);
-	}
-
-	if (ota_verify_image(verify_type, verify_value) != OTA_STATUS_OK)
-	{
-		ret = -1;
-		ADDLOG_ERROR(LOG_FEATURE_OTA, "OTA verify image failed");
-		goto update_ota_exit;
-	}
+	ret = XR_OTA_Update(ota_update_rest_get);
 
 update_ota_exit:
-	if (ret != -1)
-	{
-		ADDLOG_INFO(LOG_FEATURE_OTA, "OTA is successful");
-	}
-	else
-	{
-		ADDLOG_ERROR(LOG_FEATURE_OTA, "OTA failed.");
-		return http_rest_error(request, ret, "error");
-	}
-	ADDLOG_DEBUG(LOG_FEATURE_OTA, "%d total bytes written", total);
-	http_setup(request, httpMimeTypeJson);
-	hprintf255(request, "{\"size\":%d}", total);
-	poststr(request, NULL);
-	CFG_IncrementOTACount();
-	return 0;
+	return XR_OTA_Reply(request, ret, total);
 }
 
 int HAL_FlashRead(char*buffer, int readlen, int startaddr) {
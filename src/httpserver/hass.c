@@ -20,6 +20,34 @@ Sensor - https://www.home-assistant.io/integrations/sensor.mqtt/
 //Buffer used to populate values in cJSON_Add* calls. The values are based on
 //CFG_GetShortDeviceName and clientId so it needs to be bigger than them. +64 for light/switch/etc.
 static char g_hassBuffer[CGF_MQTT_CLIENT_ID_SIZE + 128];
+// Heap taken by discovery: device infos that are alive, plus cJSON tree of the
+// one being queued (estimated from its nodes). Counted here, allocator is not touched.
+static int g_hassHeapInUse = 0;
+static int g_hassHeapPeak = 0;
+
+static int hass_jsonTreeSize(const cJSON* item) {
+	int size = 0;
+
+	for (; item != NULL; item = item->next) {
+		size += sizeof(cJSON);
+		if (item->string != NULL && (item->type & cJSON_StringIsConst) == 0) {
+			size += strlen(item->string) + 1;
+		}
+		if (item->valuestring != NULL) {
+			size += strlen(item->valuestring) + 1;
+		}
+		size += hass_jsonTreeSize(item->child);
+	}
+	return size;
+}
+int hass_get_heap_peak(bool bReset) {
+	int ret = g_hassHeapPeak;
+	if (bReset) {
+		g_hassHeapPeak = g_hassHeapInUse;
+	}
+	return ret;
+}
+
 const char *g_template_lowMidHigh = "{% if value == '0' %}\n"
 			"	Low\n"
 			"{% elif value == '1' %}\n"
@@ -535,6 +563,7 @@ HassDeviceInfo* hass_createShutter(int index) {
 HassDeviceInfo* hass_init_device_info(ENTITY_TYPE type, int index, const char* payload_on, const char* payload_off, int asensdatasetix, const char *title) {
 	HassDeviceInfo* info = os_malloc(sizeof(HassDeviceInfo));
 	addLogAdv(LOG_DEBUG, LOG_FEATURE_HASS, "hass_init_device_info=%p", info);
+	g_hassHeapInUse += sizeof(HassDeviceInfo);
 
 	hass_populate_unique_id(type, index, info->unique_id, asensdatasetix, title);
 	hass_populate_device_config_channel(type, info->unique_id, info);
@@ -1206,20 +1235,34 @@ HassDeviceInfo* hass_init_sensor_device_info(ENTITY_TYPE type, int channel, int
 	return info;
 }
 
-/// @brief Returns the discovery JSON.
+/// @brief Prints the discovery JSON straight into the MQTT publish queue.
+/// No intermediate copy of the JSON is made.
+/// @param topic Discovery topic prefix
 /// @param info 
-/// @return 
-const char* hass_build_discovery_json(HassDeviceInfo* info) {
+/// @return true if queued
+bool hass_queue_discovery(const char* topic, HassDeviceInfo* info) {
+	char* buffer;
+	int heap;
+
 	if (info == NULL) {
-		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "ERROR: someone passed NULL pointer to hass_build_discovery_json");
-		return "";
+		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "ERROR: someone passed NULL pointer to hass_queue_discovery");
+		return false;
+	}
+	buffer = MQTT_QueueBeginPublish(topic, info->channel, HASS_JSON_SIZE - 1, OBK_PUBLISH_FLAG_RETAIN);
+	if (buffer == NULL) {
+		return false;
+	}
+	heap = g_hassHeapInUse + hass_jsonTreeSize(info->root);
+	if (heap > g_hassHeapPeak) {
+		g_hassHeapPeak = heap;
 	}
-	int bOk = cJSON_PrintPreallocated(info->root, info->json, HASS_JSON_SIZE, 0);
-	if (bOk == false) {
-		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "ERROR: too long JSON in hass_build_discovery_json");
-		return "";
+	if (cJSON_PrintPreallocated(info->root, buffer, HASS_JSON_SIZE, 0) == false) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "ERROR: too long JSON in hass_queue_discovery");
+		MQTT_QueueEndPublish(false);
+		return false;
 	}
-	return info->json;
+	MQTT_QueueEndPublish(true);
+	return true;
 }
 
 /// @brief Release allocated memory.
@@ -1234,6 +1277,7 @@ void hass_free_device_info(HassDeviceInfo* info) {
 	}
 
 	os_free(info);
+	g_hassHeapInUse -= sizeof(HassDeviceInfo);
 }
 
 #endif // ENABLE_HA_DISCOVERY
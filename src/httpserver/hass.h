@@ -126,7 +126,6 @@ typedef enum {
 typedef struct HassDeviceInfo_s {
 	char unique_id[HASS_UNIQUE_ID_SIZE];
 	char channel[HASS_CHANNEL_SIZE];
-	char json[HASS_JSON_SIZE];
 
 	cJSON* root;
 	cJSON* device;
@@ -157,9 +156,11 @@ HassDeviceInfo* hass_createShutter(int index);
 
 HassDeviceInfo* hass_createToggle(const char *label, const char *stateTopic, const char *commandTopic);
 HassDeviceInfo* hass_init_textField_info(int index);
-const char* hass_build_discovery_json(HassDeviceInfo* info);
+bool hass_queue_discovery(const char* topic, HassDeviceInfo* info);
 void hass_free_device_info(HassDeviceInfo* info); 
 char *hass_generate_multiplyAndRound_template(int decimalPlacesForRounding, int decimalPointOffset, int divider);
 HassDeviceInfo* hass_init_textField_info(int index);
 HassDeviceInfo* hass_init_button_device_info(char* title,char* cmd_id, char* press_payload, HASS_CATEGORY_TYPE type);
+// peak heap taken by discovery, in bytes
+int hass_get_heap_peak(bool bReset);
 #endif // ENABLE_HA_DISCOVERY
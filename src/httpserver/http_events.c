@@ -0,0 +1,379 @@
+#include "../new_common.h"
+#include "../obk_config.h"
+
+#if ENABLE_HTTP_EVENTS
+
+#include "lwip/sockets.h"
+#ifdef LINUX
+#include <unistd.h>
+#endif
+#include "../logging/logging.h"
+#include "../new_pins.h"
+#include "../quicktick.h"
+#include "../cmnds/cmd_public.h"
+#include "../driver/drv_public.h"
+#include "new_http.h"
+
+// Server-Sent Events stream for the main page.
+// GET /sse keeps the socket open and the quick tick pushes compact deltas:
+// data: {"ch":{"1":100},"led":{"en":1,"dim":80},"en":{"v":230.1}}
+// Channel changes are only marked here, formatting and sending is done
+// in HTTP_Events_RunQuickTick, so the caller of CHANNEL_Set does no I/O.
+// Sockets come from HTTP client threads, they wait in g_eventNewFds until
+// the main thread takes them, so only main thread touches g_eventFds.
+
+#define HTTP_EVENTS_MAX_CLIENTS		2
+#define HTTP_EVENTS_KEEPALIVE_MS	15000
+#define HTTP_EVENTS_CHECK_MS		1000
+#define HTTP_EVENTS_BUFFER_SIZE		384
+// left free by channels, for led and energy sections
+#define HTTP_EVENTS_RESERVE			128
+
+// browser may close the stream any time, that must not raise SIGPIPE in simulator
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static int g_eventFds[HTTP_EVENTS_MAX_CLIENTS];
+static int g_numEventClients = 0;
+// handed over by HTTP threads, protected by g_eventMutex
+static int g_eventNewFds[HTTP_EVENTS_MAX_CLIENTS];
+static int g_numEventNewFds = 0;
+static SemaphoreHandle_t g_eventMutex = 0;
+static unsigned int g_eventChannels[(CHANNEL_MAX + 31) / 32];
+static unsigned int g_eventLastSend = 0;
+static unsigned int g_eventLastCheck = 0;
+// set when new client connects, so cached values are sent again
+static int g_eventResend = 0;
+
+#if ENABLE_LED_BASIC
+static int g_eventLedEnable;
+static int g_eventLedDimmer;
+static int g_eventLedTemperature;
+static int g_eventLedMode;
+static char g_eventLedColor[16];
+#endif
+#if ENABLE_BL_SHARED
+static const energySensor_t g_eventEnergyTypes[] = { OBK_VOLTAGE, OBK_CURRENT, OBK_POWER };
+static const char *g_eventEnergyNames[] = { "v", "c", "p" };
+static float g_eventEnergy[3];
+#endif
+
+static void HTTP_Events_Remove(int i) {
+	close(g_eventFds[i]);
+	g_numEventClients--;
+	g_eventFds[i] = g_eventFds[g_numEventClients];
+}
+
+static void HTTP_Events_SendToAll(const char *data, int len) {
+	int i;
+
+	for (i = g_numEventClients - 1; i >= 0; i--) {
+		// non-blocking socket, slow client would get a torn event, so drop it
+		if (send(g_eventFds[i], data, len, MSG_NOSIGNAL) != len) {
+			HTTP_Events_Remove(i);
+		}
+	}
+	g_eventLastSend = g_timeMs;
+}
+
+// browser closes stream on page reload, find it before next client needs the slot
+static void HTTP_Events_CheckClosed() {
+	fd_set readfds;
+	struct timeval tv;
+	char tmp[32];
+	int i, maxFd = -1;
+
+	FD_ZERO(&readfds);
+	for (i = 0; i < g_numEventClients; i++) {
+		FD_SET(g_eventFds[i], &readfds);
+		if (g_eventFds[i] > maxFd) {
+			maxFd = g_eventFds[i];
+		}
+	}
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	if (select(maxFd + 1, &readfds, NULL, NULL, &tv) <= 0) {
+		return;
+	}
+	for (i = g_numEventClients - 1; i >= 0; i--) {
+		if (FD_ISSET(g_eventFds[i], &readfds) && recv(g_eventFds[i], tmp, sizeof(tmp), 0) <= 0) {
+			HTTP_Events_Remove(i);
+		}
+	}
+}
+
+// may be called from any thread, bitmap is shared with main thread under g_eventMutex
+void HTTP_Events_OnChannelChanged(int ch) {
+	// socket may still wait in new queue, its first event must carry this change
+	if (HTTP_Events_GetClients() == 0 || ch < 0 || ch >= CHANNEL_MAX) {
+		return;
+	}
+	if (xSemaphoreTake(g_eventMutex, 100) != pdTRUE) {
+		return;
+	}
+	g_eventChannels[ch / 32] |= 1u << (ch % 32);
+	xSemaphoreGive(g_eventMutex);
+}
+
+// appends formatted value to JSON object 'name' inside event, opening it if needed.
+// Returns 0 and leaves len unchanged when it doesn't fit below limit
+// together with closing "}}\n\n", then caller keeps the value for next tick.
+static int HTTP_Events_Add(char *buf, int *len, int limit, const char *name, int *bOpen, const char *fmt, ...) {
+	va_list argList;
+	int n = *len;
+	int r;
+
+	limit -= 5;
+	if (limit - n <= 0) {
+		return 0;
+	}
+	if (*bOpen == 0) {
+		r = snprintf(buf + n, limit - n, "%s\"%s\":{", n > 7 ? "}," : "", name);
+	}
+	else {
+		r = snprintf(buf + n, limit - n, ",");
+	}
+	if (r < 0 || r >= limit - n) {
+		return 0;
+	}
+	n += r;
+	va_start(argList, fmt);
+	r = vsnprintf(buf + n, limit - n, fmt, argList);
+	va_end(argList);
+	if (r < 0 || r >= limit - n) {
+		return 0;
+	}
+	*len = n + r;
+	*bOpen = 1;
+	return 1;
+}
+
+// puts back channels that did not fit into this event
+static void HTTP_Events_Requeue(const unsigned int *channels, int from) {
+	int ch;
+
+	if (xSemaphoreTake(g_eventMutex, 100) != pdTRUE) {
+		return;
+	}
+	for (ch = from; ch < CHANNEL_MAX; ch++) {
+		if (channels[ch / 32] & (1u << (ch % 32))) {
+			g_eventChannels[ch / 32] |= 1u << (ch % 32);
+		}
+	}
+	xSemaphoreGive(g_eventMutex);
+}
+
+// takes sockets handed over since last tick
+static void HTTP_Events_TakeNewClients() {
+	int i;
+
+	if (xSemaphoreTake(g_eventMutex, 10) != pdTRUE) {
+		return;
+	}
+	for (i = 0; i < g_numEventNewFds; i++) {
+		g_eventFds[g_numEventClients] = g_eventNewFds[i];
+		g_numEventClients++;
+		g_eventResend = 1;
+	}
+	g_numEventNewFds = 0;
+	xSemaphoreGive(g_eventMutex);
+}
+
+void HTTP_Events_RunQuickTick() {
+	char buf[HTTP_EVENTS_BUFFER_SIZE];
+	unsigned int channels[(CHANNEL_MAX + 31) / 32];
+	int len, ch, bOpen, bAdded;
+	int bResend, bFull = 0;
+	float f;
+
+	if (g_numEventNewFds) {
+		HTTP_Events_TakeNewClients();
+	}
+	if (g_numEventClients == 0) {
+		return;
+	}
+	if ((int)(g_timeMs - g_eventLastCheck) >= HTTP_EVENTS_CHECK_MS) {
+		g_eventLastCheck = g_timeMs;
+		HTTP_Events_CheckClosed();
+		if (g_numEventClients == 0) {
+			return;
+		}
+	}
+	if (xSemaphoreTake(g_eventMutex, 10) != pdTRUE) {
+		return;
+	}
+	bResend = g_eventResend;
+	g_eventResend = 0;
+	memcpy(channels, g_eventChannels, sizeof(channels));
+	memset(g_eventChannels, 0, sizeof(g_eventChannels));
+	xSemaphoreGive(g_eventMutex);
+
+	strcpy(buf, "data: {");
+	len = 7;
+	bOpen = 0;
+	for (ch = 0; ch < CHANNEL_MAX; ch++) {
+		if ((channels[ch / 32] & (1u << (ch % 32))) == 0) {
+			continue;
+		}
+		f = CHANNEL_GetFloat(ch);
+		if (f != CHANNEL_Get(ch)) {
+			bAdded = HTTP_Events_Add(buf, &len, HTTP_EVENTS_BUFFER_SIZE - HTTP_EVENTS_RESERVE, "ch", &bOpen, "\"%i\":%.2f", ch, f);
+		}
+		else {
+			bAdded = HTTP_Events_Add(buf, &len, HTTP_EVENTS_BUFFER_SIZE - HTTP_EVENTS_RESERVE, "ch", &bOpen, "\"%i\":%i", ch, CHANNEL_Get(ch));
+		}
+		// rest waits for next tick
+		if (bAdded == 0) {
+			HTTP_Events_Requeue(channels, ch);
+			break;
+		}
+	}
+#if ENABLE_LED_BASIC
+	if (LED_IsLEDRunning()) {
+		char color[16];
+		int v;
+
+		bOpen = 0;
+		v = LED_GetEnableAll();
+		if (bResend || v != g_eventLedEnable) {
+			if (HTTP_Events_Add(buf, &len, sizeof(buf), "led", &bOpen, "\"en\":%i", v)) {
+				g_eventLedEnable = v;
+			}
+			else {
+				bFull = 1;
+			}
+		}
+		v = (int)LED_GetDimmer();
+		if (bResend || v != g_eventLedDimmer) {
+			if (HTTP_Events_Add(buf, &len, sizeof(buf), "led", &bOpen, "\"dim\":%i", v)) {
+				g_eventLedDimmer = v;
+			}
+			else {
+				bFull = 1;
+			}
+		}
+		v = (int)LED_GetTemperature();
+		if (bResend || v != g_eventLedTemperature) {
+			if (HTTP_Events_Add(buf, &len, sizeof(buf), "led", &bOpen, "\"ct\":%i", v)) {
+				g_eventLedTemperature = v;
+			}
+			else {
+				bFull = 1;
+			}
+		}
+		v = LED_GetMode();
+		if (bResend || v != g_eventLedMode) {
+			if (HTTP_Events_Add(buf, &len, sizeof(buf), "led", &bOpen, "\"mode\":%i", v)) {
+				g_eventLedMode = v;
+			}
+			else {
+				bFull = 1;
+			}
+		}
+		LED_GetBaseColorString(color);
+		if (bResend || strcmp(color, g_eventLedColor)) {
+			if (HTTP_Events_Add(buf, &len, sizeof(buf), "led", &bOpen, "\"rgb\":\"%s\"", color)) {
+				strcpy(g_eventLedColor, color);
+			}
+			else {
+				bFull = 1;
+			}
+		}
+	}
+#endif
+#if ENABLE_BL_SHARED
+	if (DRV_IsMeasuringPower()) {
+		int i;
+
+		bOpen = 0;
+		for (i = 0; i < 3; i++) {
+			f = DRV_GetReading(g_eventEnergyTypes[i]);
+			if (bResend || f != g_eventEnergy[i]) {
+				if (HTTP_Events_Add(buf, &len, sizeof(buf), "en", &bOpen, "\"%s\":%.2f", g_eventEnergyNames[i], f)) {
+					g_eventEnergy[i] = f;
+				}
+				else {
+					bFull = 1;
+				}
+			}
+		}
+	}
+#endif
+	// changed values that did not fit kept their old cached value,
+	// but values sent only for new client must be sent again
+	if (bFull && bResend) {
+		g_eventResend = 1;
+	}
+	if (len > 7) {
+		strcpy(buf + len, "}}\n\n");
+		HTTP_Events_SendToAll(buf, len + 4);
+	}
+	else if ((int)(g_timeMs - g_eventLastSend) >= HTTP_EVENTS_KEEPALIVE_MS) {
+		// comment line, keeps proxies and NAT from dropping idle stream
+		HTTP_Events_SendToAll(":\n\n", 3);
+	}
+}
+
+// called on HTTP client thread, main thread takes the socket in next quick tick
+int HTTP_Events_AddClient(int fd) {
+	int bAdded = 0;
+
+	if (xSemaphoreTake(g_eventMutex, 100) != pdTRUE) {
+		return 0;
+	}
+	// main thread only moves sockets from new to active under the mutex,
+	// so their sum can't grow behind our back
+	if (g_numEventClients + g_numEventNewFds < HTTP_EVENTS_MAX_CLIENTS) {
+		lwip_fcntl(fd, F_SETFL, O_NONBLOCK);
+		g_eventNewFds[g_numEventNewFds] = fd;
+		g_numEventNewFds++;
+		bAdded = 1;
+	}
+	xSemaphoreGive(g_eventMutex);
+	return bAdded;
+}
+
+int HTTP_Events_GetClients() {
+	return g_numEventClients + g_numEventNewFds;
+}
+
+void HTTP_Events_CloseAll() {
+	HTTP_Events_TakeNewClients();
+	while (g_numEventClients > 0) {
+		HTTP_Events_Remove(g_numEventClients - 1);
+	}
+}
+
+static int HTTP_Events_Handler(http_request_t *request) {
+	if (HTTP_Events_GetClients() >= HTTP_EVENTS_MAX_CLIENTS) {
+		request->responseCode = HTTP_RESPONSE_SERVICE_UNAVAILABLE;
+		http_setup(request, httpMimeTypeText);
+		poststr(request, "Too many event clients");
+		poststr(request, NULL);
+		return 0;
+	}
+	// no length, stream ends when socket is closed
+	poststr(request, "HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/event-stream\r\n"
+		"Cache-Control: no-cache\r\n"
+		"Connection: keep-alive\r\n"
+		"\r\n"
+		"retry: 2000\n\n");
+	poststr(request, NULL);
+	// fd is 0 for locally faked requests
+	if (request->fd > 0) {
+		request->bDetached = 1;
+	}
+	return 0;
+}
+
+void HTTP_Events_Init() {
+	// before any HTTP thread can hand over a socket
+	if (g_eventMutex == 0) {
+		g_eventMutex = xSemaphoreCreateMutex();
+	}
+	HTTP_RegisterCallback("/sse", HTTP_GET, HTTP_Events_Handler, 1);
+}
+
+#endif
@@ -414,11 +414,12 @@ int http_fn_index(http_request_t* request) {
 				if (i <= 1) {
 					hprintf255(request, "<tr>");
 				}
+				// data-ch marks what pushed channel changes update, see script.js
 				if (CHANNEL_Check(i) != bToggleInv) {
-					poststr(request, "<td class='on'>ON</td>");
+					hprintf255(request, "<td class='on' data-ch='%i'%s>ON</td>", i, bToggleInv ? " data-inv='1'" : "");
 				}
 				else {
-					poststr(request, "<td class='off'>OFF</td>");
+					hprintf255(request, "<td class='off' data-ch='%i'%s>OFF</td>", i, bToggleInv ? " data-inv='1'" : "");
 				}
 				if (i == CHANNEL_MAX - 1) {
 					poststr(request, "</tr>");
@@ -460,7 +461,8 @@ int http_fn_index(http_request_t* request) {
 				prefix = "";
 			}
 
-			hprintf255(request, "<input class=\"%s\" type=\"submit\" value=\"%s%s\"/></form></td>", c, prefix, CHANNEL_GetLabel(i));
+			hprintf255(request, "<input class=\"%s\" data-ch=\"%i\"%s type=\"submit\" value=\"%s%s\"/></form></td>",
+				c, i, bToggleInv ? " data-inv=\"1\"" : "", prefix, CHANNEL_GetLabel(i));
 			if (i == CHANNEL_MAX - 1) {
 				poststr(request, "</tr>");
 			}
@@ -524,11 +526,12 @@ int http_fn_index(http_request_t* request) {
 			const char* types[] = { "Low","Mid","High" };
 			iValue = CHANNEL_Get(i);
 			poststr(request, "<tr><td>");
+			hprintf255(request, "Channel %s = <span data-ch=\"%i\" data-opts=\"Low|Mid|High\">", CHANNEL_GetLabel(i), i);
 			if (iValue >= 0 && iValue <= 2) {
-				hprintf255(request, "Channel %s = %s", CHANNEL_GetLabel(i), types[iValue]);
+				hprintf255(request, "%s</span>", types[iValue]);
 			}
 			else {
-				hprintf255(request, "Channel %s = %i", CHANNEL_GetLabel(i), iValue);
+				hprintf255(request, "%i</span>", iValue);
 			}
 			poststr(request, "</td></tr>");
 		} else if (channelType == ChType_Enum) {
@@ -552,7 +555,7 @@ int http_fn_index(http_request_t* request) {
 				poststr(request, "<tr><td>");
 				hprintf255(request, "<form action=\"index\"><label for=\"select%i\">Channel %s Enum:</label>", i, CHANNEL_GetLabel(i));
 				hprintf255(request, "<input type=\"hidden\" name=\"setIndex\" value=\"%i\">", i);
-				hprintf255(request, "<select id=\"select%i\" name=\"set\" onchange=\"this.form.submit()\">", i);
+				hprintf255(request, "<select id=\"select%i\" data-ch=\"%i\" name=\"set\" onchange=\"this.form.submit()\">", i, i);
 
 				bool found = false;
 				for (int o = 0; o < en->numOptions; o++) {
@@ -597,7 +600,7 @@ int http_fn_index(http_request_t* request) {
 			iValue = CHANNEL_Get(i);
 
 			poststr(request, "<tr><td>");
-			hprintf255(request, "<p>Select %s:</p><form action=\"index\">", what);
+			hprintf255(request, "<p>Select %s:</p><form action=\"index\" data-ch=\"%i\">", what, i);
 			hprintf255(request, "<input type=\"hidden\" name=\"setIndex\" value=\"%i\">", i);
 			for (j = 0; j < numTypes; j++) {
 				const char* check;
@@ -627,18 +630,20 @@ int http_fn_index(http_request_t* request) {
 			iValue = CHANNEL_Get(i);
 
 			poststr(request, "<tr><td>");
-			hprintf255(request, "Channel %s = %i", CHANNEL_GetLabel(i), iValue);
+			hprintf255(request, "Channel %s = <span data-ch=\"%i\">%i</span>", CHANNEL_GetLabel(i), i, iValue);
 			poststr(request, "</td></tr>");
 		}
 		else if (channelType == ChType_Motion || channelType == ChType_Motion_n) {
 			iValue = CHANNEL_Get(i);
 
 			poststr(request, "<tr><td>");
+			hprintf255(request, "<span data-ch=\"%i\" data-opts=\"%s\">", i,
+				channelType == ChType_Motion ? "No motion|Motion!" : "Motion!|No motion");
 			if (iValue == (channelType != ChType_Motion)) {
-				hprintf255(request, "No motion (ch %i)", i);
+				hprintf255(request, "No motion</span> (ch %i)", i);
 			}
 			else {
-				hprintf255(request, "Motion! (ch %i)", i);
+				hprintf255(request, "Motion!</span> (ch %i)", i);
 			}
 			poststr(request, "</td></tr>");
 		}
@@ -646,11 +651,12 @@ int http_fn_index(http_request_t* request) {
 			iValue = CHANNEL_Get(i);
 
 			poststr(request, "<tr><td>");
+			hprintf255(request, "<span data-ch=\"%i\" data-opts=\"OPEN|CLOSED\">", i);
 			if (iValue) {
-				hprintf255(request, "CLOSED (ch %i)", i);
+				hprintf255(request, "CLOSED</span> (ch %i)", i);
 			}
 			else {
-				hprintf255(request, "OPEN (ch %i)", i);
+				hprintf255(request, "OPEN</span> (ch %i)", i);
 			}
 			poststr(request, "</td></tr>");
 		}
@@ -658,11 +664,12 @@ int http_fn_index(http_request_t* request) {
 			iValue = CHANNEL_Get(i);
 
 			poststr(request, "<tr><td>");
+			hprintf255(request, "<span data-ch=\"%i\" data-opts=\"CLOSED|OPEN\">", i);
 			if (!iValue) {
-				hprintf255(request, "CLOSED (ch %i)", i);
+				hprintf255(request, "CLOSED</span> (ch %i)", i);
 			}
 			else {
-				hprintf255(request, "OPEN (ch %i)", i);
+				hprintf255(request, "OPEN</span> (ch %i)", i);
 			}
 			poststr(request, "</td></tr>");
 		}
@@ -689,7 +696,7 @@ int http_fn_index(http_request_t* request) {
 			pwmValue = CHANNEL_Get(i);
 			poststr(request, "<tr><td>");
 			hprintf255(request, "Channel %s:<br><form action=\"index\" id=\"form%i\">", CHANNEL_GetLabel(i), i);
-			hprintf255(request, "<input type=\"range\" min=\"0\" max=\"%i\" name=\"%s\" id=\"slider%i\" value=\"%i\" onchange=\"this.form.submit()\">", maxValue, inputName, i, pwmValue);
+			hprintf255(request, "<input type=\"range\" min=\"0\" max=\"%i\" name=\"%s\" id=\"slider%i\" data-ch=\"%i\" value=\"%i\" onchange=\"this.form.submit()\">", maxValue, inputName, i, i, pwmValue);
 			hprintf255(request, "<input type=\"hidden\" name=\"%sIndex\" value=\"%i\">", inputName, i);
 			hprintf255(request, "<input type=\"submit\" class='disp-none' value=\"Toggle %s\"/></form>", CHANNEL_GetLabel(i));
 			poststr(request, "</td></tr>");
@@ -699,7 +706,7 @@ int http_fn_index(http_request_t* request) {
 			iValue = CHANNEL_Get(i);
 
 			poststr(request, "<tr><td>");
-			hprintf255(request, "<p>Select level:</p><form action=\"index\">");
+			hprintf255(request, "<p>Select level:</p><form action=\"index\" data-ch=\"%i\">", i);
 			hprintf255(request, "<input type=\"hidden\" name=\"setIndex\" value=\"%i\">", i);
 			for (j = 0; j < 3; j++) {
 				const char* check;
@@ -722,7 +729,7 @@ int http_fn_index(http_request_t* request) {
 				int div;
 				const char *channelUnit;
 				char formatStr[16];
-				strcpy(formatStr, " %.4f");
+				strcpy(formatStr, "%.4f");
 
 				div = ChannelType_GetDivider(channelType);
 				channelUnit = ChannelType_GetUnit(channelType);
@@ -733,9 +740,11 @@ int http_fn_index(http_request_t* request) {
 				poststr(request, "<tr><td>");
 				poststr(request, channelTitle);
 				// how many decimal places?
-				formatStr[3] = '0'+ChannelType_GetDecimalPlaces(channelType);
+				formatStr[2] = '0'+ChannelType_GetDecimalPlaces(channelType);
 
+				hprintf255(request, " <span data-ch=\"%i\" data-div=\"%i\" data-dp=\"%i\">", i, div, ChannelType_GetDecimalPlaces(channelType));
 				hprintf255(request, formatStr, fValue);
+				poststr(request, "</span>");
 				poststr(request, channelUnit);
 				hprintf255(request, " (%s)", CHANNEL_GetLabel(i));
 				poststr(request, "</td></tr>");
@@ -788,7 +797,7 @@ int http_fn_index(http_request_t* request) {
 			poststr(request, "<tr><td>");
 			poststr(request, "<form action=\"index\">");
 			hprintf255(request, "<input type=\"hidden\" name=\"tgl\" value=\"%i\">", SPECIAL_CHANNEL_LEDPOWER);
-			hprintf255(request, "<input class=\"%s\" type=\"submit\" value=\"Toggle Light\"/></form>", c);
+			hprintf255(request, "<input class=\"%s\" data-led=\"en\" type=\"submit\" value=\"Toggle Light\"/></form>", c);
 			poststr(request, "</td></tr>");
 		}
 
@@ -802,7 +811,7 @@ int http_fn_index(http_request_t* request) {
 			poststr(request, "<tr><td>");
 			hprintf255(request, "<h5>LED Dimmer/Brightness</h5>");
 			hprintf255(request, "<form action=\"index\" id=\"form%i\">", SPECIAL_CHANNEL_BRIGHTNESS);
-			hprintf255(request, "<input type=\"range\" min=\"0\" max=\"100\" name=\"%s\" id=\"slider%i\" value=\"%i\" onchange=\"this.form.submit()\">", inputName, SPECIAL_CHANNEL_BRIGHTNESS, pwmValue);
+			hprintf255(request, "<input type=\"range\" min=\"0\" max=\"100\" name=\"%s\" id=\"slider%i\" data-led=\"dim\" value=\"%i\" onchange=\"this.form.submit()\">", inputName, SPECIAL_CHANNEL_BRIGHTNESS, pwmValue);
 			hprintf255(request, "<input type=\"hidden\" name=\"%sIndex\" value=\"%i\">", inputName, SPECIAL_CHANNEL_BRIGHTNESS);
 			hprintf255(request, "<input  type=\"submit\" class='disp-none' value=\"Toggle %i\"/></form>", SPECIAL_CHANNEL_BRIGHTNESS);
 			poststr(request, "</td></tr>");
@@ -821,7 +830,7 @@ int http_fn_index(http_request_t* request) {
 			hprintf255(request, "<form action=\"index\" id=\"form%i\">", SPECIAL_CHANNEL_BASECOLOR);
 			// onchange would fire only if colour was changed
 			// onblur will fire every time
-			hprintf255(request, "<input type=\"color\" name=\"%s\" id=\"color%i\" value=\"#%s\"  oninput=\"this.form.submit()\" >", inputName, SPECIAL_CHANNEL_BASECOLOR, colorValue);
+			hprintf255(request, "<input type=\"color\" name=\"%s\" id=\"color%i\" data-led=\"rgb\" value=\"#%s\"  oninput=\"this.form.submit()\" >", inputName, SPECIAL_CHANNEL_BASECOLOR, colorValue);
 			hprintf255(request, "<input type=\"hidden\" name=\"%sIndex\" value=\"%i\">", inputName, SPECIAL_CHANNEL_BASECOLOR);
 			hprintf255(request, "<input  type=\"submit\" class='disp-none' value=\"Toggle Light\"/></form>");
 			poststr(request, "</td></tr>");
@@ -854,7 +863,7 @@ int http_fn_index(http_request_t* request) {
 			hprintf255(request, "<form class='r' action=\"index\" id=\"form%i\">", SPECIAL_CHANNEL_TEMPERATURE);
 
 			//(KELVIN_TEMPERATURE_MAX - KELVIN_TEMPERATURE_MIN) / (HASS_TEMPERATURE_MAX - HASS_TEMPERATURE_MIN) = 13
-			hprintf255(request, "<input type=\"range\" step='13' min=\"%ld\" max=\"%ld\" ", pwmKelvinMin, pwmKelvinMax);
+			hprintf255(request, "<input type=\"range\" data-led=\"ct\" data-kelvin=\"1\" step='13' min=\"%ld\" max=\"%ld\" ", pwmKelvinMin, pwmKelvinMax);
 			hprintf255(request, "value=\"%ld\" onchange=\"submitTemperature(this);\"/>", pwmKelvin);
 
 			hprintf255(request, "<input type=\"hidden\" name=\"%sIndex\" value=\"%i\"/>", inputName, SPECIAL_CHANNEL_TEMPERATURE);
@@ -890,7 +899,7 @@ int http_fn_index(http_request_t* request) {
 				if (bFirst == false) {
 					hprintf255(request, ", ");
 				}
-				hprintf255(request, "Channel %i = %.2f", i, value);
+				hprintf255(request, "Channel %i = <span data-ch=\"%i\" data-dp=\"2\">%.2f</span>", i, i, value);
 				bFirst = false;
 			}
 		}
@@ -1994,51 +2003,308 @@ extern void* _os_malloc(size_t size);
 extern void _os_free(void* ptr);
 #endif
 
-void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
-	int i;
-	int relayCount;
-	int pwmCount;
-	int dInputCount;
-	int excludedCount = 0;
-	bool ledDriverChipRunning;
-	HassDeviceInfo* dev_info = NULL;
-	bool measuringPower = false;
-	bool measuringBattery = false;
-	struct cJSON_Hooks hooks;
-	bool discoveryQueued = false;
-	int type;
-	// warning - this is 32 bit
-	int flagsChannelPublished;
-	int ch;
-	int dimmer, toggle, brightness_scale = 0;
-
-	// no channels published yet
-	flagsChannelPublished = 0;
+#if ENABLE_ADVANCED_CHANNELTYPES_DISCOVERY
+static HassDeviceInfo* hass_createChannelTypeInfo(int i, int type) {
+	HassDeviceInfo* dev_info = 0;
 
-	for (i = 0; i < CHANNEL_MAX; i++) {
-		if (CHANNEL_HasNeverPublishFlag(i)) {
-			BIT_SET(flagsChannelPublished, i);
-			excludedCount++;
+	switch (type)
+	{
+		case ChType_Motion:
+		{
+			dev_info = hass_init_binary_sensor_device_info(i, true);
+			cJSON_AddStringToObject(dev_info->root, "dev_cla", "motion");
 		}
+		break;
+		case ChType_Motion_n:
+		{
+			dev_info = hass_init_binary_sensor_device_info(i, false);
+			cJSON_AddStringToObject(dev_info->root, "dev_cla", "motion");
+		}
+		break;
+		case ChType_OpenClosed:
+		{
+			dev_info = hass_init_binary_sensor_device_info(i, false);
+		}
+		break;
+		case ChType_OpenClosed_Inv:
+		{
+			dev_info = hass_init_binary_sensor_device_info(i, true);
+		}
+		break;
+		case ChType_Voltage_div10:
+		{
+			dev_info = hass_init_sensor_device_info(VOLTAGE_SENSOR, i, 2, 1, 1);
+		}
+		break;
+		case ChType_Voltage_div100:
+		{
+			dev_info = hass_init_sensor_device_info(VOLTAGE_SENSOR, i, 2, 2, 1);
+		}
+		break;
+		case ChType_ReadOnlyLowMidHigh:
+		{
+			dev_info = hass_init_sensor_device_info(READONLYLOWMIDHIGH_SENSOR, i, -1, -1, 1);
+		}
+		break;
+		case ChType_BatteryLevelPercent:
+		{
+			dev_info = hass_init_sensor_device_info(BATTERY_CHANNEL_SENSOR, i, -1, -1, 1);
+		}
+		break;
+		case ChType_SmokePercent:
+		{
+			dev_info = hass_init_sensor_device_info(SMOKE_SENSOR, i, -1, -1, 1);
+		}
+		break;
+		case ChType_Illuminance:
+		{
+			dev_info = hass_init_sensor_device_info(ILLUMINANCE_SENSOR, i, -1, -1, 1);
+		}
+		break;
+		case ChType_Custom:
+		case ChType_ReadOnly:
+		{
+			dev_info = hass_init_sensor_device_info(CUSTOM_SENSOR, i, -1, -1, 1);
+		}
+		break;
+		case ChType_Temperature:
+		{
+			dev_info = hass_init_sensor_device_info(TEMPERATURE_SENSOR, i, -1, -1, 1);
+		}
+		break;
+		case ChType_Temperature_div2:
+		{
+			dev_info = hass_init_sensor_device_info(TEMPERATURE_SENSOR, i, 2, 1, 5);
+		}
+		break;
+		case ChType_Temperature_div10:
+		{
+			dev_info = hass_init_sensor_device_info(TEMPERATURE_SENSOR, i, 2, 1, 1);
+		}
+		break;
+		case ChType_ReadOnly_div10:
+		{
+			dev_info = hass_init_sensor_device_info(CUSTOM_SENSOR, i, 2, 1, 1);
+		}
+		break;
+		case ChType_Temperature_div100:
+		{
+			dev_info = hass_init_sensor_device_info(TEMPERATURE_SENSOR, i, 2, 2, 1);
+		}
+		break;
+		case ChType_ReadOnly_div100:
+		{
+			dev_info = hass_init_sensor_device_info(CUSTOM_SENSOR, i, 2, 2, 1);
+		}
+		break;
+		case ChType_Humidity:
+		{
+			dev_info = hass_init_sensor_device_info(HUMIDITY_SENSOR, i, -1, -1, 1);
+		}
+		break;
+		case ChType_Humidity_div10:
+		{
+			dev_info = hass_init_sensor_device_info(HUMIDITY_SENSOR, i, 2, 1, 1);
+		}
+		break;
+		case ChType_Current_div100:
+		{
+			dev_info = hass_init_sensor_device_info(CURRENT_SENSOR, i, 3, 2, 1);
+		}
+		break;
+		case ChType_ReadOnly_div1000:
+		{
+			dev_info = hass_init_sensor_device_info(CUSTOM_SENSOR, i, 3, 3, 1);
+		}
+		break;
+		case ChType_LeakageCurrent_div1000:
+		case ChType_Current_div1000:
+		{
+			dev_info = hass_init_sensor_device_info(CURRENT_SENSOR, i, 3, 3, 1);
+		}
+		break;
+		case ChType_Power:
+		{
+			dev_info = hass_init_sensor_device_info(POWER_SENSOR, i, -1, -1, 1);
+		}
+		break;
+		case ChType_Power_div10:
+		{
+			dev_info = hass_init_sensor_device_info(POWER_SENSOR, i, 2, 1, 1);
+		}
+		break;
+		case ChType_Power_div100:
+		{
+			dev_info = hass_init_sensor_device_info(POWER_SENSOR, i, 3, 2, 1);
+		}
+		break;
+		case ChType_PowerFactor_div100:
+		{
+			dev_info = hass_init_sensor_device_info(POWERFACTOR_SENSOR, i, 3, 2, 1);
+		}
+		break;
+		case ChType_Pressure_div100:
+		{
+			dev_info = hass_init_sensor_device_info(PRESSURE_SENSOR, i, 3, 2, 1);
+		}
+		break;
+		case ChType_PowerFactor_div1000:
+		{
+			dev_info = hass_init_sensor_device_info(POWERFACTOR_SENSOR, i, 4, 3, 1);
+		}
+		break;
+		case ChType_Frequency_div100:
+		{
+			dev_info = hass_init_sensor_device_info(FREQUENCY_SENSOR, i, 3, 2, 1);
+		}
+		break;
+		case ChType_Percent:
+		{
+			dev_info = hass_init_sensor_device_info(HASS_PERCENT, i, 3, 2, 1);
+		}
+		break;
+		case ChType_Frequency_div1000:
+		{
+			dev_info = hass_init_sensor_device_info(FREQUENCY_SENSOR, i, 4, 3, 1);
+		}
+		break;
+		case ChType_Frequency_div10:
+		{
+			dev_info = hass_init_sensor_device_info(FREQUENCY_SENSOR, i, 3, 1, 1);
+		}
+		break;
+		case ChType_EnergyTotal_kWh_div100:
+		{
+			dev_info = hass_init_sensor_device_info(ENERGY_SENSOR, i, 3, 2, 1);
+		}
+		break;
+		case ChType_EnergyExport_kWh_div1000:
+		{
+			dev_info = hass_init_sensor_device_info(ENERGY_SENSOR, i, 3, 3, 1);
+		}
+		break;
+		case ChType_EnergyImport_kWh_div1000:
+		{
+			dev_info = hass_init_sensor_device_info(ENERGY_SENSOR, i, 3, 3, 1);
+		}
+		break;
+		case ChType_EnergyTotal_kWh_div1000:
+		{
+			dev_info = hass_init_sensor_device_info(ENERGY_SENSOR, i, 3, 3, 1);
+		}
+		break;
+		case ChType_Ph:
+		{
+			dev_info = hass_init_sensor_device_info(WATER_QUALITY_PH, i, 2, 2, 1);
+		}
+		break;
+		case ChType_Orp:
+		{
+			dev_info = hass_init_sensor_device_info(WATER_QUALITY_ORP, i, -1, 2, 1);
+		}
+		break;
+		case ChType_Tds:
+		{
+			dev_info = hass_init_sensor_device_info(WATER_QUALITY_TDS, i, -1, 2, 1);
+		}
+		break;
+		case ChType_TextField:
+		{
+			dev_info = hass_init_textField_info(i);
+		}
+		break;
+		case ChType_ReadOnlyEnum:
+		{
+			dev_info = hass_init_sensor_device_info(HASS_READONLYENUM, i, -1, -1, -1);
+		}
+		break;
+		case ChType_Enum:
+		{			
+			dev_info = hass_createEnumChannelInfo(i);
+		}
+		break;
+		case ChType_Illuminance_div10:
+		{
+			dev_info = hass_init_sensor_device_info(ILLUMINANCE_SENSOR, i, 2, 1, 1);
+		}
+		break;
+		default:
+		{
+			int numOptions;
+			const char **options = Channel_GetOptionsForChannelType(type, &numOptions);
+			if (options && numOptions) {
+				// backlog setChannelType 2 LowMidHigh; scheduleHADiscovery 1
+				// backlog setChannelType 3 OpenStopClose; scheduleHADiscovery 1
+				char stateTopic[16];
+				char cmdTopic[16];
+				// TODO: lengths
+				sprintf(stateTopic, "~/%i/get", i);
+				sprintf(cmdTopic, "~/%i/set", i);
+				dev_info = hass_createSelectEntityIndexed(
+					stateTopic,
+					cmdTopic,
+					numOptions,
+					options,
+					CHANNEL_GetLabel(i)
+				);
+			}
+		}
+		break;
 	}
-	
-	if (topic == 0 || *topic == 0) {
-		topic = "homeassistant";
-	}
-
-#ifdef ENABLE_DRIVER_BL0937
-	measuringPower = DRV_IsMeasuringPower();
+	return dev_info;
+}
 #endif
-	measuringBattery = DRV_IsMeasuringBattery();
-
-	PIN_get_Relay_PWM_Count(&relayCount, &pwmCount, &dInputCount);
-	addLogAdv(LOG_INFO, LOG_FEATURE_HTTP, "HASS counts: %i rels, %i pwms, %i inps, %i excluded", relayCount, pwmCount, dInputCount, excludedCount);
 
-#if ENABLE_LED_BASIC
-	ledDriverChipRunning = LED_IsLedDriverChipRunning();
-#else
-	ledDriverChipRunning = 0;
-#endif
+// Discovery is done by a generator, which emits one entity (or a pair
+// of related ones) per step, straight into the MQTT queue.
+// It only continues when the queue has room, so large devices
+// don't overflow the queue and don't do everything in a single tick.
+enum {
+	HASS_STAGE_MERGED_LIGHTS,
+	HASS_STAGE_LED,
+	HASS_STAGE_ENERGY,
+	HASS_STAGE_ENERGY_B,
+	HASS_STAGE_BATTERY,
+	HASS_STAGE_PIN_SENSORS,
+	HASS_STAGE_CHANNEL_TYPES,
+	HASS_STAGE_RELAYS,
+	HASS_STAGE_INPUTS,
+	HASS_STAGE_SELF_STATE,
+	HASS_STAGE_DONE,
+};
+// max entities emitted by single step
+#define HASS_MAX_ENTITIES_PER_STEP	2
+// max steps done per call of HASS_RunDiscoveryStep
+#define HASS_STEPS_PER_CALL			4
+
+// same size as other MQTT topic config fields
+#define HASS_MAX_PREFIX		sizeof(g_cfg.mqtt_group)
+
+typedef struct hassDiscovery_s {
+	char topic[HASS_MAX_PREFIX];
+	byte bActive;
+	byte stage;
+	// loop index within the stage
+	short index;
+	// warning - this is 32 bit
+	int flagsChannelPublished;
+	int relayCount;
+	int pwmCount;
+	int dInputCount;
+	bool measuringPower;
+	bool measuringBattery;
+	bool discoveryQueued;
+} hassDiscovery_t;
+
+// only touched by main thread
+static hassDiscovery_t g_hassDiscovery;
+// start request posted by any thread, prefix is written only while
+// request flag is clear and read only while it is set
+static char g_hassRequestedPrefix[HASS_MAX_PREFIX];
+static volatile bool g_bHassDiscoveryRequested = false;
+
+static void hass_setupCJSONHooks() {
+	struct cJSON_Hooks hooks;
 
 #if PLATFORM_TXW81X || PLATFORM_BL_NEW
 	hooks.malloc_fn = _os_malloc;
@@ -2048,544 +2314,369 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 	hooks.free_fn = os_free;
 #endif
 	cJSON_InitHooks(&hooks);
+}
+static void hass_queueAndFree(HassDeviceInfo* dev_info) {
+	if (dev_info == NULL) {
+		return;
+	}
+	hass_queue_discovery(g_hassDiscovery.topic, dev_info);
+	hass_free_device_info(dev_info);
+	g_hassDiscovery.discoveryQueued = true;
+}
 
-	DRV_OnHassDiscovery(topic);
-	EventHandlers_FireEvent(CMD_EVENT_ON_DISCOVERY, 0);
+// emits next entity, returns false when there is nothing more to do
+static bool hass_discoveryStep() {
+	hassDiscovery_t* d = &g_hassDiscovery;
+	HassDeviceInfo* dev_info = NULL;
+	int i, type, ch;
 
+	while (d->stage != HASS_STAGE_DONE) {
+		switch (d->stage) {
+		case HASS_STAGE_MERGED_LIGHTS:
 #if ENABLE_ADVANCED_CHANNELTYPES_DISCOVERY
-	// try to pair toggles with dimmers. This is needed only for TuyaMCU, 
-	// where custom channel types are used. This is NOT used for simple
-	// CW/RGB/RGBCW/etc lights.
-	if (CFG_HasFlag(OBK_FLAG_DISCOVERY_DONT_MERGE_LIGHTS) == false) {
-		while (true) {
-			// find first dimmer
-			dimmer = -1;
-			for (i = 0; i < CHANNEL_MAX; i++) {
-				type = g_cfg.pins.channelTypes[i];
-				if (BIT_CHECK(flagsChannelPublished, i)) {
-					continue;
-				}
-				if (type == ChType_Dimmer) {
-					brightness_scale = 100;
-					dimmer = i;
-					break;
+			// try to pair toggles with dimmers. This is needed only for TuyaMCU, 
+			// where custom channel types are used. This is NOT used for simple
+			// CW/RGB/RGBCW/etc lights.
+			if (CFG_HasFlag(OBK_FLAG_DISCOVERY_DONT_MERGE_LIGHTS) == false) {
+				int dimmer, toggle, brightness_scale = 0;
+
+				// find first dimmer
+				dimmer = -1;
+				for (i = 0; i < CHANNEL_MAX; i++) {
+					type = g_cfg.pins.channelTypes[i];
+					if (BIT_CHECK(d->flagsChannelPublished, i)) {
+						continue;
+					}
+					if (type == ChType_Dimmer) {
+						brightness_scale = 100;
+						dimmer = i;
+						break;
+					}
+					if (type == ChType_Dimmer1000) {
+						brightness_scale = 1000;
+						dimmer = i;
+						break;
+					}
+					if (type == ChType_Dimmer256) {
+						brightness_scale = 256;
+						dimmer = i;
+						break;
+					}
 				}
-				if (type == ChType_Dimmer1000) {
-					brightness_scale = 1000;
-					dimmer = i;
-					break;
+				// find first togle
+				toggle = -1;
+				for (i = 0; i < CHANNEL_MAX; i++) {
+					type = g_cfg.pins.channelTypes[i];
+					if (BIT_CHECK(d->flagsChannelPublished, i)) {
+						continue;
+					}
+					if (type == ChType_Toggle) {
+						toggle = i;
+						break;
+					}
 				}
-				if (type == ChType_Dimmer256) {
-					brightness_scale = 256;
-					dimmer = i;
-					break;
+				// if found, publish and stay in this stage
+				if (toggle != -1 && dimmer != -1) {
+					BIT_SET(d->flagsChannelPublished, toggle);
+					BIT_SET(d->flagsChannelPublished, dimmer);
+					hass_queueAndFree(hass_init_light_singleColor_onChannels(toggle, dimmer, brightness_scale));
+					return true;
 				}
 			}
-			// find first togle
-			toggle = -1;
-			for (i = 0; i < CHANNEL_MAX; i++) {
-				type = g_cfg.pins.channelTypes[i];
-				if (BIT_CHECK(flagsChannelPublished, i)) {
-					continue;
+#endif
+			d->stage = HASS_STAGE_LED;
+			break;
+		case HASS_STAGE_LED:
+			d->stage = HASS_STAGE_ENERGY;
+#if ENABLE_LED_BASIC
+			if (d->pwmCount == 5 || (d->pwmCount == 4 && CFG_HasFlag(OBK_FLAG_LED_EMULATE_COOL_WITH_RGB))) {
+				// Enable + RGB control + CW control
+				dev_info = hass_init_light_device_info(LIGHT_RGBCW);
+			}
+			else if (d->pwmCount > 0) {
+				if (d->pwmCount == 4) {
+					addLogAdv(LOG_ERROR, LOG_FEATURE_HTTP, "4 PWM device not yet handled");
 				}
-				if (type == ChType_Toggle) {
-					toggle = i;
-					break;
+				else if (d->pwmCount == 3) {
+					// Enable + RGB control
+					dev_info = hass_init_light_device_info(LIGHT_RGB);
+				}
+				else if (d->pwmCount == 2) {
+					// PWM + Temperature (https://github.com/openshwprojects/OpenBK7231T_App/issues/279)
+					dev_info = hass_init_light_device_info(LIGHT_PWMCW);
+				}
+				else {
+					dev_info = hass_init_light_device_info(LIGHT_PWM);
 				}
 			}
-			// if nothing found, stop
-			if (toggle == -1 || dimmer == -1) {
-				break;
+			if (dev_info != NULL) {
+				hass_queueAndFree(dev_info);
+				return true;
 			}
-
-			BIT_SET(flagsChannelPublished, toggle);
-			BIT_SET(flagsChannelPublished, dimmer);
-			dev_info = hass_init_light_singleColor_onChannels(toggle, dimmer, brightness_scale);
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-			discoveryQueued = true;
-		}
-	}
 #endif
-
-
-#if ENABLE_LED_BASIC
-	if (ledDriverChipRunning) {
-		pwmCount = CFG_CountLEDRemapChannels();
-	}
-	if (pwmCount == 5 || (pwmCount == 4 && CFG_HasFlag(OBK_FLAG_LED_EMULATE_COOL_WITH_RGB))) {
-		if (dev_info == NULL) {
-			dev_info = hass_init_light_device_info(LIGHT_RGBCW);
-		}
-		// Enable + RGB control + CW control
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-		hass_free_device_info(dev_info);
-		dev_info = NULL;
-		discoveryQueued = true;
-	}
-	else if (pwmCount > 0) {
-		if (pwmCount == 4) {
-			addLogAdv(LOG_ERROR, LOG_FEATURE_HTTP, "4 PWM device not yet handled");
-		}
-		else if (pwmCount == 3) {
-			// Enable + RGB control
-			dev_info = hass_init_light_device_info(LIGHT_RGB);
-		}
-		else if (pwmCount == 2) {
-			// PWM + Temperature (https://github.com/openshwprojects/OpenBK7231T_App/issues/279)
-			dev_info = hass_init_light_device_info(LIGHT_PWMCW);
-		}
-		else {
-			dev_info = hass_init_light_device_info(LIGHT_PWM);
-		}
-
-		if (dev_info != NULL) {
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-			dev_info = NULL;
-			discoveryQueued = true;
-		}
-	}
-#endif
-
+			break;
+		case HASS_STAGE_ENERGY:
+		case HASS_STAGE_ENERGY_B:
 #ifdef ENABLE_DRIVER_BL0937
-	if (measuringPower == true) {
-		for (i = OBK__FIRST; i <= OBK__LAST; i++)
-		{
-			dev_info = hass_init_energy_sensor_device_info(i, BL_SENSORS_IX_0);
-			if (dev_info) {
-				MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-				hass_free_device_info(dev_info);
-				discoveryQueued = true;
-			}
-			if (i == OBK_VOLTAGE) {
-				//20250319 XJIKKA to simplify and save space in flash frequency together with voltage
-				dev_info = hass_init_sensor_device_info(FREQUENCY_SENSOR, SPECIAL_CHANNEL_OBK_FREQUENCY, -1, -1, -1);
-				if (dev_info) {
-					MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-					hass_free_device_info(dev_info);
-					discoveryQueued = true;
-				}
-			}
-		}
+			if (d->measuringPower == true) {
+				int dataset = BL_SENSORS_IX_0;
 #if ENABLE_BL_TWIN
-		//BL_SENSORS_IX_1 - mqtt hass discovery using hass_uniq_id_suffix (_b) from drv_bl_shared.c
-		if (BL_IsMeteringDeviceIndexActive(BL_SENSORS_IX_1)) {
-			for (i = OBK__FIRST; i <= OBK__LAST; i++)
-			{
-				dev_info = hass_init_energy_sensor_device_info(i, BL_SENSORS_IX_1);
-				if (dev_info) {
-					MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-					hass_free_device_info(dev_info);
-					discoveryQueued = true;
+				if (d->stage == HASS_STAGE_ENERGY_B) {
+					//BL_SENSORS_IX_1 - mqtt hass discovery using hass_uniq_id_suffix (_b) from drv_bl_shared.c
+					dataset = BL_SENSORS_IX_1;
+					if (BL_IsMeteringDeviceIndexActive(BL_SENSORS_IX_1) == false) {
+						d->index = OBK__LAST + 1;
+					}
+				}
+#else
+				if (d->stage == HASS_STAGE_ENERGY_B) {
+					d->index = OBK__LAST + 1;
 				}
-			}
-		}
-#endif
-	}
 #endif
-
-	if (measuringBattery == true) {
-		dev_info = hass_init_sensor_device_info(BATTERY_SENSOR, 0, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-		hass_free_device_info(dev_info);
-
-		dev_info = hass_init_sensor_device_info(BATTERY_VOLTAGE_SENSOR, 0, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-		hass_free_device_info(dev_info);
-
-		discoveryQueued = true;
-	}
-
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (IS_PIN_DHT_ROLE(g_cfg.pins.roles[i]) || IS_PIN_TEMP_HUM_SENSOR_ROLE(g_cfg.pins.roles[i])) {
-			ch = PIN_GetPinChannelForPinIndex(i);
-			// TODO: flags are 32 bit and there are 64 max channels
-			BIT_SET(flagsChannelPublished, ch);
-			dev_info = hass_init_sensor_device_info(TEMPERATURE_SENSOR, ch, 2, 1, 1);
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-
-			ch = PIN_GetPinChannel2ForPinIndex(i);
-			// TODO: flags are 32 bit and there are 64 max channels
-			BIT_SET(flagsChannelPublished, ch);
-			dev_info = hass_init_sensor_device_info(HUMIDITY_SENSOR, ch, -1, -1, 1);
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-
-			discoveryQueued = true;
-		}
-		else if (IS_PIN_AIR_SENSOR_ROLE(g_cfg.pins.roles[i])) {
-			ch = PIN_GetPinChannelForPinIndex(i);
-			// TODO: flags are 32 bit and there are 64 max channels
-			BIT_SET(flagsChannelPublished, ch);
-			dev_info = hass_init_sensor_device_info(CO2_SENSOR, ch, -1, -1, 1);
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-
-			ch = PIN_GetPinChannel2ForPinIndex(i);
-			// TODO: flags are 32 bit and there are 64 max channels
-			BIT_SET(flagsChannelPublished, ch);
-			dev_info = hass_init_sensor_device_info(TVOC_SENSOR, ch, -1, -1, 1);
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-
-			discoveryQueued = true;
-		}
-	}
-	//{
-	//	HassDeviceInfo*dev_info = hass_createGarageEntity("~/1/get", "~/1/set",
-	//	 "Main Door");
-	//	MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-	//	hass_free_device_info(dev_info);
-	//	discoveryQueued = true;
-	//}
-#if ENABLE_ADVANCED_CHANNELTYPES_DISCOVERY
-	for (i = 0; i < CHANNEL_MAX; i++) {
-		type = g_cfg.pins.channelTypes[i];
-		// TODO: flags are 32 bit and there are 64 max channels
-		if (BIT_CHECK(flagsChannelPublished, i)) {
-			continue;
-		}
-		dev_info = 0;
-		switch (type)
-		{
-			case ChType_Motion:
-			{
-				dev_info = hass_init_binary_sensor_device_info(i, true);
-				cJSON_AddStringToObject(dev_info->root, "dev_cla", "motion");
-			}
-			break;
-			case ChType_Motion_n:
-			{
-				dev_info = hass_init_binary_sensor_device_info(i, false);
-				cJSON_AddStringToObject(dev_info->root, "dev_cla", "motion");
-			}
-			break;
-			case ChType_OpenClosed:
-			{
-				dev_info = hass_init_binary_sensor_device_info(i, false);
-			}
-			break;
-			case ChType_OpenClosed_Inv:
-			{
-				dev_info = hass_init_binary_sensor_device_info(i, true);
-			}
-			break;
-			case ChType_Voltage_div10:
-			{
-				dev_info = hass_init_sensor_device_info(VOLTAGE_SENSOR, i, 2, 1, 1);
-			}
-			break;
-			case ChType_Voltage_div100:
-			{
-				dev_info = hass_init_sensor_device_info(VOLTAGE_SENSOR, i, 2, 2, 1);
-			}
-			break;
-			case ChType_ReadOnlyLowMidHigh:
-			{
-				dev_info = hass_init_sensor_device_info(READONLYLOWMIDHIGH_SENSOR, i, -1, -1, 1);
-			}
-			break;
-			case ChType_BatteryLevelPercent:
-			{
-				dev_info = hass_init_sensor_device_info(BATTERY_CHANNEL_SENSOR, i, -1, -1, 1);
-			}
-			break;
-			case ChType_SmokePercent:
-			{
-				dev_info = hass_init_sensor_device_info(SMOKE_SENSOR, i, -1, -1, 1);
-			}
-			break;
-			case ChType_Illuminance:
-			{
-				dev_info = hass_init_sensor_device_info(ILLUMINANCE_SENSOR, i, -1, -1, 1);
-			}
-			break;
-			case ChType_Custom:
-			case ChType_ReadOnly:
-			{
-				dev_info = hass_init_sensor_device_info(CUSTOM_SENSOR, i, -1, -1, 1);
-			}
-			break;
-			case ChType_Temperature:
-			{
-				dev_info = hass_init_sensor_device_info(TEMPERATURE_SENSOR, i, -1, -1, 1);
-			}
-			break;
-			case ChType_Temperature_div2:
-			{
-				dev_info = hass_init_sensor_device_info(TEMPERATURE_SENSOR, i, 2, 1, 5);
-			}
-			break;
-			case ChType_Temperature_div10:
-			{
-				dev_info = hass_init_sensor_device_info(TEMPERATURE_SENSOR, i, 2, 1, 1);
-			}
-			break;
-			case ChType_ReadOnly_div10:
-			{
-				dev_info = hass_init_sensor_device_info(CUSTOM_SENSOR, i, 2, 1, 1);
-			}
-			break;
-			case ChType_Temperature_div100:
-			{
-				dev_info = hass_init_sensor_device_info(TEMPERATURE_SENSOR, i, 2, 2, 1);
-			}
-			break;
-			case ChType_ReadOnly_div100:
-			{
-				dev_info = hass_init_sensor_device_info(CUSTOM_SENSOR, i, 2, 2, 1);
-			}
-			break;
-			case ChType_Humidity:
-			{
-				dev_info = hass_init_sensor_device_info(HUMIDITY_SENSOR, i, -1, -1, 1);
-			}
-			break;
-			case ChType_Humidity_div10:
-			{
-				dev_info = hass_init_sensor_device_info(HUMIDITY_SENSOR, i, 2, 1, 1);
-			}
-			break;
-			case ChType_Current_div100:
-			{
-				dev_info = hass_init_sensor_device_info(CURRENT_SENSOR, i, 3, 2, 1);
-			}
-			break;
-			case ChType_ReadOnly_div1000:
-			{
-				dev_info = hass_init_sensor_device_info(CUSTOM_SENSOR, i, 3, 3, 1);
-			}
-			break;
-			case ChType_LeakageCurrent_div1000:
-			case ChType_Current_div1000:
-			{
-				dev_info = hass_init_sensor_device_info(CURRENT_SENSOR, i, 3, 3, 1);
-			}
-			break;
-			case ChType_Power:
-			{
-				dev_info = hass_init_sensor_device_info(POWER_SENSOR, i, -1, -1, 1);
-			}
-			break;
-			case ChType_Power_div10:
-			{
-				dev_info = hass_init_sensor_device_info(POWER_SENSOR, i, 2, 1, 1);
-			}
-			break;
-			case ChType_Power_div100:
-			{
-				dev_info = hass_init_sensor_device_info(POWER_SENSOR, i, 3, 2, 1);
-			}
-			break;
-			case ChType_PowerFactor_div100:
-			{
-				dev_info = hass_init_sensor_device_info(POWERFACTOR_SENSOR, i, 3, 2, 1);
-			}
-			break;
-			case ChType_Pressure_div100:
-			{
-				dev_info = hass_init_sensor_device_info(PRESSURE_SENSOR, i, 3, 2, 1);
-			}
-			break;
-			case ChType_PowerFactor_div1000:
-			{
-				dev_info = hass_init_sensor_device_info(POWERFACTOR_SENSOR, i, 4, 3, 1);
-			}
-			break;
-			case ChType_Frequency_div100:
-			{
-				dev_info = hass_init_sensor_device_info(FREQUENCY_SENSOR, i, 3, 2, 1);
-			}
-			break;
-			case ChType_Percent:
-			{
-				dev_info = hass_init_sensor_device_info(HASS_PERCENT, i, 3, 2, 1);
-			}
-			break;
-			case ChType_Frequency_div1000:
-			{
-				dev_info = hass_init_sensor_device_info(FREQUENCY_SENSOR, i, 4, 3, 1);
-			}
-			break;
-			case ChType_Frequency_div10:
-			{
-				dev_info = hass_init_sensor_device_info(FREQUENCY_SENSOR, i, 3, 1, 1);
-			}
-			break;
-			case ChType_EnergyTotal_kWh_div100:
-			{
-				dev_info = hass_init_sensor_device_info(ENERGY_SENSOR, i, 3, 2, 1);
-			}
-			break;
-			case ChType_EnergyExport_kWh_div1000:
-			{
-				dev_info = hass_init_sensor_device_info(ENERGY_SENSOR, i, 3, 3, 1);
-			}
-			break;
-			case ChType_EnergyImport_kWh_div1000:
-			{
-				dev_info = hass_init_sensor_device_info(ENERGY_SENSOR, i, 3, 3, 1);
-			}
-			break;
-			case ChType_EnergyTotal_kWh_div1000:
-			{
-				dev_info = hass_init_sensor_device_info(ENERGY_SENSOR, i, 3, 3, 1);
-			}
-			break;
-			case ChType_Ph:
-			{
-				dev_info = hass_init_sensor_device_info(WATER_QUALITY_PH, i, 2, 2, 1);
-			}
-			break;
-			case ChType_Orp:
-			{
-				dev_info = hass_init_sensor_device_info(WATER_QUALITY_ORP, i, -1, 2, 1);
+				if (d->index < OBK__FIRST) {
+					d->index = OBK__FIRST;
+				}
+				if (d->index <= OBK__LAST) {
+					i = d->index++;
+					hass_queueAndFree(hass_init_energy_sensor_device_info(i, dataset));
+					if (i == OBK_VOLTAGE && d->stage == HASS_STAGE_ENERGY) {
+						//20250319 XJIKKA to simplify and save space in flash frequency together with voltage
+						hass_queueAndFree(hass_init_sensor_device_info(FREQUENCY_SENSOR, SPECIAL_CHANNEL_OBK_FREQUENCY, -1, -1, -1));
+					}
+					return true;
+				}
 			}
+#endif
+			d->index = 0;
+			d->stage++;
 			break;
-			case ChType_Tds:
-			{
-				dev_info = hass_init_sensor_device_info(WATER_QUALITY_TDS, i, -1, 2, 1);
+		case HASS_STAGE_BATTERY:
+			d->stage = HASS_STAGE_PIN_SENSORS;
+			d->index = 0;
+			if (d->measuringBattery == true) {
+				hass_queueAndFree(hass_init_sensor_device_info(BATTERY_SENSOR, 0, -1, -1, 1));
+				hass_queueAndFree(hass_init_sensor_device_info(BATTERY_VOLTAGE_SENSOR, 0, -1, -1, 1));
+				return true;
 			}
 			break;
-			case ChType_TextField:
-			{
-				dev_info = hass_init_textField_info(i);
+		case HASS_STAGE_PIN_SENSORS:
+			while (d->index < PLATFORM_GPIO_MAX) {
+				i = d->index++;
+				if (IS_PIN_DHT_ROLE(g_cfg.pins.roles[i]) || IS_PIN_TEMP_HUM_SENSOR_ROLE(g_cfg.pins.roles[i])) {
+					ch = PIN_GetPinChannelForPinIndex(i);
+					// TODO: flags are 32 bit and there are 64 max channels
+					BIT_SET(d->flagsChannelPublished, ch);
+					hass_queueAndFree(hass_init_sensor_device_info(TEMPERATURE_SENSOR, ch, 2, 1, 1));
+
+					ch = PIN_GetPinChannel2ForPinIndex(i);
+					// TODO: flags are 32 bit and there are 64 max channels
+					BIT_SET(d->flagsChannelPublished, ch);
+					hass_queueAndFree(hass_init_sensor_device_info(HUMIDITY_SENSOR, ch, -1, -1, 1));
+					return true;
+				}
+				else if (IS_PIN_AIR_SENSOR_ROLE(g_cfg.pins.roles[i])) {
+					ch = PIN_GetPinChannelForPinIndex(i);
+					// TODO: flags are 32 bit and there are 64 max channels
+					BIT_SET(d->flagsChannelPublished, ch);
+					hass_queueAndFree(hass_init_sensor_device_info(CO2_SENSOR, ch, -1, -1, 1));
+
+					ch = PIN_GetPinChannel2ForPinIndex(i);
+					// TODO: flags are 32 bit and there are 64 max channels
+					BIT_SET(d->flagsChannelPublished, ch);
+					hass_queueAndFree(hass_init_sensor_device_info(TVOC_SENSOR, ch, -1, -1, 1));
+					return true;
+				}
 			}
+			d->index = 0;
+			d->stage = HASS_STAGE_CHANNEL_TYPES;
 			break;
-			case ChType_ReadOnlyEnum:
-			{
-				dev_info = hass_init_sensor_device_info(HASS_READONLYENUM, i, -1, -1, -1);
+		case HASS_STAGE_CHANNEL_TYPES:
+#if ENABLE_ADVANCED_CHANNELTYPES_DISCOVERY
+			while (d->index < CHANNEL_MAX) {
+				i = d->index++;
+				// TODO: flags are 32 bit and there are 64 max channels
+				if (BIT_CHECK(d->flagsChannelPublished, i)) {
+					continue;
+				}
+				dev_info = hass_createChannelTypeInfo(i, g_cfg.pins.channelTypes[i]);
+				if (dev_info) {
+					BIT_SET(d->flagsChannelPublished, i);
+					hass_queueAndFree(dev_info);
+					return true;
+				}
 			}
+#endif
+			d->index = 0;
+			d->stage = HASS_STAGE_RELAYS;
 			break;
-			case ChType_Enum:
-			{			
-				dev_info = hass_createEnumChannelInfo(i);
+		case HASS_STAGE_RELAYS:
+			while (d->index < CHANNEL_MAX) {
+				i = d->index++;
+				// if already included by light, skip
+				if (BIT_CHECK(d->flagsChannelPublished, i)) {
+					continue;
+				}
+				bool bToggleInv = g_cfg.pins.channelTypes[i] == ChType_Toggle_Inv;
+				if (h_isChannelRelay(i) || g_cfg.pins.channelTypes[i] == ChType_Toggle || bToggleInv) {
+					// TODO: flags are 32 bit and there are 64 max channels
+					BIT_SET(d->flagsChannelPublished, i);
+					if (CFG_HasFlag(OBK_FLAG_MQTT_HASS_ADD_RELAYS_AS_LIGHTS)) {
+						dev_info = hass_init_relay_device_info(i, LIGHT_ON_OFF, bToggleInv);
+					}
+					else {
+						dev_info = hass_init_relay_device_info(i, RELAY, bToggleInv);
+					}
+					hass_queueAndFree(dev_info);
+					return true;
+				}
 			}
+			d->index = 0;
+			d->stage = HASS_STAGE_INPUTS;
 			break;
-			case ChType_Illuminance_div10:
-			{
-				dev_info = hass_init_sensor_device_info(ILLUMINANCE_SENSOR, i, 2, 1, 1);
+		case HASS_STAGE_INPUTS:
+			while (d->dInputCount > 0 && d->index < CHANNEL_MAX) {
+				i = d->index++;
+				if (h_isChannelDigitalInput(i)) {
+					if (BIT_CHECK(d->flagsChannelPublished, i)) {
+						continue;
+					}
+					// TODO: flags are 32 bit and there are 64 max channels
+					BIT_SET(d->flagsChannelPublished, i);
+					hass_queueAndFree(hass_init_binary_sensor_device_info(i, false));
+					return true;
+				}
 			}
+			d->index = 0;
+			d->stage = HASS_STAGE_SELF_STATE;
 			break;
-			default:
-			{
-				int numOptions;
-				const char **options = Channel_GetOptionsForChannelType(type, &numOptions);
-				if (options && numOptions) {
-					// backlog setChannelType 2 LowMidHigh; scheduleHADiscovery 1
-					// backlog setChannelType 3 OpenStopClose; scheduleHADiscovery 1
-					char stateTopic[16];
-					char cmdTopic[16];
-					// TODO: lengths
-					sprintf(stateTopic, "~/%i/get", i);
-					sprintf(cmdTopic, "~/%i/set", i);
-					dev_info = hass_createSelectEntityIndexed(
-						stateTopic,
-						cmdTopic,
-						numOptions,
-						options,
-						CHANNEL_GetLabel(i)
-					);
+		case HASS_STAGE_SELF_STATE:
+			if (CFG_HasFlag(OBK_FLAG_MQTT_BROADCASTSELFSTATEPERMINUTE) || CFG_HasFlag(OBK_FLAG_MQTT_BROADCASTSELFSTATEONCONNECT)) {
+				static const ENTITY_TYPE selfStateTypes[] = {
+#ifndef NO_CHIP_TEMPERATURE
+					HASS_TEMP,
+#endif
+					HASS_RSSI, HASS_UPTIME, HASS_BUILD, HASS_SSID, HASS_IP
+				};
+				if (d->index < sizeof(selfStateTypes) / sizeof(selfStateTypes[0])) {
+					//use -1 for channel as these don't correspond to channels
+					hass_queueAndFree(hass_init_sensor_device_info(selfStateTypes[d->index++], -1, -1, -1, 1));
+					return true;
 				}
 			}
+			d->stage = HASS_STAGE_DONE;
 			break;
 		}
-		if (dev_info) {
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
+	}
+	return false;
+}
+static void hass_finishDiscovery() {
+	int bytesUsed, peakBytes;
 
-			BIT_SET(flagsChannelPublished, i);
-			discoveryQueued = true;
+	g_hassDiscovery.bActive = false;
+	if (g_hassDiscovery.discoveryQueued) {
+		// paced discovery may have been published already
+		MQTT_GetPublishQueueStats(&bytesUsed, &peakBytes, false);
+		if (bytesUsed == 0) {
+			MQTT_PublishOnlyDeviceChannelsIfPossible();
+		}
+		else {
+			MQTT_InvokeCommandAtEnd(PublishChannels);
 		}
 	}
-#endif
+	else {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_HTTP, "HA discovery: No relay, PWM, sensor or power driver running.");
+	}
+}
 
-	//if (relayCount > 0) {
-	for (i = 0; i < CHANNEL_MAX; i++) {
-		// if already included by light, skip
-		if (BIT_CHECK(flagsChannelPublished, i)) {
-			continue;
+static void hass_runDiscoverySteps() {
+	int steps;
+
+	if (g_hassDiscovery.bActive == false) {
+		return;
+	}
+	hass_setupCJSONHooks();
+	for (steps = 0; steps < HASS_STEPS_PER_CALL; steps++) {
+		if (MQTT_CanQueuePublish(HASS_MAX_ENTITIES_PER_STEP, HASS_JSON_SIZE - 1) == false) {
+			break;
 		}
-		bool bToggleInv = g_cfg.pins.channelTypes[i] == ChType_Toggle_Inv;
-		if (h_isChannelRelay(i) || g_cfg.pins.channelTypes[i] == ChType_Toggle || bToggleInv) {
-			// TODO: flags are 32 bit and there are 64 max channels
-			BIT_SET(flagsChannelPublished, i);
-			if (CFG_HasFlag(OBK_FLAG_MQTT_HASS_ADD_RELAYS_AS_LIGHTS)) {
-				dev_info = hass_init_relay_device_info(i, LIGHT_ON_OFF, bToggleInv);
-			}
-			else {
-				dev_info = hass_init_relay_device_info(i, RELAY, bToggleInv);
-			}
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-			dev_info = NULL;
-			discoveryQueued = true;
+		if (hass_discoveryStep() == false) {
+			hass_finishDiscovery();
+			break;
 		}
 	}
-	//}
-	if (dInputCount > 0) {
-		for (i = 0; i < CHANNEL_MAX; i++) {
-			if (h_isChannelDigitalInput(i)) {
-				if (BIT_CHECK(flagsChannelPublished, i)) {
-					continue;
-				}
-				// TODO: flags are 32 bit and there are 64 max channels
-				BIT_SET(flagsChannelPublished, i);
-				dev_info = hass_init_binary_sensor_device_info(i, false);
-				MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-				hass_free_device_info(dev_info);
-				dev_info = NULL;
-				discoveryQueued = true;
-			}
+}
+
+static void hass_startDiscovery(const char* topic) {
+	hassDiscovery_t* d = &g_hassDiscovery;
+	int i;
+	int excludedCount = 0;
+
+	memset(d, 0, sizeof(*d));
+
+	for (i = 0; i < CHANNEL_MAX; i++) {
+		if (CHANNEL_HasNeverPublishFlag(i)) {
+			BIT_SET(d->flagsChannelPublished, i);
+			excludedCount++;
 		}
 	}
-	if(CFG_HasFlag(OBK_FLAG_MQTT_BROADCASTSELFSTATEPERMINUTE) || CFG_HasFlag(OBK_FLAG_MQTT_BROADCASTSELFSTATEONCONNECT)) {
-		//use -1 for channel as these don't correspond to channels
-#ifndef NO_CHIP_TEMPERATURE
-		dev_info = hass_init_sensor_device_info(HASS_TEMP, -1, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-		hass_free_device_info(dev_info);
-#endif
-		dev_info = hass_init_sensor_device_info(HASS_RSSI, -1, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-		hass_free_device_info(dev_info);
-		dev_info = hass_init_sensor_device_info(HASS_UPTIME, -1, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-		hass_free_device_info(dev_info);
-		dev_info = hass_init_sensor_device_info(HASS_BUILD, -1, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-		hass_free_device_info(dev_info);
-		dev_info = hass_init_sensor_device_info(HASS_SSID, -1, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-		hass_free_device_info(dev_info);
-		dev_info = hass_init_sensor_device_info(HASS_IP, -1, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-		hass_free_device_info(dev_info);
-		discoveryQueued = true;
-
-	}
-	if (discoveryQueued) {
-		MQTT_InvokeCommandAtEnd(PublishChannels);
+	
+	if (topic == 0 || *topic == 0) {
+		topic = "homeassistant";
 	}
-	else {
-		const char* msg = "No relay, PWM, sensor or power driver running.";
-		if (request) {
-			poststr(request, msg);
-			poststr(request, NULL);
-		}
-		else {
-			addLogAdv(LOG_ERROR, LOG_FEATURE_HTTP, "HA discovery: %s", msg);
-		}
+	strcpy_safe(d->topic, topic, sizeof(d->topic));
+
+#ifdef ENABLE_DRIVER_BL0937
+	d->measuringPower = DRV_IsMeasuringPower();
+#endif
+	d->measuringBattery = DRV_IsMeasuringBattery();
+
+	PIN_get_Relay_PWM_Count(&d->relayCount, &d->pwmCount, &d->dInputCount);
+	addLogAdv(LOG_INFO, LOG_FEATURE_HTTP, "HASS counts: %i rels, %i pwms, %i inps, %i excluded", d->relayCount, d->pwmCount, d->dInputCount, excludedCount);
+
+#if ENABLE_LED_BASIC
+	if (LED_IsLedDriverChipRunning()) {
+		d->pwmCount = CFG_CountLEDRemapChannels();
+	}
+#endif
+
+	hass_setupCJSONHooks();
+
+	DRV_OnHassDiscovery(d->topic);
+	EventHandlers_FireEvent(CMD_EVENT_ON_DISCOVERY, 0);
+
+	d->stage = HASS_STAGE_MERGED_LIGHTS;
+	d->bActive = true;
+}
+
+/// @brief Starts discovery requested by doHomeAssistantDiscovery and continues it.
+/// Called every second from main thread, emits a few entities if the MQTT queue has room.
+void HASS_RunDiscoveryStep() {
+	if (g_bHassDiscoveryRequested) {
+		hass_startDiscovery(g_hassRequestedPrefix);
+		g_bHassDiscoveryRequested = false;
+	}
+	hass_runDiscoverySteps();
+}
+
+/// @brief Requests HA discovery, it is done by main thread in HASS_RunDiscoveryStep.
+/// May be called from any thread.
+void doHomeAssistantDiscovery(const char* topic) {
+	if (g_bHassDiscoveryRequested) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_HTTP, "HA discovery already requested");
+		return;
+	}
+	if (topic == 0) {
+		topic = "";
 	}
+	strcpy_safe(g_hassRequestedPrefix, topic, sizeof(g_hassRequestedPrefix));
+	g_bHassDiscoveryRequested = true;
 }
 
 /// @brief Sends HomeAssistant discovery MQTT messages.
 /// @param request 
 /// @return 
 int http_fn_ha_discovery(http_request_t* request) {
-	char topic[32];
+	char topic[HASS_MAX_PREFIX];
 
 	http_setup(request, httpMimeTypeText);
 
@@ -2598,7 +2689,7 @@ int http_fn_ha_discovery(http_request_t* request) {
 	// even if it returns the empty HA topic,
 	// the function call below will set default
 	http_getArg(request->url, "prefix", topic, sizeof(topic));
-	doHomeAssistantDiscovery(topic, request);
+	doHomeAssistantDiscovery(topic);
 
 	poststr(request, "MQTT discovery queued.");
 	poststr(request, NULL);
@@ -2813,7 +2904,7 @@ int http_fn_ha_cfg(http_request_t* request) {
 	poststr(request, "<br/><div><label for=\"ha_disc_topic\">Discovery topic:</label><input id=\"ha_disc_topic\" value=\"homeassistant\"><button onclick=\"send_ha_disc();\">Start Home Assistant Discovery</button>&nbsp;<form action=\"cfg_mqtt\" class='disp-inline'><button type=\"submit\">Configure MQTT</button></form></div><br/>");
 	poststr(request, htmlFooterReturnToCfgOrMainPage);
 	http_html_end(request);
-	poststr(request, ha_discovery_script);
+	poststr_const(request, ha_discovery_script);
 	poststr(request, NULL);
 	return 0;
 }
@@ -2828,8 +2919,14 @@ void runHTTPCommandInternal(http_request_t* request, const char *cmd) {
 		JSON_ProcessCommandReply(cmd, skipToNextWord(cmd), request, (jsonCb_t)hprintf255, COMMAND_FLAG_SOURCE_HTTP);
 	}
 	else {
-		const char *s = Tokenizer_GetArg(0);
-		poststr(request, s);
+		// expand the same way as echo did, in a context of its own like a command
+		tokenizer_t *t;
+
+		Tokenizer_PushContext();
+		t = Tokenizer_GetCurrentContext();
+		TokenizerCtx_TokenizeString(t, skipToNextWord(cmd), TOKENIZER_ALTERNATE_EXPAND_AT_START | TOKENIZER_FORCE_SINGLE_ARGUMENT_MODE);
+		poststr(request, TokenizerCtx_GetArg(t, 0));
+		Tokenizer_PopContext();
 	}
 #endif
 }
@@ -2,7 +2,8 @@
 
 
 // TODO: move it out 
-void doHomeAssistantDiscovery(const char *topic, http_request_t *request);
+void doHomeAssistantDiscovery(const char *topic);
+void HASS_RunDiscoveryStep();
 
 int http_fn_about(http_request_t* request);
 int http_fn_cfg_mqtt(http_request_t* request);
@@ -34,3 +35,5 @@ int http_fn_cfg_generic(http_request_t* request);
 int http_fn_cfg_startup(http_request_t* request);
 int http_fn_cfg_dgr(http_request_t* request);
 int http_fn_pmntp(http_request_t* request);
+// true if base (URL without leading '/') is fileName, query string is ignored
+bool http_checkUrlBase(const char* base, const char* fileName);
@@ -0,0 +1,85 @@
+#include "../new_common.h"
+#include "../obk_config.h"
+
+#if ENABLE_HTTP_STATIC_ASSETS
+
+#include "../logging/logging.h"
+#include "new_http.h"
+#include "http_fns.h"
+
+// CSS and JS of the pages, gzipped at build time by scripts/gen_static_assets.js.
+// Pages refer to them as obk.css?v=<hash>, so browser can keep them for a long
+// time and asks again only after firmware with other content is flashed.
+
+typedef struct httpStaticAsset_s {
+	const char *name;
+	const char *mimeType;
+	// content hash, also the ETag
+	const char *hash;
+	const unsigned char *gz;
+	int gzLen;
+	// length before compression, to check that blob matches source string
+	int rawLen;
+} httpStaticAsset_t;
+
+#include "http_static_assets.h"
+
+#define HTTP_STATIC_MAX_AGE		31536000
+
+static const httpStaticAsset_t *HTTP_Static_Find(const char *url) {
+	int i;
+
+	for (i = 0; i < (int)(sizeof(g_staticAssets) / sizeof(g_staticAssets[0])); i++) {
+		if (http_checkUrlBase(url, g_staticAssets[i].name)) {
+			return &g_staticAssets[i];
+		}
+	}
+	return 0;
+}
+
+const char *HTTP_Static_GetHash(const char *name) {
+	const httpStaticAsset_t *a = HTTP_Static_Find(name);
+
+	return a ? a->hash : "";
+}
+
+int HTTP_Static_GetRawLength(const char *name) {
+	const httpStaticAsset_t *a = HTTP_Static_Find(name);
+
+	return a ? a->rawLen : 0;
+}
+
+static int HTTP_Static_Handler(http_request_t *request) {
+	const httpStaticAsset_t *a;
+	char etag[16];
+
+	a = HTTP_Static_Find(request->url);
+	if (a == 0) {
+		return http_fn_other(request);
+	}
+	snprintf(etag, sizeof(etag), "\"%s\"", a->hash);
+	if (HTTP_IsNotModified(request, etag)) {
+		request->responseCode = HTTP_RESPONSE_NOT_MODIFIED;
+		http_setup_cached(request, a->mimeType, etag, HTTP_STATIC_MAX_AGE, 0);
+		poststr(request, NULL);
+		return 0;
+	}
+	// pages link here only if browser accepts gzip
+	http_setup_cached(request, a->mimeType, etag, HTTP_STATIC_MAX_AGE, 1);
+	postany_const(request, (const char*)a->gz, a->gzLen);
+	poststr(request, NULL);
+	return 0;
+}
+
+void HTTP_Static_Init() {
+	int i;
+
+	for (i = 0; i < (int)(sizeof(g_staticAssets) / sizeof(g_staticAssets[0])); i++) {
+		char url[32];
+
+		snprintf(url, sizeof(url), "/%s", g_staticAssets[i].name);
+		HTTP_RegisterCallback(url, HTTP_GET, HTTP_Static_Handler, 0);
+	}
+}
+
+#endif
@@ -0,0 +1,135 @@
+// generated by scripts/gen_static_assets.js from new_http.c, do not edit
+
+// obk.css, 1693 bytes before compression
+static const unsigned char obk_css_gz[] = {
+	0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0x75,0x55,0x61,0x8f,0xa3,0x2c,
+	0x10,0xfe,0x2b,0xbd,0x34,0x9b,0xdc,0x25,0x4a,0xb0,0xd6,0xee,0x2e,0xe6,0xfd,0x25,
+	0x97,0xfd,0x30,0xca,0xa0,0x64,0x15,0x78,0x11,0x5b,0x7a,0x86,0xff,0x7e,0xc1,0xea,
+	0x9e,0x6d,0xba,0x21,0x69,0xca,0xc0,0xcc,0xf3,0xcc,0x33,0x33,0xc8,0xe5,0x39,0x11,
+	0x12,0x3b,0x3e,0xa0,0x4b,0xa4,0x32,0xa3,0x4b,0x06,0xec,0xb0,0x76,0x93,0x01,0xce,
+	0xa5,0x6a,0x58,0x61,0x7c,0x29,0xb4,0x72,0xe9,0x20,0xff,0x20,0xcb,0xb0,0x2f,0x7b,
+	0xb0,0x8d,0x54,0x8c,0xee,0xe8,0x8e,0x1c,0xb0,0x0f,0xab,0xff,0x54,0x41,0xfd,0xd9,
+	0x58,0x3d,0x2a,0xce,0xf6,0x47,0x11,0x57,0x30,0xd3,0x72,0x9b,0x14,0xd8,0xef,0x68,
+	0x98,0x21,0xa6,0x8b,0xe4,0xae,0x65,0x19,0xa5,0x2f,0x65,0xa5,0x7d,0x8c,0x1c,0x91,
+	0x2a,0x6d,0x39,0xda,0xb4,0xd2,0xbe,0x4c,0x2f,0x58,0x7d,0x4a,0x97,0x7e,0x73,0xda,
+	0xeb,0x3f,0xdf,0x1c,0x6d,0x29,0x70,0xce,0xcb,0x5a,0x77,0xda,0xb2,0x3d,0xa5,0x34,
+	0x08,0x6d,0xfb,0x85,0x4d,0x5a,0x69,0xe7,0x74,0x3f,0x93,0xba,0x51,0xfa,0xed,0xae,
+	0x06,0xff,0xab,0x5b,0xac,0x3f,0x2b,0xed,0x3f,0x92,0x8d,0xd1,0x02,0x97,0xfa,0x63,
+	0xe5,0xfc,0x95,0x7f,0x6a,0x65,0xd3,0x3a,0x76,0x32,0xbe,0x3c,0xa3,0x75,0xb2,0x86,
+	0x2e,0x85,0x4e,0x36,0x8a,0xa5,0x99,0xf1,0xe1,0x2e,0x80,0x6a,0x70,0x0d,0xf0,0xfe,
+	0xfe,0x12,0x16,0x85,0xb7,0x2a,0x7c,0x4f,0xdb,0xa1,0x77,0x60,0x11,0x26,0x8b,0x73,
+	0x05,0x56,0xb0,0x72,0x89,0xf7,0xf6,0x52,0xb6,0x38,0x53,0xc9,0xb3,0x37,0xe3,0xcb,
+	0x6d,0xdd,0xf4,0x19,0xad,0xe8,0xf4,0x85,0xc1,0xe8,0xf4,0x1d,0x48,0x26,0xe2,0x5a,
+	0x71,0x4e,0x45,0x9d,0x65,0x45,0xa8,0x34,0xbf,0x4e,0x11,0x6f,0x49,0xa4,0x46,0xe5,
+	0xd0,0xde,0xaa,0x2f,0xa0,0x97,0xdd,0x35,0xa2,0x73,0x50,0x90,0x0c,0xa0,0x86,0x74,
+	0x40,0x2b,0xc5,0xec,0x95,0xb4,0xd9,0x0e,0xee,0xea,0x7f,0xc8,0xf2,0x3c,0xc7,0x15,
+	0x00,0x21,0xae,0xe0,0xf8,0x57,0x5b,0xd1,0x50,0x8d,0xce,0x69,0xb5,0x55,0x7a,0x18,
+	0xab,0x5e,0xba,0x8f,0xe9,0x56,0x4f,0x46,0xcb,0xa5,0xb0,0xb1,0x02,0xe3,0xc0,0x48,
+	0x6e,0xb1,0x7f,0xc8,0x02,0x72,0xac,0x57,0x10,0x01,0x42,0x08,0x51,0x76,0x52,0x61,
+	0xba,0x48,0x72,0x20,0xc7,0xe8,0xb3,0xe9,0x5f,0x72,0x88,0x86,0x7a,0xb4,0x83,0xb6,
+	0xcc,0x68,0x19,0x33,0x0c,0x4f,0x38,0x6c,0x8a,0xe3,0x2c,0xa8,0x41,0x3a,0xa9,0x55,
+	0xca,0x47,0x0b,0xf1,0x0f,0x23,0xc7,0xe1,0x89,0x17,0x6b,0xa3,0xe2,0x77,0x3a,0x50,
+	0x7c,0xa5,0x70,0x0c,0xa4,0xb2,0xc8,0xef,0x0e,0xf8,0x31,0x2f,0xf2,0xe2,0x87,0xec,
+	0x8d,0xb6,0x0e,0x94,0xbb,0x5d,0x79,0x12,0xe1,0x3d,0x8f,0xa5,0xba,0xbb,0xd8,0x58,
+	0x75,0x3f,0x6c,0xaf,0xf5,0xe1,0x74,0x7a,0xbc,0xf2,0x24,0x56,0x01,0x20,0x4e,0xdb,
+	0x58,0x30,0x2d,0xe2,0x2d,0x52,0xce,0xd5,0xe7,0x58,0xeb,0x25,0x4f,0xa5,0x15,0x06,
+	0x62,0x26,0xd1,0x69,0x70,0xac,0x43,0xe1,0xca,0x4d,0x83,0xc4,0x7d,0x20,0xff,0x2f,
+	0xa7,0xf3,0x40,0x6c,0x8f,0x67,0x43,0x20,0x76,0x7a,0xac,0x23,0xf6,0x5f,0x6d,0x7a,
+	0x30,0x7e,0x7d,0x50,0x4e,0xc6,0xef,0xe2,0x76,0x43,0x38,0xd6,0x12,0x6c,0xda,0x44,
+	0x4f,0x54,0xee,0xe7,0x3b,0xe5,0xd8,0x24,0x7b,0x21,0x80,0x52,0x9a,0xec,0xe1,0xc4,
+	0x33,0x21,0x7e,0x05,0xd2,0x8a,0x89,0xcb,0xc1,0x74,0x70,0x5d,0x18,0xb7,0x5c,0x9e,
+	0xd7,0x89,0x2b,0x5e,0xca,0x4b,0x2b,0x1d,0xa6,0x83,0x81,0x1a,0x99,0xd2,0x17,0x0b,
+	0x26,0x90,0x16,0x3b,0x5c,0xae,0x1c,0x32,0x6a,0x7c,0xb9,0x46,0x90,0x6a,0x6e,0xa1,
+	0xaa,0xd3,0xf5,0xe7,0x3a,0xec,0x31,0xd3,0xc8,0x35,0x70,0x79,0xde,0x0f,0x0e,0x1c,
+	0x6e,0x3a,0x39,0xda,0xea,0x36,0x4e,0xf9,0xa6,0xbf,0xd7,0xa9,0x3c,0xe4,0x8b,0x57,
+	0x0f,0x52,0x4d,0x0f,0xe2,0x3d,0xc7,0xbc,0x1b,0x9a,0xb2,0x97,0x2a,0xbd,0xd1,0xcc,
+	0x8f,0x74,0x56,0xcb,0x2f,0xfb,0x37,0x4a,0x8d,0x0f,0x0e,0xaa,0x0e,0xa7,0xf9,0x37,
+	0xed,0xe0,0xaa,0x47,0xc7,0x84,0xf4,0xc8,0xcb,0x7f,0x2d,0x1c,0x48,0xc4,0x49,0xa3,
+	0x34,0x0f,0x3a,0xcd,0xf6,0x1b,0xf8,0xf4,0x8c,0x4b,0x20,0x03,0x08,0x5c,0x9a,0xc4,
+	0x22,0x9f,0x5f,0x51,0x22,0x15,0x47,0xf5,0xf5,0x89,0xb8,0x89,0x93,0x9d,0x8c,0x0f,
+	0x9d,0x5c,0xdf,0xfb,0xc2,0xf8,0x1d,0x0d,0x44,0x0b,0x91,0x10,0xad,0xbe,0x7b,0x55,
+	0xe6,0x99,0x2c,0x8e,0xc6,0x87,0x78,0x69,0x36,0x5d,0x6e,0xb2,0xbd,0x52,0x1a,0xfe,
+	0x02,0xb0,0xd4,0x79,0x7e,0x9d,0x06,0x00,0x00
+};
+
+// obk.js, 2579 bytes before compression
+static const unsigned char obk_js_gz[] = {
+	0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0x95,0x56,0x61,0x4f,0x23,0x37,
+	0x10,0xfd,0x2b,0x8b,0x0b,0x91,0x2d,0xdc,0x65,0x53,0xae,0xa8,0x4a,0xce,0x44,0xd7,
+	0xbb,0xd0,0xa3,0x05,0x82,0x20,0x57,0x55,0x42,0x48,0x31,0xeb,0x09,0xd9,0x9e,0x63,
+	0x2f,0xf6,0x6c,0x20,0x4a,0xf2,0xdf,0x2b,0xef,0x86,0x64,0x37,0x6d,0x8f,0xf6,0x9b,
+	0x3d,0x7e,0xb6,0xdf,0x8c,0x67,0xe6,0x79,0x26,0x5d,0x34,0xce,0x9c,0xc7,0x61,0x36,
+	0x05,0xae,0xe5,0x7a,0x60,0x8d,0xce,0x0c,0x9c,0x59,0xc7,0x61,0x36,0xc8,0xc1,0x88,
+	0x84,0xc3,0xec,0x06,0x52,0x6b,0x0c,0xa4,0x28,0x12,0xee,0xe0,0x49,0x98,0x42,0xeb,
+	0x2d,0xb2,0xaf,0x2b,0xc3,0x23,0x60,0x5f,0xc3,0x14,0x0c,0x0a,0x10,0xa7,0xca,0xa6,
+	0x45,0x18,0xc7,0x5b,0xf3,0xcf,0xf3,0x73,0x45,0x81,0x75,0xc7,0x85,0x49,0x31,0xb3,
+	0x26,0xf2,0x13,0xfb,0x7c,0x8b,0x12,0x81,0xb2,0x45,0xaa,0x41,0xba,0x40,0xc1,0x16,
+	0x48,0x37,0xc4,0x18,0x6f,0xd8,0x5f,0x69,0x32,0x1e,0x6e,0xdc,0x13,0x0e,0x9e,0x5a,
+	0x2d,0x07,0x4f,0xb1,0x7c,0xb0,0x0e,0x29,0xe3,0x14,0xc4,0xf6,0x3e,0x4a,0x7c,0x38,
+	0x9c,0x30,0xd6,0x6a,0x51,0x5a,0x12,0x87,0xe7,0xe8,0x8f,0xcb,0x8b,0xcf,0x88,0xf9,
+	0x0d,0x3c,0x15,0xe0,0x91,0xc5,0xd6,0x38,0x90,0x6a,0x5e,0x42,0xd3,0x89,0x34,0x8f,
+	0x20,0x28,0x13,0xa7,0x8b,0x77,0x22,0x1c,0x1f,0x97,0x8b,0x25,0xc9,0x56,0x8b,0x0c,
+	0x7e,0x23,0x95,0x35,0xa0,0x0b,0x3f,0x84,0x17,0x6c,0xb5,0x28,0xb9,0xed,0x5f,0xf4,
+	0x3f,0x0e,0xc9,0x9e,0xd8,0x38,0x2d,0x53,0xcc,0x66,0xb0,0xe6,0x11,0xa3,0x7c,0xbc,
+	0x92,0x53,0x08,0xd0,0xf3,0xab,0xeb,0x2f,0x6f,0x23,0x97,0x4b,0x62,0x8a,0xe9,0x03,
+	0xb8,0x6f,0x20,0xe7,0x79,0x60,0x94,0x5a,0x6d,0xdf,0x40,0x05,0xef,0x21,0xce,0x8c,
+	0x01,0xf7,0x79,0x78,0x79,0xb1,0xf6,0xca,0xe7,0xd6,0x78,0x08,0x1e,0xec,0xc4,0xf8,
+	0xed,0xd8,0x57,0x99,0xb1,0x5c,0x6e,0x4c,0xc2,0x03,0xbe,0xc2,0x36,0x6f,0xca,0x1d,
+	0x8c,0x1d,0xf8,0xc9,0xa5,0x67,0x8c,0xad,0x42,0xde,0xc4,0x36,0x07,0x43,0xc9,0x2f,
+	0xfd,0x21,0xe1,0x24,0x33,0x0a,0x5e,0x7a,0x65,0xd4,0x45,0x9b,0xf0,0xbd,0x84,0x95,
+	0x10,0x0f,0x46,0x51,0x56,0xbb,0x63,0x43,0xe7,0xcd,0x4b,0x56,0x9b,0xbc,0x1a,0x4f,
+	0xf1,0x4b,0x1e,0xb0,0x14,0xd8,0x62,0x26,0x5d,0x84,0xdc,0x70,0x2b,0x2e,0x25,0x4e,
+	0xe2,0xb1,0xb6,0xd6,0x51,0x38,0xfa,0xe9,0xe4,0x5d,0x92,0xb0,0xae,0x03,0x2c,0x9c,
+	0x89,0xe0,0x40,0x94,0x06,0x8e,0x4d,0xd4,0xf1,0x49,0x92,0x30,0x0e,0x07,0x22,0x0c,
+	0xb8,0x69,0x2e,0x9e,0x84,0x25,0x01,0x07,0x27,0x09,0x4f,0xde,0xdb,0x9e,0x3d,0x1c,
+	0x45,0x4a,0xce,0x3d,0x8f,0xf6,0x17,0xb8,0x8a,0x26,0xb6,0x70,0xe5,0xd8,0xac,0xa2,
+	0x69,0x66,0x0a,0x04,0x1f,0x49,0xa3,0xa2,0xfd,0x05,0xac,0x22,0x1f,0x2a,0x4a,0xf9,
+	0x51,0x27,0x79,0x8f,0x3d,0x3c,0x1c,0xfd,0x67,0xb4,0xe9,0x99,0xc3,0xd1,0x37,0x10,
+	0xa3,0x3f,0x0b,0x8f,0x4d,0xdb,0x36,0x2e,0x1e,0xf0,0xba,0xf0,0x13,0x50,0xbf,0x4b,
+	0x5d,0x00,0x05,0x8e,0x55,0x78,0x4c,0x17,0xfe,0x2d,0x83,0x42,0xce,0x0e,0x3f,0x11,
+	0x21,0xa0,0x96,0x9b,0xbe,0x78,0x98,0x66,0x58,0x19,0xe7,0x39,0xf4,0xa8,0x11,0xc9,
+	0x9e,0xc0,0x3d,0x41,0x49,0xbb,0xb4,0x2a,0x89,0xd2,0x03,0xc6,0x99,0x99,0x31,0xbe,
+	0xb3,0xbf,0x47,0x21,0x4e,0xb5,0xf4,0x3e,0x4c,0x84,0xe9,0x11,0x6b,0x48,0x87,0xd8,
+	0xf1,0x98,0x70,0x88,0x11,0x5e,0xf0,0xa3,0x35,0x18,0x9a,0x88,0xe9,0x91,0xc1,0x15,
+	0xe9,0x90,0xc1,0xd9,0x19,0x61,0x9d,0x9d,0x4d,0x0f,0x8f,0x2e,0x6c,0x7b,0x70,0xa0,
+	0x08,0xeb,0x90,0xb3,0xc1,0xcd,0x65,0xe3,0x12,0x88,0x9f,0x0a,0x70,0xf3,0x5b,0xd0,
+	0x90,0xa2,0x75,0x1f,0xb4,0xa6,0x24,0x33,0x79,0x81,0x77,0x81,0xb1,0x70,0x52,0x65,
+	0xf6,0x9e,0xb0,0x78,0x6c,0x5d,0x5f,0xa6,0x13,0x0a,0xe2,0x14,0xe2,0x74,0x02,0xe9,
+	0x57,0x50,0x02,0xe2,0x59,0x08,0x90,0x10,0xc8,0x3a,0xe4,0xf6,0xfa,0xc3,0xd5,0xce,
+	0xd1,0xaf,0xee,0xd9,0x1c,0x7d,0xaf,0x49,0xba,0xb9,0x18,0xfb,0x5c,0x67,0x48,0xc9,
+	0x92,0xb0,0x3b,0xbc,0x5f,0x2e,0xb1,0xd3,0x44,0x53,0x3c,0xa2,0xdb,0x1d,0x2a,0x9b,
+	0x2d,0x97,0x6d,0xc6,0x62,0xb4,0x67,0xd9,0x0b,0xa8,0xfa,0x52,0xbe,0x5c,0x26,0xac,
+	0xb3,0x2e,0xf7,0x4d,0xe0,0x5f,0x89,0x92,0xef,0xc8,0x61,0x38,0xbb,0x9a,0x6d,0xb7,
+	0x7d,0x05,0x3d,0xcb,0x4c,0xaf,0xcc,0x5a,0x67,0x0b,0xa3,0x68,0x1b,0x4e,0x8e,0x90,
+	0x75,0xb0,0x56,0x2d,0x32,0xcf,0xf5,0xbc,0x3f,0x0b,0x0d,0xb3,0x51,0x2e,0x8b,0x74,
+	0xd2,0x21,0xe1,0xa4,0xef,0xd3,0x09,0xe1,0x1a,0xd4,0x7a,0xa6,0x41,0x11,0x0e,0x66,
+	0x3d,0x03,0x43,0x56,0xdd,0xb1,0x75,0x14,0xa3,0xcc,0x44,0x96,0x85,0xa1,0x09,0x43,
+	0x28,0x3d,0x5e,0xac,0xd8,0x26,0xb1,0xfe,0xf6,0x22,0xa3,0xbb,0xfd,0x85,0xbd,0xc3,
+	0xfb,0x95,0x20,0x21,0xf1,0xc9,0xfd,0x68,0xfb,0x20,0x4e,0x9c,0xee,0xa4,0xab,0xe3,
+	0xe1,0xc8,0x3b,0x73,0x5f,0x2f,0x75,0x8f,0xd2,0x61,0x49,0xde,0xd3,0x8a,0x3c,0x74,
+	0x9f,0x33,0xa3,0xec,0x73,0x5c,0x5a,0x6f,0x6d,0xe1,0x52,0x68,0xb5,0xfe,0x41,0x15,
+	0x82,0x28,0x40,0x29,0x09,0x35,0x24,0x25,0xde,0x07,0xc5,0x88,0xad,0x09,0xdd,0xaa,
+	0x92,0x82,0xb5,0x14,0xb6,0xeb,0x52,0xd8,0xab,0x89,0x57,0x87,0xfe,0xbf,0x0e,0xca,
+	0x1a,0x9a,0xda,0x5e,0x71,0x88,0xad,0x99,0x82,0xf7,0xf2,0x11,0x82,0x76,0x2e,0x6a,
+	0x4f,0xf2,0xeb,0xed,0xe0,0x2a,0xce,0xa5,0xf3,0xb0,0x4e,0x87,0xd0,0x4c,0x03,0x1e,
+	0x9c,0xb3,0xae,0xce,0x2f,0xb4,0xf9,0x57,0xcd,0xae,0x91,0x63,0xab,0x5a,0xb8,0x8a,
+	0x5c,0x49,0x84,0xc1,0xab,0x74,0x53,0xb6,0xa8,0xc9,0x78,0x23,0x35,0xb7,0x3d,0xf4,
+	0xf0,0x70,0x83,0xa9,0x9d,0x64,0xcd,0x85,0x95,0x8a,0xb2,0x05,0xad,0x7f,0x04,0xea,
+	0x61,0xde,0xd8,0x2b,0x01,0xde,0x4c,0x45,0xe9,0xcd,0xb9,0xc1,0xfa,0xce,0x5a,0xcb,
+	0xc8,0x30,0x93,0x9a,0xb7,0x93,0xb0,0xcb,0x03,0x9e,0x1b,0x04,0x37,0x93,0x9a,0xee,
+	0x70,0xe7,0x6d,0x38,0x66,0x75,0x47,0x79,0x23,0x17,0x6a,0x29,0x52,0x76,0xab,0x21,
+	0x4c,0x73,0x70,0x12,0x0b,0xb7,0x55,0x85,0x06,0xdd,0xb1,0x75,0xd3,0xf6,0xf1,0x0f,
+	0x84,0x75,0xeb,0xd6,0xaa,0x82,0x4a,0xfb,0xba,0xba,0x76,0x8a,0x69,0xe3,0xcc,0xba,
+	0xfa,0x18,0xe3,0x18,0x57,0x57,0x52,0xb6,0x5a,0xa7,0xa2,0x54,0xaa,0xe4,0x75,0x91,
+	0x79,0x04,0x03,0x8e,0x12,0x6d,0xa5,0x22,0xbc,0x0a,0x22,0xe3,0x93,0xcc,0xa3,0x75,
+	0xf3,0xd8,0x41,0xae,0x65,0x0a,0x95,0x43,0xe5,0xa7,0x8a,0x10,0xbe,0x3e,0x43,0xdb,
+	0x54,0x06,0x7f,0xe2,0x5c,0xe2,0xc4,0xc8,0x29,0xc4,0x5e,0x67,0x29,0xd0,0x36,0x63,
+	0xbc,0x26,0x8d,0x65,0x42,0x94,0x75,0xd0,0xf0,0xae,0xfa,0xd9,0x28,0xc2,0xba,0xb0,
+	0xf3,0x1d,0x20,0x84,0xad,0xf8,0x8f,0x70,0xcc,0xba,0x7f,0x01,0x47,0x86,0x1a,0x7d,
+	0x13,0x0a,0x00,0x00
+};
+
+static const httpStaticAsset_t g_staticAssets[] = {
+	{ "obk.css", httpMimeTypeCSS, "21a9d195", obk_css_gz, sizeof(obk_css_gz), 1693 },
+	{ "obk.js", httpMimeTypeJavascript, "621de0ca", obk_js_gz, sizeof(obk_js_gz), 2579 },
+};
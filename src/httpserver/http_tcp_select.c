@@ -0,0 +1,538 @@
+#include "../new_common.h"
+#include "../obk_config.h"
+
+#if ENABLE_HTTP_SELECT_SERVER
+
+#include "lwip/sockets.h"
+#ifdef LINUX
+#include <unistd.h>
+#endif
+#include "lwip/ip_addr.h"
+#include "lwip/inet.h"
+#include "../logging/logging.h"
+#include "../quicktick.h"
+#include "new_http.h"
+
+// Single threaded HTTP server, all clients are served from one select() loop.
+// Each connection has its own receive buffer for partial requests and its own
+// send queue, so a slow or stalled client does not hold up the others.
+// Nothing here waits for a socket: replies are queued and sent when select()
+// says the socket is writable, big request bodies (OTA, file upload) are given
+// to the handler in parts as they arrive.
+
+#define HTTP_SELECT_MAX_CLIENTS		4
+#ifdef WINDOWS
+#define HTTP_SELECT_RX_SIZE			10000
+#define HTTP_SELECT_REPLY_SIZE		10000
+#else
+#define HTTP_SELECT_RX_SIZE			2048
+#define HTTP_SELECT_REPLY_SIZE		2048
+#endif
+// send queue grows in these steps while client is slower than reply
+#define HTTP_SELECT_TX_SIZE			4096
+#define HTTP_SELECT_TX_MAX			(8 * HTTP_SELECT_TX_SIZE)
+// select() timeout while a handler defers request body
+#define HTTP_SELECT_RETRY_MS		5
+
+typedef enum {
+	HTTPCONN_FREE,
+	// waiting for (rest of) request
+	HTTPCONN_RECV,
+	// request body is given to handler as it arrives
+	HTTPCONN_BODY,
+	// reply queued, close when it is sent
+	HTTPCONN_CLOSING,
+	// event stream headers queued, socket goes to events module when sent
+	HTTPCONN_DETACH,
+} httpConnState_t;
+
+typedef struct httpConn_s {
+	int state;
+	int fd;
+	char *rx;
+	int rxLen;
+	char *tx;
+	int txSize;
+	int txLen;
+	int txSent;
+	int numRequests;
+	unsigned int lastActivity;
+	// request that receives body in HTTPCONN_BODY
+	http_request_t *stream;
+	// body bytes still expected, -1 if until client closes
+	int bodyLeft;
+} httpConn_t;
+
+#ifdef WINDOWS
+#define HTTP_SELECT_WOULDBLOCK() (WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+#define HTTP_SELECT_WOULDBLOCK() (errno == EWOULDBLOCK || errno == EAGAIN)
+#endif
+
+static httpConn_t g_conns[HTTP_SELECT_MAX_CLIENTS];
+// replies are built one at a time, so one buffer serves all clients
+static char *g_selectReply = 0;
+
+// frees slot, socket is closed unless someone else owns it now
+static void HTTPSelect_Release(httpConn_t *c, int bCloseSocket) {
+	if (c->state == HTTPCONN_FREE) {
+		return;
+	}
+	if (c->stream) {
+		// body was not complete, let handler free what it has
+		c->stream->reply = g_selectReply;
+		c->stream->bodyCallback(c->stream, 0, -1);
+		free(c->stream);
+	}
+	if (bCloseSocket) {
+		close(c->fd);
+	}
+	free(c->rx);
+	free(c->tx);
+	memset(c, 0, sizeof(*c));
+	c->state = HTTPCONN_FREE;
+}
+
+static void HTTPSelect_Close(httpConn_t *c) {
+	HTTPSelect_Release(c, 1);
+}
+
+void HTTPSelect_CloseAll() {
+	int i;
+
+	for (i = 0; i < HTTP_SELECT_MAX_CLIENTS; i++) {
+		HTTPSelect_Close(&g_conns[i]);
+	}
+}
+
+// sends as much of queued reply as socket takes, returns 0 on error
+static int HTTPSelect_Flush(httpConn_t *c) {
+	char *smaller;
+	int sent;
+
+	while (c->txSent < c->txLen) {
+		sent = send(c->fd, c->tx + c->txSent, c->txLen - c->txSent, 0);
+		if (sent <= 0) {
+			if (sent < 0 && HTTP_SELECT_WOULDBLOCK()) {
+				return 1;
+			}
+			return 0;
+		}
+		c->txSent += sent;
+		c->lastActivity = g_timeMs;
+	}
+	c->txLen = c->txSent = 0;
+	// big reply is gone, give its memory back
+	if (c->txSize > HTTP_SELECT_TX_SIZE) {
+		smaller = (char*)realloc(c->tx, HTTP_SELECT_TX_SIZE);
+		if (smaller) {
+			c->tx = smaller;
+			c->txSize = HTTP_SELECT_TX_SIZE;
+		}
+	}
+	return 1;
+}
+
+// reply can't be sent, connection is closed without it
+static void HTTPSelect_DropReply(httpConn_t *c) {
+	c->state = HTTPCONN_CLOSING;
+	free(c->tx);
+	c->tx = 0;
+	c->txSize = c->txLen = c->txSent = 0;
+}
+
+// called by postany and HTTP_FinishResponse instead of send()
+static void HTTPSelect_Queue(http_request_t *request, const char *data, int len) {
+	httpConn_t *c = (httpConn_t*)request->serverData;
+	char *bigger;
+	int size;
+
+	if (c->tx == 0) {
+		// reply was dropped
+		return;
+	}
+	if (c->txLen + len > c->txSize) {
+		// socket may take some of it right away
+		if (!HTTPSelect_Flush(c)) {
+			HTTPSelect_DropReply(c);
+			return;
+		}
+		if (c->txSent) {
+			memmove(c->tx, c->tx + c->txSent, c->txLen - c->txSent);
+			c->txLen -= c->txSent;
+			c->txSent = 0;
+		}
+	}
+	if (c->txLen + len > c->txSize) {
+		// client is slower than reply, rest is sent when select() allows
+		size = c->txSize;
+		while (size < c->txLen + len) {
+			size += HTTP_SELECT_TX_SIZE;
+		}
+		bigger = 0;
+		if (size <= HTTP_SELECT_TX_MAX) {
+			bigger = (char*)realloc(c->tx, size);
+		}
+		if (bigger == 0) {
+			ADDLOG_ERROR(LOG_FEATURE_HTTP, "HTTP select: reply too big for slow client, dropped");
+			HTTPSelect_DropReply(c);
+			return;
+		}
+		c->tx = bigger;
+		c->txSize = size;
+	}
+	memcpy(c->tx + c->txLen, data, len);
+	c->txLen += len;
+}
+
+#if ENABLE_HTTP_EVENTS
+// event stream, socket goes to events module once its headers are sent
+static void HTTPSelect_Detach(httpConn_t *c) {
+	if (c->state == HTTPCONN_DETACH && c->txSent >= c->txLen) {
+		HTTPSelect_Release(c, !HTTP_Events_AddClient(c->fd));
+	}
+}
+#endif
+
+static void HTTPSelect_Accept(int listenFd) {
+	httpConn_t *c = 0;
+	int fd, i;
+
+	fd = accept(listenFd, NULL, NULL);
+	if (fd < 0) {
+		return;
+	}
+	for (i = 0; i < HTTP_SELECT_MAX_CLIENTS; i++) {
+		if (g_conns[i].state == HTTPCONN_FREE) {
+			c = &g_conns[i];
+			break;
+		}
+	}
+	if (c == 0) {
+		close(fd);
+		return;
+	}
+	c->rx = (char*)malloc(HTTP_SELECT_RX_SIZE + 1);
+	c->tx = (char*)malloc(HTTP_SELECT_TX_SIZE);
+	if (c->rx == 0 || c->tx == 0) {
+		ADDLOG_ERROR(LOG_FEATURE_HTTP, "HTTP select: no memory for client");
+		free(c->rx);
+		free(c->tx);
+		c->rx = c->tx = 0;
+		close(fd);
+		return;
+	}
+	lwip_fcntl(fd, F_SETFL, O_NONBLOCK);
+	c->fd = fd;
+	c->state = HTTPCONN_RECV;
+	c->rxLen = 0;
+	c->txSize = HTTP_SELECT_TX_SIZE;
+	c->txLen = c->txSent = 0;
+	c->numRequests = 0;
+	c->lastActivity = g_timeMs;
+}
+
+// whole body was given (or handler gave up), reply is queued and connection closed.
+// Returns 0 if handler is not ready to reply yet, it is asked again on next loop.
+static int HTTPSelect_EndBody(httpConn_t *c, int bFailed) {
+	http_request_t *r = c->stream;
+
+	if (!bFailed) {
+		r->reply = g_selectReply;
+		r->replylen = 0;
+		if (r->bodyCallback(r, 0, 0) > 0) {
+			return 0;
+		}
+	}
+	c->stream = 0;
+	HTTP_FinishResponse(r);
+	free(r);
+	c->state = HTTPCONN_CLOSING;
+	return 1;
+}
+
+// gives received part of request body to handler.
+// Returns 0 if handler is busy and did not take it, caller keeps the data.
+static int HTTPSelect_FeedBody(httpConn_t *c, const char *data, int len) {
+	http_request_t *r = c->stream;
+	int res;
+
+	if (c->bodyLeft >= 0 && len > c->bodyLeft) {
+		len = c->bodyLeft;
+	}
+	if (len > 0) {
+		// handler may reply with an error, so it gets the reply buffer
+		r->reply = g_selectReply;
+		r->replylen = 0;
+		res = r->bodyCallback(r, data, len);
+		if (res > 0) {
+			return 0;
+		}
+		if (res < 0) {
+			HTTPSelect_EndBody(c, 1);
+			return 1;
+		}
+		if (c->bodyLeft > 0) {
+			c->bodyLeft -= len;
+		}
+	}
+	if (c->bodyLeft == 0) {
+		HTTPSelect_EndBody(c, 0);
+	}
+	return 1;
+}
+
+// part of body (kept in rx buffer) or its end was deferred by handler, gives it again.
+// Returns 0 while handler is still busy.
+static int HTTPSelect_RetryBody(httpConn_t *c) {
+	if (c->rxLen > 0) {
+		if (!HTTPSelect_FeedBody(c, c->rx, c->rxLen)) {
+			return 0;
+		}
+		c->rxLen = 0;
+		c->lastActivity = g_timeMs;
+		return 1;
+	}
+	if (c->bodyLeft == 0) {
+		return HTTPSelect_EndBody(c, 0);
+	}
+	return 1;
+}
+
+// handler wants the body in parts, request is kept until body ends
+static void HTTPSelect_StartBody(httpConn_t *c, http_request_t *request) {
+	c->stream = (http_request_t*)malloc(sizeof(http_request_t));
+	if (c->stream == 0) {
+		request->bodyCallback(request, 0, -1);
+		HTTPSelect_DropReply(c);
+		return;
+	}
+	memcpy(c->stream, request, sizeof(http_request_t));
+	c->bodyLeft = -1;
+	if (request->contentLength >= 0) {
+		c->bodyLeft = request->contentLength;
+	}
+	c->state = HTTPCONN_BODY;
+	c->rxLen = 0;
+	// part of body came with headers
+	if (request->bodystart && request->bodylen > 0) {
+		if (!HTTPSelect_FeedBody(c, request->bodystart, request->bodylen)) {
+			// handler is busy, keep it for next loop
+			memmove(c->rx, request->bodystart, request->bodylen);
+			c->rxLen = request->bodylen;
+		}
+	}
+	else if (c->bodyLeft == 0) {
+		HTTPSelect_EndBody(c, 0);
+	}
+}
+
+// handles all complete requests in receive buffer
+static void HTTPSelect_ProcessRequests(httpConn_t *c) {
+	http_request_t request;
+	int reqLen;
+	int bIncomplete;
+	char saved;
+
+	memset(&request, 0, sizeof(request));
+	request.fd = c->fd;
+	request.reply = g_selectReply;
+	request.replymaxlen = HTTP_SELECT_REPLY_SIZE - 1;
+	request.receivedLenmax = HTTP_SELECT_RX_SIZE;
+	request.sendCallback = HTTPSelect_Queue;
+	request.serverData = c;
+
+	while (c->state == HTTPCONN_RECV && c->rxLen > 0) {
+		reqLen = HTTP_GetRequestLength(c->rx, c->rxLen);
+		bIncomplete = 0;
+		if (reqLen == 0) {
+			if (c->rxLen < HTTP_SELECT_RX_SIZE) {
+				// wait for rest of it
+				return;
+			}
+			// does not fit, handler may take the rest in parts, e.g. OTA
+			reqLen = c->rxLen;
+			bIncomplete = 1;
+		}
+		HTTP_ResetRequest(&request);
+		saved = c->rx[reqLen];
+		c->rx[reqLen] = 0;
+		request.received = c->rx;
+		request.receivedLen = reqLen;
+		request.keepAliveAllowed = !bIncomplete && c->numRequests + 1 < HTTP_KEEPALIVE_MAX_REQUESTS;
+		request.bStreamBody = bIncomplete;
+
+		HTTP_ProcessPacket(&request);
+		if (request.bodyCallback) {
+			HTTPSelect_StartBody(c, &request);
+			return;
+		}
+		if (!HTTP_FinishResponse(&request)) {
+			c->state = HTTPCONN_CLOSING;
+#if ENABLE_HTTP_EVENTS
+			if (request.bDetached && c->tx) {
+				// handed over when headers are sent
+				c->state = HTTPCONN_DETACH;
+				return;
+			}
+#endif
+		}
+		c->numRequests++;
+		c->rx[reqLen] = saved;
+		c->rxLen -= reqLen;
+		memmove(c->rx, c->rx + reqLen, c->rxLen);
+	}
+}
+
+static void HTTPSelect_Receive(httpConn_t *c) {
+	int len;
+
+	len = recv(c->fd, c->rx + c->rxLen, HTTP_SELECT_RX_SIZE - c->rxLen, 0);
+	if (len <= 0) {
+		if (len < 0 && HTTP_SELECT_WOULDBLOCK()) {
+			return;
+		}
+		// client has closed connection
+		if (c->state == HTTPCONN_BODY && c->bodyLeft < 0) {
+			// body without length ends here, reply may still get through
+			HTTPSelect_EndBody(c, 0);
+			HTTPSelect_Flush(c);
+		}
+		HTTPSelect_Close(c);
+		return;
+	}
+	c->lastActivity = g_timeMs;
+	if (c->state == HTTPCONN_BODY) {
+		// not read while a part is deferred, so rx buffer is empty here
+		if (!HTTPSelect_FeedBody(c, c->rx, len)) {
+			c->rxLen = len;
+		}
+	}
+	else {
+		c->rxLen += len;
+		c->rx[c->rxLen] = 0;
+		HTTPSelect_ProcessRequests(c);
+	}
+	// try to send it at once, select will take care of the rest
+	if (!HTTPSelect_Flush(c)) {
+		HTTPSelect_Close(c);
+		return;
+	}
+#if ENABLE_HTTP_EVENTS
+	HTTPSelect_Detach(c);
+#endif
+}
+
+void HTTPSelect_Run(int listenFd, int timeoutMs) {
+	fd_set readfds, writefds;
+	struct timeval tv;
+	httpConn_t *c;
+	int i, maxFd, bFree, bDeferred, res;
+
+	if (g_selectReply == 0) {
+		g_selectReply = (char*)malloc(HTTP_SELECT_REPLY_SIZE);
+		if (g_selectReply == 0) {
+			return;
+		}
+	}
+	FD_ZERO(&readfds);
+	FD_ZERO(&writefds);
+	maxFd = -1;
+	bFree = 0;
+	bDeferred = 0;
+	for (i = 0; i < HTTP_SELECT_MAX_CLIENTS; i++) {
+		c = &g_conns[i];
+		if (c->state == HTTPCONN_FREE) {
+			bFree = 1;
+			continue;
+		}
+		// idle or stalled client, including one that does not read its reply
+		if ((int)(g_timeMs - c->lastActivity) > HTTP_KEEPALIVE_TIMEOUT_MS) {
+			HTTPSelect_Close(c);
+			bFree = 1;
+			continue;
+		}
+		if (c->state == HTTPCONN_BODY && !HTTPSelect_RetryBody(c)) {
+			// handler is busy, client waits in its TCP window until it is not
+			bDeferred = 1;
+			continue;
+		}
+		if (c->txSent < c->txLen) {
+			FD_SET(c->fd, &writefds);
+		}
+		else if (c->state == HTTPCONN_CLOSING) {
+			// reply was sent
+			HTTPSelect_Close(c);
+			bFree = 1;
+			continue;
+		}
+#if ENABLE_HTTP_EVENTS
+		else if (c->state == HTTPCONN_DETACH) {
+			HTTPSelect_Detach(c);
+			bFree = 1;
+			continue;
+		}
+#endif
+		else {
+			FD_SET(c->fd, &readfds);
+		}
+		if (c->fd > maxFd) {
+			maxFd = c->fd;
+		}
+	}
+	// when all slots are busy, new clients wait in listen backlog
+	if (bFree && listenFd >= 0) {
+		FD_SET(listenFd, &readfds);
+		if (listenFd > maxFd) {
+			maxFd = listenFd;
+		}
+	}
+	if (maxFd < 0) {
+		return;
+	}
+	// deferred body is given again soon, without waiting for a socket
+	if (bDeferred && timeoutMs > HTTP_SELECT_RETRY_MS) {
+		timeoutMs = HTTP_SELECT_RETRY_MS;
+	}
+	tv.tv_sec = timeoutMs / 1000;
+	tv.tv_usec = (timeoutMs % 1000) * 1000;
+	res = select(maxFd + 1, &readfds, &writefds, NULL, &tv);
+	if (res <= 0) {
+		return;
+	}
+	for (i = 0; i < HTTP_SELECT_MAX_CLIENTS; i++) {
+		c = &g_conns[i];
+		if (c->state == HTTPCONN_FREE) {
+			continue;
+		}
+		if (FD_ISSET(c->fd, &writefds)) {
+			if (!HTTPSelect_Flush(c)) {
+				HTTPSelect_Close(c);
+			}
+#if ENABLE_HTTP_EVENTS
+			else {
+				HTTPSelect_Detach(c);
+			}
+#endif
+		}
+		else if (FD_ISSET(c->fd, &readfds)) {
+			HTTPSelect_Receive(c);
+		}
+	}
+	if (bFree && listenFd >= 0 && FD_ISSET(listenFd, &readfds)) {
+		HTTPSelect_Accept(listenFd);
+	}
+}
+
+int HTTPSelect_GetActiveClients() {
+	int i, r = 0;
+
+	for (i = 0; i < HTTP_SELECT_MAX_CLIENTS; i++) {
+		if (g_conns[i].state != HTTPCONN_FREE) {
+			r++;
+		}
+	}
+	return r;
+}
+
+#endif
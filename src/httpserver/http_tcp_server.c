@@ -18,18 +18,31 @@
 // See: https://github.com/openshwprojects/OpenBK7231T_App/issues/314
 #define HTTP_CLIENT_STACK_SIZE 8192
 
-#if PLATFORM_XR809 || PLATFORM_XR872
-
-#define DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT 1
-
-#endif
-
 static void tcp_server_thread(beken_thread_arg_t arg);
 static void tcp_client_thread(beken_thread_arg_t arg);
 
 
 xTaskHandle g_http_thread = NULL;
 
+// client threads alive, each holds a socket
+static int g_httpClients = 0;
+static SemaphoreHandle_t g_httpClientsMutex = 0;
+
+static void http_changeClients(int delta)
+{
+	if (xSemaphoreTake(g_httpClientsMutex, 100) == pdTRUE) {
+		g_httpClients += delta;
+		xSemaphoreGive(g_httpClientsMutex);
+	}
+}
+
+// idle keep-alive connection must not take the last socket,
+// one is for listening and one must stay for the next client
+static int http_has_free_slot()
+{
+	return g_httpClients < MEMP_NUM_TCP_PCB - 1;
+}
+
 void HTTPServer_Stop()
 {
 	OSStatus err = kNoErr;
@@ -57,11 +70,11 @@ static void tcp_client_thread(beken_thread_arg_t arg)
 	char* buf = NULL;
 	char* reply = NULL;
 	int replyBufferSize = REPLY_BUFFER_SIZE;
+	int bDetached = 0;
 	//int res;
 	//char reply[8192];
 
   //my_fd = fd;
-	rtos_delay_milliseconds(20);
 
 	reply = (char*)os_malloc(replyBufferSize);
 	buf = (char*)os_malloc(INCOMING_BUFFER_SIZE);
@@ -117,14 +130,8 @@ static void tcp_client_thread(beken_thread_arg_t arg)
 		goto exit;
 	}
 
-	//addLog( "TCP received string %s",buf );
-	// returns length to be sent if any
-	//ADDLOG_ERROR(LOG_FEATURE_HTTP,  "TCP will process packet of len %i", request.receivedLen );
-	int lenret = HTTP_ProcessPacket(&request);
-	if (lenret > 0) {
-		//ADDLOG_ERROR(LOG_FEATURE_HTTP, "TCP sending reply len %i", lenret);
-		send(fd, reply, lenret, 0);
-	}
+	// serve requests until client closes or connection is idle for too long
+	bDetached = HTTP_ServeConnection(&request, http_has_free_slot);
 
 	//rtos_delay_milliseconds(10);
 
@@ -137,13 +144,11 @@ exit:
 	if (reply != NULL)
 		os_free(reply);
 
-	lwip_close(fd);
-
-#if DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT
+	if (!bDetached)
+		lwip_close(fd);
+	http_changeClients(-1);
 
-#else
 	rtos_delete_thread(NULL);
-#endif
 }
 
 /* TCP server listener thread */
@@ -166,6 +171,18 @@ static void tcp_server_thread(beken_thread_arg_t arg)
 
 	err = listen(tcp_listen_fd, 0);
 
+	if (g_httpClientsMutex == 0) {
+		g_httpClientsMutex = xSemaphoreCreateMutex();
+	}
+
+#if ENABLE_HTTP_SELECT_SERVER
+	// no thread per client (XR809 fails to create them), so all clients
+	// are served from this thread, without blocking on any of them
+	while (1)
+	{
+		HTTPSelect_Run(tcp_listen_fd, 1000);
+	}
+#else
 	while (1)
 	{
 		FD_ZERO(&readfds);
@@ -179,19 +196,9 @@ static void tcp_server_thread(beken_thread_arg_t arg)
 			if (client_fd >= 0)
 			{
 #if PLATFORM_XR809
-#if DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT
-
-#else
 				OS_Thread_t clientThreadUnused;
-#endif
 #endif
 				strcpy(client_ip_str, inet_ntoa(client_addr.sin_addr));
-#if DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT
-				//ADDLOG_ERROR(LOG_FEATURE_HTTP, "HTTP [single thread] Client %s:%d connected, fd: %d", client_ip_str, client_addr.sin_port, client_fd);
-				// Use main server thread (blocking all other clients)
-				// right now, I am getting OS_ThreadCreate everytime on XR809 platform
-				tcp_client_thread((beken_thread_arg_t)client_fd);
-#else
 				//ADDLOG_ERROR(LOG_FEATURE_HTTP, "HTTP [multi thread] Client %s:%d connected, fd: %d", client_ip_str, client_addr.sin_port, client_fd);
 				// delay each accept by 20ms
 				// this allows previous to finish if
@@ -199,6 +206,7 @@ static void tcp_server_thread(beken_thread_arg_t arg)
 				// and we MUST get some IDLE thread time, else
 				// thread resources are not deleted.
 				rtos_delay_milliseconds(20);
+				http_changeClients(1);
 				// Create separate thread for client
 				if (kNoErr !=
 #if PLATFORM_XR809
@@ -221,12 +229,13 @@ static void tcp_server_thread(beken_thread_arg_t arg)
 				{
 					ADDLOG_DEBUG(LOG_FEATURE_HTTP, "TCP Client %s:%d thread creation failed! fd: %d", client_ip_str, client_addr.sin_port, client_fd);
 					lwip_close(client_fd);
+					http_changeClients(-1);
 					client_fd = -1;
 				}
-#endif
 			}
 		}
 	}
+#endif
 
 	if (err != kNoErr)
 		ADDLOG_ERROR(LOG_FEATURE_HTTP, "Server listener thread exit with err: %d", err);
@@ -1,3 +1,5 @@
 
 void HTTPServer_Start();
-void HTTPServer_Stop();
\ No newline at end of file
+void HTTPServer_Stop();
+// runs non-blocking server from quick tick
+void HTTPServer_RunQuickTick();
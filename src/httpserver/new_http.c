@@ -15,6 +15,20 @@
 // define the feature ADDLOGF_XXX will use
 #define LOG_FEATURE LOG_FEATURE_HTTP
 
+#if PLATFORM_BL602 || PLATFORM_BEKEN_NEW || PLATFORM_RTL8720D
+// these platforms send every postany at once, reply buffer is not used
+#define HTTP_DIRECT_SEND 1
+#else
+#define HTTP_DIRECT_SEND 0
+#endif
+
+#ifdef WINDOWS
+int g_httpBytesCopied = 0;
+#define HTTP_COUNT_COPY(n) g_httpBytesCopied += (n)
+#else
+#define HTTP_COUNT_COPY(n)
+#endif
+
 const char httpHeader[] = "HTTP/1.1 %d OK\nContent-type: %s";	// HTTP header
 const char httpMimeTypeHTML[] = "text/html";					// HTML MIME type
 const char httpMimeTypeText[] = "text/plain";					// TEXT MIME type
@@ -85,11 +99,35 @@ typedef struct http_callback_tag
 	int method;
 	http_callback_fn callback;
 	int auth_required;
+	// hash of first path segment of url
+	unsigned int segmentHash;
+	// index + 1 of next callback in the same bucket, 0 for last
+	int next;
 } http_callback_t;
 
 #define MAX_HTTP_CALLBACKS 32
+#define HTTP_CALLBACK_BUCKETS 16
 static http_callback_t *callbacks[MAX_HTTP_CALLBACKS];
 static int numCallbacks = 0;
+// index + 1 of first callback for each hash bucket, chains keep registration order
+static byte callbackBuckets[HTTP_CALLBACK_BUCKETS];
+
+// FNV-1a of URL path without query, optionally only up to first '/'
+static unsigned int http_hashUrl(const char *url, int bSegmentOnly)
+{
+	unsigned int h = 2166136261u;
+
+	while (*url != 0 && *url != '?' && *url != ' ')
+	{
+		if (bSegmentOnly && *url == '/')
+		{
+			break;
+		}
+		h = (h ^ (byte)*url) * 16777619u;
+		url++;
+	}
+	return h;
+}
 
 int HTTP_RegisterCallback(const char *url, int method, http_callback_fn callback, int auth_required)
 {
@@ -128,6 +166,24 @@ int HTTP_RegisterCallback(const char *url, int method, http_callback_fn callback
 	callbacks[numCallbacks]->callback = callback;
 	callbacks[numCallbacks]->method = method;
 	callbacks[numCallbacks]->auth_required = auth_required > 0 ? 1 : 0;
+	callbacks[numCallbacks]->segmentHash = http_hashUrl(url + 1, 1);
+	callbacks[numCallbacks]->next = 0;
+
+	// append to end of bucket chain
+	i = callbacks[numCallbacks]->segmentHash % HTTP_CALLBACK_BUCKETS;
+	if (callbackBuckets[i] == 0)
+	{
+		callbackBuckets[i] = numCallbacks + 1;
+	}
+	else
+	{
+		i = callbackBuckets[i] - 1;
+		while (callbacks[i]->next)
+		{
+			i = callbacks[i]->next - 1;
+		}
+		callbacks[i]->next = numCallbacks + 1;
+	}
 
 	numCallbacks++;
 
@@ -302,8 +358,37 @@ bool http_checkUrlBase(const char *base, const char *fileName)
 	return true;
 }
 
+// ends headers and decides how the reply is framed
+static void http_endHeaders(http_request_t *request, int bSentBefore)
+{
+	if (request->keepAlive && bSentBefore)
+	{
+		// something went out before headers, it can't be framed
+		request->keepAlive = 0;
+	}
+	if (request->keepAlive == 0)
+	{
+		poststr(request, "Connection: close");
+		poststr(request, "\r\n"); // end headers with double CRLF
+		poststr(request, "\r\n");
+		return;
+	}
+	hprintf255(request, "Connection: keep-alive\r\nKeep-Alive: timeout=%i, max=%i\r\n",
+		HTTP_KEEPALIVE_TIMEOUT_MS / 1000, HTTP_KEEPALIVE_MAX_REQUESTS);
+#if HTTP_DIRECT_SEND
+	// nothing is buffered, so length is never known in advance
+	poststr(request, "Transfer-Encoding: chunked\r\n\r\n");
+	request->bChunked = 1;
+#else
+	poststr(request, "\r\n");
+	request->headerEnd = request->replylen;
+#endif
+}
+
 void http_setup(http_request_t *request, const char *type)
 {
+	int bSentBefore = request->bSent || request->replylen;
+
 	hprintf255(request, httpHeader, request->responseCode, type);
 	poststr(request, "\r\n"); // next header
 	poststr(request, httpCorsHeaders);
@@ -321,21 +406,74 @@ void http_setup(http_request_t *request, const char *type)
 	poststr(request, "Transfer-Encoding: chunked");
 #endif
 	poststr(request, "\r\n");
-	poststr(request, "Connection: close");
-	poststr(request, "\r\n"); // end headers with double CRLF
-	poststr(request, "\r\n");
+	http_endHeaders(request, bSentBefore);
 }
 void http_setup_gz(http_request_t *request, const char *type)
 {
+	int bSentBefore = request->bSent || request->replylen;
+
 	hprintf255(request, httpHeader, request->responseCode, type);
 	poststr(request, "\r\n"); // next header
 	poststr(request, httpCorsHeaders);
 	poststr(request, "\r\n");
 	poststr(request, "Content-Encoding: gzip");
 	poststr(request, "\r\n");
-	poststr(request, "Connection: close");
-	poststr(request, "\r\n"); // end headers with double CRLF
+	http_endHeaders(request, bSentBefore);
+}
+// reply that browser may keep, etag must be quoted, e.g. "\"1a2b\""
+void http_setup_cached(http_request_t *request, const char *type, const char *etag, int maxAge, int bGzip)
+{
+	int bSentBefore = request->bSent || request->replylen;
+
+	hprintf255(request, httpHeader, request->responseCode, type);
+	poststr(request, "\r\n"); // next header
+	poststr(request, httpCorsHeaders);
 	poststr(request, "\r\n");
+	if (bGzip)
+	{
+		poststr(request, "Content-Encoding: gzip\r\n");
+	}
+	// pages and LFS files pick gzip or plain copy by Accept-Encoding, caches must not mix them
+	poststr(request, "Vary: Accept-Encoding\r\n");
+	hprintf255(request, "ETag: %s\r\nCache-Control: max-age=%i\r\n", etag, maxAge);
+	http_endHeaders(request, bSentBefore);
+}
+
+// value of request header, or 0 if not present
+const char *HTTP_GetHeader(http_request_t *request, const char *name)
+{
+	const char *v;
+	int i, len;
+
+	len = strlen(name);
+	for (i = 0; i < request->numheaders; i++)
+	{
+		if (!my_strnicmp(request->headers[i], name, len) && request->headers[i][len] == ':')
+		{
+			v = request->headers[i] + len + 1;
+			while (*v == ' ')
+			{
+				v++;
+			}
+			return v;
+		}
+	}
+	return 0;
+}
+
+int HTTP_AcceptsGzip(http_request_t *request)
+{
+	const char *v = HTTP_GetHeader(request, "Accept-Encoding");
+
+	return v && strstr(v, "gzip");
+}
+
+// If-None-Match lists etag that browser already has
+int HTTP_IsNotModified(http_request_t *request, const char *etag)
+{
+	const char *v = HTTP_GetHeader(request, "If-None-Match");
+
+	return v && strstr(v, etag);
 }
 
 void http_html_start(http_request_t *request, const char *pagename)
@@ -348,18 +486,27 @@ void http_html_start(http_request_t *request, const char *pagename)
 		hprintf255(request, " - %s", pagename);
 	}
 	poststr(request, "</title>");
-	poststr(request, htmlShortcutIcon);
+	poststr_const(request, htmlShortcutIcon);
 	poststr(request, htmlHeadMeta);
-	poststr(request, htmlHeadStyle);
+#if ENABLE_HTTP_STATIC_ASSETS
+	if (HTTP_AcceptsGzip(request))
+	{
+		hprintf255(request, "<link rel=\"stylesheet\" href=\"obk.css?v=%s\">", HTTP_Static_GetHash("obk.css"));
+	}
+	else
+#endif
+	{
+		poststr_const(request, htmlHeadStyle);
+	}
 	poststr(request, "</head>");
 	poststr(request, htmlBodyStart);
 	poststr(request, CFG_GetDeviceName());
 	poststr(request, htmlBodyStart2);
 }
 
-const char pageScriptPart1[] = "<script type='text/javascript'>var firstTime,lastTime,onlineFor,req=null,onlineForEl=null,getElement=e=>document.getElementById(e);function showState(){clearTimeout(firstTime),clearTimeout(lastTime),null!=req&&req.abort(),(e=getElement(\"state\"))&&((req=new XMLHttpRequest).onreadystatechange=()=>{4==req.readyState&&\"OK\"==req.statusText&&(\"SELECT\"!=document.activeElement.tagName&&(\"INPUT\"!=document.activeElement.tagName||\"number\"!=document.activeElement.type&&\"color\"!=document.activeElement.type)&&(e.innerHTML=req.responseText),clearTimeout(firstTime),clearTimeout(lastTime),lastTime=setTimeout(showState,";
-const char pageScriptPart2[] = "))},req.open(\"GET\",\"index?state=1\",!0),req.send()),firstTime=setTimeout(showState,";
-const char pageScriptPart3[] = ")}function fmtUpTime(e){var t,n,o=Math.floor(e/86400);return e%=86400,t=Math.floor(e/3600),e%=3600,n=Math.floor(e/60),e=e%60,0<o?o+` days, ${t} hours, ${n} minutes and ${e} seconds`:0<t?t+` hours, ${n} minutes and ${e} seconds`:0<n?n+` minutes and ${e} seconds`:`just ${e} seconds`}function updateOnlineFor(){onlineForEl.textContent=fmtUpTime(++onlineFor)}function onLoad(){(onlineForEl=getElement(\"onlineFor\"))&&(onlineFor=parseInt(onlineForEl.dataset.initial,10))&&setInterval(updateOnlineFor,1e3),showState()}function submitTemperature(e){var t=getElement(\"form132\");getElement(\"kelvin132\").value=Math.round(1e6/parseInt(e.value)),t.submit()}window.addEventListener(\"load\",onLoad),history.replaceState(null,\"\",window.location.pathname.slice(1)),setTimeout(()=>{var e=getElement(\"changed\");e&&(e.innerHTML=\"\")},5e3);</script>";
+// region_start pageScript
+const char pageScript[] = "<script type='text/javascript'>var firstTime,lastTime,onlineFor,evOpen=0,evReconnect=0,req=null,onlineForEl=null,getElement=e=>document.getElementById(e);function showState(){clearTimeout(firstTime),clearTimeout(lastTime),null!=req&&req.abort(),(e=getElement(\"state\"))&&((req=new XMLHttpRequest).onreadystatechange=()=>{4==req.readyState&&\"OK\"==req.statusText&&(\"SELECT\"!=document.activeElement.tagName&&(\"INPUT\"!=document.activeElement.tagName||\"number\"!=document.activeElement.type&&\"color\"!=document.activeElement.type)&&(e.innerHTML=req.responseText),clearTimeout(firstTime),clearTimeout(lastTime),evOpen||(lastTime=setTimeout(showState,refreshMs)))},req.open(\"GET\",\"index?state=1\",!0),req.send()),evOpen||(firstTime=setTimeout(showState,refreshMs))}function fmtUpTime(e){var t,n,o=Math.floor(e/86400);return e%=86400,t=Math.floor(e/3600),e%=3600,n=Math.floor(e/60),e=e%60,0<o?o+` days, ${t} hours, ${n} minutes and ${e} seconds`:0<t?t+` hours, ${n} minutes and ${e} seconds`:0<n?n+` minutes and ${e} seconds`:`just ${e} seconds`}function setPushedValue(e,t){var n;e!=document.activeElement&&(\"TD\"==e.tagName||\"submit\"==e.type?(n=0!=t!=(\"1\"==e.dataset.inv),\"TD\"==e.tagName?(e.className=n?\"on\":\"off\",e.textContent=n?\"ON\":\"OFF\"):e.className=n?\"bgrn\":\"bred\"):\"FORM\"==e.tagName?e.querySelectorAll(\"input[type=radio]\").forEach(e=>e.checked=e.value==t):\"SPAN\"==e.tagName?e.dataset.opts?e.textContent=e.dataset.opts.split(\"|\")[t]||t:e.textContent=(t/(e.dataset.div||1)).toFixed(e.dataset.dp||0):\"color\"==e.type?e.value=\"#\"+t:e.value=e.dataset.kelvin?Math.round(1e6/t):t)}function applyEvent(e){var t,n,o={ch:\"data-ch\",led:\"data-led\",en:\"data-en\"};for(t in o)for(n in e[t]||{})document.querySelectorAll(`[${o[t]}=\"${n}\"]`).forEach(r=>setPushedValue(r,e[t][n]))}function startEvents(){var e;window.EventSource&&getElement(\"state\")&&((e=new EventSource(\"sse\")).onopen=()=>{evOpen=1,evReconnect?showState():(clearTimeout(firstTime),clearTimeout(lastTime)),evReconnect=1},e.onmessage=e=>{applyEvent(JSON.parse(e.data))},e.onerror=()=>{evOpen&&(evOpen=0,showState())})}function updateOnlineFor(){onlineForEl.textContent=fmtUpTime(++onlineFor)}function onLoad(){(onlineForEl=getElement(\"onlineFor\"))&&(onlineFor=parseInt(onlineForEl.dataset.initial,10))&&setInterval(updateOnlineFor,1e3),showState(),startEvents()}function submitTemperature(e){var t=getElement(\"form132\");getElement(\"kelvin132\").value=Math.round(1e6/parseInt(e.value)),t.submit()}window.addEventListener(\"load\",onLoad),history.replaceState(null,\"\",window.location.pathname.slice(1)),setTimeout(()=>{var e=getElement(\"changed\");e&&(e.innerHTML=\"\")},5e3);</script>";
+// region_end pageScript
 
 void http_html_end(http_request_t *request)
 {
@@ -367,7 +514,7 @@ void http_html_end(http_request_t *request)
 	unsigned char mac[32];
 
 	poststr(request, " | ");
-	poststr(request, htmlFooterInfo);
+	poststr_const(request, htmlFooterInfo);
 	poststr(request, "<br>");
 	poststr(request, g_build_str);
 
@@ -384,11 +531,16 @@ void http_html_end(http_request_t *request)
 #endif
 
 	poststr(request, htmlBodyEnd);
-	poststr(request, pageScriptPart1);
-	hprintf255(request, "%i", g_indexAutoRefreshInterval);
-	poststr(request, pageScriptPart2);
-	hprintf255(request, "%i", g_indexAutoRefreshInterval);
-	poststr(request, pageScriptPart3);
+	hprintf255(request, "<script>var refreshMs=%i</script>", g_indexAutoRefreshInterval);
+#if ENABLE_HTTP_STATIC_ASSETS
+	if (HTTP_AcceptsGzip(request))
+	{
+		// cached by browser, see http_static.c
+		hprintf255(request, "<script src=\"obk.js?v=%s\"></script>", HTTP_Static_GetHash("obk.js"));
+		return;
+	}
+#endif
+	poststr_const(request, pageScript);
 }
 
 const char *http_checkArg(const char *p, const char *n)
@@ -664,13 +816,86 @@ void setupAllWB2SPinsAsButtons()
 	PIN_SetPinChannelForPinIndex(27, 1);
 }
 
+// all reply data goes through here, server may queue it instead of sending
+static void http_send(http_request_t *request, const char *data, int len)
+{
+	if (request->sendCallback)
+	{
+		request->sendCallback(request, data, len);
+		return;
+	}
+	send(request->fd, data, len, 0);
+}
+
+// sends part of reply body, as a chunk if reply is chunked
+static void http_sendBody(http_request_t *request, const char *data, int len)
+{
+	char tmp[256];
+	int hdrLen;
+
+	if (len <= 0)
+	{
+		return;
+	}
+	request->bSent = 1;
+	if (request->bChunked == 0)
+	{
+		http_send(request, data, len);
+		return;
+	}
+	hdrLen = sprintf(tmp, "%X\r\n", len);
+	// small chunks go in one packet
+	if (hdrLen + len + 2 <= (int)sizeof(tmp))
+	{
+		memcpy(tmp + hdrLen, data, len);
+		memcpy(tmp + hdrLen + len, "\r\n", 2);
+		http_send(request, tmp, hdrLen + len + 2);
+		return;
+	}
+	http_send(request, tmp, hdrLen);
+	http_send(request, data, len);
+	http_send(request, "\r\n", 2);
+}
+
+// sends reply buffer from given offset as body, const blocks go out in their place
+static void http_sendReplyBody(http_request_t *request, int from)
+{
+	httpConstBlock_t *b;
+	int i;
+
+	for (i = 0; i < request->numConstBlocks; i++)
+	{
+		b = &request->constBlocks[i];
+		http_sendBody(request, request->reply + from, b->offset - from);
+		http_sendBody(request, b->data, b->len);
+		from = b->offset;
+	}
+	http_sendBody(request, request->reply + from, request->replylen - from);
+	request->numConstBlocks = 0;
+	request->constLen = 0;
+}
+
+// reply does not fit into buffer, so Content-Length can't be used,
+// send headers with chunked encoding and buffered body as first chunk
+static void http_startChunked(http_request_t *request)
+{
+	static const char chunkedHeader[] = "Transfer-Encoding: chunked\r\n\r\n";
+
+	// headers end with empty line, replace it
+	http_send(request, request->reply, request->headerEnd - 2);
+	http_send(request, chunkedHeader, sizeof(chunkedHeader) - 1);
+	request->bSent = 1;
+	request->bChunked = 1;
+	http_sendReplyBody(request, request->headerEnd);
+}
+
 // add some more output safely, sending if necessary.
 // call with str == NULL to force send. - can be binary.
 // supply length
 int postany(http_request_t *request, const char *str, int len)
 {
-#if PLATFORM_BL602 || PLATFORM_BEKEN_NEW || PLATFORM_RTL8720D
-	send(request->fd, str, len, 0);
+#if HTTP_DIRECT_SEND
+	http_sendBody(request, str, len);
 	return 0;
 #else
 	int currentlen;
@@ -685,11 +910,13 @@ int postany(http_request_t *request, const char *str, int len)
 		{
 			return request->replylen;
 		}
-		if (request->replylen > 0)
+		// keep-alive reply is sent by HTTP_FinishResponse, when length is known
+		if (request->keepAlive && request->headerEnd && request->bChunked == 0)
 		{
-			// ADDLOG_ERROR(LOG_FEATURE_HTTP, "postany: send %i", request->replylen);
-			send(request->fd, request->reply, request->replylen, 0);
+			return 0;
 		}
+		// ADDLOG_ERROR(LOG_FEATURE_HTTP, "postany: send %i", request->replylen);
+		http_sendReplyBody(request, 0);
 		request->reply[0] = 0;
 		request->replylen = 0;
 		return 0;
@@ -699,21 +926,22 @@ int postany(http_request_t *request, const char *str, int len)
 	if (currentlen + addlen >= request->replymaxlen)
 	{
 		// ADDLOG_ERROR(LOG_FEATURE_HTTP, "postany: send %i", request->replylen);
-		send(request->fd, request->reply, request->replylen, 0);
+		if (request->keepAlive && request->headerEnd && request->bChunked == 0)
+		{
+			http_startChunked(request);
+		}
+		else
+		{
+			http_sendReplyBody(request, 0);
+		}
 		request->reply[0] = 0;
 		request->replylen = 0;
 		currentlen = 0;
 	}
 	while (addlen >= request->replymaxlen)
 	{
-		if (request->replylen > 0)
-		{
-			// ADDLOG_ERROR(LOG_FEATURE_HTTP, "postany: send %i", request->replylen);
-			send(request->fd, request->reply, request->replylen, 0);
-			request->replylen = 0;
-		}
 		// ADDLOG_ERROR(LOG_FEATURE_HTTP, "postany: send %i", (request->replymaxlen - 1));
-		send(request->fd, str, (request->replymaxlen - 1), 0);
+		http_sendBody(request, str, (request->replymaxlen - 1));
 		addlen -= (request->replymaxlen - 1);
 		str += (request->replymaxlen - 1);
 
@@ -721,11 +949,215 @@ int postany(http_request_t *request, const char *str, int len)
 	}
 
 	memcpy(request->reply + request->replylen, str, addlen);
+	HTTP_COUNT_COPY(addlen);
 	request->replylen += addlen;
 	return (currentlen + addlen);
 #endif
 }
 
+// like postany, but long data is not copied, only its place in reply is kept
+int postany_const(http_request_t *request, const char *str, int len)
+{
+#if HTTP_DIRECT_SEND
+	return postany(request, str, len);
+#else
+	httpConstBlock_t *b;
+
+	// faked local requests read whole reply from buffer,
+	// framed reply must have headers finished, blocks are counted as body
+	if (len < HTTP_CONST_MIN_LEN || request->numConstBlocks >= HTTP_MAX_CONST_BLOCKS
+		|| (request->fd == 0 && request->sendCallback == 0)
+		|| (request->keepAlive && request->headerEnd == 0))
+	{
+		return postany(request, str, len);
+	}
+	b = &request->constBlocks[request->numConstBlocks++];
+	b->data = str;
+	b->len = len;
+	b->offset = request->replylen;
+	request->constLen += len;
+	return request->replylen;
+#endif
+}
+
+int poststr_const(http_request_t *request, const char *str)
+{
+	return postany_const(request, str, strlen(str));
+}
+
+int HTTP_FinishResponse(http_request_t *request)
+{
+	char tmp[32];
+	int bodyLen, hdrLen;
+
+	if (request->keepAlive == 0 || (request->headerEnd == 0 && request->bChunked == 0))
+	{
+		// old style, connection close marks end of reply
+		http_sendReplyBody(request, 0);
+		request->replylen = 0;
+		return 0;
+	}
+	if (request->bChunked)
+	{
+		http_sendReplyBody(request, 0);
+		request->replylen = 0;
+		http_send(request, "0\r\n\r\n", 5);
+		return 1;
+	}
+	// whole reply is still in buffer, so add Content-Length before empty line
+	bodyLen = request->replylen - request->headerEnd + request->constLen;
+	hdrLen = sprintf(tmp, "Content-Length: %i\r\n", bodyLen);
+	if (request->numConstBlocks == 0 && request->replylen + hdrLen <= request->replymaxlen)
+	{
+		memmove(request->reply + request->headerEnd - 2 + hdrLen, request->reply + request->headerEnd - 2, bodyLen + 2);
+		memcpy(request->reply + request->headerEnd - 2, tmp, hdrLen);
+		http_send(request, request->reply, request->replylen + hdrLen);
+	}
+	else
+	{
+		http_send(request, request->reply, request->headerEnd - 2);
+		http_send(request, tmp, hdrLen);
+		http_sendReplyBody(request, request->headerEnd - 2);
+	}
+	request->replylen = 0;
+	return 1;
+}
+
+int HTTP_GetRequestLength(const char *buf, int len)
+{
+	const char *end;
+	const char *p;
+	int headerLen;
+	int contentLength = 0;
+
+	end = strstr(buf, "\r\n\r\n");
+	if (end == 0)
+	{
+		return 0;
+	}
+	headerLen = end - buf + 4;
+	p = buf;
+	while ((p = strchr(p, '\n')) != 0 && p < end)
+	{
+		p++;
+		if (!my_strnicmp(p, "Content-Length:", 15))
+		{
+			contentLength = atoi(p + 15);
+		}
+	}
+	if (contentLength < 0)
+	{
+		contentLength = 0;
+	}
+	if (headerLen + contentLength > len)
+	{
+		return 0;
+	}
+	return headerLen + contentLength;
+}
+
+void HTTP_ResetRequest(http_request_t *request)
+{
+	request->method = 0;
+	request->url = 0;
+	request->numqueryitems = 0;
+	request->numheaders = 0;
+	request->bodystart = 0;
+	request->bodylen = 0;
+	request->contentLength = -1;
+	request->responseCode = HTTP_RESPONSE_OK;
+	request->replylen = 0;
+	request->reply[0] = 0;
+	request->userCounter = 0;
+	request->keepAlive = 0;
+	request->headerEnd = 0;
+	request->bChunked = 0;
+	request->bSent = 0;
+	request->bDetached = 0;
+	request->numConstBlocks = 0;
+	request->constLen = 0;
+	request->bodyCallback = 0;
+	request->bodyContext = 0;
+}
+
+int HTTP_WaitForData(int fd, int timeoutMs)
+{
+	fd_set readfds;
+	struct timeval tv;
+
+	FD_ZERO(&readfds);
+	FD_SET(fd, &readfds);
+	tv.tv_sec = timeoutMs / 1000;
+	tv.tv_usec = (timeoutMs % 1000) * 1000;
+	return select(fd + 1, &readfds, NULL, NULL, &tv) > 0;
+}
+
+// Serves the requests already received into request->received, then
+// further ones on the same connection, until client closes it, goes idle
+// or keep-alive is refused. Shared by the thread per client servers.
+// canKeepAlive is asked before each reply (may be NULL).
+// Returns 1 if the socket was taken over by event stream and must stay open.
+int HTTP_ServeConnection(http_request_t *request, int (*canKeepAlive)())
+{
+	int numRequests = 0;
+	int total, reqLen, remaining, received;
+	char saved;
+
+	while (request->receivedLen > 0)
+	{
+		total = request->receivedLen;
+		reqLen = HTTP_GetRequestLength(request->received, total);
+		saved = 0;
+
+		HTTP_ResetRequest(request);
+		// incomplete request (e.g. OTA upload) is read further by handler, close after it
+		request->keepAliveAllowed = reqLen > 0 && numRequests + 1 < HTTP_KEEPALIVE_MAX_REQUESTS
+			&& (canKeepAlive == 0 || canKeepAlive());
+		if (reqLen > 0)
+		{
+			saved = request->received[reqLen];
+			request->received[reqLen] = 0;
+			request->receivedLen = reqLen;
+		}
+		else
+		{
+			reqLen = total;
+		}
+		HTTP_ProcessPacket(request);
+		if (!HTTP_FinishResponse(request))
+		{
+#if ENABLE_HTTP_EVENTS
+			// event stream keeps socket after the connection thread ends
+			return request->bDetached && HTTP_Events_AddClient(request->fd);
+#else
+			return 0;
+#endif
+		}
+		numRequests++;
+		// keep pipelined data
+		request->received[reqLen] = saved;
+		total -= reqLen;
+		memmove(request->received, request->received + reqLen, total + 1);
+		request->receivedLen = total;
+		while (HTTP_GetRequestLength(request->received, request->receivedLen) == 0)
+		{
+			remaining = request->receivedLenmax - request->receivedLen;
+			if (remaining <= 0 || !HTTP_WaitForData(request->fd, HTTP_KEEPALIVE_TIMEOUT_MS))
+			{
+				return 0;
+			}
+			received = recv(request->fd, request->received + request->receivedLen, remaining, 0);
+			if (received <= 0)
+			{
+				return 0;
+			}
+			request->receivedLen += received;
+			request->received[request->receivedLen] = 0;
+		}
+	}
+	return 0;
+}
+
 // add some more output safely, sending if necessary.
 // call with str == NULL to force send.
 int poststr(http_request_t *request, const char *str)
@@ -740,26 +1172,223 @@ int poststr(http_request_t *request, const char *str)
 int hprintf255(http_request_t *request, const char *fmt, ...)
 {
 	va_list argList;
-	// BaseType_t taken;
 	char tmp[256];
-	memset(tmp, 0, sizeof(tmp));
+	int len;
+
+#if !HTTP_DIRECT_SEND
+	// enough room, format right into reply buffer
+	if (request->replylen + 256 < request->replymaxlen)
+	{
+		va_start(argList, fmt);
+		len = vsnprintf(request->reply + request->replylen, 255, fmt, argList);
+		va_end(argList);
+		if (len < 0)
+		{
+			len = 0;
+		}
+		else if (len > 254)
+		{
+			len = 254;
+		}
+		HTTP_COUNT_COPY(len);
+		request->replylen += len;
+		return request->replylen;
+	}
+#endif
 	va_start(argList, fmt);
-	vsnprintf(tmp, 255, fmt, argList);
+	len = vsnprintf(tmp, 255, fmt, argList);
 	va_end(argList);
-	return postany(request, tmp, strlen(tmp));
+	if (len < 0)
+	{
+		len = 0;
+	}
+	else if (len > 254)
+	{
+		len = 254;
+	}
+	// postany counts the copy
+	return postany(request, tmp, len);
 }
 
 int HUE_APICall(http_request_t *request);
 
+#if (ENABLE_DRIVER_DS1820_FULL)
+// including "../driver/drv_ds1820_simple.h" will complain about typedefs not used here
+// so lets declare it "extern"
+extern int http_fn_cfg_ds18b20(http_request_t *request);
+#endif
+
+// built-in pages, matched by whole path, query string is ignored
+static const httpRoute_t g_httpPages[] = {
+	{ "", http_fn_empty_url, 0 },
+	{ "testmsg", http_fn_testmsg, 0 },
+	{ "index", http_fn_index, 0 },
+	{ "about", http_fn_about, 0 },
+#if ENABLE_HTTP_MQTT
+	{ "cfg_mqtt", http_fn_cfg_mqtt, 0 },
+	{ "cfg_mqtt_set", http_fn_cfg_mqtt_set, 0 },
+#endif
+#if ENABLE_HTTP_IP
+	{ "cfg_ip", http_fn_cfg_ip, 0 },
+#endif
+#if (ENABLE_DRIVER_DS1820_FULL)
+	{ "cfg_ds18b20", http_fn_cfg_ds18b20, 0 },
+#endif
+#if ENABLE_HTTP_WEBAPP
+	{ "cfg_webapp", http_fn_cfg_webapp, 0 },
+	{ "cfg_webapp_set", http_fn_cfg_webapp_set, 0 },
+#endif
+	{ "cfg_wifi", http_fn_cfg_wifi, 0 },
+#if ENABLE_HTTP_NAMES
+	{ "cfg_name", http_fn_cfg_name, 0 },
+#endif
+	{ "cfg_wifi_set", http_fn_cfg_wifi_set, 0 },
+	{ "cfg_loglevel_set", http_fn_cfg_loglevel_set, 0 },
+#if ENABLE_HTTP_MAC
+	{ "cfg_mac", http_fn_cfg_mac, 0 },
+#endif
+	{ "cmd_tool", http_fn_cmd_tool, 0 },
+#if ENABLE_HTTP_STARTUP
+	{ "startup_command", http_fn_startup_command, 0 },
+#endif
+#if ENABLE_HTTP_FLAGS
+	{ "cfg_generic", http_fn_cfg_generic, 0 },
+#endif
+#if ENABLE_HTTP_STARTUP
+	{ "cfg_startup", http_fn_cfg_startup, 0 },
+#endif
+#if ENABLE_HTTP_DGR
+	{ "cfg_dgr", http_fn_cfg_dgr, 0 },
+#endif
+#if ENABLE_HA_DISCOVERY
+	{ "ha_cfg", http_fn_ha_cfg, 0 },
+	{ "ha_discovery", http_fn_ha_discovery, 0 },
+#endif
+	{ "cfg", http_fn_cfg, 0 },
+	{ "cfg_pins", http_fn_cfg_pins, 0 },
+#if ENABLE_HTTP_PING
+	{ "cfg_ping", http_fn_cfg_ping, 0 },
+#endif
+	{ "ota", http_fn_ota, 0 },
+	{ "ota_exec", http_fn_ota_exec, 0 },
+	{ "cm", http_fn_cm, 0 },
+#if ENABLE_TIME_PMNTP
+	{ "pmntp", http_fn_pmntp, 0 }, // poor mans NTP
+#endif
+};
+static httpRouteTable_t g_httpPageTable = HTTP_ROUTE_TABLE(g_httpPages);
+
+void HTTP_BuildRouteHash(httpRouteTable_t *table)
+{
+	int i, slot;
+
+	// simulator restarts call init again, lookups may be running meanwhile
+	if (table->bReady)
+	{
+		return;
+	}
+	memset(table->hash, 0, sizeof(table->hash));
+	for (i = 0; i < table->count; i++)
+	{
+		if (table->routes[i].bPrefix)
+		{
+			continue;
+		}
+		// open addressing, table is never full as routes are far fewer than slots
+		slot = http_hashUrl(table->routes[i].name, 0) % HTTP_ROUTE_HASH_SIZE;
+		while (table->hash[slot])
+		{
+			slot = (slot + 1) % HTTP_ROUTE_HASH_SIZE;
+		}
+		table->hash[slot] = i + 1;
+	}
+	table->bReady = 1;
+}
+
+const httpRoute_t *HTTP_FindRoute(httpRouteTable_t *table, const char *url)
+{
+	const httpRoute_t *r;
+	int i, slot;
+
+	slot = http_hashUrl(url, 0) % HTTP_ROUTE_HASH_SIZE;
+	while (table->hash[slot])
+	{
+		r = &table->routes[table->hash[slot] - 1];
+		if (http_checkUrlBase(url, r->name))
+		{
+			return r;
+		}
+		slot = (slot + 1) % HTTP_ROUTE_HASH_SIZE;
+	}
+	// there are only a few prefix routes
+	for (i = 0; i < table->count; i++)
+	{
+		r = &table->routes[i];
+		if (r->bPrefix && http_startsWith(url, r->name))
+		{
+			return r;
+		}
+	}
+	return 0;
+}
+
+void HTTP_Init()
+{
+	HTTP_BuildRouteHash(&g_httpPageTable);
+}
+
+static http_callback_t *http_findCallback(const char *url, int method)
+{
+	http_callback_t *cb;
+	unsigned int h;
+	int i;
+
+	h = http_hashUrl(url, 1);
+	for (i = callbackBuckets[h % HTTP_CALLBACK_BUCKETS]; i; i = cb->next)
+	{
+		cb = callbacks[i - 1];
+		if (cb->segmentHash != h || !http_startsWith(url, &cb->url[1]))
+		{
+			continue;
+		}
+		if (cb->method == HTTP_ANY || cb->method == method)
+		{
+			return cb;
+		}
+	}
+	return 0;
+}
+
+http_callback_fn HTTP_FindHandler(const char *url, int method)
+{
+	http_callback_t *cb;
+	const httpRoute_t *route;
+
+	cb = http_findCallback(url, method);
+	if (cb)
+	{
+		return cb->callback;
+	}
+	route = HTTP_FindRoute(&g_httpPageTable, url);
+	if (route)
+	{
+		return route->callback;
+	}
+	return http_fn_other;
+}
+
 int HTTP_ProcessPacket(http_request_t *request)
 {
 	int i;
+	http_callback_t *cb;
+	const httpRoute_t *route;
 	char *p;
 	char *headers;
 	char *protocol;
 	// int bChanged = 0;
 	char *urlStr = "";
 	char *recvbuf;
+	int bWantKeepAlive;
 
 	if (request->received == 0)
 	{
@@ -767,6 +1396,7 @@ int HTTP_ProcessPacket(http_request_t *request)
 		return 0;
 	}
 	request->method = -1;
+	request->keepAlive = 0;
 	recvbuf = request->received;
 	for (i = 0; i < sizeof(methodNames) / sizeof(*methodNames); i++)
 	{
@@ -846,6 +1476,8 @@ int HTTP_ProcessPacket(http_request_t *request)
 			return 0;
 		}
 	}
+	// HTTP/1.1 connections are persistent unless client says otherwise
+	bWantKeepAlive = !strcmp(protocol, "HTTP/1.1");
 	// i.e. not received
 	request->contentLength = -1;
 	headers = p;
@@ -868,6 +1500,16 @@ int HTTP_ProcessPacket(http_request_t *request)
 					{
 						request->contentLength = atoi(headers + 15);
 					}
+					else if (!my_strnicmp(headers, "Connection:", 11))
+					{
+						char *v = headers + 11;
+						while (*v == ' ')
+							v++;
+						if (!my_strnicmp(v, "keep-alive", 10))
+							bWantKeepAlive = 1;
+						else if (!my_strnicmp(v, "close", 5))
+							bWantKeepAlive = 0;
+					}
 
 					*p = 0;
 					p++; // past \r
@@ -890,6 +1532,8 @@ int HTTP_ProcessPacket(http_request_t *request)
 		} while (1);
 	}
 
+	request->keepAlive = request->keepAliveAllowed && bWantKeepAlive;
+
 	if (p == 0)
 	{
 		request->bodystart = 0;
@@ -915,21 +1559,14 @@ int HTTP_ProcessPacket(http_request_t *request)
 #endif
 
 	// look for a callback with this URL and method, or HTTP_ANY
-	for (i = 0; i < numCallbacks; i++)
+	cb = http_findCallback(urlStr, request->method);
+	if (cb)
 	{
-		char *url = callbacks[i]->url;
-		if (http_startsWith(urlStr, &url[1]))
+		if (cb->auth_required > 0 && http_basic_auth_run(request) == HTTP_BASIC_AUTH_FAIL)
 		{
-			int method = callbacks[i]->method;
-			if (method == HTTP_ANY || method == request->method)
-			{
-				if (callbacks[i]->auth_required > 0 && http_basic_auth_run(request) == HTTP_BASIC_AUTH_FAIL)
-				{
-					return 0;
-				}
-				return callbacks[i]->callback(request);
-			}
+			return 0;
 		}
+		return cb->callback(request);
 	}
 
 	if (http_basic_auth_run(request) == HTTP_BASIC_AUTH_FAIL)
@@ -950,104 +1587,11 @@ int HTTP_ProcessPacket(http_request_t *request)
 	}
 #endif
 
-	if (http_checkUrlBase(urlStr, ""))
-		return http_fn_empty_url(request);
-
-	if (http_checkUrlBase(urlStr, "testmsg"))
-		return http_fn_testmsg(request);
-	if (http_checkUrlBase(urlStr, "index"))
-		return http_fn_index(request);
-
-	if (http_checkUrlBase(urlStr, "about"))
-		return http_fn_about(request);
-
-#if ENABLE_HTTP_MQTT
-	if (http_checkUrlBase(urlStr, "cfg_mqtt"))
-		return http_fn_cfg_mqtt(request);
-	if (http_checkUrlBase(urlStr, "cfg_mqtt_set"))
-		return http_fn_cfg_mqtt_set(request);
-#endif
-#if ENABLE_HTTP_IP
-	if (http_checkUrlBase(urlStr, "cfg_ip"))
-		return http_fn_cfg_ip(request);
-#endif
-#if (ENABLE_DRIVER_DS1820_FULL)
-	// including "../driver/drv_ds1820_simple.h" will complain about typedefs not used here
-	// so lets declare it "extern"
-	extern int http_fn_cfg_ds18b20(http_request_t * request);
-	if (http_checkUrlBase(urlStr, "cfg_ds18b20"))
-		return http_fn_cfg_ds18b20(request);
-#endif
-
-#if ENABLE_HTTP_WEBAPP
-	if (http_checkUrlBase(urlStr, "cfg_webapp"))
-		return http_fn_cfg_webapp(request);
-	if (http_checkUrlBase(urlStr, "cfg_webapp_set"))
-		return http_fn_cfg_webapp_set(request);
-#endif
-
-	if (http_checkUrlBase(urlStr, "cfg_wifi"))
-		return http_fn_cfg_wifi(request);
-#if ENABLE_HTTP_NAMES
-	if (http_checkUrlBase(urlStr, "cfg_name"))
-		return http_fn_cfg_name(request);
-#endif
-	if (http_checkUrlBase(urlStr, "cfg_wifi_set"))
-		return http_fn_cfg_wifi_set(request);
-
-	if (http_checkUrlBase(urlStr, "cfg_loglevel_set"))
-		return http_fn_cfg_loglevel_set(request);
-#if ENABLE_HTTP_MAC
-	if (http_checkUrlBase(urlStr, "cfg_mac"))
-		return http_fn_cfg_mac(request);
-#endif
-	if (http_checkUrlBase(urlStr, "cmd_tool"))
-		return http_fn_cmd_tool(request);
-
-#if ENABLE_HTTP_STARTUP
-	if (http_checkUrlBase(urlStr, "startup_command"))
-		return http_fn_startup_command(request);
-#endif
-#if ENABLE_HTTP_FLAGS
-	if (http_checkUrlBase(urlStr, "cfg_generic"))
-		return http_fn_cfg_generic(request);
-#endif
-#if ENABLE_HTTP_STARTUP
-	if (http_checkUrlBase(urlStr, "cfg_startup"))
-		return http_fn_cfg_startup(request);
-#endif
-#if ENABLE_HTTP_DGR
-	if (http_checkUrlBase(urlStr, "cfg_dgr"))
-		return http_fn_cfg_dgr(request);
-#endif
-
-#if ENABLE_HA_DISCOVERY
-	if (http_checkUrlBase(urlStr, "ha_cfg"))
-		return http_fn_ha_cfg(request);
-	if (http_checkUrlBase(urlStr, "ha_discovery"))
-		return http_fn_ha_discovery(request);
-#endif
-	if (http_checkUrlBase(urlStr, "cfg"))
-		return http_fn_cfg(request);
-
-	if (http_checkUrlBase(urlStr, "cfg_pins"))
-		return http_fn_cfg_pins(request);
-#if ENABLE_HTTP_PING
-	if (http_checkUrlBase(urlStr, "cfg_ping"))
-		return http_fn_cfg_ping(request);
-#endif
-
-	if (http_checkUrlBase(urlStr, "ota"))
-		return http_fn_ota(request);
-	if (http_checkUrlBase(urlStr, "ota_exec"))
-		return http_fn_ota_exec(request);
-	if (http_checkUrlBase(urlStr, "cm"))
-		return http_fn_cm(request);
-
-#if ENABLE_TIME_PMNTP
-	if (http_checkUrlBase(urlStr, "pmntp"))
-		return http_fn_pmntp(request); // poor mans NTP
-#endif
+	route = HTTP_FindRoute(&g_httpPageTable, urlStr);
+	if (route)
+	{
+		return route->callback(request);
+	}
 	return http_fn_other(request);
 }
 
@@ -28,11 +28,28 @@ extern const char pageScript[];
 extern const char ha_discovery_script[];
 
 #define HTTP_RESPONSE_OK 200
+#define HTTP_RESPONSE_NOT_MODIFIED 304
 #define HTTP_RESPONSE_NOT_FOUND 404
 #define HTTP_RESPONSE_SERVER_ERROR 500
+#define HTTP_RESPONSE_SERVICE_UNAVAILABLE 503
 
 #define MAX_QUERY 16
 #define MAX_HEADERS 16
+
+// persistent connections, idle connection is closed after timeout
+#define HTTP_KEEPALIVE_TIMEOUT_MS 5000
+#define HTTP_KEEPALIVE_MAX_REQUESTS 32
+// const strings at least this long are sent from where they are, not copied to reply
+#define HTTP_CONST_MIN_LEN 256
+#define HTTP_MAX_CONST_BLOCKS 8
+
+// const data that goes out at given offset of reply buffer
+typedef struct httpConstBlock_s {
+	const char* data;
+	int len;
+	int offset;
+} httpConstBlock_t;
+
 typedef struct http_request_tag {
 	char* received; // partial or whole received data, up to 1024
 	int receivedLen;
@@ -59,18 +76,89 @@ typedef struct http_request_tag {
 
 	// user variables used to build JSON data
 	int userCounter;
+
+	// set by server if connection may stay open after this request
+	int keepAliveAllowed;
+	// filled by HTTP_ProcessPacket, client wants a persistent connection
+	int keepAlive;
+	// offset of body in reply, set by http_setup, 0 for unframed replies
+	int headerEnd;
+	// reply did not fit into buffer and is sent in chunks
+	int bChunked;
+	// part of reply was already sent
+	int bSent;
+	// handler keeps the socket (event stream), server must not close it
+	int bDetached;
+	// queued by postany_const, sent together with reply buffer
+	int numConstBlocks;
+	int constLen;
+	httpConstBlock_t constBlocks[HTTP_MAX_CONST_BLOCKS];
+	// if set, reply data is given to server instead of send() on fd
+	void (*sendCallback)(struct http_request_tag* request, const char* data, int len);
+	void* serverData;
+	// set by server if body that did not fit is given to bodyCallback
+	// as it arrives, instead of being read by handler with recv()
+	int bStreamBody;
+	// set by handler in stream mode, instead of replying. Called for each part
+	// of body (only data given to it is valid, not url or headers), then with
+	// len 0 at the end to write reply, or with len -1 if client is gone.
+	// Returns < 0 to stop after writing error reply, it is not called again.
+	// Returns > 0 without writing anything if it can't take the part (or end)
+	// yet; server stops reading from client and gives the same data again
+	// on a later loop, or len -1 if it stays busy past the keep-alive timeout.
+	int (*bodyCallback)(struct http_request_tag* request, const char* data, int len);
+	void* bodyContext;
 } http_request_t;
 
 
 int HTTP_ProcessPacket(http_request_t* request);
+// length of first complete request in buffer, 0 if more data is needed
+int HTTP_GetRequestLength(const char* buf, int len);
+// clears per-request state before next request on the same connection
+void HTTP_ResetRequest(http_request_t* request);
+// sends rest of reply, returns 1 if connection can be kept open
+int HTTP_FinishResponse(http_request_t* request);
+// waits for incoming data on idle connection, returns 0 on timeout
+int HTTP_WaitForData(int fd, int timeoutMs);
+// keep-alive request loop of thread per client servers,
+// returns 1 if socket was detached and must not be closed
+int HTTP_ServeConnection(http_request_t* request, int (*canKeepAlive)());
+// select() based server, serves all clients from the calling thread
+void HTTPSelect_Run(int listenFd, int timeoutMs);
+void HTTPSelect_CloseAll();
+int HTTPSelect_GetActiveClients();
+// Server-Sent Events push of channel/LED/energy changes
+void HTTP_Events_Init();
+void HTTP_Events_OnChannelChanged(int ch);
+void HTTP_Events_RunQuickTick();
+// takes over socket of detached request, returns 0 if there is no free slot
+int HTTP_Events_AddClient(int fd);
+int HTTP_Events_GetClients();
+void HTTP_Events_CloseAll();
+// pre-compressed CSS/JS of the pages, see http_static.c
+void HTTP_Static_Init();
+// content hash of asset, used as version in its URL
+const char* HTTP_Static_GetHash(const char* name);
+int HTTP_Static_GetRawLength(const char* name);
 void http_setup(http_request_t* request, const char* type);
 void http_setup_gz(http_request_t* request, const char* type);
+void http_setup_cached(http_request_t* request, const char* type, const char* etag, int maxAge, int bGzip);
+const char* HTTP_GetHeader(http_request_t* request, const char* name);
+int HTTP_AcceptsGzip(http_request_t* request);
+int HTTP_IsNotModified(http_request_t* request, const char* etag);
 void http_html_start(http_request_t* request, const char* pagename);
 void http_html_end(http_request_t* request);
 int poststr(http_request_t* request, const char* str);
 void poststr_escaped(http_request_t* request, char* str);
 void poststr_escapedForJSON(http_request_t* request, char* str);
 int postany(http_request_t* request, const char* str, int len);
+// for data that stays valid until reply is sent, e.g. const strings in flash
+int postany_const(http_request_t* request, const char* str, int len);
+int poststr_const(http_request_t* request, const char* str);
+#ifdef WINDOWS
+// bytes copied into reply buffers, for measurements in simulator
+extern int g_httpBytesCopied;
+#endif
 void misc_formatUpTimeString(int totalSeconds, char* o);
 // void HTTP_AddBuildFooter(http_request_t *request);
 // void HTTP_AddHeader(http_request_t *request);
@@ -92,9 +180,38 @@ typedef enum {
 // callback function for http
 typedef int (*http_callback_fn)(http_request_t* request);
 // url MUST start with '/'
-// urls must be unique (i.e. you can't have /about and /aboutme or /about/me)
+// url is a prefix that must end on path segment, so /about matches /about?x but not /aboutme
+// urls must be unique (i.e. you can't have /about and /about/me)
 int HTTP_RegisterCallback(const char* url, int method, http_callback_fn callback, int auth_required);
 
+// built-in route, URL is matched without query string
+typedef struct httpRoute_s {
+	const char* name;
+	http_callback_fn callback;
+	// name is only a prefix, e.g. "lfs/" matches "lfs/file.txt"
+	int bPrefix;
+} httpRoute_t;
+
+#define HTTP_ROUTE_HASH_SIZE 64
+
+// hash index is built by HTTP_BuildRouteHash at init, before server threads start
+typedef struct httpRouteTable_s {
+	const httpRoute_t* routes;
+	int count;
+	// route index + 1, 0 for empty slot
+	unsigned char hash[HTTP_ROUTE_HASH_SIZE];
+	unsigned char bReady;
+} httpRouteTable_t;
+
+#define HTTP_ROUTE_TABLE(list) { .routes = list, .count = sizeof(list) / sizeof(list[0]) }
+
+void HTTP_BuildRouteHash(httpRouteTable_t* table);
+const httpRoute_t* HTTP_FindRoute(httpRouteTable_t* table, const char* url);
+// builds built-in page index, call before HTTPServer_Start
+void HTTP_Init();
+// handler that HTTP_ProcessPacket would call for url, without calling it
+http_callback_fn HTTP_FindHandler(const char* url, int method);
+
 int my_strnicmp(const char* a, const char* b, int len);
 
 int http_rest_error(http_request_t* request, int code, char* msg);
@@ -52,12 +52,26 @@ static tcp_thread_t sock[MAX_SOCKETS_TCP - 1] =
 	[0 ... MAX_SOCKETS_TCP - 2] = { -1, NULL, false },
 };
 
+// idle keep-alive connection must not take the last slot
+static int tcp_has_free_slot()
+{
+	for(int i = 0; i < max_socks; ++i)
+	{
+		if(sock[i].fd == INVALID_SOCK)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 static void tcp_client_thread(tcp_thread_t* arg)
 {
 	int fd = arg->fd;
 	char* buf = NULL;
 	char* reply = NULL;
 	int replyBufferSize = REPLY_BUFFER_SIZE;
+	bool bDetached = false;
 
 	reply = (char*)os_malloc(replyBufferSize);
 	buf = (char*)os_malloc(INCOMING_BUFFER_SIZE);
@@ -116,15 +130,8 @@ static void tcp_client_thread(tcp_thread_t* arg)
 		goto exit;
 	}
 
-	//addLog( "TCP received string %s",buf );
-	// returns length to be sent if any
-	 // ADDLOG_DEBUG(LOG_FEATURE_HTTP,  "TCP will process packet of len %i", request.receivedLen );
-	int lenret = HTTP_ProcessPacket(&request);
-	if(lenret > 0)
-	{
-		ADDLOG_DEBUG(LOG_FEATURE_HTTP, "TCP sending reply len %i", lenret);
-		send(fd, reply, lenret, 0);
-	}
+	// serve requests until client closes or connection is idle for too long
+	bDetached = HTTP_ServeConnection(&request, tcp_has_free_slot);
 
 exit:
 	if(buf != NULL)
@@ -132,7 +139,8 @@ exit:
 	if(reply != NULL)
 		os_free(reply);
 
-	lwip_close(fd);
+	if(!bDetached)
+		lwip_close(fd);
 	arg->isCompleted = true;
 #if PLATFORM_RDA5981
 	arg->thread = NULL;
@@ -311,7 +319,6 @@ static void tcp_server_thread(beken_thread_arg_t arg)
 			{
 				//ADDLOG_EXTRADEBUG(LOG_FEATURE_HTTP, "[sock=%d]: Connection accepted from IP:%s", sock[new_idx].fd, get_clientaddr(&source_addr));
 
-				rtos_delay_milliseconds(20);
 				if(kNoErr != rtos_create_thread(&sock[new_idx].thread,
 					BEKEN_APPLICATION_PRIORITY,
 					"HTTP Client",
@@ -326,7 +333,11 @@ static void tcp_server_thread(beken_thread_arg_t arg)
 				}
 			}
 		}
-		rtos_delay_milliseconds(10);
+		else
+		{
+			// all slots busy, wait for a client to finish
+			rtos_delay_milliseconds(10);
+		}
 	}
 
 error:
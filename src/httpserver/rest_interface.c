@@ -32,6 +32,9 @@ extern uint8_t flash_size_8720;
 #ifndef OBK_DISABLE_ALL_DRIVERS
 #include "../driver/drv_local.h"
 #endif
+#if ENABLE_MQTT
+#include "../mqtt/new_mqtt.h"
+#endif
 
 #define MAX_JSON_VALUE_LENGTH   128
 
@@ -40,6 +43,8 @@ int http_rest_error(http_request_t* request, int code, char* msg);
 
 static int http_rest_get(http_request_t* request);
 static int http_rest_post(http_request_t* request);
+static httpRouteTable_t g_restGetTable;
+static httpRouteTable_t g_restPostTable;
 static int http_rest_app(http_request_t* request);
 
 static int http_rest_post_pins(http_request_t* request);
@@ -76,6 +81,8 @@ static int http_rest_post_cmd(http_request_t* request);
 
 
 void init_rest() {
+	HTTP_BuildRouteHash(&g_restGetTable);
+	HTTP_BuildRouteHash(&g_restPostTable);
 	HTTP_RegisterCallback("/api/", HTTP_GET, http_rest_get, 1);
 	HTTP_RegisterCallback("/api/", HTTP_POST, http_rest_post, 1);
 	HTTP_RegisterCallback("/app", HTTP_GET, http_rest_app, 1);
@@ -100,71 +107,56 @@ bool tryGetTokenString(const char* json, jsmntok_t* tok, char* outBuffer) {
 	return true;
 }
 
-static int http_rest_get(http_request_t* request) {
-	ADDLOG_DEBUG(LOG_FEATURE_API, "GET of %s", request->url);
+#if ENABLE_LITTLEFS
+static int http_rest_get_fsblock(http_request_t* request) {
+	uint32_t newsize = CFG_GetLFS_Size();
+	uint32_t newstart = (LFS_BLOCKS_END - newsize);
 
-	if (!strcmp(request->url, "api/channels")) {
-		return http_rest_get_channels(request);
-	}
+	newsize = (newsize / LFS_BLOCK_SIZE) * LFS_BLOCK_SIZE;
 
-	if (!strcmp(request->url, "api/pins")) {
-		return http_rest_get_pins(request);
-	}
-	if (!strcmp(request->url, "api/channelTypes")) {
-		return http_rest_get_channelTypes(request);
+	// double check again that we're within bounds - don't want
+	// boot overwrite or anything nasty....
+	if (newstart < LFS_BLOCKS_START_MIN) {
+		return http_rest_error(request, -20, "LFS Size mismatch");
 	}
-	if (!strcmp(request->url, "api/logconfig")) {
-		return http_rest_get_logconfig(request);
+	if ((newstart + newsize > LFS_BLOCKS_END) ||
+		(newstart + newsize < LFS_BLOCKS_START_MIN)) {
+		return http_rest_error(request, -20, "LFS Size mismatch");
 	}
 
-	if (!strncmp(request->url, "api/seriallog", 13)) {
-		return http_rest_get_seriallog(request);
-	}
-
-#if ENABLE_LITTLEFS
-	if (!strcmp(request->url, "api/fsblock")) {
-		uint32_t newsize = CFG_GetLFS_Size();
-		uint32_t newstart = (LFS_BLOCKS_END - newsize);
-
-		newsize = (newsize / LFS_BLOCK_SIZE) * LFS_BLOCK_SIZE;
-
-		// double check again that we're within bounds - don't want
-		// boot overwrite or anything nasty....
-		if (newstart < LFS_BLOCKS_START_MIN) {
-			return http_rest_error(request, -20, "LFS Size mismatch");
-		}
-		if ((newstart + newsize > LFS_BLOCKS_END) ||
-			(newstart + newsize < LFS_BLOCKS_START_MIN)) {
-			return http_rest_error(request, -20, "LFS Size mismatch");
-		}
-
-		return http_rest_get_flash(request, newstart, newsize);
-	}
+	return http_rest_get_flash(request, newstart, newsize);
+}
 #endif
 
+// paths below api/
+static const httpRoute_t g_restGetRoutes[] = {
+	{ "channels", http_rest_get_channels, 0 },
+	{ "pins", http_rest_get_pins, 0 },
+	{ "channelTypes", http_rest_get_channelTypes, 0 },
+	{ "logconfig", http_rest_get_logconfig, 0 },
+	{ "seriallog", http_rest_get_seriallog, 1 },
 #if ENABLE_LITTLEFS
-	if (!strncmp(request->url, "api/lfs/", 8)) {
-		return http_rest_get_lfs_file(request);
-	}
-	if (!strncmp(request->url, "api/run/", 8)) {
-		return http_rest_run_lfs_file(request);
-	}
-	if (!strncmp(request->url, "api/del/", 8)) {
-		return http_rest_get_lfs_delete(request);
-	}
+	{ "fsblock", http_rest_get_fsblock, 0 },
+	{ "lfs/", http_rest_get_lfs_file, 1 },
+	{ "run/", http_rest_run_lfs_file, 1 },
+	{ "del/", http_rest_get_lfs_delete, 1 },
 #endif
-
-	if (!strcmp(request->url, "api/info")) {
-		return http_rest_get_info(request);
-	}
+	{ "info", http_rest_get_info, 0 },
 #if ENABLE_BT_PROXY
-	if (!strcmp(request->url, "api/bt_scan")) {
-		return http_rest_get_bt_scan(request);
-	}
+	{ "bt_scan", http_rest_get_bt_scan, 0 },
 #endif
+	{ "flash/", http_rest_get_flash_advanced, 1 },
+};
+static httpRouteTable_t g_restGetTable = HTTP_ROUTE_TABLE(g_restGetRoutes);
+
+static int http_rest_get(http_request_t* request) {
+	const httpRoute_t* route;
 
-	if (!strncmp(request->url, "api/flash/", 10)) {
-		return http_rest_get_flash_advanced(request);
+	ADDLOG_DEBUG(LOG_FEATURE_API, "GET of %s", request->url);
+
+	route = HTTP_FindRoute(&g_restGetTable, request->url + 4);
+	if (route) {
+		return route->callback(request);
 	}
 
 	http_setup(request, httpMimeTypeHTML);
@@ -176,102 +168,98 @@ static int http_rest_get(http_request_t* request) {
 	return 0;
 }
 
-static int http_rest_post(http_request_t* request) {
-	char tmp[20];
-	ADDLOG_DEBUG(LOG_FEATURE_API, "POST to %s", request->url);
-
-	if (!strcmp(request->url, "api/channels")) {
-		return http_rest_post_channels(request);
-	}
-	
-	if (!strcmp(request->url, "api/pins")) {
-		return http_rest_post_pins(request);
-	}
-	if (!strcmp(request->url, "api/channelTypes")) {
-		return http_rest_post_channelTypes(request);
-	}
-	if (!strcmp(request->url, "api/logconfig")) {
-		return http_rest_post_logconfig(request);
-	}
-
-	if (!strcmp(request->url, "api/reboot")) {
-		return http_rest_post_reboot(request);
-	}
-	if (!strcmp(request->url, "api/ota")) {
-		OTA_IncrementProgress(1);
+static int http_rest_post_ota(http_request_t* request) {
+	OTA_IncrementProgress(1);
 #if ENABLE_BT_PROXY
-		HAL_BTProxy_StopScan();
+	HAL_BTProxy_StopScan();
 #endif
-		int r = 0;
+	int r = 0;
 #if PLATFORM_BEKEN
-		r = http_rest_post_flash(request, START_ADR_OF_BK_PARTITION_OTA, LFS_BLOCKS_END);
+	r = http_rest_post_flash(request, START_ADR_OF_BK_PARTITION_OTA, LFS_BLOCKS_END);
 #elif PLATFORM_W600
-		r = http_rest_post_flash(request, -1, -1);
+	r = http_rest_post_flash(request, -1, -1);
 #elif PLATFORM_W800
-		r = http_rest_post_flash(request, -1, -1);
+	r = http_rest_post_flash(request, -1, -1);
 #elif PLATFORM_BL602 || PLATFORM_BL_NEW
-		r = http_rest_post_flash(request, -1, -1);
+	r = http_rest_post_flash(request, -1, -1);
 #elif PLATFORM_LN882H || PLATFORM_LN8825
-		r = http_rest_post_flash(request, -1, -1);
+	r = http_rest_post_flash(request, -1, -1);
 #elif PLATFORM_ESPIDF || PLATFORM_ESP8266
-		r = http_rest_post_flash(request, -1, -1);
+	r = http_rest_post_flash(request, -1, -1);
 #elif PLATFORM_REALTEK
-		r = http_rest_post_flash(request, 0, -1);
+	r = http_rest_post_flash(request, 0, -1);
 #elif PLATFORM_ECR6600 || PLATFORM_TR6260
-		r = http_rest_post_flash(request, -1, -1);
+	r = http_rest_post_flash(request, -1, -1);
 #elif PLATFORM_XRADIO && !PLATFORM_XR809
-		r = http_rest_post_flash(request, 0, -1);
+	r = http_rest_post_flash(request, 0, -1);
 #elif PLATFORM_TXW81X
-		r = http_rest_post_flash(request, 0, -1);
+	r = http_rest_post_flash(request, 0, -1);
 #elif PLATFORM_RDA5981
-		r = http_rest_post_flash(request, 0, -1);
+	r = http_rest_post_flash(request, 0, -1);
 #else
-		// TODO
-		ADDLOG_ERROR(LOG_FEATURE_API, "No OTA");
+	// TODO
+	(void)request;
+	ADDLOG_ERROR(LOG_FEATURE_API, "No OTA");
 #endif
-		OTA_ResetProgress();
-		return r;
-	}
-	if (!strncmp(request->url, "api/flash/", 10)) {
-		return http_rest_post_flash_advanced(request);
+	OTA_ResetProgress();
+	return r;
+}
+
+#if ENABLE_LITTLEFS
+static int http_rest_post_fsblock(http_request_t* request) {
+	if (lfs_present()) {
+		release_lfs();
 	}
+	uint32_t newsize = CFG_GetLFS_Size();
+	uint32_t newstart = (LFS_BLOCKS_END - newsize);
+
+	newsize = (newsize / LFS_BLOCK_SIZE) * LFS_BLOCK_SIZE;
 
-	if (!strcmp(request->url, "api/cmnd")) {
-		return http_rest_post_cmd(request);
+	// double check again that we're within bounds - don't want
+	// boot overwrite or anything nasty....
+	if (newstart < LFS_BLOCKS_START_MIN) {
+		return http_rest_error(request, -20, "LFS Size mismatch");
+	}
+	if ((newstart + newsize > LFS_BLOCKS_END) ||
+		(newstart + newsize < LFS_BLOCKS_START_MIN)) {
+		return http_rest_error(request, -20, "LFS Size mismatch");
 	}
 
+	// we are writing the lfs block
+	int res = http_rest_post_flash(request, newstart, LFS_BLOCKS_END);
+	// initialise the filesystem, it should be there now.
+	// don't create if it does not mount
+	init_lfs(0);
+	return res;
+}
+#endif
 
+static const httpRoute_t g_restPostRoutes[] = {
+	{ "channels", http_rest_post_channels, 0 },
+	{ "pins", http_rest_post_pins, 0 },
+	{ "channelTypes", http_rest_post_channelTypes, 0 },
+	{ "logconfig", http_rest_post_logconfig, 0 },
+	{ "reboot", http_rest_post_reboot, 0 },
+	{ "ota", http_rest_post_ota, 0 },
+	{ "flash/", http_rest_post_flash_advanced, 1 },
+	{ "cmnd", http_rest_post_cmd, 0 },
 #if ENABLE_LITTLEFS
-	if (!strcmp(request->url, "api/fsblock")) {
-		if (lfs_present()) {
-			release_lfs();
-		}
-		uint32_t newsize = CFG_GetLFS_Size();
-		uint32_t newstart = (LFS_BLOCKS_END - newsize);
+	{ "fsblock", http_rest_post_fsblock, 0 },
+	{ "lfs/", http_rest_post_lfs_file, 1 },
+#endif
+};
+static httpRouteTable_t g_restPostTable = HTTP_ROUTE_TABLE(g_restPostRoutes);
 
-		newsize = (newsize / LFS_BLOCK_SIZE) * LFS_BLOCK_SIZE;
+static int http_rest_post(http_request_t* request) {
+	const httpRoute_t* route;
+	char tmp[20];
 
-		// double check again that we're within bounds - don't want
-		// boot overwrite or anything nasty....
-		if (newstart < LFS_BLOCKS_START_MIN) {
-			return http_rest_error(request, -20, "LFS Size mismatch");
-		}
-		if ((newstart + newsize > LFS_BLOCKS_END) ||
-			(newstart + newsize < LFS_BLOCKS_START_MIN)) {
-			return http_rest_error(request, -20, "LFS Size mismatch");
-		}
+	ADDLOG_DEBUG(LOG_FEATURE_API, "POST to %s", request->url);
 
-		// we are writing the lfs block
-		int res = http_rest_post_flash(request, newstart, LFS_BLOCKS_END);
-		// initialise the filesystem, it should be there now.
-		// don't create if it does not mount
-		init_lfs(0);
-		return res;
+	route = HTTP_FindRoute(&g_restPostTable, request->url + 4);
+	if (route) {
+		return route->callback(request);
 	}
-	if (!strncmp(request->url, "api/lfs/", 8)) {
-		return http_rest_post_lfs_file(request);
-	}
-#endif
 
 	http_setup(request, httpMimeTypeHTML);
 	http_html_start(request, "POST REST API");
@@ -304,7 +292,7 @@ static int http_rest_app(http_request_t* request) {
 		poststr(request, CFG_GetDeviceName());
 		poststr(request, "</title>");
 
-		poststr(request, htmlShortcutIcon);
+		poststr_const(request, htmlShortcutIcon);
 		poststr(request, htmlHeadMeta);
 		hprintf255(request, "<script>var root='%s',device='http://'+location.host;</script>", webhost);
 		hprintf255(request, "<script src='%s/startup.js'></script>", webhost);
@@ -454,6 +442,25 @@ static int http_rest_run_lfs_file(http_request_t* request) {
 	return 0;
 }
 
+// ETag of LFS file is hash of its content, there is no modification time.
+// File is read twice, but unchanged file is not sent again.
+static void http_lfs_getETag(lfs_file_t* file, char* buff, char* etag) {
+	unsigned int hash = 2166136261u;
+	int len, i, total = 0;
+
+	do {
+		len = lfs_file_read(&lfs, file, buff, 1024);
+		for (i = 0; i < len; i++) {
+			hash = (hash ^ (unsigned char)buff[i]) * 16777619u;
+		}
+		if (len > 0) {
+			total += len;
+		}
+	} while (len > 0);
+	lfs_file_rewind(&lfs, file);
+	sprintf(etag, "\"%x-%08x\"", total, hash);
+}
+
 static int http_rest_get_lfs_file(http_request_t* request) {
 	char* fpath;
 	char* buff;
@@ -473,7 +480,8 @@ static int http_rest_get_lfs_file(http_request_t* request) {
 		return 0;
 	}
 
-	fpath = os_malloc(strlen(request->url) - strlen("api/lfs/") + 1);
+	// room for .gz
+	fpath = os_malloc(strlen(request->url) - strlen("api/lfs/") + 4);
 
 	buff = os_malloc(1024);
 	file = os_malloc(sizeof(lfs_file_t));
@@ -490,7 +498,21 @@ static int http_rest_get_lfs_file(http_request_t* request) {
 	isGzip = EndsWith(fpath, "gz");
 
 	ADDLOG_DEBUG(LOG_FEATURE_API, "LFS read of %s", fpath);
-	lfsres = lfs_file_open(&lfs, file, fpath, LFS_O_RDONLY);
+	lfsres = -1;
+	// prefer compressed copy uploaded next to the file, e.g. app.js.gz for app.js
+	if (!isGzip && HTTP_AcceptsGzip(request)) {
+		strcat(fpath, ".gz");
+		lfsres = lfs_file_open(&lfs, file, fpath, LFS_O_RDONLY);
+		if (lfsres >= 0) {
+			isGzip = true;
+		}
+		else {
+			fpath[strlen(fpath) - 3] = 0;
+		}
+	}
+	if (lfsres < 0) {
+		lfsres = lfs_file_open(&lfs, file, fpath, LFS_O_RDONLY);
+	}
 
 	if (lfsres == -21) {
 		lfs_dir_t* dir;
@@ -590,12 +612,21 @@ static int http_rest_get_lfs_file(http_request_t* request) {
 				}
 			}
 
-			if (isGzip) {
-				http_setup_gz(request, mimetype);
-			}
-			else {
-				http_setup(request, mimetype);
+			char etag[24];
+
+			http_lfs_getETag(file, buff, etag);
+			if (HTTP_IsNotModified(request, etag)) {
+				lfs_file_close(&lfs, file);
+				request->responseCode = HTTP_RESPONSE_NOT_MODIFIED;
+				http_setup_cached(request, mimetype, etag, 0, 0);
+				poststr(request, NULL);
+				os_free(fpath);
+				os_free(file);
+				os_free(buff);
+				return 0;
 			}
+			// max-age 0, browser must ask each time, but gets 304 when file is the same
+			http_setup_cached(request, mimetype, etag, 0, isGzip);
 			//#if ENABLE_OBK_BERRY
 			//			http_runBerryFile(request, fpath);
 			//#else
@@ -678,6 +709,9 @@ static int http_rest_get_lfs_delete(http_request_t* request) {
 
 	if (lfsres == LFS_ERR_OK) {
 		ADDLOG_DEBUG(LOG_FEATURE_API, "LFS delete of %s OK", fpath);
+#if ENABLE_OBK_SCRIPTING
+		SVM_InvalidateFile(fpath);
+#endif
 
 		poststr(request, "OK");
 	}
@@ -690,6 +724,56 @@ static int http_rest_get_lfs_delete(http_request_t* request) {
 	return 0;
 }
 
+// upload whose body is given in parts by select server
+typedef struct lfsUpload_s {
+	lfs_file_t* file;
+	char* fpath;
+	int total;
+} lfsUpload_t;
+
+#if WINDOWS
+// selftest makes upload handler defer this many parts, like a busy flash writer
+int g_lfsUploadDeferCalls = 0;
+#endif
+
+static int http_rest_post_lfs_part(http_request_t* request, const char* data, int len) {
+	lfsUpload_t* up = (lfsUpload_t*)request->bodyContext;
+	int res;
+
+#if WINDOWS
+	if (len >= 0 && g_lfsUploadDeferCalls > 0) {
+		g_lfsUploadDeferCalls--;
+		return 1;
+	}
+#endif
+	if (len > 0) {
+		res = lfs_file_write(&lfs, up->file, data, len);
+		if (res >= 0) {
+			up->total += res;
+			return 0;
+		}
+		// keep what was written, like the recv() loop does
+		ADDLOG_ERROR(LOG_FEATURE_API, "Failed to write to %s with error %i", up->fpath, res);
+	}
+	if (len >= 0) {
+		lfs_file_truncate(&lfs, up->file, up->total);
+	}
+	lfs_file_close(&lfs, up->file);
+	if (len >= 0) {
+		ADDLOG_DEBUG(LOG_FEATURE_API, "%d total bytes written", up->total);
+#if ENABLE_OBK_SCRIPTING
+		SVM_InvalidateFile(up->fpath);
+#endif
+		http_setup(request, httpMimeTypeJson);
+		hprintf255(request, "{\"fname\":\"%s\",\"size\":%d}", up->fpath, up->total);
+		poststr(request, NULL);
+	}
+	os_free(up->file);
+	os_free(up->fpath);
+	os_free(up);
+	return len > 0 ? -1 : 0;
+}
+
 static int http_rest_post_lfs_file(http_request_t* request) {
 	int len;
 	int lfsres;
@@ -753,6 +837,19 @@ static int http_rest_post_lfs_file(http_request_t* request) {
 			hprintf255(request, "{\"fname\":\"%s\",\"error\":%d}", fpath, -20);
 			goto exit;
 		}
+		if (request->bStreamBody) {
+			// rest of body is given to http_rest_post_lfs_part as it arrives
+			lfsUpload_t* up = os_malloc(sizeof(lfsUpload_t));
+			if (up) {
+				up->file = file;
+				up->fpath = fpath;
+				up->total = 0;
+				request->bodyCallback = http_rest_post_lfs_part;
+				request->bodyContext = up;
+				if (folder) os_free(folder);
+				return 0;
+			}
+		}
 
 		do {
 			loops++;
@@ -793,6 +890,9 @@ static int http_rest_post_lfs_file(http_request_t* request) {
 		//ADDLOG_DEBUG(LOG_FEATURE_API, "closing %s", fpath);
 		lfs_file_close(&lfs, file);
 		ADDLOG_DEBUG(LOG_FEATURE_API, "%d total bytes written", total);
+#if ENABLE_OBK_SCRIPTING
+		SVM_InvalidateFile(fpath);
+#endif
 		http_setup(request, httpMimeTypeJson);
 		hprintf255(request, "{\"fname\":\"%s\",\"size\":%d}", fpath, total);
 	}
@@ -1067,6 +1167,15 @@ static int http_rest_get_info(http_request_t* request) {
 	hprintf255(request, "\"supportsSSDP\":0,");
 #endif
 
+#if ENABLE_MQTT
+	{
+		int lookups, hits, delayed;
+
+		MQTT_Dedup_GetStats(&lookups, &hits, &delayed);
+		hprintf255(request, "\"mqttDedup\":{\"lookups\":%i,\"hits\":%i,\"delayed\":%i,\"hitRate\":%i},",
+			lookups, hits, delayed, lookups ? (int)((long long)hits * 100 / lookups) : 0);
+	}
+#endif
 	hprintf255(request, "\"supportsClientDeviceDB\":true}");
 
 	poststr(request, NULL);
@@ -1,44 +1,49 @@
-//The content of this file get set into htmlHeadStyle (new_http.cs)
+//The content of this file get set into pageScript (new_http.c), gzipped copy is served as obk.js
 
 var firstTime,
 	lastTime,
 	req = null;
 var onlineFor;
 var onlineForEl = null;
+// state changes are pushed by /sse, polling is then only a fallback
+var evOpen = 0;
+var evReconnect = 0;
 
 var getElement = (id) => document.getElementById(id);
 
-// refresh status section every 3 seconds
+// refresh status section every refreshMs (set by page before this script)
 function showState() {
 	clearTimeout(firstTime);
 	clearTimeout(lastTime);
 	if (req != null) {
 		req.abort();
 	}
-	req = new XMLHttpRequest();
-	req.onreadystatechange = () => {
-		// somehow status was 0 on Windows, but "OK" works on both Beken and Windows
-		if (req.readyState == 4 && req.statusText == "OK") {
-			if (
-				!(
-					document.activeElement.tagName == "SELECT" &&
-					(document.activeElement.tagName == "INPUT" &&
-					(document.activeElement.type == "number" || document.activeElement.type == "color"))
-				)
-			) {
-				var stateEl = getElement("state");
-				if (stateEl) {
+	var stateEl = getElement("state");
+	if (stateEl) {
+		req = new XMLHttpRequest();
+		req.onreadystatechange = () => {
+			// somehow status was 0 on Windows, but "OK" works on both Beken and Windows
+			if (req.readyState == 4 && req.statusText == "OK") {
+				if (
+					document.activeElement.tagName != "SELECT" &&
+					(document.activeElement.tagName != "INPUT" ||
+						(document.activeElement.type != "number" && document.activeElement.type != "color"))
+				) {
 					stateEl.innerHTML = req.responseText;
 				}
+				clearTimeout(firstTime);
+				clearTimeout(lastTime);
+				if (!evOpen) {
+					lastTime = setTimeout(showState, refreshMs);
+				}
 			}
-			clearTimeout(firstTime);
-			clearTimeout(lastTime);
-			lastTime = setTimeout(showState, 3e3);
-		}
-	};
-	req.open("GET", "index?state=1", true);
-	req.send();
-	firstTime = setTimeout(showState, 3e3);
+		};
+		req.open("GET", "index?state=1", true);
+		req.send();
+	}
+	if (!evOpen) {
+		firstTime = setTimeout(showState, refreshMs);
+	}
 }
 
 function fmtUpTime(totalSeconds) {
@@ -63,6 +68,80 @@ function fmtUpTime(totalSeconds) {
 	return `just ${seconds} seconds`;
 }
 
+// shows pushed value in element marked by state page with data-ch, data-led or data-en
+function setPushedValue(el, value) {
+	var on, opts;
+
+	if (el == document.activeElement) {
+		return;
+	}
+	if (el.tagName == "TD" || el.type == "submit") {
+		// relay state or toggle button
+		on = (value != 0) != (el.dataset.inv == "1");
+		if (el.tagName == "TD") {
+			el.className = on ? "on" : "off";
+			el.textContent = on ? "ON" : "OFF";
+		} else {
+			el.className = on ? "bgrn" : "bred";
+		}
+	} else if (el.tagName == "FORM") {
+		el.querySelectorAll("input[type=radio]").forEach((radio) => (radio.checked = radio.value == value));
+	} else if (el.tagName == "SPAN") {
+		if (el.dataset.opts) {
+			opts = el.dataset.opts.split("|");
+			el.textContent = opts[value] || value;
+		} else {
+			el.textContent = (value / (el.dataset.div || 1)).toFixed(el.dataset.dp || 0);
+		}
+	} else if (el.type == "color") {
+		el.value = "#" + value;
+	} else {
+		// slider or select, temperature slider shows Kelvin
+		el.value = el.dataset.kelvin ? Math.round(1e6 / value) : value;
+	}
+}
+
+// event is {"ch":{"1":100},"led":{"dim":80},"en":{"v":230.1}}, see http_events.c
+function applyEvent(data) {
+	var attrs = { ch: "data-ch", led: "data-led", en: "data-en" };
+
+	for (var group in attrs) {
+		for (var key in data[group] || {}) {
+			document
+				.querySelectorAll(`[${attrs[group]}="${key}"]`)
+				.forEach((el) => setPushedValue(el, data[group][key]));
+		}
+	}
+}
+
+// changes are applied in place, whole state is fetched only after (re)connect
+function startEvents() {
+	if (!window.EventSource || !getElement("state")) {
+		return;
+	}
+	var events = new EventSource("sse");
+	events.onopen = () => {
+		evOpen = 1;
+		// first state came with page, after reconnect changes may have been missed
+		if (evReconnect) {
+			showState();
+		} else {
+			clearTimeout(firstTime);
+			clearTimeout(lastTime);
+		}
+		evReconnect = 1;
+	};
+	events.onmessage = (e) => {
+		applyEvent(JSON.parse(e.data));
+	};
+	events.onerror = () => {
+		if (evOpen) {
+			evOpen = 0;
+			showState();
+		}
+	};
+}
+
 function updateOnlineFor() {
 	onlineForEl.textContent = fmtUpTime(++onlineFor);
 }
@@ -77,6 +156,7 @@ function onLoad() {
 	}
 
 	showState();
+	startEvents();
 }
 
 function submitTemperature(slider) {
@@ -357,6 +357,9 @@ static commandResult_t CMD_LFS_Format(const void *context, const char *cmd, cons
 
     int err  = lfs_format(&lfs, &cfg);
     ADDLOG_INFO(LOG_FEATURE_CMD, "LFS formatted size 0x%X (err %d)", LFS_Size, err);
+#if ENABLE_OBK_SCRIPTING
+	SVM_InvalidateFile(NULL);
+#endif
     init_lfs(1);
     if (!lfs_initialised){
         ADDLOG_ERROR(LOG_FEATURE_CMD, "LFS error");
@@ -410,6 +413,9 @@ static commandResult_t CMD_LFS_Append_Internal(lcdPrintType_t type, bool bLine,
 		lfs_file_write(&lfs, &file, "\r\n", 2);
 	}
 	lfs_file_close(&lfs, &file);
+#if ENABLE_OBK_SCRIPTING
+	SVM_InvalidateFile(fileName);
+#endif
 
 
 	return CMD_RES_OK;
@@ -458,6 +464,9 @@ static commandResult_t CMD_LFS_Remove(const void *context, const char *cmd, cons
 	fileName = Tokenizer_GetArg(0);
 
 	lfs_remove(&lfs, fileName);
+#if ENABLE_OBK_SCRIPTING
+	SVM_InvalidateFile(fileName);
+#endif
 
 	return CMD_RES_OK;
 }
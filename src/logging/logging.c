@@ -117,17 +117,40 @@ static void log_serial_thread(beken_thread_arg_t arg);
 static void startSerialLog();
 static void startLogServer();
 
+// must be a power of two
 #define LOGSIZE 4096
 #define LOGPORT 9000
 
 int logTcpPort = LOGPORT;
 
+#if defined(__GNUC__)
+#define LOG_MEMORY_BARRIER() __sync_synchronize()
+#else
+#define LOG_MEMORY_BARRIER()
+#endif
+
+// Log ring has a single producer (writers are serialized by the mutex,
+// because they share g_loggingBuffer) and a cursor per each sink.
+// Positions are free running counters, so head - tail is the amount of
+// pending data. Sinks don't take the mutex - a writer first moves
+// 'oldest' past the entries it will overwrite and 'reserved' forward,
+// then copies data, then moves 'head'. A reader checks 'reserved' after
+// copying, so it knows whether something was overwritten meanwhile.
+// A sink that is too slow just loses the oldest entries and counts them as dropped.
+typedef struct logSink_s {
+	// start of current entry
+	unsigned int tail;
+	// position within text of current entry
+	int offset;
+	unsigned int dropped;
+} logSink_t;
+
 static struct tag_logMemory {
 	char log[LOGSIZE];
-	int head;
-	int tailserial;
-	int tailtcp;
-	int tailhttp;
+	volatile unsigned int head;
+	volatile unsigned int reserved;
+	volatile unsigned int oldest;
+	logSink_t sinks[LOG_SINK_MAX];
 	SemaphoreHandle_t mutex;
 } logMemory;
 
@@ -227,7 +250,8 @@ logPort 1
 static void initLog(void)
 {
 	bk_printf("Entering initLog()...\r\n");
-	logMemory.head = logMemory.tailserial = logMemory.tailtcp = logMemory.tailhttp = 0;
+	memset(&logMemory.sinks, 0, sizeof(logMemory.sinks));
+	logMemory.head = logMemory.reserved = logMemory.oldest = 0;
 	logMemory.mutex = xSemaphoreCreateMutex();
 	initialised = 1;
 	startSerialLog();
@@ -254,6 +278,13 @@ static void initLog(void)
 	//cmddetail:"fn":"log_command","file":"logging/logging.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("logdelay", log_command, NULL);
+#if ENABLE_DEFERRED_LOG
+	//cmddetail:{"name":"logdeferred","args":"[1or0]",
+	//cmddetail:"descr":"Enables or disables deferred log formatting. When enabled, some frequent logs are stored as format and arguments and are formatted only when log is read by serial, TCP or HTTP. Default is 1.",
+	//cmddetail:"fn":"log_command","file":"logging/logging.c","requires":"",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("logdeferred", log_command, NULL);
+#endif
 #if PLATFORM_BEKEN || PLATFORM_LN882H
 	//cmddetail:{"name":"logport","args":"[Index]",
 	//cmddetail:"descr":"Allows you to change log output port. On Beken, the UART1 is used for flashing and for TuyaMCU/BL0942, while UART2 is for log. Sometimes it might be easier for you to have log on UART1, so now you can just use this command like backlog uartInit 115200; logport 1 to enable logging on UART1..",
@@ -319,26 +350,75 @@ void LOG_SetCommandHTTPRedirectReply(http_request_t* request) {
 	}
 #endif
 
-// adds a log to the log memory
-// if head collides with either tail, move the tails on.
-void addLogAdv(int level, int feature, const char* fmt, ...)
-{
-	char* tmp;
-	char* t;
-	int len;
-	va_list argList;
-	BaseType_t taken;
-	int i;
+// every entry in the ring starts with a 2 byte header:
+// entry length (with header) and LOG_ENTRY_DEFERRED flag
+#define LOG_ENTRY_HEADER		2
+#define LOG_ENTRY_DEFERRED		0x8000
+#define LOG_ENTRY_LENGTH_MASK	0x7FFF
 
-	if (fmt == 0)
-	{
-		return;
+static void LOG_RingCopyIn(unsigned int at, const void* data, int len) {
+	int pos = at & (LOGSIZE - 1);
+	int first = LOGSIZE - pos;
+
+	if (first > len) {
+		first = len;
+	}
+	memcpy(logMemory.log + pos, data, first);
+	memcpy(logMemory.log, (const char*)data + first, len - first);
+}
+static void LOG_RingCopyOut(unsigned int at, void* out, int len) {
+	int pos = at & (LOGSIZE - 1);
+	int first = LOGSIZE - pos;
+
+	if (first > len) {
+		first = len;
+	}
+	memcpy(out, logMemory.log + pos, first);
+	memcpy((char*)out + first, logMemory.log, len - first);
+}
+static int LOG_RingGetEntryHeader(unsigned int at) {
+	byte hdr[LOG_ENTRY_HEADER];
+
+	LOG_RingCopyOut(at, hdr, LOG_ENTRY_HEADER);
+	return hdr[0] | (hdr[1] << 8);
+}
+
+// Writes entry to the ring, the first LOG_ENTRY_HEADER bytes of 'entry'
+// are space for the header. Caller must hold the mutex.
+// Sink cursors are not touched here, each sink detects by itself that it
+// was overrun, and then continues from the 'oldest' entry.
+static void LOG_WriteEntry(char* entry, int len, int flags) {
+	unsigned int head = logMemory.head;
+	unsigned int end = head + len;
+	unsigned int oldest = logMemory.oldest;
+	int n;
+
+	entry[0] = (len | flags) & 0xFF;
+	entry[1] = (len | flags) >> 8;
+	// drop the entries that will be overwritten
+	while (end - oldest > LOGSIZE) {
+		n = LOG_RingGetEntryHeader(oldest) & LOG_ENTRY_LENGTH_MASK;
+		if (n <= LOG_ENTRY_HEADER || n > (int)(head - oldest)) {
+			// broken header (writers raced after mutex timeout), start over
+			oldest = head;
+			break;
+		}
+		oldest += n;
 	}
+	logMemory.oldest = oldest;
+	logMemory.reserved = end;
+	LOG_MEMORY_BARRIER();
+	LOG_RingCopyIn(head, entry, len);
+	LOG_MEMORY_BARRIER();
+	logMemory.head = end;
+}
+
+static bool LOG_CheckFilterAndInit(int level, int feature) {
 	if (!((1 << feature) & logfeatures)) {
-		return;
+		return false;
 	}
 	if (level > g_loglevel) {
-		return;
+		return false;
 	}
 
 	// if not initialised, direct output
@@ -348,41 +428,83 @@ void addLogAdv(int level, int feature, const char* fmt, ...)
 	if (g_StartupDelayOver && !tcpLogStarted){
 		inittcplog();
 	}
+	return true;
+}
 
+static void LOG_AfterAdd(int len) {
+#ifdef PLATFORM_BEKEN
+	trigger_log_send();
+#endif	
+	if (log_delay != 0) 
+    {
+		int timems = log_delay;
+		// is log_delay set -ve, then calculate delay
+		// required for the number of characters to TX
+		// plus 2ms to be sure.
+		if (log_delay < 0) 
+        {
+			int cps = (115200 / 8);
+			timems = (((1000 / portTICK_RATE_MS) * len) / cps) + 2;
+            if (timems < 2)
+                timems = 2;
+		}
+		rtos_delay_milliseconds(timems);
+	}
+}
 
-	taken = xSemaphoreTake(logMemory.mutex, 100);
-	tmp = g_loggingBuffer;
-	memset(tmp, 0, LOGGING_BUFFER_SIZE);
-	t = tmp;
+// formats line with prefixes to out, returns length, always adds \r\n
+static int LOG_FormatLineV(char* out, int outSize, int level, int feature, const char* fmt, va_list argList) {
+	char* t;
+	int len;
+	int maxLen;
+
+	t = out;
 
 	if (feature == LOG_FEATURE_RAW)
 	{
 		// raw means no prefixes
 	}
 	else {
-		strncpy(t, loglevelnames[level], (LOGGING_BUFFER_SIZE - (3 + t - tmp)));
-		t += strlen(t);
-		if (feature < sizeof(logfeaturenames) / sizeof(*logfeaturenames))
+		len = strlen(loglevelnames[level]);
+		memcpy(t, loglevelnames[level], len);
+		t += len;
+		if (feature < (int)(sizeof(logfeaturenames) / sizeof(*logfeaturenames)))
 		{
-			strncpy(t, logfeaturenames[feature], (LOGGING_BUFFER_SIZE - (3 + t - tmp)));
-			t += strlen(t);
+			len = strlen(logfeaturenames[feature]);
+			memcpy(t, logfeaturenames[feature], len);
+			t += len;
 		}
 	}
 
-	va_start(argList, fmt);
-	//vsnprintf3(t, (LOGGING_BUFFER_SIZE - (3 + t - tmp)), fmt, argList);
-	//vsnprintf2(t, (LOGGING_BUFFER_SIZE - (3 + t - tmp)), fmt, argList);
-	vsnprintf(t, (LOGGING_BUFFER_SIZE - (3 + t - tmp)), fmt, argList);
-	va_end(argList);
-	if (tmp[strlen(tmp) - 1] == '\n') tmp[strlen(tmp) - 1] = '\0';
-	if (tmp[strlen(tmp) - 1] == '\r') tmp[strlen(tmp) - 1] = '\0';
+	// save 3 bytes at end for /r/n/0
+	maxLen = outSize - (3 + t - out);
+	len = vsnprintf(t, maxLen, fmt, argList);
+	// some SDK vsnprintf return -1 or untruncated length on overflow
+	if (len < 0 || len >= maxLen) {
+		len = strlen(t);
+	}
+	t += len;
+	if (t > out && t[-1] == '\n') t--;
+	if (t > out && t[-1] == '\r') t--;
+
+	*t++ = '\r';
+	*t++ = '\n';
+	*t = '\0';
+	return t - out;
+}
 
-	len = strlen(tmp); // save 3 bytes at end for /r/n/0
-	tmp[len++] = '\r';
-	tmp[len++] = '\n';
-	tmp[len] = '\0';
+static void LOG_AddFormattedV(int level, int feature, const char* fmt, va_list argList) {
+	char* tmp;
+	int len;
+	BaseType_t taken;
+
+	taken = xSemaphoreTake(logMemory.mutex, 100);
+	tmp = g_loggingBuffer + LOG_ENTRY_HEADER;
+	len = LOG_FormatLineV(tmp, LOGGING_BUFFER_SIZE - LOG_ENTRY_HEADER, level, feature, fmt, argList);
 #if WINDOWS
-	printf("%s", tmp);
+	if (direct_serial_log != LOGTYPE_NONE) {
+		printf("%s", tmp);
+	}
 #endif
 	// This is used by HTTP console
 	if (g_log_alsoPrintToHTTP) {
@@ -396,7 +518,7 @@ void addLogAdv(int level, int feature, const char* fmt, ...)
 	}
 	if (g_extraSocketToSendLOG)
 	{
-		send(g_extraSocketToSendLOG, tmp, strlen(tmp), 0);
+		send(g_extraSocketToSendLOG, tmp, len, 0);
 	}
 
 	if (direct_serial_log == LOGTYPE_DIRECT) {
@@ -416,78 +538,501 @@ void addLogAdv(int level, int feature, const char* fmt, ...)
 		return;
 	}
 
-	for ( i = 0; i < len; i++)
+	LOG_WriteEntry(g_loggingBuffer, LOG_ENTRY_HEADER + len, 0);
+
+	if (taken == pdTRUE) {
+		xSemaphoreGive(logMemory.mutex);
+	}
+	LOG_AfterAdd(len);
+}
+
+// adds a log to the log memory
+void addLogAdv(int level, int feature, const char* fmt, ...)
+{
+	va_list argList;
+
+	if (fmt == 0)
 	{
-		logMemory.log[logMemory.head] = tmp[i];
-		logMemory.head = (logMemory.head + 1) % LOGSIZE;
-		if (logMemory.tailserial == logMemory.head)
-		{
-			logMemory.tailserial = (logMemory.tailserial + 1) % LOGSIZE;
+		return;
+	}
+	if (LOG_CheckFilterAndInit(level, feature) == false) {
+		return;
+	}
+	va_start(argList, fmt);
+	LOG_AddFormattedV(level, feature, fmt, argList);
+	va_end(argList);
+}
+
+#if ENABLE_DEFERRED_LOG
+
+// Deferred entry keeps format pointer, level, feature and raw arguments.
+// It is formatted to text only when a sink reads it. Lines that might not
+// fit in LOG_DEFERRED_MAX_TEXT are formatted right away instead.
+#define LOG_DEFERRED_MAX_RECORD		192
+#define LOG_DEFERRED_MAX_TEXT		256
+
+static int g_logDeferred = 1;
+
+typedef enum logArgType_e {
+	LOG_ARG_NONE,
+	LOG_ARG_INT,
+	LOG_ARG_LONG,
+	LOG_ARG_LONGLONG,
+	LOG_ARG_SIZE,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_STRING,
+	LOG_ARG_POINTER,
+	LOG_ARG_UNSUPPORTED,
+} logArgType_t;
+
+typedef struct logDeferredHeader_s {
+	const char* fmt;
+	byte level;
+	byte feature;
+} logDeferredHeader_t;
+
+// parses conversion spec, p points after '%'.
+// Returns pointer after the spec, sets argument type and count of '*'
+static const char* LOG_ParseSpec(const char* p, int* type, int* stars) {
+	int longs = 0;
+	bool bSize = false;
+
+	*stars = 0;
+	while (*p && strchr("-+ #0", *p)) {
+		p++;
+	}
+	if (*p == '*') {
+		(*stars)++;
+		p++;
+	}
+	while (*p >= '0' && *p <= '9') {
+		p++;
+	}
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			(*stars)++;
+			p++;
 		}
-		if (logMemory.tailtcp == logMemory.head)
-		{
-			logMemory.tailtcp = (logMemory.tailtcp + 1) % LOGSIZE;
+		while (*p >= '0' && *p <= '9') {
+			p++;
+		}
+	}
+	while (*p == 'h' || *p == 'l' || *p == 'z') {
+		if (*p == 'l') {
+			longs++;
+		}
+		else if (*p == 'z') {
+			bSize = true;
 		}
-		if (logMemory.tailhttp == logMemory.head)
+		p++;
+	}
+	switch (*p) {
+	case '%':
+		*type = LOG_ARG_NONE;
+		break;
+	case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+		if (bSize)
+			*type = LOG_ARG_SIZE;
+		else if (longs >= 2)
+			*type = LOG_ARG_LONGLONG;
+		else if (longs == 1)
+			*type = LOG_ARG_LONG;
+		else
+			*type = LOG_ARG_INT;
+		break;
+	case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+		*type = LOG_ARG_DOUBLE;
+		break;
+	case 's':
+		*type = LOG_ARG_STRING;
+		break;
+	case 'p':
+		*type = LOG_ARG_POINTER;
+		break;
+	default:
+		// %n, %L, %j and others
+		*type = LOG_ARG_UNSUPPORTED;
+		return p;
+	}
+	return p + 1;
+}
+
+#define LOG_PACK_VALUE(T) { T v = va_arg(argList, T); \
+	if (len + (int)sizeof(v) > maxLen) return -1; \
+	memcpy(out + len, &v, sizeof(v)); len += sizeof(v); }
+
+// sum of width and precision written as digits in a conversion spec
+static int LOG_SpecDigits(const char* p, const char* end) {
+	int sum = 0;
+
+	while (p < end) {
+		if (*p >= '1' && *p <= '9') {
+			sum += atoi(p);
+			while (*p >= '0' && *p <= '9') {
+				p++;
+			}
+		}
+		else {
+			p++;
+		}
+	}
+	return sum;
+}
+
+// stores arguments as raw bytes, returns length or -1 if not possible,
+// also when the formatted text might not fit in maxText characters
+static int LOG_PackArgsV(byte* out, int maxLen, int maxText, const char* fmt, va_list argList) {
+	const char* p = fmt;
+	const char* spec;
+	const char* s;
+	int len = 0;
+	int type, stars, slen, starValue;
+	int text = strlen(fmt);
+	double d;
+
+	while ((p = strchr(p, '%')) != 0) {
+		spec = p;
+		p = LOG_ParseSpec(p + 1, &type, &stars);
+		if (type == LOG_ARG_UNSUPPORTED) {
+			return -1;
+		}
+		// upper bound of the text produced by this conversion
+		text += LOG_SpecDigits(spec, p);
+		while (stars--) {
+			starValue = va_arg(argList, int);
+			if (len + (int)sizeof(starValue) > maxLen) {
+				return -1;
+			}
+			memcpy(out + len, &starValue, sizeof(starValue));
+			len += sizeof(starValue);
+			text += starValue > 0 ? starValue : -starValue;
+		}
+		switch (type) {
+		case LOG_ARG_INT:
+			LOG_PACK_VALUE(int);
+			text += 24;
+			break;
+		case LOG_ARG_LONG:
+			LOG_PACK_VALUE(long);
+			text += 24;
+			break;
+		case LOG_ARG_LONGLONG:
+			LOG_PACK_VALUE(long long);
+			text += 24;
+			break;
+		case LOG_ARG_SIZE:
+			LOG_PACK_VALUE(size_t);
+			text += 24;
+			break;
+		case LOG_ARG_DOUBLE:
+			d = va_arg(argList, double);
+			if (len + (int)sizeof(d) > maxLen) {
+				return -1;
+			}
+			memcpy(out + len, &d, sizeof(d));
+			len += sizeof(d);
+			// %f of a huge value can be hundreds of digits
+			if (!(d < 1e15 && d > -1e15)) {
+				return -1;
+			}
+			text += 24;
+			break;
+		case LOG_ARG_POINTER:
+			LOG_PACK_VALUE(void*);
+			text += 24;
+			break;
+		case LOG_ARG_STRING:
+			s = va_arg(argList, const char*);
+			if (s == 0) {
+				s = "(null)";
+			}
+			slen = strlen(s) + 1;
+			if (len + slen > maxLen) {
+				return -1;
+			}
+			memcpy(out + len, s, slen);
+			len += slen;
+			text += slen;
+			break;
+		}
+		if (text > maxText) {
+			return -1;
+		}
+	}
+	return len;
+}
+
+#define LOG_UNPACK_VALUE(T) { T v; \
+	if (argsPos + (int)sizeof(v) > argsLen) goto done; \
+	memcpy(&v, args + argsPos, sizeof(v)); argsPos += sizeof(v); \
+	LOG_PRINT_VALUE(v); }
+#define LOG_PRINT_VALUE(v) \
+	if (stars == 0) n = snprintf(t, remaining, spec, v); \
+	else if (stars == 1) n = snprintf(t, remaining, spec, starValues[0], v); \
+	else n = snprintf(t, remaining, spec, starValues[0], starValues[1], v);
+
+// formats a deferred record to text, like LOG_FormatLineV does
+static int LOG_FormatDeferred(char* out, int outSize, const byte* rec, int recLen) {
+	logDeferredHeader_t hdr;
+	const byte* args = rec + sizeof(hdr);
+	int argsLen = recLen - sizeof(hdr);
+	int argsPos = 0;
+	const char* p;
+	const char* specEnd;
+	char spec[24];
+	char* t;
+	int remaining, n, i;
+	int type, stars;
+	int starValues[2];
+
+	memcpy(&hdr, rec, sizeof(hdr));
+	t = out;
+	if (hdr.feature != LOG_FEATURE_RAW) {
+		t += sprintf(t, "%s", loglevelnames[hdr.level]);
+		if (hdr.feature < sizeof(logfeaturenames) / sizeof(*logfeaturenames)) {
+			t += sprintf(t, "%s", logfeaturenames[hdr.feature]);
+		}
+	}
+	p = hdr.fmt;
+	// save 3 bytes at end for /r/n/0
+	while (*p && (remaining = outSize - 3 - (t - out)) > 1) {
+		if (*p != '%') {
+			*t++ = *p++;
+			continue;
+		}
+		specEnd = LOG_ParseSpec(p + 1, &type, &stars);
+		if (type == LOG_ARG_NONE) {
+			*t++ = '%';
+			p = specEnd;
+			continue;
+		}
+		if (specEnd - p >= (int)sizeof(spec)) {
+			break;
+		}
+		memcpy(spec, p, specEnd - p);
+		spec[specEnd - p] = 0;
+		p = specEnd;
+		for (i = 0; i < stars; i++) {
+			if (argsPos + (int)sizeof(int) > argsLen) {
+				goto done;
+			}
+			memcpy(&starValues[i], args + argsPos, sizeof(int));
+			argsPos += sizeof(int);
+		}
+		n = 0;
+		switch (type) {
+		case LOG_ARG_INT:
+			LOG_UNPACK_VALUE(int);
+			break;
+		case LOG_ARG_LONG:
+			LOG_UNPACK_VALUE(long);
+			break;
+		case LOG_ARG_LONGLONG:
+			LOG_UNPACK_VALUE(long long);
+			break;
+		case LOG_ARG_SIZE:
+			LOG_UNPACK_VALUE(size_t);
+			break;
+		case LOG_ARG_DOUBLE:
+			LOG_UNPACK_VALUE(double);
+			break;
+		case LOG_ARG_POINTER:
+			LOG_UNPACK_VALUE(void*);
+			break;
+		case LOG_ARG_STRING:
 		{
-			logMemory.tailhttp = (logMemory.tailhttp + 1) % LOGSIZE;
+			const char* v = (const char*)args + argsPos;
+			argsPos += strlen(v) + 1;
+			LOG_PRINT_VALUE(v);
+		}
+		break;
 		}
+		if (n < 0) {
+			n = 0;
+		}
+		else if (n >= remaining) {
+			n = remaining - 1;
+		}
+		t += n;
 	}
+done:
+	if (t > out && t[-1] == '\n') t--;
+	if (t > out && t[-1] == '\r') t--;
+
+	*t++ = '\r';
+	*t++ = '\n';
+	*t = '\0';
+	return t - out;
+}
+
+// like addLogAdv, but format string must be a literal (it's stored as pointer)
+// and the formatting is done later, by the sink reading the log
+void addLogDeferred(int level, int feature, const char* fmt, ...)
+{
+	va_list argList;
+	BaseType_t taken;
+	logDeferredHeader_t hdr;
+	int len, maxText;
 
+	if (fmt == 0)
+	{
+		return;
+	}
+	if (LOG_CheckFilterAndInit(level, feature) == false) {
+		return;
+	}
+	// those outputs need text right now
+	if (g_logDeferred == 0 || g_log_alsoPrintToHTTP || g_extraSocketToSendLOG
+		|| direct_serial_log == LOGTYPE_DIRECT
+#if WINDOWS
+		|| direct_serial_log != LOGTYPE_NONE
+#endif
+		) {
+		va_start(argList, fmt);
+		LOG_AddFormattedV(level, feature, fmt, argList);
+		va_end(argList);
+		return;
+	}
+	taken = xSemaphoreTake(logMemory.mutex, 100);
+	hdr.fmt = fmt;
+	hdr.level = level;
+	hdr.feature = feature;
+	memcpy(g_loggingBuffer + LOG_ENTRY_HEADER, &hdr, sizeof(hdr));
+	len = LOG_ENTRY_HEADER + sizeof(hdr);
+	// prefixes and \r\n\0 take some of the text space
+	maxText = LOG_DEFERRED_MAX_TEXT - 3;
+	if (feature != LOG_FEATURE_RAW) {
+		maxText -= strlen(loglevelnames[level]);
+		if (feature < (int)(sizeof(logfeaturenames) / sizeof(*logfeaturenames))) {
+			maxText -= strlen(logfeaturenames[feature]);
+		}
+	}
+	va_start(argList, fmt);
+	len = LOG_PackArgsV((byte*)g_loggingBuffer + len, LOG_DEFERRED_MAX_RECORD - sizeof(hdr), maxText, fmt, argList);
+	va_end(argList);
+	if (len >= 0) {
+		len += LOG_ENTRY_HEADER + sizeof(hdr);
+		LOG_WriteEntry(g_loggingBuffer, len, LOG_ENTRY_DEFERRED);
+	}
 	if (taken == pdTRUE) {
 		xSemaphoreGive(logMemory.mutex);
 	}
-#ifdef PLATFORM_BEKEN
-	trigger_log_send();
-#endif	
-	if (log_delay != 0) 
-    {
-		int timems = log_delay;
-		// is log_delay set -ve, then calculate delay
-		// required for the number of characters to TX
-		// plus 2ms to be sure.
-		if (log_delay < 0) 
-        {
-			int cps = (115200 / 8);
-			timems = (((1000 / portTICK_RATE_MS) * len) / cps) + 2;
-            if (timems < 2)
-                timems = 2;
-		}
-		rtos_delay_milliseconds(timems);
+	if (len < 0) {
+		// too long, text might not fit or unsupported format, do it now
+		va_start(argList, fmt);
+		LOG_AddFormattedV(level, feature, fmt, argList);
+		va_end(argList);
+		return;
 	}
+	LOG_AfterAdd(len);
 }
 
+#endif
 
-static int getData(char* buff, int buffsize, int* tail) {
-	BaseType_t taken;
+// skips entries that were already overwritten
+static unsigned int LOG_ClampSinkTail(logSink_t* sink, int* offset) {
+	unsigned int oldest = logMemory.oldest;
+
+	if ((int)(oldest - sink->tail) > 0) {
+		sink->dropped += oldest - sink->tail;
+		sink->tail = oldest;
+		sink->offset = 0;
+	}
+	*offset = sink->offset;
+	return sink->tail;
+}
+
+// Copies text from the ring to buff, formatting the deferred entries.
+// Each sink remembers entry and offset in its text, so an entry
+// can be returned in a few parts.
+static int getData(char* buff, int buffsize, logSink_t* sink) {
+	unsigned int head, tail, start;
+	int offset;
+	int hdr, entryLen, textLen, n;
 	int count;
-	char* p;
+	int tries;
+	const char* text;
+#if ENABLE_DEFERRED_LOG
+	byte rec[LOG_DEFERRED_MAX_RECORD];
+	char deferredText[LOG_DEFERRED_MAX_TEXT];
+#endif
+
 	if (!initialised)
 		return 0;
-	taken = xSemaphoreTake(logMemory.mutex, 100);
-	if (taken == 0)
-	{
-		return 0;
-	}
 
-	count = 0;
-	p = buff;
-	while (buffsize > 1) {
-		if (*tail == logMemory.head) {
-			break;
+	for (tries = 0; tries < 4; tries++) {
+		head = logMemory.head;
+		LOG_MEMORY_BARRIER();
+		start = tail = LOG_ClampSinkTail(sink, &offset);
+		count = 0;
+		while (tail != head && count < buffsize - 1) {
+			hdr = LOG_RingGetEntryHeader(tail);
+			entryLen = hdr & LOG_ENTRY_LENGTH_MASK;
+			if (entryLen <= LOG_ENTRY_HEADER || entryLen > (int)(head - tail)) {
+				// header was overwritten
+				break;
+			}
+			textLen = entryLen - LOG_ENTRY_HEADER;
+			text = 0;
+#if ENABLE_DEFERRED_LOG
+			if (hdr & LOG_ENTRY_DEFERRED) {
+				if (textLen > (int)sizeof(rec)) {
+					break;
+				}
+				LOG_RingCopyOut(tail + LOG_ENTRY_HEADER, rec, textLen);
+				LOG_MEMORY_BARRIER();
+				// format pointer must be valid before it's used
+				if (logMemory.reserved - start > LOGSIZE) {
+					break;
+				}
+				textLen = LOG_FormatDeferred(deferredText, sizeof(deferredText), rec, textLen);
+				text = deferredText;
+			}
+#endif
+			n = textLen - offset;
+			if (n > buffsize - 1 - count) {
+				n = buffsize - 1 - count;
+			}
+			if (text) {
+				memcpy(buff + count, text + offset, n);
+			}
+			else {
+				LOG_RingCopyOut(tail + LOG_ENTRY_HEADER + offset, buff + count, n);
+			}
+			count += n;
+			offset += n;
+			if (offset == textLen) {
+				tail += entryLen;
+				offset = 0;
+			}
 		}
-		*p = logMemory.log[*tail];
-		p++;
-		(*tail) = ((*tail) + 1) % LOGSIZE;
-		buffsize--;
-		count++;
+		LOG_MEMORY_BARRIER();
+		// if a writer has overwritten what we have copied, try again
+		if (logMemory.reserved - start > LOGSIZE) {
+			continue;
+		}
+		sink->tail = tail;
+		sink->offset = offset;
+		buff[count] = 0;
+		return count;
 	}
-	*p = 0;
+	buff[0] = 0;
+	return 0;
+}
 
-	if (taken == pdTRUE) {
-		xSemaphoreGive(logMemory.mutex);
+int LOG_ReadSink(int sinkIndex, char* buff, int buffsize) {
+	return getData(buff, buffsize, &logMemory.sinks[sinkIndex]);
+}
+// includes the data that was overwritten, but not yet noticed by the sink
+unsigned int LOG_GetSinkDropped(int sinkIndex) {
+	logSink_t* sink = &logMemory.sinks[sinkIndex];
+	unsigned int oldest = logMemory.oldest;
+
+	if ((int)(oldest - sink->tail) > 0) {
+		return sink->dropped + oldest - sink->tail;
 	}
-	return count;
+	return sink->dropped;
 }
 
 #if PLATFORM_BEKEN
@@ -496,44 +1041,44 @@ static int getData(char* buff, int buffsize, int* tail) {
 // and not wait.
 // so in our thread, send until full, and never spin waiting to send...
 // H/W TX fifo seems to be 256 bytes!!!
+static char serialStage[64];
+static int serialStageLen = 0;
+static int serialStagePos = 0;
+
 static int getSerial2() {
 	if (!initialised) return 0;
-	int* tail = &logMemory.tailserial;
-	char c;
-	BaseType_t taken = xSemaphoreTake(logMemory.mutex, 100);
-	char overflow = 0;
+	logSink_t* sink = &logMemory.sinks[LOG_SINK_SERIAL];
+	unsigned int dropped;
 
-	// if we hit overflow
-	if (logMemory.tailserial == (logMemory.head + 1) % LOGSIZE) {
-		overflow = 1;
-	}
-
-	while ((*tail != logMemory.head) && !uart_is_tx_fifo_full(UART_PORT)) {
-		c = logMemory.log[*tail];
-		if (overflow) {
-			c = '^'; // replace the first char with ^ if we overflowed....
-			overflow = 0;
+	while (1) {
+		if (serialStagePos == serialStageLen) {
+			dropped = sink->dropped;
+			serialStagePos = 0;
+			serialStageLen = getData(serialStage, sizeof(serialStage), sink);
+			if (serialStageLen == 0) {
+				return 0;
+			}
+			// if we hit overflow
+			if (dropped != sink->dropped) {
+				serialStage[0] = '^'; // replace the first char with ^ if we overflowed....
+			}
 		}
-
-		(*tail) = ((*tail) + 1) % LOGSIZE;
-
-		if (direct_serial_log == LOGTYPE_THREAD) {
-			UART_WRITE_BYTE(UART_PORT_INDEX, c);
+		while (serialStagePos < serialStageLen) {
+			if (uart_is_tx_fifo_full(UART_PORT)) {
+				return 1;
+			}
+			if (direct_serial_log == LOGTYPE_THREAD) {
+				UART_WRITE_BYTE(UART_PORT_INDEX, serialStage[serialStagePos]);
+			}
+			serialStagePos++;
 		}
 	}
-
-	int remains = (*tail != logMemory.head);
-
-	if (taken == pdTRUE) {
-		xSemaphoreGive(logMemory.mutex);
-	}
-	return remains;
 }
 
 #else
 
 static int getSerial(char* buff, int buffsize) {
-	int len = getData(buff, buffsize, &logMemory.tailserial);
+	int len = getData(buff, buffsize, &logMemory.sinks[LOG_SINK_SERIAL]);
 	//bk_printf("got serial: %d:%s\r\n", len, buff);
 	return len;
 }
@@ -542,13 +1087,13 @@ static int getSerial(char* buff, int buffsize) {
 
 
 static int getTcp(char* buff, int buffsize) {
-	int len = getData(buff, buffsize, &logMemory.tailtcp);
+	int len = getData(buff, buffsize, &logMemory.sinks[LOG_SINK_TCP]);
 	//bk_printf("got tcp: %d:%s\r\n", len,buff);
 	return len;
 }
 
 static int getHttp(char* buff, int buffsize) {
-	int len = getData(buff, buffsize, &logMemory.tailhttp);
+	int len = getData(buff, buffsize, &logMemory.sinks[LOG_SINK_HTTP]);
 	//printf("got tcp: %d:%s\r\n", len,buff);
 	return len;
 }
@@ -848,6 +1393,13 @@ commandResult_t log_command(const void* context, const char* cmd, const char* ar
 			result = CMD_RES_OK;
 			break;
 		}
+#if ENABLE_DEFERRED_LOG
+		if (!stricmp(cmd, "logdeferred")) {
+			g_logDeferred = atoi(args);
+			result = CMD_RES_OK;
+			break;
+		}
+#endif
 		if (!stricmp(cmd, "logdelay")) {
 			int res, delay;
 			res = sscanf(args, "%d", &delay);
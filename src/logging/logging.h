@@ -15,14 +15,35 @@
 #define _OBK_LOGGING_H
 
 void addLogAdv(int level, int feature, const char *fmt, ...);
+// Format string must be a literal, because only the pointer is stored.
+// Arguments are copied and the text is formatted later, when log is read.
+// Use it only for frequent logs.
+void addLogDeferred(int level, int feature, const char *fmt, ...);
 void LOG_SetRawSocketCallback(int newFD);
 
+// each log output keeps its own position in the log ring
+typedef enum logSinkIndex_e {
+	LOG_SINK_SERIAL,
+	LOG_SINK_TCP,
+	LOG_SINK_HTTP,
+	LOG_SINK_MAX,
+} logSinkIndex_t;
+
+int LOG_ReadSink(int sinkIndex, char *buff, int buffsize);
+unsigned int LOG_GetSinkDropped(int sinkIndex);
+
 #define ADDLOG_ERROR(x, fmt, ...) addLogAdv(LOG_ERROR, x, fmt, ##__VA_ARGS__)
 #define ADDLOG_WARN(x, fmt, ...)  addLogAdv(LOG_WARN, x, fmt, ##__VA_ARGS__)
 #define ADDLOG_INFO(x, fmt, ...)  addLogAdv(LOG_INFO, x, fmt, ##__VA_ARGS__)
 #define ADDLOG_DEBUG(x, fmt, ...) addLogAdv(LOG_DEBUG, x, fmt, ##__VA_ARGS__)
 #define ADDLOG_EXTRADEBUG(x, fmt, ...) addLogAdv(LOG_EXTRADEBUG, x, fmt, ##__VA_ARGS__)
 
+#if ENABLE_DEFERRED_LOG
+#define ADDLOG_DEFERRED(level, x, fmt, ...) addLogDeferred(level, x, fmt, ##__VA_ARGS__)
+#else
+#define ADDLOG_DEFERRED(level, x, fmt, ...) addLogAdv(level, x, fmt, ##__VA_ARGS__)
+#endif
+
 #define ADDLOGF_ERROR(fmt, ...) addLogAdv(LOG_ERROR, LOG_FEATURE, fmt, ##__VA_ARGS__)
 #define ADDLOGF_WARN(fmt, ...)  addLogAdv(LOG_WARN, LOG_FEATURE, fmt, ##__VA_ARGS__)
 #define ADDLOGF_INFO(fmt, ...)  addLogAdv(LOG_INFO, LOG_FEATURE, fmt, ##__VA_ARGS__)
@@ -4,6 +4,7 @@
 #if ENABLE_MQTT 
 
 #include "new_mqtt.h"
+#include "new_mqtt_topicTrie.h"
 #include "../new_common.h"
 #include "../new_pins.h"
 #include "../new_cfg.h"
@@ -16,6 +17,7 @@
 #include "../driver/drv_deviceclock.h"
 #include "../driver/drv_tuyaMCU.h"
 #include "../hal/hal_ota.h"
+#include "../quicktick.h"
 #include <math.h>
 #ifndef WINDOWS
 #include <lwip/dns.h>
@@ -93,62 +95,44 @@ static short g_teleState_interval = 120;
 static short g_teleSensor_interval = 3;
 
 /////////////////////////////////////////////////////////////
-// mqtt receive buffer, so we can action in our threads, not
+// mqtt receive ring, so we can action in our threads, not
 // in tcp_thread
 //
+// Every message is one contiguous record: mqttRxRecord_t, topic, data,
+// each null terminated. Records that don't fit at the end of the ring
+// go to the start, like in publish queue, so consumer gets pointers into
+// the ring and nothing is copied after lwIP hands us the data.
+#ifndef MQTT_RX_BUFFER_MAX
 #define MQTT_RX_BUFFER_MAX 4096
-unsigned char mqtt_rx_buffer[MQTT_RX_BUFFER_MAX];
-int mqtt_rx_buffer_head;
-int mqtt_rx_buffer_tail;
-int mqtt_rx_buffer_count;
-unsigned char temp_topic[128];
-unsigned char temp_data[2048];
-
-int addLenData(int len, const unsigned char *data){
-	mqtt_rx_buffer[mqtt_rx_buffer_head] = (len >> 8) & 0xff;
-	mqtt_rx_buffer_head = (mqtt_rx_buffer_head + 1) % MQTT_RX_BUFFER_MAX;
-	mqtt_rx_buffer_count++;
-	mqtt_rx_buffer[mqtt_rx_buffer_head] = (len) & 0xff;
-	mqtt_rx_buffer_head = (mqtt_rx_buffer_head + 1) % MQTT_RX_BUFFER_MAX;
-	mqtt_rx_buffer_count++;
-	for (int i = 0; i < len; i++){
-		mqtt_rx_buffer[mqtt_rx_buffer_head] = data[i];
-		mqtt_rx_buffer_head = (mqtt_rx_buffer_head + 1) % MQTT_RX_BUFFER_MAX;
-		mqtt_rx_buffer_count++;
-	}
-	return len + 2;
-}
-
-int getLenData(int *len, unsigned char *data, int maxlen){
-	int l;
-	l = mqtt_rx_buffer[mqtt_rx_buffer_tail];
-	mqtt_rx_buffer_tail = (mqtt_rx_buffer_tail + 1) % MQTT_RX_BUFFER_MAX;
-	mqtt_rx_buffer_count--;
-	l = l<<8;
-	l |= mqtt_rx_buffer[mqtt_rx_buffer_tail];
-	mqtt_rx_buffer_tail = (mqtt_rx_buffer_tail + 1) % MQTT_RX_BUFFER_MAX;
-	mqtt_rx_buffer_count--;
-
-	for (int i = 0; i < l; i++){
-		if (i < maxlen){
-			data[i] = mqtt_rx_buffer[mqtt_rx_buffer_tail];
-		}
-		mqtt_rx_buffer_tail = (mqtt_rx_buffer_tail + 1) % MQTT_RX_BUFFER_MAX;
-		mqtt_rx_buffer_count--;
-	}
-	if (mqtt_rx_buffer_count < 0){
-		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_rx buffer underflow!!!");
-		mqtt_rx_buffer_count = 0;
-		mqtt_rx_buffer_tail = mqtt_rx_buffer_head = 0;
-	}
-
-	if (l > maxlen){
-		*len = maxlen;
-	} else {
-		*len = l;
-	}
-	return l + 2;
-}
+#endif
+
+typedef struct mqttRxRecord_s {
+	// whole record with padding, 0 marks skipped end of ring
+	unsigned short size;
+	unsigned short topicLen;
+	int dataLen;
+} mqttRxRecord_t;
+
+#define MQTT_RX_RECORD_SIZE(topicLen, dataLen) \
+	((sizeof(mqttRxRecord_t) + (topicLen) + 1 + (dataLen) + 1 + 3) & ~3)
+#define MQTT_RX_RECORD_TOPIC(rec) ((char*)(rec) + sizeof(mqttRxRecord_t))
+#define MQTT_RX_RECORD_DATA(rec) ((unsigned char*)MQTT_RX_RECORD_TOPIC(rec) + (rec)->topicLen + 1)
+
+static int g_mqttRxArena[MQTT_RX_BUFFER_MAX / sizeof(int)];
+#define g_mqttRxBuffer ((byte*)g_mqttRxArena)
+// offset of the oldest record
+static int g_mqttRxHead = 0;
+// offset where next record will be written
+static int g_mqttRxTail = 0;
+static int g_mqttRxCount = 0;
+// record being filled by fragments, not visible to consumer yet
+static int g_mqttRxPending = -1;
+// how much of the pending record data has arrived
+static int g_mqttRxPendingFill = 0;
+// largest message that will be reassembled, see mqtt_rxMaxSize
+static int g_mqttRxMaxMessage = 2048;
+static int stat_mqttRxReassembled = 0;
+static int stat_mqttRxDropped = 0;
 
 static SemaphoreHandle_t g_mutex = 0;
 
@@ -171,6 +155,124 @@ static void MQTT_Mutex_Free()
 	xSemaphoreGive(g_mutex);
 }
 
+// returns offset where a record of given size can be written, or -1
+static int MQTT_RxFindSpace(int size) {
+	if (g_mqttRxCount == 0 && g_mqttRxPending < 0) {
+		g_mqttRxHead = g_mqttRxTail = 0;
+	}
+	if (g_mqttRxCount == 0 && g_mqttRxTail == 0) {
+		return size <= MQTT_RX_BUFFER_MAX ? 0 : -1;
+	}
+	if (g_mqttRxTail > g_mqttRxHead || g_mqttRxCount == 0) {
+		if (g_mqttRxTail + size <= MQTT_RX_BUFFER_MAX) {
+			return g_mqttRxTail;
+		}
+		// doesn't fit at the end, try to wrap to the start
+		if (size <= g_mqttRxHead) {
+			if (g_mqttRxTail + (int)sizeof(mqttRxRecord_t) <= MQTT_RX_BUFFER_MAX) {
+				((mqttRxRecord_t*)(g_mqttRxBuffer + g_mqttRxTail))->size = 0;
+			}
+			return 0;
+		}
+		return -1;
+	}
+	// already wrapped, free space is between tail and head
+	if (g_mqttRxTail + size <= g_mqttRxHead) {
+		return g_mqttRxTail;
+	}
+	return -1;
+}
+// reserves record for message with dataLen bytes and copies topic into it,
+// data is written later with MQTT_RxAppend. Call with mutex taken.
+static mqttRxRecord_t* MQTT_RxReserve(const char* topic, int topicLen, int dataLen) {
+	mqttRxRecord_t* rec;
+	int size, ofs;
+
+	if (dataLen > g_mqttRxMaxMessage) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_rx message too large (%i) for topic %s", dataLen, topic);
+		stat_mqttRxDropped++;
+		return NULL;
+	}
+	size = MQTT_RX_RECORD_SIZE(topicLen, dataLen);
+	ofs = MQTT_RxFindSpace(size);
+	if (ofs < 0) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_rx buffer overflow for topic %s", topic);
+		stat_mqttRxDropped++;
+		return NULL;
+	}
+	rec = (mqttRxRecord_t*)(g_mqttRxBuffer + ofs);
+	rec->size = size;
+	rec->topicLen = topicLen;
+	rec->dataLen = dataLen;
+	memcpy(MQTT_RX_RECORD_TOPIC(rec), topic, topicLen);
+	MQTT_RX_RECORD_TOPIC(rec)[topicLen] = 0;
+	g_mqttRxPending = ofs;
+	g_mqttRxPendingFill = 0;
+	// tail moves now, so that wrap marker written above stays valid
+	g_mqttRxTail = ofs + size;
+	return rec;
+}
+// adds fragment to pending record, returns 1 once it's complete and visible
+static int MQTT_RxAppend(const unsigned char* data, int len) {
+	mqttRxRecord_t* rec;
+
+	if (g_mqttRxPending < 0) {
+		return 0;
+	}
+	rec = (mqttRxRecord_t*)(g_mqttRxBuffer + g_mqttRxPending);
+	if (len > rec->dataLen - g_mqttRxPendingFill) {
+		len = rec->dataLen - g_mqttRxPendingFill;
+	}
+	memcpy(MQTT_RX_RECORD_DATA(rec) + g_mqttRxPendingFill, data, len);
+	g_mqttRxPendingFill += len;
+	if (g_mqttRxPendingFill < rec->dataLen) {
+		return 0;
+	}
+	MQTT_RX_RECORD_DATA(rec)[rec->dataLen] = 0;
+	g_mqttRxPending = -1;
+	g_mqttRxCount++;
+	return 1;
+}
+// forgets pending record, like if message never came
+static void MQTT_RxDropPending() {
+	if (g_mqttRxPending < 0) {
+		return;
+	}
+	g_mqttRxTail = g_mqttRxPending;
+	g_mqttRxPending = -1;
+	stat_mqttRxDropped++;
+}
+// returns the oldest complete record, skipping the wrap marker
+static mqttRxRecord_t* MQTT_RxPeek() {
+	mqttRxRecord_t* rec;
+
+	if (g_mqttRxCount == 0) {
+		return NULL;
+	}
+	if (g_mqttRxHead + (int)sizeof(mqttRxRecord_t) > MQTT_RX_BUFFER_MAX) {
+		g_mqttRxHead = 0;
+	}
+	rec = (mqttRxRecord_t*)(g_mqttRxBuffer + g_mqttRxHead);
+	if (rec->size == 0) {
+		g_mqttRxHead = 0;
+		rec = (mqttRxRecord_t*)g_mqttRxBuffer;
+	}
+	return rec;
+}
+static void MQTT_RxPop() {
+	mqttRxRecord_t* rec = MQTT_RxPeek();
+
+	if (rec == NULL) {
+		return;
+	}
+	g_mqttRxHead += rec->size;
+	g_mqttRxCount--;
+}
+void MQTT_GetRxStats(int* reassembled, int* dropped) {
+	*reassembled = stat_mqttRxReassembled;
+	*dropped = stat_mqttRxDropped;
+}
+
 // this is called from tcp_thread context to queue received mqtt,
 // and then we'll retrieve them from our own thread for processing.
 //
@@ -179,11 +281,10 @@ static void MQTT_Mutex_Free()
 // are working...
 int MQTT_Post_Received(const char *topic, int topiclen, const unsigned char *data, int datalen){
 	MQTT_Mutex_Take(100);
-	if ((MQTT_RX_BUFFER_MAX - 1 - mqtt_rx_buffer_count) < topiclen + datalen + 2 + 2){
-		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_rx buffer overflow for topic %s", topic);
-	} else {
-		addLenData(topiclen, (unsigned char *)topic);
-		addLenData(datalen, data);
+	// message being reassembled now can't be finished anyway
+	MQTT_RxDropPending();
+	if (MQTT_RxReserve(topic, topiclen, datalen)) {
+		MQTT_RxAppend(data, datalen);
 	}
 	MQTT_Mutex_Free();
 
@@ -196,29 +297,26 @@ int MQTT_Post_Received(const char *topic, int topiclen, const unsigned char *dat
 int MQTT_Post_Received_Str(const char *topic, const char *data) {
 	return MQTT_Post_Received(topic, strlen(topic), (const unsigned char*)data, strlen(data));
 }
-int get_received(char **topic, int *topiclen, unsigned char **data, int *datalen){
-	int res = 0;
-	MQTT_Mutex_Take(100);
-	if (mqtt_rx_buffer_tail != mqtt_rx_buffer_head){
-		getLenData(topiclen, temp_topic, sizeof(temp_topic)-1);
-		temp_topic[*topiclen] = 0;
-		getLenData(datalen, temp_data, sizeof(temp_data)-1);
-		temp_data[*datalen] = 0;
-		*topic = (char *)temp_topic;
-		*data = temp_data;
-		res = 1;
-	}
-	MQTT_Mutex_Free();
-	return res;
-}
 //
 //////////////////////////////////////////////////////////////////////
 
-#define MQTT_QUEUE_ITEM_IS_REUSABLE(x)  (x->topic[0] == 0)
-#define MQTT_QUEUE_ITEM_SET_REUSABLE(x) (x->topic[0] = 0)
-
-MqttPublishItem_t* g_MqttPublishQueueHead = NULL;
-int g_MqttPublishItemsQueued = 0;   //Items in the queue waiting to be published. This is not the queue length.
+// publish queue ring buffer, see MqttPublishItem_t
+static byte* g_mqttQueueArena = NULL;
+// offset of the oldest record
+static int g_mqttQueueHead = 0;
+// offset where next record will be written
+static int g_mqttQueueTail = 0;
+// offset of the newest record, for MQTT_InvokeCommandAtEnd
+static int g_mqttQueueLast = -1;
+// offset of record reserved by MQTT_QueueBeginPublish, not yet committed
+static int g_mqttQueuePending = -1;
+// bytes taken by queued records, and the highest value seen
+static int g_mqttQueueBytes = 0;
+static int g_mqttQueuePeakBytes = 0;
+// seconds the queue was empty, arena is freed after a while
+static int g_mqttQueueIdleSeconds = 0;
+static void MQTT_QueueFreeIfIdle();
+int g_MqttPublishItemsQueued = 0;   //Items in the queue waiting to be published.
 
 // from mqtt.c
 extern void mqtt_disconnect(mqtt_client_t* client);
@@ -248,6 +346,8 @@ typedef struct mqtt_callback_tag {
 #define MAX_MQTT_CALLBACKS 32
 static mqtt_callback_t* callbacks[MAX_MQTT_CALLBACKS];
 static int numCallbacks = 0;
+// base topics of callbacks, owner is index in callbacks
+static mqttTopicTrie_t g_mqtt_callbackTrie;
 // note: only one incomming can be processed at a time.
 static obk_mqtt_request_t g_mqtt_request;
 static obk_mqtt_request_t g_mqtt_request_cb;
@@ -399,8 +499,23 @@ char* MQTT_GetStatusMessage(void)
 	return mqtt_status_message;
 }
 
+// base topic ending with '/' gets everything below it
+static void MQTT_SetCallbackFilter(int index, const char* basetopic, int bAdd) {
+	char filter[128];
+
+	snprintf(filter, sizeof(filter), "%s%s", basetopic, *basetopic && basetopic[strlen(basetopic) - 1] == '/' ? "#" : "");
+	if (bAdd) {
+		MQTT_TopicTrie_Add(&g_mqtt_callbackTrie, filter, index);
+	}
+	else {
+		MQTT_TopicTrie_Remove(&g_mqtt_callbackTrie, filter, index);
+	}
+}
+
 void MQTT_ClearCallbacks() {
 	int i;
+
+	MQTT_TopicTrie_Clear(&g_mqtt_callbackTrie);
 	for (i = 0; i < MAX_MQTT_CALLBACKS; i++) {
 		if (callbacks[i]) {
 			free(callbacks[i]->topic);
@@ -453,6 +568,7 @@ int MQTT_RegisterCallback(const char* basetopic, const char* subscriptiontopic,
 	}
 	if (!callbacks[index]->topic || strcmp(callbacks[index]->topic, basetopic)) {
 		if (callbacks[index]->topic) {
+			MQTT_SetCallbackFilter(index, callbacks[index]->topic, 0);
 			os_free(callbacks[index]->topic);
 		}
 		callbacks[index]->topic = (char*)os_malloc(strlen(basetopic) + 1);
@@ -461,6 +577,7 @@ int MQTT_RegisterCallback(const char* basetopic, const char* subscriptiontopic,
 			return -3;
 		}
 		strcpy(callbacks[index]->topic, basetopic);
+		MQTT_SetCallbackFilter(index, basetopic, 1);
 	}
 
 	if (!callbacks[index]->subscriptionTopic || strcmp(callbacks[index]->subscriptionTopic, subscriptiontopic)) {
@@ -492,6 +609,7 @@ int MQTT_RegisterCallback(const char* basetopic, const char* subscriptiontopic,
 	}
 
 	callbacks[index]->callback = callback;
+	callbacks[index]->ID = ID;
 	if (index == numCallbacks) {
 		numCallbacks++;
 	}
@@ -512,6 +630,7 @@ int MQTT_RemoveCallback(int ID) {
 		if (callbacks[index]) {
 			if (callbacks[index]->ID == ID) {
 				if (callbacks[index]->topic) {
+					MQTT_SetCallbackFilter(index, callbacks[index]->topic, 0);
 					os_free(callbacks[index]->topic);
 					callbacks[index]->topic = NULL;
 				}
@@ -629,7 +748,11 @@ int channelGet(obk_mqtt_request_t* request) {
 		return 0;
 	}
 
-	MQTT_ChannelPublish(channel, 0);
+	// this is explicit request, so answer even if value did not change
+	if (MQTT_ChannelPublish(channel, OBK_PUBLISH_FLAG_NO_DEDUP) == OBK_PUBLISH_WINDOW_FULL) {
+		// sent with the next channel batch instead
+		MQTT_QueueChannelPublishFlags(channel, OBK_PUBLISH_FLAG_NO_DEDUP);
+	}
 
 	// return 1 to stop processing callbacks here.
 	// return 0 to allow later callbacks to process this topic.
@@ -764,6 +887,8 @@ int onHassStatus(obk_mqtt_request_t* request) {
 		const char *args = (const char *)request->received;
 		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "HA status - %s", args);
 		if (!strcmp(args, "online")) {
+			// HA has forgotten all states, so send them even if unchanged
+			MQTT_Dedup_Reset();
 			MQTT_PublishWholeDeviceState_Internal(true);
 		}
 	}
@@ -788,8 +913,8 @@ int tasCmnd(obk_mqtt_request_t* request) {
 
 #if 1
 	args = (const char *)request->received;
-	// I think that our function get_received always ensured that
-	// there is a NULL terminating character after payload of MQTT
+	// receive ring always puts
+	// a NULL terminating character after payload of MQTT
 	// So we can feed it directly as command
 	CMD_ExecuteCommandArgs(p, args, COMMAND_FLAG_SOURCE_MQTT);
 #if ENABLE_TASMOTA_JSON
@@ -843,9 +968,82 @@ static void MQTT_disconnect(mqtt_client_t* client)
 
 }
 
+// Platforms building libraries/mqtt_patched.c define OBK_MQTT_PATCHED and get
+// its request slot count, lwIP headers seen here may have another one.
+#if OBK_MQTT_PATCHED
+#include "../../libraries/mqtt_patched.h"
+#define MQTT_CLIENT_REQ_SLOTS MQTT_PATCHED_REQ_MAX_IN_FLIGHT
+#elif defined(MQTT_REQ_MAX_IN_FLIGHT)
+#define MQTT_CLIENT_REQ_SLOTS MQTT_REQ_MAX_IN_FLIGHT
+#else
+#define MQTT_CLIENT_REQ_SLOTS 4
+#endif
+// Every publish holds one lwIP request slot until PUBACK (or until sent for QoS 0).
+// Publishes are not started when the slots are used up, so bursts wait
+// instead of failing with ERR_MEM. One slot is left for subscribes.
+#define MQTT_PUBLISH_WINDOW (MQTT_CLIENT_REQ_SLOTS > 2 ? MQTT_CLIENT_REQ_SLOTS - 1 : 1)
+// topics up to this size are built without malloc
+#define MQTT_PUBLISH_TOPIC_BUFFER 128
+
+// changed from publishing thread and from lwIP callbacks, which run on
+// tcpip thread where LOCK_TCPIP_CORE does nothing, so it has own mutex
+static volatile int g_mqtt_publishesInFlight = 0;
+static SemaphoreHandle_t g_mqtt_inFlightMutex = 0;
+// releases that could not take the mutex, applied by next take
+static volatile int g_mqtt_publishesReleaseMissed = 0;
+// seconds without any free slot, in case lwIP lost some callbacks
+static int g_mqtt_publishWindowStuck = 0;
+static int stat_mqttPublishWindowFull = 0;
+// guarded by MQTT mutex
+static char g_mqtt_publishTopic[MQTT_PUBLISH_TOPIC_BUFFER];
+
+// mutex is created by MQTT_init, nothing is published before that
+// takes a publish slot, returns false when window is full
+static bool MQTT_InFlight_Take()
+{
+	bool bTaken = false;
+
+	if (xSemaphoreTake(g_mqtt_inFlightMutex, 100) != pdTRUE) {
+		return false;
+	}
+	if (g_mqtt_publishesReleaseMissed) {
+		g_mqtt_publishesInFlight -= g_mqtt_publishesReleaseMissed;
+		g_mqtt_publishesReleaseMissed = 0;
+		if (g_mqtt_publishesInFlight < 0) {
+			g_mqtt_publishesInFlight = 0;
+		}
+	}
+	if (g_mqtt_publishesInFlight < MQTT_PUBLISH_WINDOW) {
+		g_mqtt_publishesInFlight++;
+		bTaken = true;
+	}
+	xSemaphoreGive(g_mqtt_inFlightMutex);
+	return bTaken;
+}
+// gives back one slot, or all of them when bAll is set
+static void MQTT_InFlight_Release(bool bAll)
+{
+	// mutex is held only for a counter update, so this should not time out,
+	// but if it does, slot is given back by next MQTT_InFlight_Take
+	if (xSemaphoreTake(g_mqtt_inFlightMutex, 1000) != pdTRUE) {
+		if (!bAll) {
+			g_mqtt_publishesReleaseMissed++;
+		}
+		return;
+	}
+	if (bAll) {
+		g_mqtt_publishesInFlight = 0;
+	}
+	else if (g_mqtt_publishesInFlight > 0) {
+		g_mqtt_publishesInFlight--;
+	}
+	xSemaphoreGive(g_mqtt_inFlightMutex);
+}
+
 /* Called when publish is complete either with sucess or failure */
 static void mqtt_pub_request_cb(void* arg, err_t result)
 {
+	MQTT_InFlight_Release(false);
 	if (result != ERR_OK)
 	{
 		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Publish result: %d(%s)", result, get_error_name(result));
@@ -853,119 +1051,215 @@ static void mqtt_pub_request_cb(void* arg, err_t result)
 	}
 }
 
-// This publishes value to the specified topic/channel.
-static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const char* sTopic, const char* sChannel, const char* sVal, int flags, bool appendGet)
+// must be called with TCPIP core locked
+static err_t MQTT_SubmitPublish(mqtt_client_t* client, const char* topic, const char* val, int len, int qos, int retain)
 {
 	err_t err;
-	u8_t qos = 1; /* 0 1 or 2, see MQTT specification */
-	if (flags & OBK_PUBLISH_FLAG_QOS_ZERO)
-	{
-		qos = 0;
+
+	// counted before, because callback may come before mqtt_publish returns
+	if (MQTT_InFlight_Take() == false) {
+		stat_mqttPublishWindowFull++;
+		return ERR_WOULDBLOCK;
 	}
-	u8_t retain = 0; /* No don't retain such crappy payload... */
-	size_t sVal_len;
-	char* pub_topic;
+	err = mqtt_publish(client, topic, val, len, qos, retain, mqtt_pub_request_cb, 0);
+	if (err != ERR_OK) {
+		MQTT_InFlight_Release(false);
+	}
+	return err;
+}
 
-	if (client == 0)
-		return OBK_PUBLISH_WAS_DISCONNECTED;
+void MQTT_GetPublishWindowStats(int* inFlight, int* windowSize, int* windowFull)
+{
+	*inFlight = g_mqtt_publishesInFlight;
+	*windowSize = MQTT_PUBLISH_WINDOW;
+	*windowFull = stat_mqttPublishWindowFull;
+}
 
-	if (flags & OBK_PUBLISH_FLAG_MUTEX_SILENT)
+// returns topic in shared buffer, or malloced one if it is too long for it
+static char* MQTT_BuildPublishTopic(const char* sTopic, const char* sChannel, int flags, bool appendGet)
+{
+	char* topic = g_mqtt_publishTopic;
+	int len;
+
+	if (flags & OBK_PUBLISH_FLAG_RAW_TOPIC_NAME)
 	{
-		if (MQTT_Mutex_Take(100) == 0)
-		{
-			return OBK_PUBLISH_MUTEX_FAIL;
-		}
+		len = strlen(sChannel);
 	}
-	else {
-		if (MQTT_Mutex_Take(500) == 0)
-		{
-			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_PublishTopicToClient: mutex failed for %s=%s", sChannel, sVal);
-			return OBK_PUBLISH_MUTEX_FAIL;
+	else
+	{
+		len = strlen(sTopic) + 1 + strlen(sChannel) + 4; // 4 for /get
+	}
+	if (len >= MQTT_PUBLISH_TOPIC_BUFFER) {
+		topic = (char*)os_malloc(len + 1);
+		if (topic == NULL) {
+			return NULL;
 		}
 	}
-	if (flags & OBK_PUBLISH_FLAG_RETAIN)
+	if (flags & OBK_PUBLISH_FLAG_RAW_TOPIC_NAME)
 	{
-		retain = 1;
+		strcpy(topic, sChannel);
 	}
-	// global tool
-	if (CFG_HasFlag(OBK_FLAG_MQTT_ALWAYSSETRETAIN))
+	else
 	{
-		retain = 1;
+		sprintf(topic, "%s/%s%s", sTopic, sChannel, (appendGet == true ? "/get" : ""));
 	}
-	if (flags & OBK_PUBLISH_FLAG_FORCE_REMOVE_GET)
-	{
-		appendGet = false;
+	return topic;
+}
+
+// This publishes values to the specified topic/channels.
+// MQTT mutex and TCPIP core are taken once for all of them.
+static int MQTT_PublishItemsToClient(mqtt_client_t* client, const char* sTopic, const obk_mqtt_batchItem_t* items, int count, bool appendGet, OBK_Publish_Result* result)
+{
+	err_t err = ERR_OK;
+	u8_t qos;
+	u8_t retain;
+	bool itemAppendGet;
+	size_t sVal_len;
+	char* pub_topic = NULL;
+	const char* failedChannel = "";
+	mqtt_dedup_token_t dedup;
+	int flags;
+	int sent;
+
+	*result = OBK_PUBLISH_OK;
+	if (client == 0) {
+		*result = OBK_PUBLISH_WAS_DISCONNECTED;
+		return 0;
 	}
-	if (CFG_HasFlag(OBK_FLAG_MQTT_NEVERAPPENDGET))
-	{
-		appendGet = false;
+	if (count <= 0) {
+		return 0;
 	}
 
+	if (items[0].flags & OBK_PUBLISH_FLAG_MUTEX_SILENT)
+	{
+		if (MQTT_Mutex_Take(100) == 0)
+		{
+			*result = OBK_PUBLISH_MUTEX_FAIL;
+			return 0;
+		}
+	}
+	else {
+		if (MQTT_Mutex_Take(500) == 0)
+		{
+			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_PublishTopicToClient: mutex failed for %s=%s", items[0].channel, items[0].value);
+			*result = OBK_PUBLISH_MUTEX_FAIL;
+			return 0;
+		}
+	}
 
 	LOCK_TCPIP_CORE();
-	int res = mqtt_client_is_connected(client);
-	UNLOCK_TCPIP_CORE();
-
-	if (res == 0)
+	if (mqtt_client_is_connected(client) == 0)
 	{
+		UNLOCK_TCPIP_CORE();
 		g_my_reconnect_mqtt_after_time = 5;
 		MQTT_Mutex_Free();
-		return OBK_PUBLISH_WAS_DISCONNECTED;
+		*result = OBK_PUBLISH_WAS_DISCONNECTED;
+		return 0;
 	}
 
 	g_timeSinceLastMQTTPublish = 0;
 
-	pub_topic = (char*)os_malloc(strlen(sTopic) + 1 + strlen(sChannel) + 5 + 1); //5 for /get
-	if ((pub_topic != NULL) && (sVal != NULL))
+	for (sent = 0; sent < count; sent++)
 	{
-		sVal_len = strlen(sVal);
-		if (flags & OBK_PUBLISH_FLAG_RAW_TOPIC_NAME)
+		flags = items[sent].flags;
+		qos = 1; /* 0 1 or 2, see MQTT specification */
+		if (flags & OBK_PUBLISH_FLAG_QOS_ZERO)
 		{
-			strcpy(pub_topic, sChannel);
+			qos = 0;
 		}
-		else 
+		retain = 0; /* No don't retain such crappy payload... */
+		if (flags & OBK_PUBLISH_FLAG_RETAIN)
 		{
-			sprintf(pub_topic, "%s/%s%s", sTopic, sChannel, (appendGet == true ? "/get" : ""));
+			retain = 1;
 		}
-		if (sVal_len < 128)
+		// global tool
+		if (CFG_HasFlag(OBK_FLAG_MQTT_ALWAYSSETRETAIN))
 		{
-			addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Publishing val %s to %s retain=%i", sVal, pub_topic, retain);
+			retain = 1;
 		}
-		else {
-			addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Publishing val (%d bytes) to %s retain=%i", sVal_len, pub_topic, retain);
+		itemAppendGet = appendGet;
+		if (flags & OBK_PUBLISH_FLAG_FORCE_REMOVE_GET)
+		{
+			itemAppendGet = false;
 		}
-
-
-		LOCK_TCPIP_CORE();
-		err = mqtt_publish(client, pub_topic, sVal, strlen(sVal), qos, retain, mqtt_pub_request_cb, 0);
-		UNLOCK_TCPIP_CORE();
-		os_free(pub_topic);
-
-		if (err != ERR_OK)
+		if (CFG_HasFlag(OBK_FLAG_MQTT_NEVERAPPENDGET))
 		{
-			if (err == ERR_CONN)
-			{
-				addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Publish err: ERR_CONN aka %d", err);
+			itemAppendGet = false;
+		}
+		failedChannel = items[sent].channel;
+		if (items[sent].value == NULL) {
+			*result = OBK_PUBLISH_MEM_FAIL;
+			break;
+		}
+		pub_topic = MQTT_BuildPublishTopic(sTopic, items[sent].channel, flags, itemAppendGet);
+		if (pub_topic == NULL) {
+			*result = OBK_PUBLISH_MEM_FAIL;
+			break;
+		}
+		if (MQTT_Dedup_Check(pub_topic, items[sent].value, flags, &dedup)) {
+			// broker already has this value, or it will be sent later
+			if (pub_topic != g_mqtt_publishTopic) {
+				os_free(pub_topic);
 			}
-			else if (err == ERR_MEM) {
-				addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Publish err: ERR_MEM aka %d", err);
-				g_memoryErrorsThisSession++;
+			continue;
+		}
+		sVal_len = strlen(items[sent].value);
+		err = MQTT_SubmitPublish(client, pub_topic, items[sent].value, sVal_len, qos, retain);
+		if (err == ERR_OK) {
+			MQTT_Dedup_Sent(&dedup);
+			if (sVal_len < 128)
+			{
+				ADDLOG_DEFERRED(LOG_INFO, LOG_FEATURE_MQTT, "Publishing val %s to %s retain=%i", items[sent].value, pub_topic, retain);
 			}
 			else {
-				addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Publish err: %d", err);
+				ADDLOG_DEFERRED(LOG_INFO, LOG_FEATURE_MQTT, "Publishing val (%d bytes) to %s retain=%i", (int)sVal_len, pub_topic, retain);
 			}
-			mqtt_publish_errors++;
-			MQTT_Mutex_Free();
-			return OBK_PUBLISH_MEM_FAIL;
+			mqtt_published_events++;
+		}
+		if (pub_topic != g_mqtt_publishTopic) {
+			os_free(pub_topic);
+		}
+		if (err != ERR_OK) {
+			*result = err == ERR_WOULDBLOCK ? OBK_PUBLISH_WINDOW_FULL : OBK_PUBLISH_MEM_FAIL;
+			break;
 		}
-		mqtt_published_events++;
-		MQTT_Mutex_Free();
-		return OBK_PUBLISH_OK;
 	}
-	else {
-		MQTT_Mutex_Free();
-		return OBK_PUBLISH_MEM_FAIL;
+	UNLOCK_TCPIP_CORE();
+
+	if (err == ERR_WOULDBLOCK)
+	{
+		addLogAdv(LOG_DEBUG, LOG_FEATURE_MQTT, "Publish of %s postponed, %i publishes wait for broker", failedChannel, MQTT_PUBLISH_WINDOW);
 	}
+	else if (err != ERR_OK)
+	{
+		if (err == ERR_CONN)
+		{
+			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Publish err: ERR_CONN aka %d", err);
+		}
+		else if (err == ERR_MEM) {
+			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Publish err: ERR_MEM aka %d", err);
+			g_memoryErrorsThisSession++;
+		}
+		else {
+			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Publish err: %d", err);
+		}
+		mqtt_publish_errors++;
+	}
+	MQTT_Mutex_Free();
+	return sent;
+}
+
+// This publishes value to the specified topic/channel.
+static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const char* sTopic, const char* sChannel, const char* sVal, int flags, bool appendGet)
+{
+	obk_mqtt_batchItem_t item;
+	OBK_Publish_Result result;
+
+	item.channel = sChannel;
+	item.value = sVal;
+	item.flags = flags;
+	MQTT_PublishItemsToClient(client, sTopic, &item, 1, appendGet, &result);
+	return result;
 }
 
 // This is used to publish channel values in "obk0696FB33/1/get" format with numerical value,
@@ -997,6 +1291,14 @@ OBK_Publish_Result MQTT_Publish(const char* sTopic, const char* sChannel, const
 {
 	return MQTT_PublishTopicToClient(mqtt_client, sTopic, sChannel, sVal, flags, false);
 }
+int MQTT_PublishBatch(const char* sTopic, const obk_mqtt_batchItem_t* items, int count, OBK_Publish_Result* result)
+{
+	return MQTT_PublishItemsToClient(mqtt_client, sTopic, items, count, false, result);
+}
+int MQTT_PublishMain_Batch(const obk_mqtt_batchItem_t* items, int count, OBK_Publish_Result* result)
+{
+	return MQTT_PublishItemsToClient(mqtt_client, CFG_GetMQTTClientId(), items, count, true, result);
+}
 
 void MQTT_OBK_Printf(char* s) {
 	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, s);
@@ -1007,74 +1309,79 @@ void MQTT_OBK_Printf(char* s) {
 // we should do callbacks from one of our threads?
 static void mqtt_incoming_data_cb(void* arg, const u8_t* data, u16_t len, u8_t flags)
 {
-	int i;
 	// unused - left here as example
 	//const struct mqtt_connect_client_info_t* client_info = (const struct mqtt_connect_client_info_t*)arg;
 
-	// if we stored a topic in g_mqtt_request, then we found a matching callback, so use it.
-	if (g_mqtt_request.topic[0])
-	{
-		// note: data is NOT terminated (it may be binary...).
-		g_mqtt_request.received = data;
-		g_mqtt_request.receivedLen = len;
+	// if we stored a topic in g_mqtt_request, then we found a matching callback,
+	// and mqtt_incoming_publish_cb has reserved space for whole message in receive ring
+	if (g_mqtt_request.topic[0] == 0)
+		return;
 
+	MQTT_Mutex_Take(100);
+	// note: data is NOT terminated (it may be binary...).
+	// Large payloads come in many parts, message is visible to
+	// MQTT_process_received only when all of them are here.
+	if (MQTT_RxAppend(data, len)) {
 		//addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT in topic %s", g_mqtt_request.topic);
 		mqtt_received_events++;
-
-		for (i = 0; i < numCallbacks; i++)
-		{
-			if (callbacks[i] == 0)
-				continue;
-			char* cbtopic = callbacks[i]->topic;
-			if (!strncmp(g_mqtt_request.topic, cbtopic, strlen(cbtopic)))
-			{
-				MQTT_Post_Received(g_mqtt_request.topic, strlen(g_mqtt_request.topic), data, len);
-				// if ANYONE is interested, store it.
-				break;
-				// note - callback must return 1 to say it ate the mqtt, else further processing can be performed.
-				// i.e. multiple people can get each topic if required.
-				//if (callbacks[i]->callback(&g_mqtt_request))
-				//{
-				//	return;
-				//}
-			}
+		if (g_mqtt_request.receivedLen > len) {
+			stat_mqttRxReassembled++;
 		}
-		//addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT topic not handled: %s", g_mqtt_request.topic);
+		g_mqtt_request.topic[0] = 0;
+	}
+	else if (flags & MQTT_DATA_FLAG_LAST) {
+		// lwIP says that was all, but message is not complete
+		MQTT_RxDropPending();
+		g_mqtt_request.topic[0] = 0;
 	}
+	MQTT_Mutex_Free();
+
+#ifdef PLATFORM_BEKEN
+	if (g_mqtt_request.topic[0] == 0) {
+		MQTT_TriggerRead();
+	}
+#endif
 }
 
 
 // run from userland (quicktick or wakeable thread)
 int MQTT_process_received(){
-	char *topic;
-	int topiclen;
-	unsigned char *data;
-	int datalen;
-	int found = 0;
+	mqttRxRecord_t* rec;
+	unsigned int owners;
 	int count = 0;
-	do{
-		found = get_received(&topic, &topiclen, &data, &datalen);
-		if (found){
-			count++;
-			strncpy(g_mqtt_request_cb.topic, topic, sizeof(g_mqtt_request_cb.topic));
-			g_mqtt_request_cb.received = data;
-			g_mqtt_request_cb.receivedLen = datalen;
-			for (int i = 0; i < numCallbacks; i++)
+
+	while (1) {
+		MQTT_Mutex_Take(100);
+		rec = MQTT_RxPeek();
+		MQTT_Mutex_Free();
+		if (rec == NULL) {
+			break;
+		}
+		// record stays in the ring until callbacks are done with it
+		count++;
+		strncpy(g_mqtt_request_cb.topic, MQTT_RX_RECORD_TOPIC(rec), sizeof(g_mqtt_request_cb.topic) - 1);
+		g_mqtt_request_cb.topic[sizeof(g_mqtt_request_cb.topic) - 1] = 0;
+		g_mqtt_request_cb.received = MQTT_RX_RECORD_DATA(rec);
+		g_mqtt_request_cb.receivedLen = rec->dataLen;
+		owners = MQTT_TopicTrie_Match(&g_mqtt_callbackTrie, g_mqtt_request_cb.topic);
+		// callbacks are still tried in order of registration
+		for (int i = 0; owners; i++, owners >>= 1)
+		{
+			if ((owners & 1) && callbacks[i])
 			{
-				char* cbtopic = callbacks[i]->topic;
-				if (!strncmp(topic, cbtopic, strlen(cbtopic)))
+				// note - callback must return 1 to say it ate the mqtt, else further processing can be performed.
+				// i.e. multiple people can get each topic if required.
+				if (callbacks[i]->callback(&g_mqtt_request_cb))
 				{
-					// note - callback must return 1 to say it ate the mqtt, else further processing can be performed.
-					// i.e. multiple people can get each topic if required.
-					if (callbacks[i]->callback(&g_mqtt_request_cb))
-					{
-						// if no further processing, then break this loop.
-						break;
-					}
+					// if no further processing, then break this loop.
+					break;
 				}
 			}
 		}
-	} while (found);
+		MQTT_Mutex_Take(100);
+		MQTT_RxPop();
+		MQTT_Mutex_Free();
+	}
 
 	return count;
 }
@@ -1085,24 +1392,50 @@ int MQTT_process_received(){
 static void mqtt_incoming_publish_cb(void* arg, const char* topic, u32_t tot_len)
 {
 	//const char *p;
-	int i;
 	// unused - left here as example
 	//const struct mqtt_connect_client_info_t* client_info = (const struct mqtt_connect_client_info_t*)arg;
 
-	// look for a callback with this URL and method, or HTTP_ANY
+	MQTT_Mutex_Take(100);
+	// previous message never got its last part
+	MQTT_RxDropPending();
 	g_mqtt_request.topic[0] = '\0';
-	for (i = 0; i < numCallbacks; i++)
-	{
-		char* cbtopic = callbacks[i]->topic;
-		if (strncmp(topic, cbtopic, strlen(cbtopic)))
-		{
+	// if ANYONE is interested, space for whole message is reserved now
+	if (MQTT_TopicTrie_Match(&g_mqtt_callbackTrie, topic)) {
+		if (MQTT_RxReserve(topic, strlen(topic), tot_len)) {
 			strncpy(g_mqtt_request.topic, topic, sizeof(g_mqtt_request.topic) - 1);
 			g_mqtt_request.topic[sizeof(g_mqtt_request.topic) - 1] = 0;
-			break;
+			g_mqtt_request.receivedLen = tot_len;
 		}
 	}
+	MQTT_Mutex_Free();
 	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT client in mqtt_incoming_publish_cb topic %s", topic);
+	// empty payload still comes with one data callback
 }
+#ifdef WINDOWS
+// feeds message like lwIP does, with payload split in parts of fragmentSize bytes
+void SIM_MQTT_IncomingFragmented(const char* topic, const char* data, int fragmentSize) {
+	int len = strlen(data);
+	int ofs = 0;
+	int part;
+
+	mqtt_incoming_publish_cb(0, topic, len);
+	do {
+		part = len - ofs;
+		if (part > fragmentSize) {
+			part = fragmentSize;
+		}
+		mqtt_incoming_data_cb(0, (const u8_t*)data + ofs, part, ofs + part == len ? MQTT_DATA_FLAG_LAST : 0);
+		ofs += part;
+	} while (ofs < len);
+}
+// same as above, but parts are fed one by one by the caller
+void SIM_MQTT_IncomingStart(const char* topic, int totalLen) {
+	mqtt_incoming_publish_cb(0, topic, totalLen);
+}
+void SIM_MQTT_IncomingPart(const char* data, bool bLast) {
+	mqtt_incoming_data_cb(0, (const u8_t*)data, strlen(data), bLast ? MQTT_DATA_FLAG_LAST : 0);
+}
+#endif
 
 static void mqtt_request_cb(void* arg, err_t err)
 {
@@ -1126,9 +1459,13 @@ static void mqtt_connection_cb(mqtt_client_t* client, void* arg, mqtt_connection
 	//   addLogAdv(LOG_INFO,LOG_FEATURE_MQTT,"MQTT client < removed name > connection cb: status %d",  (int)status);
 	 //  addLogAdv(LOG_INFO,LOG_FEATURE_MQTT,"MQTT client \"%s\" connection cb: status %d", client_info->client_id, (int)status);
 
+	// lwIP drops pending requests of old connection without calling back
+	MQTT_InFlight_Release(true);
 	if (status == MQTT_CONNECT_ACCEPTED)
 	{
 		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "mqtt_connection_cb: Successfully connected");
+		// broker may have lost our values, so whole state goes out again
+		MQTT_Dedup_Reset();
 
 #if LWIP_ALTCP_TLS_MBEDTLS
 		if (CFG_GetMQTTUseTls() && client && client->conn && client->conn->state) {
@@ -1170,7 +1507,7 @@ static void mqtt_connection_cb(mqtt_client_t* client, void* arg, mqtt_connection
 
 		snprintf(tmp, sizeof(tmp), "%s/connected", clientId);
 		//LOCK_TCPIP_CORE();
-		err = mqtt_publish(client, tmp, "online", strlen("online"), 2, true, mqtt_pub_request_cb, 0);
+		err = MQTT_SubmitPublish(client, tmp, "online", strlen("online"), 2, true);
 		//UNLOCK_TCPIP_CORE();
 		if (err != ERR_OK) {
 			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Publish err: %d", err);
@@ -1464,16 +1801,9 @@ OBK_Publish_Result MQTT_PublishMain_StringString(const char* sChannel, const cha
 
 }
 
-OBK_Publish_Result MQTT_ChannelPublish(int channel, int flags)
+// prints channel publish, returns flags to use for it
+static int MQTT_ChannelFormatValue(int channel, char* channelNameStr, char* valueStr, int flags)
 {
-	char channelNameStr[8];
-	char valueStr[16];
-
-	// allow users to force-hide some channels (those channels are NEVER published)
-	if (CHANNEL_HasNeverPublishFlag(channel)) {
-		return OBK_PUBLISH_OK;
-	}
-
 	if (CFG_HasFlag(OBK_FLAG_PUBLISH_MULTIPLIED_VALUES)) {
 		float dVal = CHANNEL_GetFinalValue(channel);
 		// Float value
@@ -1487,9 +1817,6 @@ OBK_Publish_Result MQTT_ChannelPublish(int channel, int flags)
 		sprintf(valueStr, "%i", iVal);
 	}
 
-	MQTT_BroadcastTasmotaTeleSTATE();
-	MQTT_BroadcastTasmotaTeleSENSOR();
-
 	// String from channel number
 	sprintf(channelNameStr, "%i", channel);
 
@@ -1499,11 +1826,212 @@ OBK_Publish_Result MQTT_ChannelPublish(int channel, int flags)
 			flags |= OBK_PUBLISH_FLAG_RETAIN;
 		}
 	}
+	return flags;
+}
+// channel value publish without Tasmota tele broadcasts
+static OBK_Publish_Result MQTT_ChannelPublishValue(int channel, int flags)
+{
+	char channelNameStr[8];
+	char valueStr[16];
+
+	// allow users to force-hide some channels (those channels are NEVER published)
+	if (CHANNEL_HasNeverPublishFlag(channel)) {
+		return OBK_PUBLISH_OK;
+	}
+	flags = MQTT_ChannelFormatValue(channel, channelNameStr, valueStr, flags);
 
 	return MQTT_PublishMain(mqtt_client, channelNameStr, valueStr, flags, true);
 }
+OBK_Publish_Result MQTT_ChannelPublish(int channel, int flags)
+{
+	// allow users to force-hide some channels (those channels are NEVER published)
+	if (CHANNEL_HasNeverPublishFlag(channel)) {
+		return OBK_PUBLISH_OK;
+	}
+	MQTT_BroadcastTasmotaTeleSTATE();
+	MQTT_BroadcastTasmotaTeleSENSOR();
+
+	return MQTT_ChannelPublishValue(channel, flags);
+}
+
+// Channel changes only mark the channel here. Once per quick tick (or per
+// mqtt_channelPublishInterval) latest value of every marked channel is
+// published, with single tele STATE/SENSOR broadcast for the whole batch.
+// Channels are marked from any thread, bitmap is guarded by MQTT mutex.
+static unsigned int g_mqtt_dirtyChannels[(CHANNEL_MAX + 31) / 32];
+// marked channels that were explicitly requested, they bypass dedup cache
+static unsigned int g_mqtt_noDedupChannels[(CHANNEL_MAX + 31) / 32];
+static int g_mqtt_bAnyDirtyChannel = 0;
+// in ms, 0 means next quick tick
+static int g_mqtt_channelPublishInterval = 0;
+static int g_mqtt_channelPublishTimer = 0;
+static int stat_channelPublishes = 0;
+static int stat_channelPublishesCoalesced = 0;
+static int stat_teleBroadcastsCoalesced = 0;
+
+void MQTT_QueueChannelPublishFlags(int channel, int flags)
+{
+	if (channel < 0 || channel >= CHANNEL_MAX) {
+		return;
+	}
+	if (MQTT_Mutex_Take(100) == 0) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_QueueChannelPublish: mutex failed for channel %i", channel);
+		return;
+	}
+	if (BIT_CHECK(g_mqtt_dirtyChannels[channel / 32], channel % 32)) {
+		// older value was not published yet, it never will be
+		stat_channelPublishesCoalesced++;
+	}
+	else {
+		BIT_SET(g_mqtt_dirtyChannels[channel / 32], channel % 32);
+		g_mqtt_bAnyDirtyChannel = 1;
+	}
+	if (flags & OBK_PUBLISH_FLAG_NO_DEDUP) {
+		BIT_SET(g_mqtt_noDedupChannels[channel / 32], channel % 32);
+	}
+	MQTT_Mutex_Free();
+}
+void MQTT_QueueChannelPublish(int channel)
+{
+	MQTT_QueueChannelPublishFlags(channel, 0);
+}
+// channels published with one MQTT_PublishMain_Batch
+#define MQTT_CHANNEL_BATCH 8
+
+// sends batch, channels that did not fit into publish window stay marked for next tick
+static int MQTT_FlushChannelBatch(obk_mqtt_batchItem_t* items, const int* channels, int count)
+{
+	OBK_Publish_Result result;
+	int sent;
+	int i;
+
+	sent = MQTT_PublishMain_Batch(items, count, &result);
+	if (result == OBK_PUBLISH_WINDOW_FULL && MQTT_Mutex_Take(100)) {
+		for (i = sent; i < count; i++) {
+			BIT_SET(g_mqtt_dirtyChannels[channels[i] / 32], channels[i] % 32);
+			if (items[i].flags & OBK_PUBLISH_FLAG_NO_DEDUP) {
+				BIT_SET(g_mqtt_noDedupChannels[channels[i] / 32], channels[i] % 32);
+			}
+		}
+		g_mqtt_bAnyDirtyChannel = 1;
+		MQTT_Mutex_Free();
+	}
+	return sent;
+}
+void MQTT_FlushChannelPublishes()
+{
+	obk_mqtt_batchItem_t items[MQTT_CHANNEL_BATCH];
+	char names[MQTT_CHANNEL_BATCH][8];
+	char values[MQTT_CHANNEL_BATCH][16];
+	int channels[MQTT_CHANNEL_BATCH];
+	unsigned int dirty[(CHANNEL_MAX + 31) / 32];
+	unsigned int noDedup[(CHANNEL_MAX + 31) / 32];
+	int count = 0;
+	int i;
+	int published = 0;
+
+	if (g_mqtt_bAnyDirtyChannel == 0) {
+		return;
+	}
+	// publishing takes the mutex too, so work on a copy
+	if (MQTT_Mutex_Take(100) == 0) {
+		return;
+	}
+	memcpy(dirty, g_mqtt_dirtyChannels, sizeof(dirty));
+	memset(g_mqtt_dirtyChannels, 0, sizeof(g_mqtt_dirtyChannels));
+	memcpy(noDedup, g_mqtt_noDedupChannels, sizeof(noDedup));
+	memset(g_mqtt_noDedupChannels, 0, sizeof(g_mqtt_noDedupChannels));
+	g_mqtt_bAnyDirtyChannel = 0;
+	MQTT_Mutex_Free();
+	g_mqtt_channelPublishTimer = 0;
+	for (i = 0; i < CHANNEL_MAX; i++) {
+		if (dirty[i / 32] == 0) {
+			i += 31;
+			continue;
+		}
+		if (BIT_CHECK(dirty[i / 32], i % 32) == 0) {
+			continue;
+		}
+		if (CHANNEL_HasNeverPublishFlag(i)) {
+			continue;
+		}
+		items[count].flags = MQTT_ChannelFormatValue(i, names[count], values[count],
+			BIT_CHECK(noDedup[i / 32], i % 32) ? OBK_PUBLISH_FLAG_NO_DEDUP : 0);
+		items[count].channel = names[count];
+		items[count].value = values[count];
+		channels[count] = i;
+		count++;
+		if (count == MQTT_CHANNEL_BATCH) {
+			published += MQTT_FlushChannelBatch(items, channels, count);
+			count = 0;
+		}
+	}
+	if (count) {
+		published += MQTT_FlushChannelBatch(items, channels, count);
+	}
+	if (published == 0) {
+		return;
+	}
+	stat_channelPublishes += published;
+	stat_teleBroadcastsCoalesced += published - 1;
+	MQTT_BroadcastTasmotaTeleSTATE();
+	MQTT_BroadcastTasmotaTeleSENSOR();
+}
+void MQTT_GetChannelPublishStats(int* published, int* coalesced, int* teleCoalesced)
+{
+	*published = stat_channelPublishes;
+	*coalesced = stat_channelPublishesCoalesced;
+	*teleCoalesced = stat_teleBroadcastsCoalesced;
+}
+static void MQTT_RunChannelPublishes()
+{
+	if (g_mqtt_bAnyDirtyChannel == 0) {
+		return;
+	}
+	g_mqtt_channelPublishTimer += g_deltaTimeMS;
+	if (g_mqtt_channelPublishTimer >= g_mqtt_channelPublishInterval) {
+		MQTT_FlushChannelPublishes();
+	}
+}
+commandResult_t MQTT_SetChannelPublishInterval(const void* context, const char* cmd, const char* args, int cmdFlags)
+{
+	Tokenizer_TokenizeString(args, 0);
+	// following check must be done after 'Tokenizer_TokenizeString',
+	// so we know arguments count in Tokenizer. 'cmd' argument is
+	// only for warning display
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	g_mqtt_channelPublishInterval = Tokenizer_GetArgInteger(0);
+
+	return CMD_RES_OK;
+}
+commandResult_t MQTT_SetRxMaxSize(const void* context, const char* cmd, const char* args, int cmdFlags)
+{
+	int maxSize;
+
+	Tokenizer_TokenizeString(args, 0);
+	// following check must be done after 'Tokenizer_TokenizeString',
+	// so we know arguments count in Tokenizer. 'cmd' argument is
+	// only for warning display
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	// whole message with topic must fit in receive ring
+	maxSize = MQTT_RX_BUFFER_MAX - MQTT_RX_RECORD_SIZE(sizeof(g_mqtt_request.topic), 0);
+	g_mqttRxMaxMessage = Tokenizer_GetArgIntegerRange(0, 0, maxSize);
+
+	return CMD_RES_OK;
+}
+commandResult_t MQTT_ChannelPublishStats(const void* context, const char* cmd, const char* args, int cmdFlags)
+{
+	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Channel publishes: %i, coalesced: %i, tele broadcasts coalesced: %i",
+		stat_channelPublishes, stat_channelPublishesCoalesced, stat_teleBroadcastsCoalesced);
+	return CMD_RES_OK;
+}
 // This console command will trigger a publish of all used variables (channels and extra stuff)
 commandResult_t MQTT_PublishAll(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	MQTT_Dedup_Reset();
 	MQTT_PublishWholeDeviceState_Internal(true);
 	return CMD_RES_OK;// TODO make return values consistent for all console commands
 }
@@ -1522,7 +2050,10 @@ commandResult_t MQTT_PublishChannel(const void* context, const char* cmd, const
 	}
 	channelIndex = Tokenizer_GetArgInteger(0);
 
-	MQTT_ChannelPublish(channelIndex,0);
+	if (MQTT_ChannelPublish(channelIndex, OBK_PUBLISH_FLAG_NO_DEDUP) == OBK_PUBLISH_WINDOW_FULL) {
+		// sent with the next channel batch instead
+		MQTT_QueueChannelPublishFlags(channelIndex, OBK_PUBLISH_FLAG_NO_DEDUP);
+	}
 
 	return CMD_RES_OK;
 }
@@ -1654,6 +2185,9 @@ commandResult_t MQTT_PublishCommandDriver(const void* context, const char* cmd,
  ****************************************************************************************************/
 #define MQTT_TMR_DURATION      50
 
+// messages submitted per timer tick, limited by publish window
+#define MQTT_BENCHMARK_BATCH 8
+
 typedef struct BENCHMARK_TEST_INFO
 {
 	portTickType TestStartTick;
@@ -1662,8 +2196,10 @@ typedef struct BENCHMARK_TEST_INFO
 	long msg_num;
 	char topic[256];
 	char value[256];
+	char values[MQTT_BENCHMARK_BATCH][64];
 	float bench_time;
 	float bench_rate;
+	int windowFullAtStart;
 	bool report_published;
 } BENCHMARK_TEST_INFO;
 
@@ -1674,68 +2210,56 @@ typedef struct BENCHMARK_TEST_INFO
 void MQTT_Test_Tick(void* param)
 {
 	BENCHMARK_TEST_INFO* info = (BENCHMARK_TEST_INFO*)param;
-	int block = 1;
-	err_t err;
-	int qos = 1;
-	int retain = 0;
+	obk_mqtt_batchItem_t items[MQTT_BENCHMARK_BATCH];
+	OBK_Publish_Result result;
+	int inFlight, windowSize, windowFull;
+	int count, sent, i;
 
-	if (info != NULL)
+	if (info == NULL || MQTT_IsReady() == false)
+		return;
+	if (info->msg_cnt < info->msg_num)
 	{
-		while (1)
+		count = info->msg_num - info->msg_cnt;
+		if (count > MQTT_BENCHMARK_BATCH)
+			count = MQTT_BENCHMARK_BATCH;
+		for (i = 0; i < count; i++) {
+			snprintf(info->values[i], sizeof(info->values[i]), "TestMSG: %li/%li Time: %i s, Rate: %i msg/s",
+				info->msg_cnt + i, info->msg_num, (int)info->bench_time, (int)info->bench_rate);
+			items[i].channel = info->topic;
+			items[i].value = info->values[i];
+			items[i].flags = OBK_PUBLISH_FLAG_RAW_TOPIC_NAME | OBK_PUBLISH_FLAG_MUTEX_SILENT;
+		}
+		sent = MQTT_PublishBatch(NULL, items, count, &result);
+		if (sent > 0)
 		{
-
-			LOCK_TCPIP_CORE();
-			int res = mqtt_client_is_connected(mqtt_client);
-			UNLOCK_TCPIP_CORE();
-
-			if (res == 0)
-				break;
-			if (info->msg_cnt < info->msg_num)
+			/* MSG published */
+			info->msg_cnt += sent;
+			info->TestStopTick = xTaskGetTickCount();
+			/* calculate stats */
+			info->bench_time = (float)(info->TestStopTick - info->TestStartTick);
+			info->bench_time /= (float)(1000 / portTICK_RATE_MS);
+			info->bench_rate = (float)info->msg_cnt;
+			if (info->bench_time != 0.0)
+				info->bench_rate /= info->bench_time;
+		}
+	}
+	else {
+		/* All messages publiched */
+		if (info->report_published == false)
+		{
+			/* Publish report */
+			MQTT_GetPublishWindowStats(&inFlight, &windowSize, &windowFull);
+			sprintf(info->value, "Benchmark completed. %li msg published. Total Time: %i s MsgRate: %i msg/s, waited for window %i times",
+				info->msg_cnt, (int)info->bench_time, (int)info->bench_rate, windowFull - info->windowFullAtStart);
+			items[0].channel = info->topic;
+			items[0].value = info->value;
+			items[0].flags = OBK_PUBLISH_FLAG_RAW_TOPIC_NAME | OBK_PUBLISH_FLAG_MUTEX_SILENT;
+			if (MQTT_PublishBatch(NULL, items, 1, &result))
 			{
-				sprintf(info->value, "TestMSG: %li/%li Time: %i s, Rate: %i msg/s", info->msg_cnt, info->msg_num,
-					(int)info->bench_time, (int)info->bench_rate);
-				LOCK_TCPIP_CORE();
-				err = mqtt_publish(mqtt_client, info->topic, info->value, strlen(info->value), qos, retain, mqtt_pub_request_cb, 0);
-				UNLOCK_TCPIP_CORE();
-				if (err == ERR_OK)
-				{
-					/* MSG published */
-					info->msg_cnt++;
-					info->TestStopTick = xTaskGetTickCount();
-					/* calculate stats */
-					info->bench_time = (float)(info->TestStopTick - info->TestStartTick);
-					info->bench_time /= (float)(1000 / portTICK_RATE_MS);
-					info->bench_rate = (float)info->msg_cnt;
-					if (info->bench_time != 0.0)
-						info->bench_rate /= info->bench_time;
-					block--;
-					if (block <= 0)
-						break;
-				}
-				else {
-					/* MSG not published, error occured */
-					break;
-				}
-			}
-			else {
-				/* All messages publiched */
-				if (info->report_published == false)
-				{
-					/* Publish report */
-					sprintf(info->value, "Benchmark completed. %li msg published. Total Time: %i s MsgRate: %i msg/s",
-						info->msg_cnt, (int)info->bench_time, (int)info->bench_rate);
-					LOCK_TCPIP_CORE();
-					err = mqtt_publish(mqtt_client, info->topic, info->value, strlen(info->value), qos, retain, mqtt_pub_request_cb, 0);
-					UNLOCK_TCPIP_CORE();
-					if (err == ERR_OK)
-					{
-						/* Report published */
-						addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, info->value);
-						info->report_published = true;
-						/* Stop timer */
-					}
-				}
-				break;
+				/* Report published */
+				addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, info->value);
+				info->report_published = true;
+				/* Stop timer */
 			}
 		}
 	}
@@ -1805,12 +2329,22 @@ static beken_timer_t g_mqtt_timer;
 
 commandResult_t MQTT_StartMQTTTestThread(const void* context, const char* cmd, const char* args, int cmdFlags)
 {
+	int inFlight, windowSize, windowFull;
+	int msgNum;
+
+	Tokenizer_TokenizeString(args, 0);
+	msgNum = Tokenizer_GetArgIntegerDefault(0, 1000);
+	MQTT_GetPublishWindowStats(&inFlight, &windowSize, &windowFull);
 	if (info != NULL)
 	{
 		/* Benchmark test already started */
 		/* try to restart */
 		info->TestStartTick = xTaskGetTickCount();
 		info->msg_cnt = 0;
+		info->msg_num = msgNum;
+		info->bench_time = 0;
+		info->bench_rate = 0;
+		info->windowFullAtStart = windowFull;
 		info->report_published = false;
 		return CMD_RES_OK;
 	}
@@ -1823,7 +2357,8 @@ commandResult_t MQTT_StartMQTTTestThread(const void* context, const char* cmd, c
 
 	memset(info, 0, sizeof(BENCHMARK_TEST_INFO));
 	info->TestStartTick = xTaskGetTickCount();
-	info->msg_num = 1000;
+	info->msg_num = msgNum;
+	info->windowFullAtStart = windowFull;
 	sprintf(info->topic, "%s/benchmark", CFG_GetMQTTClientId());
 
 #if WINDOWS
@@ -1938,6 +2473,10 @@ void MQTT_init()
 #endif
 
 	MQTT_InitCallbacks();
+	// created before any publish, publisher and lwIP callbacks both use it
+	if (g_mqtt_inFlightMutex == 0) {
+		g_mqtt_inFlightMutex = xSemaphoreCreateMutex();
+	}
 
 	mqtt_initialised = 1;
 
@@ -1971,8 +2510,8 @@ void MQTT_init()
 	//cmddetail:"fn":"MQTT_PublishChannels","file":"mqtt/new_mqtt.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("publishChannels", MQTT_PublishChannels, NULL);
-	//cmddetail:{"name":"publishBenchmark","args":"",
-	//cmddetail:"descr":"",
+	//cmddetail:{"name":"publishBenchmark","args":"[Count]",
+	//cmddetail:"descr":"Publishes given number of test messages (default 1000) as fast as publish window allows, then publishes a report with message rate",
 	//cmddetail:"fn":"MQTT_StartMQTTTestThread","file":"mqtt/new_mqtt.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("publishBenchmark", MQTT_StartMQTTTestThread, NULL);
@@ -1991,6 +2530,21 @@ void MQTT_init()
 	//cmddetail:"fn":"MQTT_SetTasTeleIntervals","file":"mqtt/new_mqtt.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("TasTeleInterval", MQTT_SetTasTeleIntervals, NULL);
+	//cmddetail:{"name":"mqtt_channelPublishInterval","args":"[ValueMS]",
+	//cmddetail:"descr":"Channel changes are published in batches, only the latest value of each changed channel is sent. This sets how often batch is sent, in milliseconds. Default 0 sends it on next quick tick.",
+	//cmddetail:"fn":"MQTT_SetChannelPublishInterval","file":"mqtt/new_mqtt.c","requires":"",
+	//cmddetail:"examples":"mqtt_channelPublishInterval 250"}
+	CMD_RegisterCommand("mqtt_channelPublishInterval", MQTT_SetChannelPublishInterval, NULL);
+	//cmddetail:{"name":"MQTTChannelPublishStats","args":"",
+	//cmddetail:"descr":"Logs how many channel publishes were sent and how many were coalesced into later ones.",
+	//cmddetail:"fn":"MQTT_ChannelPublishStats","file":"mqtt/new_mqtt.c","requires":"",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("MQTTChannelPublishStats", MQTT_ChannelPublishStats, NULL);
+	//cmddetail:{"name":"mqtt_rxMaxSize","args":"[Bytes]",
+	//cmddetail:"descr":"Sets the largest incoming MQTT payload that will be reassembled from TCP fragments and processed. Larger ones are dropped. Default is 2048, limit is size of receive buffer.",
+	//cmddetail:"fn":"MQTT_SetRxMaxSize","file":"mqtt/new_mqtt.c","requires":"",
+	//cmddetail:"examples":"mqtt_rxMaxSize 3500"}
+	CMD_RegisterCommand("mqtt_rxMaxSize", MQTT_SetRxMaxSize, NULL);
 
 #if ENABLE_LITTLEFS
 	//cmddetail:{"name":"publishFile","args":"[Topic][Value][bOptionalSkipPrefixAndSuffix]",
@@ -2006,6 +2560,7 @@ void MQTT_init()
 	//cmddetail:"fn":"MQTT_PublishCommandDriver","file":"mqtt/new_mqtt.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("publishDriver", MQTT_PublishCommandDriver, NULL);
+	MQTT_Dedup_AddCommands();
 }
 static float getInternalTemperature() {
 	return g_wifi_temperature;
@@ -2147,10 +2702,17 @@ OBK_Publish_Result MQTT_DoItemPublish(int idx)
 
 // from 5ms quicktick
 int MQTT_RunQuickTick(){
+#if WINDOWS
+	// simulator has no benchmark timer
+	if (info != NULL) {
+		MQTT_Test_Tick(info);
+	}
+#endif
 #ifndef PLATFORM_BEKEN
 	// on Beken, we use a one-shot timer for this.
 	MQTT_process_received();
 #endif
+	MQTT_RunChannelPublishes();
 	return 0;
 }
 
@@ -2185,6 +2747,20 @@ int MQTT_RunEverySecondUpdate()
 	if (!mqtt_initialised)
 		return 0;
 
+	if (g_mqtt_publishesInFlight >= MQTT_PUBLISH_WINDOW) {
+		g_mqtt_publishWindowStuck++;
+		// lwIP times out requests sooner than that, so some callbacks were lost
+		if (g_mqtt_publishWindowStuck > 60) {
+			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT publish window stuck, resetting");
+			MQTT_InFlight_Release(true);
+			g_mqtt_publishWindowStuck = 0;
+		}
+	}
+	else {
+		g_mqtt_publishWindowStuck = 0;
+	}
+	MQTT_QueueFreeIfIdle();
+
 	if (Main_HasWiFiConnected() == 0)
 	{
 		mqtt_reconnect = 0;
@@ -2361,8 +2937,10 @@ int MQTT_RunEverySecondUpdate()
 						}
 					}
 					// OBK_PUBLISH_MUTEX_FAIL - MQTT is busy
+					// OBK_PUBLISH_WINDOW_FULL - broker has not acked earlier ones yet
 					if (publishRes == OBK_PUBLISH_MUTEX_FAIL
-						|| publishRes == OBK_PUBLISH_WAS_DISCONNECTED)
+						|| publishRes == OBK_PUBLISH_WAS_DISCONNECTED
+						|| publishRes == OBK_PUBLISH_WINDOW_FULL)
 					{
 						// retry the same later
 						break;
@@ -2396,88 +2974,266 @@ int MQTT_RunEverySecondUpdate()
 	return 1;
 }
 
-MqttPublishItem_t* get_queue_tail(MqttPublishItem_t* head) {
-	if (head == NULL) { return NULL; }
+#define MQTT_QUEUE_RECORD_STRINGS(rec) ((char*)(rec) + sizeof(MqttPublishItem_t))
 
-	while (head->next != NULL) {
-		head = head->next;
+#define MQTT_QUEUE_RECORD_SIZE(topicLen, channelLen, valueLen) \
+	((sizeof(MqttPublishItem_t) + (topicLen) + 1 + (channelLen) + 1 + (valueLen) + 1 + 3) & ~3)
+
+// returns offset where a record of given size can be written with given tail and item count,
+// or -1 if there is no space. Optionally marks the skipped arena end for the reader.
+static int MQTT_QueueFindSpace(int tail, int count, int size, bool bMarkWrap) {
+	if (count == 0) {
+		return size <= MQTT_PUBLISH_QUEUE_ARENA_SIZE ? 0 : -1;
+	}
+	if (tail > g_mqttQueueHead) {
+		if (tail + size <= MQTT_PUBLISH_QUEUE_ARENA_SIZE) {
+			return tail;
+		}
+		// doesn't fit at the end, try to wrap to the start
+		if (size <= g_mqttQueueHead) {
+			if (bMarkWrap && tail + (int)sizeof(MqttPublishItem_t) <= MQTT_PUBLISH_QUEUE_ARENA_SIZE) {
+				((MqttPublishItem_t*)(g_mqttQueueArena + tail))->size = 0;
+			}
+			return 0;
+		}
+		return -1;
 	}
-	return head;
+	// already wrapped, free space is between tail and head
+	if (tail + size <= g_mqttQueueHead) {
+		return tail;
+	}
+	return -1;
 }
+/// @brief Checks if given number of publishes, each with value up to maxValueLen, can be queued now.
+bool MQTT_CanQueuePublish(int numItems, int maxValueLen) {
+	int tail, count, size, ofs;
 
-MqttPublishItem_t* find_queue_reusable_item(MqttPublishItem_t* head) {
-	while (head != NULL) {
-		if (MQTT_QUEUE_ITEM_IS_REUSABLE(head)) {
-			return head;
+	if (g_MqttPublishItemsQueued + numItems > MQTT_MAX_QUEUE_SIZE) {
+		return false;
+	}
+	size = MQTT_QUEUE_RECORD_SIZE(MQTT_PUBLISH_ITEM_TOPIC_LENGTH, MQTT_PUBLISH_ITEM_CHANNEL_LENGTH, maxValueLen);
+	tail = g_mqttQueueTail;
+	count = g_MqttPublishItemsQueued;
+	while (numItems > 0) {
+		ofs = MQTT_QueueFindSpace(tail, count, size, false);
+		if (ofs < 0) {
+			return false;
 		}
-		head = head->next;
+		tail = ofs + size;
+		count++;
+		numItems--;
 	}
-	return head;
+	return true;
 }
+// frees the arena when nothing was queued for a while, so it is not
+// a permanent loss on devices that queue only occasionally
+static void MQTT_QueueFreeIfIdle() {
+	if (g_mqttQueueArena == NULL || g_MqttPublishItemsQueued || g_mqttQueuePending >= 0) {
+		g_mqttQueueIdleSeconds = 0;
+		return;
+	}
+	g_mqttQueueIdleSeconds++;
+	if (g_mqttQueueIdleSeconds < MQTT_PUBLISH_QUEUE_FREE_SECONDS) {
+		return;
+	}
+	if (MQTT_Mutex_Take(100) == 0) {
+		return;
+	}
+	// checked again, MQTT_QueueBeginPublish resets the counter under mutex
+	if (g_mqttQueueIdleSeconds >= MQTT_PUBLISH_QUEUE_FREE_SECONDS
+		&& g_MqttPublishItemsQueued == 0 && g_mqttQueuePending < 0) {
+		os_free(g_mqttQueueArena);
+		g_mqttQueueArena = NULL;
+		g_mqttQueueHead = g_mqttQueueTail = 0;
+		g_mqttQueueLast = -1;
+	}
+	MQTT_Mutex_Free();
+}
+bool MQTT_IsPublishQueueAllocated() {
+	return g_mqttQueueArena != NULL;
+}
+/// @brief Returns bytes taken by currently queued publishes and the peak seen so far.
+void MQTT_GetPublishQueueStats(int* bytesUsed, int* peakBytes, bool bResetPeak) {
+	*bytesUsed = g_mqttQueueBytes;
+	*peakBytes = g_mqttQueuePeakBytes;
+	if (bResetPeak) {
+		g_mqttQueuePeakBytes = g_mqttQueueBytes;
+	}
+}
+// returns the oldest record, skipping the wrap marker
+static MqttPublishItem_t* MQTT_QueuePeek() {
+	MqttPublishItem_t* rec;
 
-/// @brief Queue an entry for publish and execute a command after the publish.
+	if (g_MqttPublishItemsQueued == 0) {
+		return NULL;
+	}
+	if (g_mqttQueueHead + (int)sizeof(MqttPublishItem_t) > MQTT_PUBLISH_QUEUE_ARENA_SIZE) {
+		g_mqttQueueHead = 0;
+	}
+	rec = (MqttPublishItem_t*)(g_mqttQueueArena + g_mqttQueueHead);
+	if (rec->size == 0) {
+		g_mqttQueueHead = 0;
+		rec = (MqttPublishItem_t*)g_mqttQueueArena;
+	}
+	return rec;
+}
+static void MQTT_QueuePop() {
+	MqttPublishItem_t* rec = MQTT_QueuePeek();
+
+	if (rec == NULL) {
+		return;
+	}
+	g_mqttQueueHead += rec->size;
+	g_mqttQueueBytes -= rec->size;
+	g_MqttPublishItemsQueued--;
+	if (g_MqttPublishItemsQueued == 0) {
+		g_mqttQueueHead = g_mqttQueueTail = 0;
+		g_mqttQueueLast = -1;
+	}
+}
+
+/// @brief Reserves a queue record for a publish and returns a buffer for its value.
+/// The value (up to maxValueLen chars, plus null char) must be written there and
+/// then the record must be committed or dropped with MQTT_QueueEndPublish.
+/// This way, large payloads can be written straight into the queue.
 /// @param topic 
 /// @param channel 
-/// @param value 
+/// @param maxValueLen
 /// @param flags
-/// @param command Command to execute after the publish
-void MQTT_QueuePublishWithCommand(const char* topic, const char* channel, const char* value, int flags, PostPublishCommands command) {
+/// @return buffer for value, or NULL if it can't be queued
+char* MQTT_QueueBeginPublish(const char* topic, const char* channel, int maxValueLen, int flags) {
 	MqttPublishItem_t* newItem;
+	int topicLen, channelLen;
+	int size, ofs;
+	char* p;
+
 	if (g_MqttPublishItemsQueued >= MQTT_MAX_QUEUE_SIZE) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! %i items already present", g_MqttPublishItemsQueued);
-		return;
+		return NULL;
 	}
+	topicLen = strlen(topic);
+	channelLen = strlen(channel);
 
-	if ((strlen(topic) > MQTT_PUBLISH_ITEM_TOPIC_LENGTH) ||
-		(strlen(channel) > MQTT_PUBLISH_ITEM_CHANNEL_LENGTH) ||
-		(strlen(value) > MQTT_PUBLISH_ITEM_VALUE_LENGTH)) {
+	if ((topicLen > MQTT_PUBLISH_ITEM_TOPIC_LENGTH) ||
+		(channelLen > MQTT_PUBLISH_ITEM_CHANNEL_LENGTH) ||
+		(maxValueLen > MQTT_PUBLISH_ITEM_VALUE_LENGTH)) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! Topic (%i), channel (%i) or value (%i) exceeds size limit",
-			strlen(topic), strlen(channel), strlen(value));
-		return;
+			topicLen, channelLen, maxValueLen);
+		return NULL;
+	}
+	// arena may be freed from MQTT_RunEverySecondUpdate
+	if (MQTT_Mutex_Take(100) == 0) {
+		return NULL;
+	}
+	g_mqttQueueIdleSeconds = 0;
+	if (g_mqttQueueArena == NULL) {
+		g_mqttQueueArena = os_malloc(MQTT_PUBLISH_QUEUE_ARENA_SIZE);
+	}
+	MQTT_Mutex_Free();
+	if (g_mqttQueueArena == NULL) {
+		return NULL;
+	}
+
+	// header and three strings, with null chars, padded to keep header aligned
+	size = MQTT_QUEUE_RECORD_SIZE(topicLen, channelLen, maxValueLen);
+	if (g_MqttPublishItemsQueued == 0) {
+		g_mqttQueueHead = g_mqttQueueTail = 0;
+	}
+	ofs = MQTT_QueueFindSpace(g_mqttQueueTail, g_MqttPublishItemsQueued, size, true);
+	if (ofs < 0) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! No space for %i bytes, %i items already present", size, g_MqttPublishItemsQueued);
+		return NULL;
 	}
 
-	//Queue data for publish. This might be a new item in the queue or an existing item. This is done to prevent
-	//memory fragmentation. The total queue length is limited to MQTT_MAX_QUEUE_SIZE.
+	newItem = (MqttPublishItem_t*)(g_mqttQueueArena + ofs);
+	newItem->topicLen = topicLen;
+	newItem->channelLen = channelLen;
+	newItem->command = None;
+	newItem->flags = flags;
+	p = MQTT_QUEUE_RECORD_STRINGS(newItem);
+	//memcpy copies ending null characters too
+	memcpy(p, topic, topicLen + 1);
+	p += topicLen + 1;
+	memcpy(p, channel, channelLen + 1);
+	p += channelLen + 1;
+	*p = 0;
+
+	g_mqttQueuePending = ofs;
+	return p;
+}
 
-	if (g_MqttPublishQueueHead == NULL) {
-		g_MqttPublishQueueHead = newItem = os_malloc(sizeof(MqttPublishItem_t));
-		newItem->next = NULL;
+/// @brief Commits (or drops) the record reserved by MQTT_QueueBeginPublish.
+/// @param bCommit 
+void MQTT_QueueEndPublish(bool bCommit) {
+	MqttPublishItem_t* newItem;
+	const char* topic, *channel, *value;
+
+	if (g_mqttQueuePending < 0) {
+		return;
 	}
-	else {
-		newItem = find_queue_reusable_item(g_MqttPublishQueueHead);
+	newItem = (MqttPublishItem_t*)(g_mqttQueueArena + g_mqttQueuePending);
+	if (bCommit) {
+		topic = MQTT_QUEUE_RECORD_STRINGS(newItem);
+		channel = topic + newItem->topicLen + 1;
+		value = channel + newItem->channelLen + 1;
+		// shrink record to what was really written
+		newItem->size = MQTT_QUEUE_RECORD_SIZE(newItem->topicLen, newItem->channelLen, strlen(value));
 
-		if (newItem == NULL) {
-			newItem = os_malloc(sizeof(MqttPublishItem_t));
-			if(newItem == NULL)
-			{
-				//addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "os_malloc failed for MqttPublishItem_t");
-				return;
-			}
-			newItem->next = NULL;
-			get_queue_tail(g_MqttPublishQueueHead)->next = newItem; //Append new item
+		g_mqttQueueTail = g_mqttQueuePending + newItem->size;
+		g_mqttQueueLast = g_mqttQueuePending;
+		g_mqttQueueBytes += newItem->size;
+		if (g_mqttQueueBytes > g_mqttQueuePeakBytes) {
+			g_mqttQueuePeakBytes = g_mqttQueueBytes;
 		}
+		g_MqttPublishItemsQueued++;
+		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Queued topic=%s/%s, %i items in queue", topic, channel, g_MqttPublishItemsQueued);
 	}
+	g_mqttQueuePending = -1;
+}
 
-	//strcpy does copy ending null character.
-	strcpy(newItem->topic, topic);
-	strcpy(newItem->channel, channel);
-	strcpy(newItem->value, value);
-	newItem->command = command;
-	newItem->flags = flags;
+/// @brief Queue an entry for publish and execute a command after the publish.
+/// @param topic 
+/// @param channel 
+/// @param value 
+/// @param flags
+/// @param command Command to execute after the publish
+void MQTT_QueuePublishWithCommand(const char* topic, const char* channel, const char* value, int flags, PostPublishCommands command) {
+	char* p;
+	int valueLen;
 
-	g_MqttPublishItemsQueued++;
-	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Queued topic=%s/%s, %i items in queue", newItem->topic, newItem->channel, g_MqttPublishItemsQueued);
+	valueLen = strlen(value);
+	p = MQTT_QueueBeginPublish(topic, channel, valueLen, flags);
+	if (p == NULL) {
+		return;
+	}
+	memcpy(p, value, valueLen + 1);
+	MQTT_QueueEndPublish(true);
+	if (command != None) {
+		MQTT_InvokeCommandAtEnd(command);
+	}
+}
+
+static void MQTT_RunPostPublishCommand(PostPublishCommands command) {
+	switch (command) {
+	case None:
+		break;
+	case PublishAll:
+		MQTT_PublishWholeDeviceState_Internal(true);
+		break;
+	case PublishChannels:
+		MQTT_PublishOnlyDeviceChannelsIfPossible();
+		break;
+	}
 }
 
 /// @brief Add the specified command to the last entry in the queue.
 /// @param command 
 void MQTT_InvokeCommandAtEnd(PostPublishCommands command) {
-	MqttPublishItem_t* tail = get_queue_tail(g_MqttPublishQueueHead);
-	if (tail == NULL){
+	if (g_mqttQueueLast < 0){
 		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "InvokeCommandAtEnd invoked but queue is empty");
 	}
 	else {
-		tail->command = command;
+		((MqttPublishItem_t*)(g_mqttQueueArena + g_mqttQueueLast))->command = command;
 	}
 }
 
@@ -2497,37 +3253,29 @@ OBK_Publish_Result PublishQueuedItems() {
 	OBK_Publish_Result result = OBK_PUBLISH_WAS_NOT_REQUIRED;
 
 	int count = 0;
-	MqttPublishItem_t* head = g_MqttPublishQueueHead;
+	MqttPublishItem_t* head;
+	const char* topic, *channel, *value;
+	PostPublishCommands command;
 
-	//The next actionable item might not be at the front. The queue size is limited to MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE
-	//so this traversal is fast.
 	//addLogAdv(LOG_INFO,LOG_FEATURE_MQTT,"PublishQueuedItems g_MqttPublishItemsQueued=%i",g_MqttPublishItemsQueued );
-	while ((head != NULL) && (count < MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE) && (g_MqttPublishItemsQueued > 0)) {
-		if (!MQTT_QUEUE_ITEM_IS_REUSABLE(head)) {  //Skip reusable entries
-			count++;
-			result = MQTT_PublishTopicToClient(mqtt_client, head->topic, head->channel, head->value, head->flags, false);
-			MQTT_QUEUE_ITEM_SET_REUSABLE(head); //Flag item as reusable
-			g_MqttPublishItemsQueued--;   //decrement queued count
-
-			//Stop if last publish failed
-			if (result != OBK_PUBLISH_OK) break;
-
-			switch (head->command) {
-			case None:
-				break;
-			case PublishAll:
-				MQTT_PublishWholeDeviceState_Internal(true);
-				break;
-			case PublishChannels:
-				MQTT_PublishOnlyDeviceChannelsIfPossible();
-				break;
-			}
-		}
-		else {
-			//addLogAdv(LOG_INFO,LOG_FEATURE_MQTT,"PublishQueuedItems item skipped reusable");
+	while ((count < MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE) && (head = MQTT_QueuePeek()) != NULL) {
+		count++;
+		topic = MQTT_QUEUE_RECORD_STRINGS(head);
+		channel = topic + head->topicLen + 1;
+		value = channel + head->channelLen + 1;
+		command = head->command;
+		result = MQTT_PublishTopicToClient(mqtt_client, topic, channel, value, head->flags, false);
+		if (result == OBK_PUBLISH_WINDOW_FULL) {
+			// keep it for next time
+			break;
 		}
+		// item is dropped even if publish failed
+		MQTT_QueuePop();
+
+		//Stop if last publish failed
+		if (result != OBK_PUBLISH_OK) break;
 
-		head = head->next;
+		MQTT_RunPostPublishCommand(command);
 	}
 
 	return result;
@@ -64,6 +64,8 @@ enum OBK_Publish_Result_e {
 	OBK_PUBLISH_WAS_DISCONNECTED,
 	OBK_PUBLISH_WAS_NOT_REQUIRED,
 	OBK_PUBLISH_MEM_FAIL,
+	// too many publishes are waiting for broker, try again later
+	OBK_PUBLISH_WINDOW_FULL,
 };
 
 #define OBK_PUBLISH_FLAG_MUTEX_SILENT			1
@@ -72,6 +74,15 @@ enum OBK_Publish_Result_e {
 // do not add anything to given topic
 #define OBK_PUBLISH_FLAG_RAW_TOPIC_NAME			8
 #define OBK_PUBLISH_FLAG_QOS_ZERO				16
+// reply to explicit request, send even if dedup cache has the same value
+#define OBK_PUBLISH_FLAG_NO_DEDUP				32
+
+// one publish of a batch, channel is the part of topic after base topic
+typedef struct obk_mqtt_batchItem_s {
+	const char* channel;
+	const char* value;
+	int flags;
+} obk_mqtt_batchItem_t;
 
 
 #include "new_mqtt_deduper.h"
@@ -95,15 +106,17 @@ typedef enum PostPublishCommands_e {
 } PostPublishCommands;
 
 
-/// @brief Publish queue item
+/// @brief Publish queue record header.
+/// Queue is a ring buffer over a single byte arena, each record is this header
+/// followed by null terminated topic, channel and value strings.
 typedef struct MqttPublishItem
 {
-	char topic[MQTT_PUBLISH_ITEM_TOPIC_LENGTH];
-	char channel[MQTT_PUBLISH_ITEM_CHANNEL_LENGTH];
-	char value[MQTT_PUBLISH_ITEM_VALUE_LENGTH];
 	int flags;
-	struct MqttPublishItem* next;
-	PostPublishCommands command;
+	// whole record size, with header and padding. 0 marks the wrap to arena start
+	unsigned short size;
+	byte topicLen;
+	byte channelLen;
+	byte command;
 } MqttPublishItem_t;
 
 
@@ -116,6 +129,16 @@ typedef struct MqttPublishItem
 // 16 relays, every relay will be a separate publish,
 // so I bumped MAX to 32
 #define MQTT_MAX_QUEUE_SIZE	                32
+// Size of byte arena for publish queue. Allocated on first queued publish
+// and freed when queue was empty for MQTT_PUBLISH_QUEUE_FREE_SECONDS.
+// Items take only as much space as their strings need,
+// so with typical Hass discovery payloads this holds a whole burst.
+#ifndef MQTT_PUBLISH_QUEUE_ARENA_SIZE
+#define MQTT_PUBLISH_QUEUE_ARENA_SIZE		16384
+#endif
+#ifndef MQTT_PUBLISH_QUEUE_FREE_SECONDS
+#define MQTT_PUBLISH_QUEUE_FREE_SECONDS		30
+#endif
 
 // callback function for mqtt.
 // return 0 to allow the incoming topic/data to be processed by others/channel set.
@@ -135,6 +158,17 @@ int MQTT_GetReceivedEventCounter(void);
 
 OBK_Publish_Result PublishQueuedItems();
 OBK_Publish_Result MQTT_ChannelPublish(int channel, int flags);
+// marks channel to be published with next batch
+void MQTT_QueueChannelPublish(int channel);
+void MQTT_QueueChannelPublishFlags(int channel, int flags);
+void MQTT_FlushChannelPublishes();
+void MQTT_GetChannelPublishStats(int* published, int* coalesced, int* teleCoalesced);
+// publishes items under single lock, returns number of items sent,
+// sending stops at first failure (for example, when publish window is full)
+int MQTT_PublishBatch(const char* sTopic, const obk_mqtt_batchItem_t* items, int count, OBK_Publish_Result* result);
+// same, but for base topic with /get appended, like MQTT_PublishMain_StringString
+int MQTT_PublishMain_Batch(const obk_mqtt_batchItem_t* items, int count, OBK_Publish_Result* result);
+void MQTT_GetPublishWindowStats(int* inFlight, int* windowSize, int* windowFull);
 void MQTT_ClearCallbacks();
 int MQTT_RegisterCallback(const char* basetopic, const char* subscriptiontopic, int ID, mqtt_callback_fn callback);
 int MQTT_RemoveCallback(int ID);
@@ -148,6 +182,7 @@ const char* MQTT_RemoveClientFromTopic(const char* topic, const char *prefix);
 // are working...
 int MQTT_Post_Received(const char *topic, int topiclen, const unsigned char *data, int datalen);
 int MQTT_Post_Received_Str(const char *topic, const char *data);
+void MQTT_GetRxStats(int* reassembled, int* dropped);
 
 void MQTT_GetStats(int* outUsed, int* outMax, int* outFreeMem);
 
@@ -159,6 +194,11 @@ OBK_Publish_Result MQTT_PublishMain_StringString(const char* sChannel, const cha
 void MQTT_PublishOnlyDeviceChannelsIfPossible();
 void MQTT_QueuePublish(const char* topic, const char* channel, const char* value, int flags);
 void MQTT_QueuePublishWithCommand(const char* topic, const char* channel, const char* value, int flags, PostPublishCommands command);
+char* MQTT_QueueBeginPublish(const char* topic, const char* channel, int maxValueLen, int flags);
+void MQTT_QueueEndPublish(bool bCommit);
+bool MQTT_CanQueuePublish(int numItems, int maxValueLen);
+void MQTT_GetPublishQueueStats(int* bytesUsed, int* peakBytes, bool bResetPeak);
+bool MQTT_IsPublishQueueAllocated();
 OBK_Publish_Result MQTT_Publish(const char* sTopic, const char* sChannel, const char* value, int flags);
 OBK_Publish_Result MQTT_PublishStat(const char* statName, const char* statValue);
 OBK_Publish_Result MQTT_PublishTele(const char* teleName, const char* teleValue);
@@ -12,6 +12,7 @@
 #include "../hal/hal_wifi.h"
 #include "../driver/drv_public.h"
 #include "../driver/drv_ntp.h"
+#include "new_mqtt_topicTrie.h"
 
 // Maximum lenght of both string value and publish name in MQTT deduper
 #define DEDUPER_MAX_STRING_LEN 32
@@ -61,9 +62,371 @@ static void DD_Mutex_Free()
     xSemaphoreGive(g_mutex);
 }
 
+// size of general cache, must be power of two
+#define DEDUP_CACHE_SIZE 64
+// how many slots are tried before giving up on a topic
+#define DEDUP_CACHE_PROBES 8
+#define DEDUP_MAX_POLICIES 8
+// published values waiting for minInterval, sent at most that many per second
+#define DEDUP_MAX_PENDING_PER_TICK 4
+
+typedef struct mqtt_dedup_policy_s {
+	char *filter;
+	int maxSilence;
+	int minInterval;
+} mqtt_dedup_policy_t;
+
+typedef struct mqtt_dedup_entry_s {
+	// 0 if slot was never used
+	unsigned int topicHash;
+	unsigned int valueHash;
+	unsigned int lastSend;
+	// slot can be reused after that
+	unsigned int expires;
+	int minInterval;
+	// "topic\0value" of delayed publish
+	char *pending;
+	int pendingFlags;
+} mqtt_dedup_entry_t;
+
+static mqtt_dedup_policy_t g_dedupGlobal;
+static mqtt_dedup_policy_t g_dedupPolicies[DEDUP_MAX_POLICIES];
+static int g_dedupNumPolicies = 0;
+// allocated when first policy is set
+static mqtt_dedup_entry_t *g_dedupCache = 0;
+static unsigned int g_dedupSeconds = 0;
+
+static int stat_dedupCache_lookups = 0;
+static int stat_dedupCache_hits = 0;
+static int stat_dedupCache_delayed = 0;
+
+static unsigned int DD_Hash(const char *s, unsigned int h) {
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619;
+	}
+	return h;
+}
+
+static const mqtt_dedup_policy_t *DD_GetPolicy(const char *topic) {
+	int i;
+
+	for (i = 0; i < g_dedupNumPolicies; i++) {
+		if (MQTT_TopicMatch(topic, g_dedupPolicies[i].filter)) {
+			return &g_dedupPolicies[i];
+		}
+	}
+	return &g_dedupGlobal;
+}
+
+static bool DD_IsExpired(const mqtt_dedup_entry_t *e) {
+	return e->pending == 0 && (int)(g_dedupSeconds - e->expires) >= 0;
+}
+
+static void DD_FreePending(mqtt_dedup_entry_t *e) {
+	if (e->pending) {
+		free(e->pending);
+		e->pending = 0;
+	}
+}
+
+// returns slot with this topic, or slot where it can be stored, or -1
+static int DD_FindSlot(unsigned int topicHash, bool *bFound) {
+	int i, slot;
+	int freeSlot = -1;
+	mqtt_dedup_entry_t *e;
+
+	*bFound = false;
+	for (i = 0; i < DEDUP_CACHE_PROBES; i++) {
+		slot = (topicHash + i) & (DEDUP_CACHE_SIZE - 1);
+		e = &g_dedupCache[slot];
+		if (e->topicHash == topicHash && !DD_IsExpired(e)) {
+			*bFound = true;
+			return slot;
+		}
+		if (e->topicHash == 0) {
+			// nothing was ever stored further
+			return freeSlot >= 0 ? freeSlot : slot;
+		}
+		if (freeSlot < 0 && DD_IsExpired(e)) {
+			freeSlot = slot;
+		}
+	}
+	return freeSlot;
+}
+
+int MQTT_Dedup_Check(const char *topic, const char *value, int flags, mqtt_dedup_token_t *token) {
+	const mqtt_dedup_policy_t *policy;
+	mqtt_dedup_entry_t *e;
+	bool bFound;
+	int slot, keep;
+	int res = 0;
+
+	token->slot = -1;
+	if (g_dedupCache == 0) {
+		return 0;
+	}
+	policy = DD_GetPolicy(topic);
+	keep = policy->maxSilence > policy->minInterval ? policy->maxSilence : policy->minInterval;
+	if (keep <= 0) {
+		return 0;
+	}
+	if (DD_Mutex_Take(10) == false) {
+		return 0;
+	}
+	stat_dedupCache_lookups++;
+	token->topicHash = DD_Hash(topic, 2166136261u);
+	if (token->topicHash == 0) {
+		token->topicHash = 1;
+	}
+	token->valueHash = DD_Hash(value, 2166136261u);
+	slot = DD_FindSlot(token->topicHash, &bFound);
+	if (bFound && (flags & OBK_PUBLISH_FLAG_NO_DEDUP) == 0) {
+		e = &g_dedupCache[slot];
+		if (e->valueHash == token->valueHash) {
+			if ((int)(g_dedupSeconds - e->lastSend) < keep) {
+				// anything delayed is older than this value
+				DD_FreePending(e);
+				stat_dedupCache_hits++;
+				res = 1;
+			}
+		}
+		else if (policy->minInterval > 0 && (int)(g_dedupSeconds - e->lastSend) < policy->minInterval) {
+			DD_FreePending(e);
+			e->pending = malloc(strlen(topic) + strlen(value) + 2);
+			if (e->pending) {
+				strcpy(e->pending, topic);
+				strcpy(e->pending + strlen(topic) + 1, value);
+				e->pendingFlags = flags | OBK_PUBLISH_FLAG_RAW_TOPIC_NAME;
+				stat_dedupCache_delayed++;
+				res = 1;
+			}
+		}
+	}
+	if (res == 0 && bFound) {
+		// this value goes out now, delayed one would overwrite it later
+		DD_FreePending(&g_dedupCache[slot]);
+	}
+	if (res == 0) {
+		token->slot = slot;
+		token->keep = keep;
+		token->minInterval = policy->minInterval;
+	}
+	DD_Mutex_Free();
+	return res;
+}
+
+void MQTT_Dedup_Sent(const mqtt_dedup_token_t *token) {
+	mqtt_dedup_entry_t *e;
+
+	if (token->slot < 0 || g_dedupCache == 0) {
+		return;
+	}
+	if (DD_Mutex_Take(10) == false) {
+		return;
+	}
+	e = &g_dedupCache[token->slot];
+	// slot may have been taken by other topic in the meantime
+	if (e->topicHash == token->topicHash || DD_IsExpired(e)) {
+		if (e->topicHash != token->topicHash) {
+			DD_FreePending(e);
+		}
+		e->topicHash = token->topicHash;
+		e->valueHash = token->valueHash;
+		e->lastSend = g_dedupSeconds;
+		e->expires = g_dedupSeconds + token->keep;
+		e->minInterval = token->minInterval;
+	}
+	DD_Mutex_Free();
+}
+
+void MQTT_Dedup_Reset() {
+	mqtt_dedup_entry_t *e;
+	int i;
+
+	if (g_dedupCache == 0 || DD_Mutex_Take(100) == false) {
+		return;
+	}
+	for (i = 0; i < DEDUP_CACHE_SIZE; i++) {
+		e = &g_dedupCache[i];
+		// delayed values are still newer than what broker has, keep them due
+		e->valueHash = 0;
+		e->lastSend = g_dedupSeconds - e->minInterval;
+	}
+	DD_Mutex_Free();
+}
+
+void MQTT_Dedup_GetStats(int *lookups, int *hits, int *delayed) {
+	*lookups = stat_dedupCache_lookups;
+	*hits = stat_dedupCache_hits;
+	*delayed = stat_dedupCache_delayed;
+}
+
+// sends delayed values whose minInterval has passed
+static void DD_SendPending() {
+	char *toSend[DEDUP_MAX_PENDING_PER_TICK];
+	int flags[DEDUP_MAX_PENDING_PER_TICK];
+	unsigned int hashes[DEDUP_MAX_PENDING_PER_TICK];
+	obk_mqtt_batchItem_t item;
+	OBK_Publish_Result res;
+	mqtt_dedup_entry_t *e;
+	int i, count = 0;
+	bool bFound;
+	int slot;
+
+	if (g_dedupCache == 0 || DD_Mutex_Take(10) == false) {
+		return;
+	}
+	for (i = 0; i < DEDUP_CACHE_SIZE && count < DEDUP_MAX_PENDING_PER_TICK; i++) {
+		e = &g_dedupCache[i];
+		if (e->pending && (int)(g_dedupSeconds - e->lastSend) >= e->minInterval) {
+			toSend[count] = e->pending;
+			flags[count] = e->pendingFlags;
+			hashes[count] = e->topicHash;
+			e->pending = 0;
+			count++;
+		}
+	}
+	DD_Mutex_Free();
+	// publish goes through MQTT_Dedup_Check again, so no mutex here
+	for (i = 0; i < count; i++) {
+		item.channel = toSend[i];
+		item.value = toSend[i] + strlen(toSend[i]) + 1;
+		item.flags = flags[i];
+		MQTT_PublishBatch(0, &item, 1, &res);
+		if (res == OBK_PUBLISH_WINDOW_FULL && DD_Mutex_Take(10)) {
+			// try again next second, unless something newer came
+			slot = DD_FindSlot(hashes[i], &bFound);
+			if (bFound && g_dedupCache[slot].pending == 0) {
+				g_dedupCache[slot].pending = toSend[i];
+				toSend[i] = 0;
+			}
+			DD_Mutex_Free();
+		}
+		if (toSend[i]) {
+			free(toSend[i]);
+		}
+	}
+}
+
+static bool DD_AllocCache() {
+	if (g_dedupCache == 0) {
+		g_dedupCache = (mqtt_dedup_entry_t*)malloc(sizeof(mqtt_dedup_entry_t) * DEDUP_CACHE_SIZE);
+		if (g_dedupCache == 0) {
+			return false;
+		}
+		memset(g_dedupCache, 0, sizeof(mqtt_dedup_entry_t) * DEDUP_CACHE_SIZE);
+	}
+	return true;
+}
+
+static commandResult_t CMD_MQTT_Dedup(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	(void)context;
+	(void)cmdFlags;
+	Tokenizer_TokenizeString(args, 0);
+	// following check must be done after 'Tokenizer_TokenizeString',
+	// so we know arguments count in Tokenizer. 'cmd' argument is
+	// only for warning display
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	if (DD_AllocCache() == false) {
+		return CMD_RES_ERROR;
+	}
+	g_dedupGlobal.maxSilence = Tokenizer_GetArgInteger(0);
+	g_dedupGlobal.minInterval = Tokenizer_GetArgIntegerDefault(1, 0);
+	return CMD_RES_OK;
+}
+
+static commandResult_t CMD_MQTT_DedupTopic(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	const char *filter;
+	int i;
+
+	(void)context;
+	(void)cmdFlags;
+	Tokenizer_TokenizeString(args, 0);
+	// following check must be done after 'Tokenizer_TokenizeString',
+	// so we know arguments count in Tokenizer. 'cmd' argument is
+	// only for warning display
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 2)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	if (DD_AllocCache() == false) {
+		return CMD_RES_ERROR;
+	}
+	filter = Tokenizer_GetArg(0);
+	for (i = 0; i < g_dedupNumPolicies; i++) {
+		if (!strcmp(g_dedupPolicies[i].filter, filter)) {
+			break;
+		}
+	}
+	if (i == g_dedupNumPolicies) {
+		if (i >= DEDUP_MAX_POLICIES) {
+			ADDLOG_ERROR(LOG_FEATURE_MQTT, "Too many dedup topics");
+			return CMD_RES_ERROR;
+		}
+		g_dedupPolicies[i].filter = strdup(filter);
+		if (g_dedupPolicies[i].filter == 0) {
+			return CMD_RES_ERROR;
+		}
+		g_dedupNumPolicies++;
+	}
+	g_dedupPolicies[i].maxSilence = Tokenizer_GetArgInteger(1);
+	g_dedupPolicies[i].minInterval = Tokenizer_GetArgIntegerDefault(2, 0);
+	return CMD_RES_OK;
+}
+
+static commandResult_t CMD_MQTT_DedupClear(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	int i;
+
+	(void)context;
+	(void)cmd;
+	(void)args;
+	(void)cmdFlags;
+	DD_Mutex_Take(100);
+	for (i = 0; i < g_dedupNumPolicies; i++) {
+		free(g_dedupPolicies[i].filter);
+	}
+	g_dedupNumPolicies = 0;
+	g_dedupGlobal.maxSilence = 0;
+	g_dedupGlobal.minInterval = 0;
+	if (g_dedupCache) {
+		for (i = 0; i < DEDUP_CACHE_SIZE; i++) {
+			DD_FreePending(&g_dedupCache[i]);
+		}
+		free(g_dedupCache);
+		g_dedupCache = 0;
+	}
+	stat_dedupCache_lookups = 0;
+	stat_dedupCache_hits = 0;
+	stat_dedupCache_delayed = 0;
+	DD_Mutex_Free();
+	return CMD_RES_OK;
+}
+
+void MQTT_Dedup_AddCommands() {
+	//cmddetail:{"name":"mqtt_dedup","args":"[MaxSilence] [MinInterval]",
+	//cmddetail:"descr":"Deduplicates all MQTT publishes: unchanged value is sent again only after MaxSilence seconds, changed value is delayed until MinInterval seconds passed since previous send. 0 disables",
+	//cmddetail:"fn":"CMD_MQTT_Dedup","file":"mqtt/new_mqtt_deduper.c","requires":"",
+	//cmddetail:"examples":"mqtt_dedup 60"}
+	CMD_RegisterCommand("mqtt_dedup", CMD_MQTT_Dedup, NULL);
+	//cmddetail:{"name":"mqtt_dedupTopic","args":"[TopicFilter] [MaxSilence] [MinInterval]",
+	//cmddetail:"descr":"Same as mqtt_dedup, but only for topics matching the filter (with + and # wildcards). Overrides mqtt_dedup, so 0 0 can exclude topics from it",
+	//cmddetail:"fn":"CMD_MQTT_DedupTopic","file":"mqtt/new_mqtt_deduper.c","requires":"",
+	//cmddetail:"examples":"mqtt_dedupTopic tele/+/SENSOR 300 10"}
+	CMD_RegisterCommand("mqtt_dedupTopic", CMD_MQTT_DedupTopic, NULL);
+	//cmddetail:{"name":"mqtt_dedupClear","args":"",
+	//cmddetail:"descr":"Removes all MQTT dedup settings and forgets sent values",
+	//cmddetail:"fn":"CMD_MQTT_DedupClear","file":"mqtt/new_mqtt_deduper.c","requires":"",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("mqtt_dedupClear", CMD_MQTT_DedupClear, NULL);
+}
+
 void MQTT_Dedup_Tick() {
 	int i;
 
+	g_dedupSeconds++;
+	DD_SendPending();
 	//if(DD_Mutex_Take(10)) {
 	//	return;
 	///}
@@ -85,6 +448,8 @@ void MQTT_Dedup_Tick() {
 	if (CFG_HasLoggerFlag(LOGGER_FLAG_MQTT_DEDUPER)) {
 		ADDLOG_DEBUG(LOG_FEATURE_MQTT, "MQTT deduper sent %i, culled duplicates %i, culled too fast %i",
 			stat_deduper_send, stat_deduper_culled_duplicates, stat_deduper_culled_tooFast);
+		ADDLOG_DEBUG(LOG_FEATURE_MQTT, "MQTT dedup cache lookups %i, hits %i, delayed %i",
+			stat_dedupCache_lookups, stat_dedupCache_hits, stat_dedupCache_delayed);
 	}
 
 }
@@ -27,5 +27,26 @@ OBK_Publish_Result MQTT_PublishMain_StringString_DeDuped(int slotCode, int expir
 OBK_Publish_Result MQTT_PublishMain_StringInt_DeDuped(int slotCode, int expireTime, const char* sChannel, int val, int flags);
 void MQTT_Dedup_Tick();
 
+// General cache for all publishes, keyed by full topic. Which topics are
+// deduplicated is set with mqtt_dedup (for all) and mqtt_dedupTopic (per filter).
+// With maxSilence, unchanged value is sent again only after that many seconds,
+// with minInterval, changed value waits until that many seconds passed since
+// previous send, and only the latest waiting value is sent then.
+typedef struct mqtt_dedup_token_s {
+	int slot;
+	unsigned int topicHash;
+	unsigned int valueHash;
+	int keep;
+	int minInterval;
+} mqtt_dedup_token_t;
+
+// returns 1 if publish should be skipped, otherwise call MQTT_Dedup_Sent once it was sent
+int MQTT_Dedup_Check(const char* topic, const char* value, int flags, mqtt_dedup_token_t* token);
+void MQTT_Dedup_Sent(const mqtt_dedup_token_t* token);
+// forgets sent values, so everything is sent again, e.g. after reconnect
+void MQTT_Dedup_Reset();
+void MQTT_Dedup_GetStats(int* lookups, int* hits, int* delayed);
+void MQTT_Dedup_AddCommands();
+
 #endif
 
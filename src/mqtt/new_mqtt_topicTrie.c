@@ -0,0 +1,235 @@
+#include "../new_common.h"
+#include "new_mqtt_topicTrie.h"
+
+#if ENABLE_MQTT || ENABLE_DRIVER_MQTTSERVER
+
+static unsigned char TT_Hash(const char* level, int len) {
+	unsigned char h = 0;
+
+	while (len--) {
+		h = h * 31 + (unsigned char)*level++;
+	}
+	return h;
+}
+
+static int TT_IsWildcard(const mqttTopicNode_t* n, char wildcard) {
+	return n->levelLen == 1 && n->level[0] == wildcard;
+}
+
+// length of the level at the start of s, *next is set to the following level or NULL
+static int TT_Level(const char* s, const char** next) {
+	const char* end = strchr(s, '/');
+
+	if (end == 0) {
+		*next = 0;
+		return strlen(s);
+	}
+	*next = end + 1;
+	return end - s;
+}
+
+static mqttTopicNode_t* TT_Find(mqttTopicNode_t* parent, const char* level, int len, unsigned char hash) {
+	mqttTopicNode_t* c;
+
+	for (c = parent->children; c; c = c->next) {
+		if (c->hash == hash && c->levelLen == len && !memcmp(c->level, level, len)) {
+			return c;
+		}
+	}
+	return 0;
+}
+
+static mqttTopicNode_t* TT_NewNode(const char* level, int len) {
+	mqttTopicNode_t* n = (mqttTopicNode_t*)malloc(sizeof(mqttTopicNode_t) + len);
+
+	if (n == 0) {
+		return 0;
+	}
+	memset(n, 0, sizeof(mqttTopicNode_t));
+	memcpy(n->level, level, len);
+	n->level[len] = 0;
+	n->levelLen = len;
+	n->hash = TT_Hash(level, len);
+	return n;
+}
+
+// '+' and '#' must fill whole level, '#' only as the last one
+static int TT_FilterValid(const char* filter) {
+	const char* next;
+	int len;
+
+	do {
+		len = TT_Level(filter, &next);
+		if (len > 1 && (memchr(filter, '+', len) || memchr(filter, '#', len))) {
+			return 0;
+		}
+		if (len == 1 && filter[0] == '#' && next) {
+			return 0;
+		}
+		filter = next;
+	} while (filter);
+	return 1;
+}
+
+int MQTT_TopicTrie_Add(mqttTopicTrie_t* trie, const char* filter, int owner) {
+	mqttTopicNode_t* n;
+	mqttTopicNode_t* c;
+	const char* next;
+	int len;
+
+	if (owner < 0 || owner >= MQTT_TOPICTRIE_MAX_OWNERS || !TT_FilterValid(filter)) {
+		return 0;
+	}
+	if (trie->root == 0) {
+		trie->root = TT_NewNode("", 0);
+		if (trie->root == 0) {
+			return 0;
+		}
+	}
+	n = trie->root;
+	do {
+		len = TT_Level(filter, &next);
+		c = TT_Find(n, filter, len, TT_Hash(filter, len));
+		if (c == 0) {
+			c = TT_NewNode(filter, len);
+			if (c == 0) {
+				return 0;
+			}
+			c->next = n->children;
+			n->children = c;
+		}
+		n = c;
+		filter = next;
+	} while (filter);
+	n->owners |= 1u << owner;
+	return 1;
+}
+
+static void TT_Remove(mqttTopicNode_t* parent, const char* filter, unsigned int bit) {
+	mqttTopicNode_t** pp;
+	mqttTopicNode_t* c;
+	const char* next;
+	int len;
+	unsigned char hash;
+
+	len = TT_Level(filter, &next);
+	hash = TT_Hash(filter, len);
+	for (pp = &parent->children; *pp; pp = &(*pp)->next) {
+		c = *pp;
+		if (c->hash == hash && c->levelLen == len && !memcmp(c->level, filter, len)) {
+			break;
+		}
+	}
+	if (*pp == 0) {
+		return;
+	}
+	if (next) {
+		TT_Remove(c, next, bit);
+	}
+	else {
+		c->owners &= ~bit;
+	}
+	// prune levels nobody uses anymore
+	if (c->owners == 0 && c->children == 0) {
+		*pp = c->next;
+		free(c);
+	}
+}
+
+void MQTT_TopicTrie_Remove(mqttTopicTrie_t* trie, const char* filter, int owner) {
+	if (trie->root == 0 || owner < 0 || owner >= MQTT_TOPICTRIE_MAX_OWNERS) {
+		return;
+	}
+	TT_Remove(trie->root, filter, 1u << owner);
+}
+
+static void TT_Free(mqttTopicNode_t* n) {
+	mqttTopicNode_t* next;
+
+	while (n) {
+		next = n->next;
+		TT_Free(n->children);
+		free(n);
+		n = next;
+	}
+}
+
+void MQTT_TopicTrie_Clear(mqttTopicTrie_t* trie) {
+	TT_Free(trie->root);
+	trie->root = 0;
+}
+
+// topic is the remaining part, or NULL when all levels were consumed
+static unsigned int TT_Match(const mqttTopicNode_t* n, const char* topic, int bFirst) {
+	const mqttTopicNode_t* c;
+	const char* next;
+	unsigned int owners = 0;
+	int bWild, len;
+	unsigned char hash;
+
+	bWild = !(bFirst && topic && topic[0] == '$');
+	if (topic == 0) {
+		owners = n->owners;
+		for (c = n->children; c; c = c->next) {
+			if (TT_IsWildcard(c, '#')) {
+				owners |= c->owners;
+			}
+		}
+		return owners;
+	}
+	len = TT_Level(topic, &next);
+	hash = TT_Hash(topic, len);
+	for (c = n->children; c; c = c->next) {
+		if (c->hash == hash && c->levelLen == len && !memcmp(c->level, topic, len)) {
+			owners |= TT_Match(c, next, 0);
+		}
+		else if (bWild && TT_IsWildcard(c, '+')) {
+			owners |= TT_Match(c, next, 0);
+		}
+		else if (bWild && TT_IsWildcard(c, '#')) {
+			owners |= c->owners;
+		}
+	}
+	return owners;
+}
+
+unsigned int MQTT_TopicTrie_Match(const mqttTopicTrie_t* trie, const char* topic) {
+	if (trie->root == 0) {
+		return 0;
+	}
+	return TT_Match(trie->root, topic, 1);
+}
+
+int MQTT_TopicMatch(const char* topic, const char* filter) {
+	const char* nextTopic;
+	const char* nextFilter;
+	int bFirst = 1;
+	int topicLen, filterLen;
+
+	while (1) {
+		filterLen = TT_Level(filter, &nextFilter);
+		if (filterLen == 1 && filter[0] == '#') {
+			return !(bFirst && topic[0] == '$');
+		}
+		if (topic == 0) {
+			return 0;
+		}
+		topicLen = TT_Level(topic, &nextTopic);
+		if (filterLen == 1 && filter[0] == '+') {
+			if (bFirst && topic[0] == '$') {
+				return 0;
+			}
+		}
+		else if (filterLen != topicLen || memcmp(filter, topic, topicLen)) {
+			return 0;
+		}
+		topic = nextTopic;
+		if (nextFilter == 0) {
+			return topic == 0;
+		}
+		filter = nextFilter;
+		bFirst = 0;
+	}
+}
+
+#endif
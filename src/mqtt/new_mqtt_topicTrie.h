@@ -0,0 +1,41 @@
+#ifndef __NEW_MQTT_TOPICTRIE_H__
+#define __NEW_MQTT_TOPICTRIE_H__
+
+#include "../obk_config.h"
+
+#if ENABLE_MQTT || ENABLE_DRIVER_MQTTSERVER
+
+// Subscription filters split on '/' into a tree of levels, so incoming
+// topic is matched against all filters in one walk instead of comparing
+// it with every filter. Every filter has an owner index (0..31),
+// match returns bitmask of owners whose filters accept the topic.
+// '+' matches a single level, '#' (last) matches rest including nothing,
+// wildcards at first level do not match topics starting with '$'.
+
+#define MQTT_TOPICTRIE_MAX_OWNERS	32
+
+typedef struct mqttTopicNode_s {
+	struct mqttTopicNode_s* children;
+	struct mqttTopicNode_s* next;
+	// owners with filter ending at this level
+	unsigned int owners;
+	unsigned short levelLen;
+	unsigned char hash;
+	char level[1];
+} mqttTopicNode_t;
+
+typedef struct mqttTopicTrie_s {
+	mqttTopicNode_t* root;
+} mqttTopicTrie_t;
+
+// returns 0 if out of memory
+int MQTT_TopicTrie_Add(mqttTopicTrie_t* trie, const char* filter, int owner);
+void MQTT_TopicTrie_Remove(mqttTopicTrie_t* trie, const char* filter, int owner);
+void MQTT_TopicTrie_Clear(mqttTopicTrie_t* trie);
+unsigned int MQTT_TopicTrie_Match(const mqttTopicTrie_t* trie, const char* topic);
+// same rules for a single filter, without building a trie
+int MQTT_TopicMatch(const char* topic, const char* filter);
+
+#endif
+
+#endif
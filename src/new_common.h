@@ -330,6 +330,9 @@ This platform is not supported, error!
 
 #endif
 
+// lwIP O_NONBLOCK switch, see win_rtos_stub.c
+int lwip_fcntl(int s, int cmd, int val);
+
 #define portTICK_RATE_MS 1000
 #define bk_printf printf
 
@@ -380,6 +383,10 @@ typedef int SemaphoreHandle_t;
 #define pdFALSE 0
 typedef int OSStatus;
 
+// see win_rtos_stub.c
+int xSemaphoreTake(int semaphore, int blockTime);
+int xSemaphoreCreateMutex();
+int xSemaphoreGive(int semaphore);
 int rtos_delay_milliseconds(int sec);
 int delay_ms(int sec);
 
@@ -1330,11 +1330,101 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 void PIN_SetGenericDoubleClickCallback(void (*cb)(int pinIndex)) {
 	g_doubleClickCallback = cb;
 }
+// Remembered channels are not written to flash on every change, a dimmer slider
+// or a script loop would rewrite whole flash vars many times per second.
+// Changes are only marked here and written together once channels were quiet
+// for a while, or when the oldest change waits too long. Reboot, OTA and
+// deep sleep write them at once.
+#define CHANNEL_SAVE_QUIET_SECONDS		3
+#define CHANNEL_SAVE_MAX_DELAY_SECONDS	10
+
+// channels are set from HTTP, MQTT and main threads, and OTA flushes from
+// HTTP thread, so mask is only changed under g_channelSaveMutex. Flushes are
+// serialized by g_channelFlushMutex, so an older snapshot can't be written last.
+static unsigned int g_channelSavePending = 0;
+static SemaphoreHandle_t g_channelSaveMutex = 0;
+static SemaphoreHandle_t g_channelFlushMutex = 0;
+static int g_channelSaveFirstChange;
+static int g_channelSaveLastChange;
+static int g_channelSaveWrites = 0;
+// changes that went into an already pending write
+static int g_channelSaveAvoided = 0;
+
+static bool Channel_SaveMutex_Take() {
+	if (g_channelSaveMutex == 0) {
+		g_channelSaveMutex = xSemaphoreCreateMutex();
+	}
+	return xSemaphoreTake(g_channelSaveMutex, 100) == pdTRUE;
+}
+void Channel_FlushPendingSaves() {
+	int values[MAX_RETAIN_CHANNELS];
+	unsigned int mask;
+	int i;
+
+	if (g_channelSavePending == 0) {
+		return;
+	}
+	if (g_channelFlushMutex == 0) {
+		g_channelFlushMutex = xSemaphoreCreateMutex();
+	}
+	if (xSemaphoreTake(g_channelFlushMutex, 1000) != pdTRUE) {
+		return;
+	}
+	if (Channel_SaveMutex_Take() == false) {
+		xSemaphoreGive(g_channelFlushMutex);
+		return;
+	}
+	// bits set after this point belong to the next flush
+	mask = g_channelSavePending;
+	g_channelSavePending = 0;
+	for (i = 0; i < MAX_RETAIN_CHANNELS; i++) {
+		values[i] = g_channelValues[i];
+	}
+	xSemaphoreGive(g_channelSaveMutex);
+	if (mask) {
+		HAL_FlashVars_SaveChannels(mask, values);
+		g_channelSaveWrites++;
+	}
+	xSemaphoreGive(g_channelFlushMutex);
+}
+// called every second
+void Channel_RunPendingSaves() {
+	if (g_channelSavePending == 0) {
+		return;
+	}
+	if (g_secondsElapsed - g_channelSaveLastChange >= CHANNEL_SAVE_QUIET_SECONDS
+		|| g_secondsElapsed - g_channelSaveFirstChange >= CHANNEL_SAVE_MAX_DELAY_SECONDS) {
+		Channel_FlushPendingSaves();
+	}
+}
+void Channel_GetSaveStats(int *writes, int *avoided, int *pending) {
+	*writes = g_channelSaveWrites;
+	*avoided = g_channelSaveAvoided;
+	*pending = g_channelSavePending != 0;
+}
 void Channel_SaveInFlashIfNeeded(int ch) {
 	// save, if marked as save value in flash (-1)
 	if (g_cfg.startChannelValues[ch] == -1) {
 		//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "Channel_SaveInFlashIfNeeded: Channel %i is being saved to flash, state %i", ch, g_channelValues[ch]);
-		HAL_FlashVars_SaveChannel(ch, g_channelValues[ch]);
+		if (ch >= MAX_RETAIN_CHANNELS) {
+			// no room in flash vars, HAL will tell
+			HAL_FlashVars_SaveChannel(ch, g_channelValues[ch]);
+			return;
+		}
+		if (Channel_SaveMutex_Take() == false) {
+			// better an extra write than a lost value
+			HAL_FlashVars_SaveChannel(ch, g_channelValues[ch]);
+			return;
+		}
+		if (g_channelSavePending == 0) {
+			g_channelSaveFirstChange = g_secondsElapsed;
+		}
+		else {
+			g_channelSaveAvoided++;
+		}
+		g_channelSavePending |= 1 << ch;
+		g_channelSaveLastChange = g_secondsElapsed;
+		xSemaphoreGive(g_channelSaveMutex);
 	}
 	else {
 		//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "Channel_SaveInFlashIfNeeded: Channel %i is not saved to flash, state %i", ch, g_channelValues[ch]);
@@ -1353,6 +1443,9 @@ static void Channel_OnChanged(int ch, int prevValue, int iFlags) {
 #if ENABLE_I2C
 	I2C_OnChannelChanged(ch, iVal);
 #endif
+#if ENABLE_HTTP_EVENTS
+	HTTP_Events_OnChannelChanged(ch);
+#endif
 
 #ifndef OBK_DISABLE_ALL_DRIVERS
 	DRV_OnChannelChanged(ch, iVal);
@@ -1383,7 +1476,7 @@ static void Channel_OnChanged(int ch, int prevValue, int iFlags) {
 #if ENABLE_MQTT
 	if ((iFlags & CHANNEL_SET_FLAG_SKIP_MQTT) == 0) {
 		if (CHANNEL_ShouldBePublished(ch)) {
-			MQTT_ChannelPublish(ch, 0);
+			MQTT_QueueChannelPublish(ch);
 		}
 	}
 #endif
@@ -1710,13 +1803,13 @@ void CHANNEL_Set_Ex(int ch, int iVal, int iFlags, int ausemovingaverage) {
 	if (bForce == 0) {
 		if (prevValue == iVal) {
 			if (bSilent == 0) {
-				addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "No change in channel %i (still set to %i) - ignoring", ch, prevValue);
+				ADDLOG_DEFERRED(LOG_INFO, LOG_FEATURE_GENERAL, "No change in channel %i (still set to %i) - ignoring", ch, prevValue);
 			}
 			return;
 		}
 	}
 	if (bSilent == 0) {
-		addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_Set channel %i has changed to %i (flags %i)", ch, iVal, iFlags);
+		ADDLOG_DEFERRED(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_Set channel %i has changed to %i (flags %i)", ch, iVal, iFlags);
 	}
 	#ifdef ENABLE_BL_MOVINGAVG
 	//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_Set debug channel %i has changed to %i (flags %i)", ch, iVal, iFlags);
@@ -1794,14 +1887,14 @@ void CHANNEL_Add(int ch, int iVal) {
 	prevValue = g_channelValues[ch];
 	g_channelValues[ch] = g_channelValues[ch] + iVal;
 
-	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_Add channel %i has changed to %i", ch, g_channelValues[ch]);
+	ADDLOG_DEFERRED(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_Add channel %i has changed to %i", ch, g_channelValues[ch]);
 
 	Channel_OnChanged(ch, prevValue, 0);
 #else
 	// we want to support special channel indexes, so it's better to use GET/SET interface
 	// Special channel indexes are used to access things like dimmer, led colors, etc
 	iVal = iVal + CHANNEL_Get(ch);
-	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_Add channel %i has changed to %i", ch, iVal);
+	ADDLOG_DEFERRED(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_Add channel %i has changed to %i", ch, iVal);
 	CHANNEL_Set(ch, iVal, 0);
 #endif
 }
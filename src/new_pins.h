@@ -1675,6 +1675,10 @@ int CHANNEL_HasChannelPinWithRole(int ch, int iorType);
 int CHANNEL_HasChannelPinWithRoleOrRole(int ch, int iorType, int iorType2);
 bool CHANNEL_IsInUse(int ch);
 void Channel_SaveInFlashIfNeeded(int ch);
+// writes remembered channels changed since last save
+void Channel_FlushPendingSaves();
+void Channel_RunPendingSaves();
+void Channel_GetSaveStats(int *writes, int *avoided, int *pending);
 int CHANNEL_FindMaxValueForChannel(int ch);
 int CHANNEL_FindIndexForType(int requiredType); 
 int CHANNEL_FindIndexForPinType(int requiredType);
@@ -153,6 +153,7 @@
 #define ENABLE_HA_DISCOVERY						1
 #define ENABLE_SEND_POSTANDGET					1
 #define ENABLE_MQTT								1
+#define ENABLE_DEFERRED_LOG						1
 #define ENABLE_TASMOTADEVICEGROUPS				1
 #define ENABLE_LITTLEFS							1
 #define ENABLE_NTP								1
@@ -217,6 +218,7 @@
 // #define ENABLE_SEND_POSTANDGET				1
 #define ENABLE_HA_DISCOVERY 					1
 #define ENABLE_MQTT								1
+#define ENABLE_DEFERRED_LOG						1
 #define ENABLE_TASMOTADEVICEGROUPS				1
 #define ENABLE_LITTLEFS							1
 #define ENABLE_NTP								1
@@ -279,6 +281,7 @@
 #define ENABLE_HA_DISCOVERY						1
 #define ENABLE_SEND_POSTANDGET					1
 #define ENABLE_MQTT								1
+#define ENABLE_DEFERRED_LOG						1
 #define ENABLE_TASMOTADEVICEGROUPS				1
 #define ENABLE_LITTLEFS							1
 #define ENABLE_NTP								1
@@ -425,6 +428,7 @@
 //#define ENABLE_SEND_POSTANDGET				1
 #define	ENABLE_HA_DISCOVERY						1
 #define ENABLE_MQTT								1
+#define ENABLE_DEFERRED_LOG						1
 #define ENABLE_TASMOTADEVICEGROUPS				1
 #define ENABLE_NTP								1
 //#define ENABLE_TIME_DST						1
@@ -464,6 +468,7 @@
 #define ENABLE_SEND_POSTANDGET					1
 #define	ENABLE_HA_DISCOVERY						1
 #define ENABLE_MQTT								1
+#define ENABLE_DEFERRED_LOG						1
 #define ENABLE_I2C								1
 #define ENABLE_NTP								1
 //#define ENABLE_TIME_DST						1
@@ -739,6 +744,21 @@
 // #define ENABLE_BL_MOVINGAVG					1
 #endif
 
+// platforms without a thread per HTTP client serve all clients from one select() loop
+#if WINDOWS || (!NEW_TCP_SERVER && (PLATFORM_XR809 || PLATFORM_XR872))
+#define ENABLE_HTTP_SELECT_SERVER				1
+#endif
+
+// page CSS/JS as separate gzipped files that browser can cache
+#if !PLATFORM_XR809 && !PLATFORM_W600
+#define ENABLE_HTTP_STATIC_ASSETS				1
+#endif
+
+// push state changes to main page instead of polling it
+#if WINDOWS || PLATFORM_BEKEN || PLATFORM_BL602 || PLATFORM_ESPIDF || PLATFORM_LN882H || PLATFORM_W800 || PLATFORM_REALTEK
+#define ENABLE_HTTP_EVENTS						1
+#endif
+
 // ensure that there would be no conflicts
 #if ENABLE_DRIVER_IRREMOTEESP
 #undef ENABLE_DRIVER_IR
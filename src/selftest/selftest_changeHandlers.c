@@ -1,6 +1,7 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include <time.h>
 
 void Test_ChangeHandlers() {
 	// reset whole device
@@ -222,4 +223,77 @@ void Test_ChangeHandlers_EnsureThatChannelVariableIsExpandedAtHandlerRunTime() {
 }
 
 
+// 200 handlers, only two of them for channel 1
+static void Test_ChangeHandlers_AddMany() {
+	char buffer[64];
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	// 100 pin handlers, for pins that never fire in this test
+	for (i = 0; i < 100; i++) {
+		sprintf(buffer, "addEventHandler OnClick %i addChannel 30 1", i);
+		CMD_ExecuteCommand(buffer, 0);
+	}
+	// 98 change handlers on other channels
+	for (i = 0; i < 98; i++) {
+		sprintf(buffer, "addChangeHandler Channel%i == %i addChannel 31 1", 40 + (i % 20), i);
+		CMD_ExecuteCommand(buffer, 0);
+	}
+	// and two handlers for the toggled channel
+	CMD_ExecuteCommand("addChangeHandler Channel1 == 1 addChannel 2 1", 0);
+	CMD_ExecuteCommand("addChangeHandler Channel1 == 0 addChannel 3 1", 0);
+	SELFTEST_ASSERT(EventHandlers_GetActiveCount() == 200);
+}
+
+void Test_ChangeHandlers_Stress() {
+	int i;
+	int toggles = 2000;
+
+	Test_ChangeHandlers_AddMany();
+	// toggle channel once per quick tick
+	for (i = 0; i < toggles; i++) {
+		CMD_ExecuteCommand("toggleChannel 1", 0);
+		Sim_RunFrames(1, false);
+	}
+
+	SELFTEST_ASSERT_CHANNEL(2, toggles / 2);
+	SELFTEST_ASSERT_CHANNEL(3, toggles / 2);
+	SELFTEST_ASSERT_CHANNEL(30, 0);
+	SELFTEST_ASSERT_CHANNEL(31, 0);
+
+	// handlers in other buckets must still fire
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 57);
+	SELFTEST_ASSERT_CHANNEL(30, 1);
+	CMD_ExecuteCommand("setChannel 45 5", 0);
+	SELFTEST_ASSERT_CHANNEL(31, 1);
+	CMD_ExecuteCommand("setChannel 45 25", 0);
+	SELFTEST_ASSERT_CHANNEL(31, 2);
+
+	CMD_ExecuteCommand("clearAllHandlers", 0);
+	SELFTEST_ASSERT(EventHandlers_GetActiveCount() == 0);
+	CMD_ExecuteCommand("toggleChannel 1", 0);
+	SELFTEST_ASSERT_CHANNEL(2, toggles / 2);
+	SELFTEST_ASSERT_CHANNEL(3, toggles / 2);
+}
+
+void Benchmark_ChangeHandlers() {
+	int i;
+	int toggles = 2000;
+	clock_t start;
+	double t;
+
+	Test_ChangeHandlers_AddMany();
+	start = clock();
+	for (i = 0; i < toggles; i++) {
+		CMD_ExecuteCommand("toggleChannel 1", 0);
+		Sim_RunFrames(1, false);
+	}
+	t = (double)(clock() - start) / CLOCKS_PER_SEC;
+	SELFTEST_ASSERT_CHANNEL(2, toggles / 2);
+	printf("Change handlers benchmark: %i toggles with 200 handlers took %f s\n", toggles, t);
+}
+
+
 #endif
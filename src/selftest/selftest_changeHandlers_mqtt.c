@@ -23,6 +23,7 @@ void Test_ChangeHandlers_MQTT() {
 
 	// This should trigger MQTT publish
 	CMD_ExecuteCommand("setChannel 12 1", 0);
+	Sim_RunFrames(1, false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("handlerTester/12/get", "1", false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("handlerTester/myChannel/get", "valueIsOne", false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_FLOAT("handlerTester/twelveValue/get", 10, false);
@@ -31,6 +32,7 @@ void Test_ChangeHandlers_MQTT() {
 
 	// This should trigger MQTT publish
 	CMD_ExecuteCommand("setChannel 12 2", 0);
+	Sim_RunFrames(1, false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("handlerTester/12/get", "2", false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("handlerTester/myChannel/get", "valueIsTwo", false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_FLOAT("handlerTester/twelveValue/get", 20, false);
@@ -39,6 +41,7 @@ void Test_ChangeHandlers_MQTT() {
 
 	// This should trigger MQTT publish
 	CMD_ExecuteCommand("setChannel 12 0", 0);
+	Sim_RunFrames(1, false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("handlerTester/12/get", "0", false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("handlerTester/myChannel/get", "valueIsZero", false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_FLOAT("handlerTester/twelveValue/get", 0, false);
@@ -47,6 +50,7 @@ void Test_ChangeHandlers_MQTT() {
 
 	// This should trigger MQTT publish
 	CMD_ExecuteCommand("setChannel 12 2", 0);
+	Sim_RunFrames(1, false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("handlerTester/12/get", "2", false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("handlerTester/myChannel/get", "valueIsTwo", false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_FLOAT("handlerTester/twelveValue/get", 20, false);
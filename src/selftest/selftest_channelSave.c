@@ -0,0 +1,67 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../hal/hal_flashVars.h"
+#include "../hal/hal_ota.h"
+
+void Test_ChannelSave() {
+	char cmd[32];
+	int i;
+	int writes, avoided, pending;
+	int avoidedBefore;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+	Channel_GetSaveStats(&writes, &avoidedBefore, &pending);
+
+	CMD_ExecuteCommand("SetStartValue 1 -1", 0);
+	CMD_ExecuteCommand("SetStartValue 2 -1", 0);
+
+	// slider dragged over whole range, nothing written yet
+	for (i = 1; i <= 100; i++) {
+		sprintf(cmd, "setChannel 1 %i", i);
+		CMD_ExecuteCommand(cmd, 0);
+	}
+	CMD_ExecuteCommand("setChannel 2 5", 0);
+	SELFTEST_ASSERT(SIM_GetFlashVarsWrites() == 0);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT(SIM_GetFlashVarsWrites() == 0);
+	// quiet for a while, both channels go in one write
+	Sim_RunSeconds(4, false);
+	SELFTEST_ASSERT(SIM_GetFlashVarsWrites() == 1);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(1) == 100);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(2) == 5);
+	Channel_GetSaveStats(&writes, &avoided, &pending);
+	SELFTEST_ASSERT(avoided - avoidedBefore == 100);
+	SELFTEST_ASSERT(pending == 0);
+
+	// channel without start value -1 is not written
+	CMD_ExecuteCommand("setChannel 3 1", 0);
+	Sim_RunSeconds(5, false);
+	SELFTEST_ASSERT(SIM_GetFlashVarsWrites() == 1);
+
+	// changes that never stop are still written after max delay
+	for (i = 0; i < 14; i++) {
+		sprintf(cmd, "setChannel 2 %i", 10 + i);
+		CMD_ExecuteCommand(cmd, 0);
+		Sim_RunSeconds(1, false);
+	}
+	SELFTEST_ASSERT(SIM_GetFlashVarsWrites() == 2);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(2) >= 10);
+
+	// OTA start writes pending changes at once
+	Sim_RunSeconds(5, false);
+	i = SIM_GetFlashVarsWrites();
+	CMD_ExecuteCommand("setChannel 1 42", 0);
+	OTA_IncrementProgress(1);
+	OTA_ResetProgress();
+	SELFTEST_ASSERT(SIM_GetFlashVarsWrites() == i + 1);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(1) == 42);
+
+	// nothing pending, nothing written
+	Channel_FlushPendingSaves();
+	SELFTEST_ASSERT(SIM_GetFlashVarsWrites() == i + 1);
+	CMD_ExecuteCommand("FlashChannelStats", 0);
+}
+
+#endif
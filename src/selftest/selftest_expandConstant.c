@@ -60,6 +60,10 @@ void Test_ExpandConstant() {
 	CMD_ExpandConstantsWithinString("$CH1$CH1", buffer, sizeof(buffer));
 	SELFTEST_ASSERT_STRING(buffer, "456456");
 
+	// constant names are case insensitive
+	CMD_ExpandConstantsWithinString("$ch11 $cH1", buffer, sizeof(buffer));
+	SELFTEST_ASSERT_STRING(buffer, "2022 456");
+
 	// check buffer len truncating
 	CMD_ExpandConstantsWithinString("Hello long one!", smallBuffer, sizeof(smallBuffer));
 	// Buffer was too short - text truncated!
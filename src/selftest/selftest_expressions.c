@@ -1,6 +1,7 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include <time.h>
 
 void Test_Expressions_RunTests_Basic() {
 	// reset whole device
@@ -312,4 +313,64 @@ void Test_Expressions_RunTests_Braces() {
 
 }
 
+static const char *g_benchExprs[] = {
+	"$CH11>=10",
+	"$CH11+1",
+	"!$CH12",
+	"($CH11*2+$CH12)%7 != 3 && $led_dimmer<=100",
+	"((3+4)*(5+6))+((2*3)+4)",
+	"-1.5*$CH12-$CH11/4",
+};
+
+// cached, compiled expressions must give the same results as the parser
+void Test_Expressions_Cached() {
+	int numExprs = sizeof(g_benchExprs) / sizeof(g_benchExprs[0]);
+	int j;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("setChannel 11 9", 0);
+	CMD_ExecuteCommand("setChannel 12 3", 0);
+
+	for (j = 0; j < numExprs; j++) {
+		SELFTEST_ASSERT(Float_Equals(CMD_EvaluateCachedExpression(g_benchExprs[j]), CMD_EvaluateExpression(g_benchExprs[j], 0)));
+	}
+	// cached program must see new channel values
+	CMD_ExecuteCommand("setChannel 11 10", 0);
+	SELFTEST_ASSERT_EXPRESSION("$CH11>=10", 1);
+	CMD_ExecuteCommand("setChannel 11 9", 0);
+	SELFTEST_ASSERT_EXPRESSION("$CH11>=10", 0);
+}
+
+void Benchmark_Expressions() {
+	int numExprs = sizeof(g_benchExprs) / sizeof(g_benchExprs[0]);
+	int loops = 20000;
+	int i;
+	clock_t start;
+	float sumRecursive, sumCompiled;
+	double tRecursive, tCompiled;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("setChannel 11 9", 0);
+	CMD_ExecuteCommand("setChannel 12 3", 0);
+
+	sumRecursive = 0;
+	start = clock();
+	for (i = 0; i < loops; i++) {
+		sumRecursive += CMD_EvaluateExpression(g_benchExprs[i % numExprs], 0);
+	}
+	tRecursive = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	sumCompiled = 0;
+	start = clock();
+	for (i = 0; i < loops; i++) {
+		sumCompiled += CMD_EvaluateCachedExpression(g_benchExprs[i % numExprs]);
+	}
+	tCompiled = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	SELFTEST_ASSERT(Float_Equals(sumRecursive, sumCompiled));
+	printf("Expressions benchmark: recursive %.0f evals/s, compiled %.0f evals/s\n",
+		loops / (tRecursive > 0 ? tRecursive : 0.000001),
+		loops / (tCompiled > 0 ? tCompiled : 0.000001));
+}
+
 #endif
@@ -0,0 +1,129 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../hal/hal_flashVars.h"
+#include "../hal/hal_flashVars_journal.h"
+
+// small sectors, so compaction happens often
+#define TEST_FVJ_SECTOR_SIZE 256
+
+static unsigned char g_testSectors[2][TEST_FVJ_SECTOR_SIZE];
+// how many bytes can be written before simulated power loss, -1 for no limit
+static int g_testWriteBudget = -1;
+
+static void Test_FVJ_Read(int sector, int offset, void *data, int len) {
+	memcpy(data, g_testSectors[sector] + offset, len);
+}
+static void Test_FVJ_Write(int sector, int offset, const void *data, int len) {
+	const unsigned char *src = (const unsigned char*)data;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (g_testWriteBudget == 0)
+			return;
+		if (g_testWriteBudget > 0)
+			g_testWriteBudget--;
+		g_testSectors[sector][offset + i] &= src[i];
+	}
+}
+static void Test_FVJ_Erase(int sector) {
+	memset(g_testSectors[sector], 0xFF, TEST_FVJ_SECTOR_SIZE);
+}
+static const flashVarsJournalOps_t g_testOps = {
+	TEST_FVJ_SECTOR_SIZE,
+	Test_FVJ_Read,
+	Test_FVJ_Write,
+	Test_FVJ_Erase,
+};
+
+static int Test_FVJ_NewestSector() {
+	unsigned int seq[2];
+
+	memcpy(&seq[0], g_testSectors[0] + 4, 4);
+	memcpy(&seq[1], g_testSectors[1] + 4, 4);
+	return (int)(seq[1] - seq[0]) > 0 ? 1 : 0;
+}
+
+void Test_FlashVarsJournal() {
+	FLASH_VARS_STRUCTURE vars, loaded;
+	int bytes, compactions, compactionsBefore;
+	int i, written, prev;
+
+	// simulated device flash vars survive a reboot
+	SIM_ClearOBK(0);
+	HAL_FlashVars_SaveChannel(3, 1234);
+	HAL_FlashVars_SaveChannel(4, -5);
+	SIM_ReloadFlashVars();
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(3) == 1234);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(4) == -5);
+	SELFTEST_ASSERT(SIM_GetFlashVarsWrites() == 2);
+	// same value again is not written at all
+	HAL_FlashVars_SaveChannel(3, 1234);
+	SELFTEST_ASSERT(SIM_GetFlashVarsWrites() == 2);
+
+	// fresh flash
+	Test_FVJ_Erase(0);
+	Test_FVJ_Erase(1);
+	g_testWriteBudget = -1;
+	SELFTEST_ASSERT(FlashVarsJournal_Init(&g_testOps, &vars, sizeof(vars)) == 0);
+	SELFTEST_ASSERT(vars.savedValues[0] == 0);
+	FlashVarsJournal_GetStats(&bytes, &compactionsBefore);
+
+	// first save writes whole structure
+	vars.boot_count = 7;
+	written = FlashVarsJournal_Save(&vars);
+	SELFTEST_ASSERT(written > (int)sizeof(vars));
+	// then single channel change is only few bytes
+	vars.savedValues[2] = 300;
+	written = FlashVarsJournal_Save(&vars);
+	SELFTEST_ASSERT(written > 0 && written < 10);
+	// nothing changed, nothing written
+	SELFTEST_ASSERT(FlashVarsJournal_Save(&vars) == 0);
+
+	// reboot
+	SELFTEST_ASSERT(FlashVarsJournal_Init(&g_testOps, &loaded, sizeof(loaded)) == 1);
+	SELFTEST_ASSERT(memcmp(&vars, &loaded, sizeof(vars)) == 0);
+
+	// many saves fill the sector and state moves to the other one
+	for (i = 0; i < 100; i++) {
+		vars.savedValues[i % MAX_RETAIN_CHANNELS] = 1000 + i;
+		SELFTEST_ASSERT(FlashVarsJournal_Save(&vars) > 0);
+	}
+	FlashVarsJournal_GetStats(&bytes, &compactions);
+	SELFTEST_ASSERT(compactions - compactionsBefore >= 2);
+	SELFTEST_ASSERT(FlashVarsJournal_Init(&g_testOps, &loaded, sizeof(loaded)) == 1);
+	SELFTEST_ASSERT(memcmp(&vars, &loaded, sizeof(vars)) == 0);
+
+	// power lost in the middle of a record, previous state is kept
+	prev = vars.savedValues[5];
+	vars.savedValues[5] = prev + 1;
+	g_testWriteBudget = 3;
+	FlashVarsJournal_Save(&vars);
+	g_testWriteBudget = -1;
+	SELFTEST_ASSERT(FlashVarsJournal_Init(&g_testOps, &loaded, sizeof(loaded)) == 1);
+	SELFTEST_ASSERT(loaded.savedValues[5] == prev);
+	// and journal still works after that
+	loaded.savedValues[5] = prev + 2;
+	SELFTEST_ASSERT(FlashVarsJournal_Save(&loaded) > 0);
+	SELFTEST_ASSERT(FlashVarsJournal_Init(&g_testOps, &vars, sizeof(vars)) == 1);
+	SELFTEST_ASSERT(vars.savedValues[5] == prev + 2);
+
+	// save until a compaction, remembering the state before it
+	FlashVarsJournal_GetStats(&bytes, &compactionsBefore);
+	compactions = compactionsBefore;
+	for (i = 0; compactions == compactionsBefore; i++) {
+		prev = vars.savedValues[1];
+		vars.savedValues[1] = 2000 + i;
+		FlashVarsJournal_Save(&vars);
+		FlashVarsJournal_GetStats(&bytes, &compactions);
+	}
+	// newest header damaged, older sector is used
+	g_testSectors[Test_FVJ_NewestSector()][0] = 0;
+	SELFTEST_ASSERT(FlashVarsJournal_Init(&g_testOps, &loaded, sizeof(loaded)) == 1);
+	SELFTEST_ASSERT(loaded.savedValues[1] == prev);
+
+	// give journal back to simulated device
+	SIM_ClearFlashVars();
+}
+
+#endif
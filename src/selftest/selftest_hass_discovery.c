@@ -1,6 +1,9 @@
 ﻿#ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../httpserver/hass.h"
+#include "../mqtt/new_mqtt.h"
+#include "../logging/logging.h"
 
 void CheckForCommonVars() {
 
@@ -522,7 +525,54 @@ void Test_HassDiscovery_SpecialChar() {
 	SELFTEST_ASSERT(0xC6 == ((byte*)fullName)[3]);
 }
 
+// 40 entities, more than the MQTT queue can hold at once
+void Test_HassDiscovery_ManyEntities() {
+	int i;
+	int queueBytes, queuePeak;
+	char buffer[64];
+
+	SIM_ClearOBK("ManyEntities");
+	SIM_ClearAndPrepareForMQTTTesting("testManyEntities", "bekens");
+
+	// 2 entities
+	PIN_SetPinRoleForPinIndex(24, IOR_BAT_ADC);
+	PIN_SetPinChannelForPinIndex(24, 1);
+	PIN_SetPinRoleForPinIndex(26, IOR_BAT_Relay);
+	PIN_SetPinChannelForPinIndex(26, 2);
+	CMD_ExecuteCommand("startDriver Battery", 0);
+	// 32 entities
+	for (i = 0; i < 32; i++) {
+		sprintf(buffer, "setChannelType %i %s", i, (i % 2) ? "Temperature" : "Toggle");
+		CMD_ExecuteCommand(buffer, 0);
+	}
+	// 6 entities
+	CFG_SetFlag(OBK_FLAG_MQTT_BROADCASTSELFSTATEPERMINUTE, 1);
+
+	SIM_ClearMQTTHistory();
+	hass_get_heap_peak(true);
+	MQTT_GetPublishQueueStats(&queueBytes, &queuePeak, true);
+	CMD_ExecuteCommand("scheduleHADiscovery 1", 0);
+	Sim_RunSeconds(30, false);
+
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("homeassistant") == 40);
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT_ANY("homeassistant", true, 0, 0, "stat_t", "~/0/get");
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT_ANY("homeassistant", true, 0, 0, "stat_t", "~/31/get");
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT_ANY("homeassistant", true, 0, 0, "stat_t", "~/battery/get");
+	// all discovery JSON was freed
+	MQTT_GetPublishQueueStats(&queueBytes, &queuePeak, false);
+	SELFTEST_ASSERT(queueBytes == 0);
+
+	// one entity is built at a time, so discovery heap stays small
+	SELFTEST_ASSERT(hass_get_heap_peak(false) > 0);
+	SELFTEST_ASSERT(hass_get_heap_peak(false) < 4096);
+	addLogAdv(LOG_INFO, LOG_FEATURE_HASS, "HA discovery of 40 entities: peak discovery heap %i bytes, peak MQTT queue %i bytes",
+		hass_get_heap_peak(false), queuePeak);
+
+	CFG_SetFlag(OBK_FLAG_MQTT_BROADCASTSELFSTATEPERMINUTE, 0);
+}
+
 void Test_HassDiscovery() {
+	Test_HassDiscovery_ManyEntities();
     Test_HassDiscovery_SpecialChar();
 	Test_HassDiscovery_SHTSensor();
 #if ENABLE_DRIVER_BL0942
@@ -81,6 +81,8 @@ void Test_FakeHTTPClientPacket_Generic() {
 	request.replylen = 0;
 
 	request.replymaxlen = sizeof(outbuf);
+	// like the servers do, e.g. response code is 200 unless handler changes it
+	HTTP_ResetRequest(&request);
 
 	printf("Test_FakeHTTPClientPacket_GET fake bytes sent: %d \n", iResult);
  	len = HTTP_ProcessPacket(&request);
@@ -101,6 +103,13 @@ void Test_FakeHTTPClientPacket_GET(const char *tg) {
 	sprintf(buffer, http_get_template1, tg);
 	Test_FakeHTTPClientPacket_Generic();
 }
+// same as above, with one more header line, e.g. "If-None-Match: \"abc\""
+void Test_FakeHTTPClientPacket_GET_withHeader(const char *tg, const char *header) {
+	const char *rest = strstr(http_get_template1, "\r\n") + 2;
+
+	sprintf(buffer, "GET /%s HTTP/1.1\r\n%s\r\n%s", tg, header, rest);
+	Test_FakeHTTPClientPacket_Generic();
+}
 void Test_FakeHTTPClientPacket_POST(const char *tg, const char *data) {
 	int dataLen = strlen(data);
 
@@ -280,6 +289,10 @@ const char *Test_GetJSONValue_String(const char *keyword, const char *obj) {
 const char *Test_GetLastHTMLReply() {
 	return replyAt;
 }
+// status line and headers, body may be binary
+const char *Test_GetLastHTTPHeaders() {
+	return outbuf;
+}
 const char *Test_QueryHTMLReply(const char *url) {
 	Test_FakeHTTPClientPacket_GET(url);
 	return Test_GetLastHTMLReply();
@@ -0,0 +1,552 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../httpserver/new_http.h"
+#include "../httpserver/http_tcp_server.h"
+#include <time.h>
+
+// Real TCP client connected to our own simulated HTTP server on loopback.
+// It will be skipped if port is already in use (and not in use by us)
+
+extern int g_httpPort;
+extern int g_lfsUploadDeferCalls;
+
+typedef struct testHttpClient_s {
+	SOCKET s;
+	char rx[16384];
+	int rxLen;
+} testHttpClient_t;
+
+static testHttpClient_t g_client;
+static testHttpClient_t g_clients[5];
+static char g_body[16384];
+static char g_upload[12000];
+
+static SOCKET Test_KeepAlive_ConnectClient(testHttpClient_t *c) {
+	struct sockaddr_in addr;
+	SOCKET s;
+	int argp = 1;
+
+	s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == INVALID_SOCKET) {
+		return INVALID_SOCKET;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(g_httpPort);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (connect(s, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		closesocket(s);
+		return INVALID_SOCKET;
+	}
+	ioctlsocket(s, FIONBIO, &argp);
+	c->s = s;
+	c->rxLen = 0;
+	return s;
+}
+
+static SOCKET Test_KeepAlive_Connect() {
+	return Test_KeepAlive_ConnectClient(&g_client);
+}
+
+// length of whole response in rx, 0 if not complete, body is copied to g_body
+static int Test_KeepAlive_ParseResponse(testHttpClient_t *c, bool bClosed) {
+	char *end;
+	char *p;
+	char *data;
+	int headerLen, chunk, bodyLen;
+
+	c->rx[c->rxLen] = 0;
+	end = strstr(c->rx, "\r\n\r\n");
+	if (end == 0) {
+		return 0;
+	}
+	headerLen = end - c->rx + 4;
+	p = strstr(c->rx, "Content-Length: ");
+	if (p && p < end) {
+		bodyLen = atoi(p + 16);
+		if (headerLen + bodyLen > c->rxLen) {
+			return 0;
+		}
+		memcpy(g_body, c->rx + headerLen, bodyLen);
+		g_body[bodyLen] = 0;
+		return headerLen + bodyLen;
+	}
+	p = strstr(c->rx, "Transfer-Encoding: chunked");
+	if (p && p < end) {
+		data = c->rx + headerLen;
+		bodyLen = 0;
+		while (1) {
+			p = strstr(data, "\r\n");
+			if (p == 0) {
+				return 0;
+			}
+			chunk = strtol(data, 0, 16);
+			if (p + 2 + chunk + 2 > c->rx + c->rxLen) {
+				return 0;
+			}
+			if (chunk == 0) {
+				g_body[bodyLen] = 0;
+				return p + 4 - c->rx;
+			}
+			memcpy(g_body + bodyLen, p + 2, chunk);
+			bodyLen += chunk;
+			data = p + 2 + chunk + 2;
+		}
+	}
+	// no framing, connection close marks the end
+	if (bClosed == false) {
+		return 0;
+	}
+	strcpy(g_body, c->rx + headerLen);
+	return c->rxLen;
+}
+
+// receives what is there, returns length of whole response or 0
+static int Test_KeepAlive_Poll(testHttpClient_t *c, bool *bClosed) {
+	int len, total;
+
+	total = Test_KeepAlive_ParseResponse(c, *bClosed);
+	if (total > 0) {
+		// keep pipelined responses
+		c->rxLen -= total;
+		memmove(c->rx, c->rx + total, c->rxLen);
+		return total;
+	}
+	len = recv(c->s, c->rx + c->rxLen, sizeof(c->rx) - 1 - c->rxLen, 0);
+	if (len > 0) {
+		c->rxLen += len;
+	}
+	else if (len == 0) {
+		*bClosed = true;
+	}
+	return 0;
+}
+
+// runs server until whole response is received, returns 0 on failure
+static int Test_KeepAlive_ReadClient(testHttpClient_t *c, bool *bClosed, int maxTicks) {
+	int i, total;
+
+	*bClosed = false;
+	for (i = 0; i < maxTicks; i++) {
+		total = Test_KeepAlive_Poll(c, bClosed);
+		if (total > 0) {
+			return total;
+		}
+		if (*bClosed) {
+			// whatever was left
+			return Test_KeepAlive_Poll(c, bClosed);
+		}
+		HTTPServer_RunQuickTick();
+	}
+	return 0;
+}
+
+static int Test_KeepAlive_ReadResponse(bool *bClosed) {
+	return Test_KeepAlive_ReadClient(&g_client, bClosed, 100000);
+}
+
+static bool Test_KeepAlive_WaitForClose() {
+	bool bClosed;
+
+	return Test_KeepAlive_ReadResponse(&bClosed) == 0 && bClosed;
+}
+
+static const char keepAliveRequest[] = "GET /cm?cmnd=POWER HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+static const char closeRequest[] = "GET /cm?cmnd=POWER HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+
+// sends requests on one connection, reconnecting when server closes it,
+// returns number of answered requests
+static int Test_KeepAlive_Requests(int numRequests) {
+	SOCKET s;
+	bool bClosed;
+	int i;
+
+	s = Test_KeepAlive_Connect();
+	for (i = 0; i < numRequests; i++) {
+		// server closes after HTTP_KEEPALIVE_MAX_REQUESTS
+		if (i % HTTP_KEEPALIVE_MAX_REQUESTS == 0 && i) {
+			Test_KeepAlive_WaitForClose();
+			closesocket(s);
+			s = Test_KeepAlive_Connect();
+		}
+		send(s, keepAliveRequest, strlen(keepAliveRequest), 0);
+		if (Test_KeepAlive_ReadResponse(&bClosed) == 0) {
+			break;
+		}
+	}
+	closesocket(s);
+	return i;
+}
+
+// new connection for every request, returns number of answered requests
+static int Test_KeepAlive_Connections(int numRequests) {
+	SOCKET s;
+	bool bClosed;
+	int i;
+
+	for (i = 0; i < numRequests; i++) {
+		s = Test_KeepAlive_Connect();
+		send(s, closeRequest, strlen(closeRequest), 0);
+		if (Test_KeepAlive_ReadResponse(&bClosed) == 0) {
+			closesocket(s);
+			break;
+		}
+		Test_KeepAlive_WaitForClose();
+		closesocket(s);
+	}
+	return i;
+}
+
+void Test_Http_KeepAlive() {
+	char pipelined[512];
+	SOCKET s;
+	bool bClosed;
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	CHANNEL_Set(1, 1, 0);
+
+	s = Test_KeepAlive_Connect();
+	if (s == INVALID_SOCKET) {
+		printf("Test_Http_KeepAlive: can't connect to port %i, skipped\n", g_httpPort);
+		return;
+	}
+	send(s, keepAliveRequest, strlen(keepAliveRequest), 0);
+	if (Test_KeepAlive_ReadResponse(&bClosed) == 0) {
+		printf("Test_Http_KeepAlive: no reply from port %i, skipped\n", g_httpPort);
+		closesocket(s);
+		return;
+	}
+	SELFTEST_ASSERT(strstr(g_body, "\"POWER\":\"ON\"") != 0);
+
+	// second request on the same connection
+	CHANNEL_Set(1, 0, 0);
+	send(s, keepAliveRequest, strlen(keepAliveRequest), 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadResponse(&bClosed) > 0);
+	SELFTEST_ASSERT(bClosed == false);
+	SELFTEST_ASSERT(strstr(g_body, "\"POWER\":\"OFF\"") != 0);
+
+	// three pipelined requests in one packet, server answers them in order
+	sprintf(pipelined, "%s%s%s", keepAliveRequest,
+		"GET /cm?cmnd=POWER%20ON HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", keepAliveRequest);
+	send(s, pipelined, strlen(pipelined), 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadResponse(&bClosed) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "\"POWER\":\"OFF\"") != 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadResponse(&bClosed) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "\"POWER\":\"ON\"") != 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadResponse(&bClosed) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "\"POWER\":\"ON\"") != 0);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+
+	// client asks to close
+	send(s, closeRequest, strlen(closeRequest), 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadResponse(&bClosed) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "\"POWER\":\"ON\"") != 0);
+	SELFTEST_ASSERT(Test_KeepAlive_WaitForClose());
+	closesocket(s);
+
+	// HTTP/1.0 is not persistent by default
+	s = Test_KeepAlive_Connect();
+	send(s, "GET /cm?cmnd=POWER HTTP/1.0\r\n\r\n", 31, 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadResponse(&bClosed) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "\"POWER\":\"ON\"") != 0);
+	SELFTEST_ASSERT(Test_KeepAlive_WaitForClose());
+	closesocket(s);
+
+	// page larger than reply buffer is sent in chunks
+	s = Test_KeepAlive_Connect();
+	send(s, "GET /index HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", 40, 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadResponse(&bClosed) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "</html>") != 0);
+	send(s, keepAliveRequest, strlen(keepAliveRequest), 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadResponse(&bClosed) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "\"POWER\":\"ON\"") != 0);
+	closesocket(s);
+
+	// limit of requests per connection, client opens next one
+	SELFTEST_ASSERT(Test_KeepAlive_Requests(HTTP_KEEPALIVE_MAX_REQUESTS * 2 + 1) == HTTP_KEEPALIVE_MAX_REQUESTS * 2 + 1);
+	SELFTEST_ASSERT(Test_KeepAlive_Connections(3) == 3);
+}
+
+void Benchmark_Http_KeepAlive() {
+	int numRequests = 1000;
+	clock_t start;
+	double keepAliveSeconds, closeSeconds;
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	// no stdout printing
+	CMD_ExecuteCommand("logtype none", 0);
+	start = clock();
+	SELFTEST_ASSERT(Test_KeepAlive_Requests(numRequests) == numRequests);
+	keepAliveSeconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	start = clock();
+	SELFTEST_ASSERT(Test_KeepAlive_Connections(numRequests) == numRequests);
+	closeSeconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	CMD_ExecuteCommand("logtype thread", 0);
+
+	printf("HTTP keep-alive benchmark: %i requests, keep-alive %f req/s, connection per request %f req/s\n",
+		numRequests,
+		keepAliveSeconds > 0 ? numRequests / keepAliveSeconds : 0,
+		closeSeconds > 0 ? numRequests / closeSeconds : 0);
+}
+
+// four clients send requests at the same time, returns number of answers
+static int Test_Concurrency_Rounds(int numRounds) {
+	testHttpClient_t *c;
+	bool bClientClosed[4];
+	int i, j, k, done, total;
+
+	for (i = 0; i < 4; i++) {
+		Test_KeepAlive_ConnectClient(&g_clients[i]);
+	}
+	total = 0;
+	for (j = 0; j < numRounds; j++) {
+		// server closes after HTTP_KEEPALIVE_MAX_REQUESTS
+		if (j % HTTP_KEEPALIVE_MAX_REQUESTS == 0 && j) {
+			for (i = 0; i < 4; i++) {
+				closesocket(g_clients[i].s);
+				Test_KeepAlive_ConnectClient(&g_clients[i]);
+			}
+		}
+		for (i = 0; i < 4; i++) {
+			send(g_clients[i].s, keepAliveRequest, strlen(keepAliveRequest), 0);
+			bClientClosed[i] = false;
+		}
+		done = 0;
+		for (k = 0; k < 100000 && done != 15; k++) {
+			HTTPServer_RunQuickTick();
+			for (i = 0; i < 4; i++) {
+				c = &g_clients[i];
+				if ((done & (1 << i)) == 0 && Test_KeepAlive_Poll(c, &bClientClosed[i]) > 0) {
+					done |= 1 << i;
+					total++;
+				}
+			}
+		}
+	}
+	for (i = 0; i < 4; i++) {
+		closesocket(g_clients[i].s);
+	}
+	return total;
+}
+
+// several clients at once, served by one select() loop
+void Test_Http_Concurrency() {
+	bool bClosed;
+	int i;
+	const char partial[] = "GET /cm?cmnd=POWER HTTP/1.1\r\nHo";
+	const char rest[] = "st: 127.0.0.1\r\n\r\n";
+	const char uploadGet[] = "GET /api/lfs/upload.txt HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+	char header[128];
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	CHANNEL_Set(1, 1, 0);
+
+	if (Test_KeepAlive_ConnectClient(&g_clients[0]) == INVALID_SOCKET) {
+		printf("Test_Http_Concurrency: can't connect to port %i, skipped\n", g_httpPort);
+		return;
+	}
+	// first client stalls in the middle of request
+	send(g_clients[0].s, partial, strlen(partial), 0);
+	for (i = 0; i < 100; i++) {
+		HTTPServer_RunQuickTick();
+	}
+	SELFTEST_ASSERT(HTTPSelect_GetActiveClients() == 1);
+
+	// second one is served anyway
+	Test_KeepAlive_ConnectClient(&g_clients[1]);
+	send(g_clients[1].s, keepAliveRequest, strlen(keepAliveRequest), 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadClient(&g_clients[1], &bClosed, 100000) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "\"POWER\":\"ON\"") != 0);
+
+	// stalled one finishes its request later
+	send(g_clients[0].s, rest, strlen(rest), 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadClient(&g_clients[0], &bClosed, 100000) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "\"POWER\":\"ON\"") != 0);
+
+	// upload bigger than receive buffer, body is taken in parts as it arrives
+	// and other clients are served while it stalls
+	CMD_ExecuteCommand("lfs_format", 0);
+	for (i = 0; i < (int)sizeof(g_upload); i++) {
+		g_upload[i] = 'a' + i % 26;
+	}
+	Test_KeepAlive_ConnectClient(&g_clients[2]);
+	sprintf(header, "POST /api/lfs/upload.txt HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: %i\r\n\r\n",
+		(int)sizeof(g_upload));
+	send(g_clients[2].s, header, strlen(header), 0);
+	send(g_clients[2].s, g_upload, sizeof(g_upload) - 2000, 0);
+	for (i = 0; i < 100; i++) {
+		HTTPServer_RunQuickTick();
+	}
+	send(g_clients[1].s, keepAliveRequest, strlen(keepAliveRequest), 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadClient(&g_clients[1], &bClosed, 100000) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "\"POWER\":\"ON\"") != 0);
+	send(g_clients[2].s, g_upload + sizeof(g_upload) - 2000, 2000, 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadClient(&g_clients[2], &bClosed, 100000) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "\"size\":12000") != 0);
+	closesocket(g_clients[2].s);
+	// read back, reply is bigger than send queue
+	send(g_clients[1].s, uploadGet, strlen(uploadGet), 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadClient(&g_clients[1], &bClosed, 100000) > 0);
+	SELFTEST_ASSERT(memcmp(g_body, g_upload, sizeof(g_upload)) == 0);
+
+	// handler is busy for a while, parts and end are kept and given again
+	g_lfsUploadDeferCalls = 20;
+	Test_KeepAlive_ConnectClient(&g_clients[2]);
+	send(g_clients[2].s, header, strlen(header), 0);
+	send(g_clients[2].s, g_upload, sizeof(g_upload), 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadClient(&g_clients[2], &bClosed, 100000) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "\"size\":12000") != 0);
+	SELFTEST_ASSERT(g_lfsUploadDeferCalls == 0);
+	closesocket(g_clients[2].s);
+	send(g_clients[1].s, uploadGet, strlen(uploadGet), 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadClient(&g_clients[1], &bClosed, 100000) > 0);
+	SELFTEST_ASSERT(memcmp(g_body, g_upload, sizeof(g_upload)) == 0);
+
+	// all slots taken by stalled clients, fifth one waits in backlog
+	for (i = 2; i < 4; i++) {
+		Test_KeepAlive_ConnectClient(&g_clients[i]);
+	}
+	for (i = 0; i < 4; i++) {
+		send(g_clients[i].s, partial, strlen(partial), 0);
+	}
+	Test_KeepAlive_ConnectClient(&g_clients[4]);
+	send(g_clients[4].s, keepAliveRequest, strlen(keepAliveRequest), 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadClient(&g_clients[4], &bClosed, 1000) == 0);
+	SELFTEST_ASSERT(HTTPSelect_GetActiveClients() == 4);
+	// idle timeout frees the slots
+	Sim_RunMiliseconds(HTTP_KEEPALIVE_TIMEOUT_MS + 1000, false);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadClient(&g_clients[4], &bClosed, 100000) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "\"POWER\":\"ON\"") != 0);
+	for (i = 0; i < 4; i++) {
+		SELFTEST_ASSERT(Test_KeepAlive_ReadClient(&g_clients[i], &bClosed, 100) == 0);
+		SELFTEST_ASSERT(bClosed);
+		closesocket(g_clients[i].s);
+	}
+	closesocket(g_clients[4].s);
+	Sim_RunFrames(5, false);
+	SELFTEST_ASSERT(HTTPSelect_GetActiveClients() == 0);
+
+	// all four at once, over the per-connection request limit
+	CMD_ExecuteCommand("logtype none", 0);
+	SELFTEST_ASSERT(Test_Concurrency_Rounds(HTTP_KEEPALIVE_MAX_REQUESTS + 1) == (HTTP_KEEPALIVE_MAX_REQUESTS + 1) * 4);
+	CMD_ExecuteCommand("logtype thread", 0);
+	Sim_RunFrames(5, false);
+}
+
+void Benchmark_Http_Concurrency() {
+	int numRounds = 250;
+	int total;
+	clock_t start;
+	double seconds;
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	CMD_ExecuteCommand("logtype none", 0);
+	start = clock();
+	total = Test_Concurrency_Rounds(numRounds);
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	CMD_ExecuteCommand("logtype thread", 0);
+	SELFTEST_ASSERT(total == numRounds * 4);
+	printf("HTTP select server load test: 4 clients, %i requests, %f req/s\n",
+		total, seconds > 0 ? total / seconds : 0);
+	Sim_RunFrames(5, false);
+}
+
+// receives until text shows up in stream, optionally running simulator frames
+static bool Test_Events_WaitFor(testHttpClient_t *c, const char *text, int maxTries, bool bRunFrames) {
+	int i, len;
+
+	for (i = 0; i < maxTries; i++) {
+		len = recv(c->s, c->rx + c->rxLen, sizeof(c->rx) - 1 - c->rxLen, 0);
+		if (len > 0) {
+			c->rxLen += len;
+			c->rx[c->rxLen] = 0;
+			if (strstr(c->rx, text)) {
+				// next wait looks only at new data
+				c->rxLen = 0;
+				return true;
+			}
+		}
+		if (bRunFrames) {
+			Sim_RunFrames(1, false);
+		}
+		else {
+			HTTPServer_RunQuickTick();
+		}
+	}
+	return false;
+}
+
+static const char eventsRequest[] = "GET /sse HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept: text/event-stream\r\n\r\n";
+
+// Server-Sent Events stream pushes changes without polling
+void Test_Http_Events() {
+	testHttpClient_t *c = &g_clients[0];
+	bool bClosed;
+	int i;
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	CHANNEL_Set(1, 0, 0);
+
+	if (Test_KeepAlive_ConnectClient(c) == INVALID_SOCKET) {
+		printf("Test_Http_Events: can't connect to port %i, skipped\n", g_httpPort);
+		return;
+	}
+	send(c->s, eventsRequest, strlen(eventsRequest), 0);
+	SELFTEST_ASSERT(Test_Events_WaitFor(c, "retry: 2000", 100000, false));
+	SELFTEST_ASSERT(strstr(c->rx, "Content-Type: text/event-stream") != 0);
+	// socket was handed over, HTTP slot is free again
+	SELFTEST_ASSERT(HTTP_Events_GetClients() == 1);
+	SELFTEST_ASSERT(HTTPSelect_GetActiveClients() == 0);
+
+	// change is sent by the next quick tick
+	CHANNEL_Set(1, 1, 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(Test_Events_WaitFor(c, "data: {\"ch\":{\"1\":1}}", 100000, false));
+	CHANNEL_Set(1, 0, 0);
+	CHANNEL_Set(5, 42, 0);
+	SELFTEST_ASSERT(Test_Events_WaitFor(c, "data: {\"ch\":{\"1\":0,\"5\":42}}", 1000, true));
+	// too many changes for one event, rest comes in the next ones
+	for (i = 10; i < 50; i++) {
+		CHANNEL_Set(i, 1000000 + i, 0);
+	}
+	SELFTEST_ASSERT(Test_Events_WaitFor(c, "\"49\":1000049}}", 1000, true));
+	// nothing changed, only keepalive comment
+	SELFTEST_ASSERT(Test_Events_WaitFor(c, ":\n\n", 5000, true));
+
+	// other requests still work meanwhile
+	Test_KeepAlive_ConnectClient(&g_clients[1]);
+	send(g_clients[1].s, keepAliveRequest, strlen(keepAliveRequest), 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadClient(&g_clients[1], &bClosed, 100000) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "\"POWER\":\"OFF\"") != 0);
+	closesocket(g_clients[1].s);
+
+	// all event slots taken
+	Test_KeepAlive_ConnectClient(&g_clients[1]);
+	send(g_clients[1].s, eventsRequest, strlen(eventsRequest), 0);
+	SELFTEST_ASSERT(Test_Events_WaitFor(&g_clients[1], "retry: 2000", 100000, false));
+	SELFTEST_ASSERT(HTTP_Events_GetClients() == 2);
+	Test_KeepAlive_ConnectClient(&g_clients[2]);
+	send(g_clients[2].s, eventsRequest, strlen(eventsRequest), 0);
+	SELFTEST_ASSERT(Test_KeepAlive_ReadClient(&g_clients[2], &bClosed, 100000) > 0);
+	SELFTEST_ASSERT(strstr(g_body, "Too many event clients") != 0);
+	closesocket(g_clients[2].s);
+
+	// closed streams are noticed and their slots freed
+	closesocket(g_clients[0].s);
+	closesocket(g_clients[1].s);
+	Sim_RunMiliseconds(2000, false);
+	SELFTEST_ASSERT(HTTP_Events_GetClients() == 0);
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../httpserver/new_http.h"
+#include "../httpserver/http_fns.h"
+#include <time.h>
+
+// URL mix of a web UI session, some of them go to the end of old if chain
+static const char *g_routeBenchUrls[] = {
+	"index?state=1",
+	"index",
+	"cm?cmnd=POWER%20TOGGLE",
+	"api/channels",
+	"api/info",
+	"cfg_wifi",
+	"cfg_pins",
+	"ota_exec",
+	"app",
+	"favicon.ico",
+};
+
+// built-in page names in order of former if chain in HTTP_ProcessPacket
+static const char *g_routeLinearNames[] = {
+	"", "testmsg", "index", "about", "cfg_mqtt", "cfg_mqtt_set", "cfg_ip",
+	"cfg_webapp", "cfg_webapp_set", "cfg_wifi", "cfg_name", "cfg_wifi_set",
+	"cfg_loglevel_set", "cfg_mac", "cmd_tool", "startup_command", "cfg_generic",
+	"cfg_startup", "cfg_dgr", "ha_cfg", "ha_discovery", "cfg", "cfg_pins",
+	"cfg_ping", "ota", "ota_exec", "cm", "pmntp",
+};
+
+// dispatch like before, registered prefixes first, then every page name in turn
+static int Test_Routes_Linear(const char *url) {
+	static const char *prefixes[] = { "api/", "app", "logs", "lograw", "sse" };
+	int i;
+
+	for (i = 0; i < (int)(sizeof(prefixes) / sizeof(prefixes[0])); i++) {
+		if (!strncmp(url, prefixes[i], strlen(prefixes[i]))) {
+			return i;
+		}
+	}
+	for (i = 0; i < (int)(sizeof(g_routeLinearNames) / sizeof(g_routeLinearNames[0])); i++) {
+		if (http_checkUrlBase(url, g_routeLinearNames[i])) {
+			return 100 + i;
+		}
+	}
+	return -1;
+}
+
+void Test_Http_Routes() {
+	SIM_ClearOBK(0);
+
+	// query string does not matter
+	SELFTEST_ASSERT(HTTP_FindHandler("index", HTTP_GET) == http_fn_index);
+	SELFTEST_ASSERT(HTTP_FindHandler("index?state=1", HTTP_GET) == http_fn_index);
+	SELFTEST_ASSERT(HTTP_FindHandler("", HTTP_GET) == http_fn_empty_url);
+	SELFTEST_ASSERT(HTTP_FindHandler("?x=1", HTTP_GET) == http_fn_empty_url);
+	// whole name must match
+	SELFTEST_ASSERT(HTTP_FindHandler("cfg", HTTP_GET) == http_fn_cfg);
+	SELFTEST_ASSERT(HTTP_FindHandler("cfg_pins", HTTP_GET) == http_fn_cfg_pins);
+	SELFTEST_ASSERT(HTTP_FindHandler("cfg_wifi_set?ssid=a", HTTP_GET) == http_fn_cfg_wifi_set);
+	SELFTEST_ASSERT(HTTP_FindHandler("ota_exec", HTTP_GET) == http_fn_ota_exec);
+	SELFTEST_ASSERT(HTTP_FindHandler("indexx", HTTP_GET) == http_fn_other);
+	SELFTEST_ASSERT(HTTP_FindHandler("cfg/pins", HTTP_GET) == http_fn_other);
+	// registered prefixes end on path segment
+	SELFTEST_ASSERT(HTTP_FindHandler("api/info", HTTP_GET) != http_fn_other);
+	SELFTEST_ASSERT(HTTP_FindHandler("api/info", HTTP_GET) != HTTP_FindHandler("api/info", HTTP_POST));
+	SELFTEST_ASSERT(HTTP_FindHandler("app", HTTP_GET) != http_fn_other);
+	SELFTEST_ASSERT(HTTP_FindHandler("app?x", HTTP_GET) == HTTP_FindHandler("app", HTTP_GET));
+	SELFTEST_ASSERT(HTTP_FindHandler("apple", HTTP_GET) == http_fn_other);
+	SELFTEST_ASSERT(HTTP_FindHandler("app", HTTP_POST) == http_fn_other);
+	SELFTEST_ASSERT(HTTP_FindHandler("logs", HTTP_GET) != HTTP_FindHandler("lograw", HTTP_GET));
+
+	// API sub-routes, exact and prefix
+	Test_FakeHTTPClientPacket_GET("api/channels");
+	SELFTEST_ASSERT_HTML_REPLY_NOT_CONTAINS("GET of");
+	Test_FakeHTTPClientPacket_GET("api/lfs/");
+	SELFTEST_ASSERT_HTML_REPLY_NOT_CONTAINS("GET of");
+	Test_FakeHTTPClientPacket_GET("api/nothing");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("GET of api/nothing");
+}
+
+// dispatch only, handlers are not called
+void Benchmark_Http_Routes() {
+	int i, j;
+	int numUrls = sizeof(g_routeBenchUrls) / sizeof(g_routeBenchUrls[0]);
+	int numRounds = 100000;
+	int sink = 0;
+	clock_t start;
+	double hashedSeconds, linearSeconds;
+
+	SIM_ClearOBK(0);
+	start = clock();
+	for (j = 0; j < numRounds; j++) {
+		for (i = 0; i < numUrls; i++) {
+			sink += (HTTP_FindHandler(g_routeBenchUrls[i], HTTP_GET) != 0);
+		}
+	}
+	hashedSeconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	start = clock();
+	for (j = 0; j < numRounds; j++) {
+		for (i = 0; i < numUrls; i++) {
+			sink += Test_Routes_Linear(g_routeBenchUrls[i]);
+		}
+	}
+	linearSeconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	SELFTEST_ASSERT(sink != 0);
+
+	printf("HTTP route benchmark: %i lookups, hashed %f ns, linear %f ns per request\n",
+		numRounds * numUrls,
+		hashedSeconds * 1e9 / (numRounds * numUrls),
+		linearSeconds * 1e9 / (numRounds * numUrls));
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../httpserver/new_http.h"
+
+extern const char htmlHeadStyle[];
+extern const char pageScript[];
+
+void Test_Http_StaticAssets() {
+	char header[64];
+	const char *etag;
+	const char *body;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	// blobs must be regenerated when strings in new_http.c change,
+	// see scripts/gen_static_assets.js
+	SELFTEST_ASSERT(HTTP_Static_GetRawLength("obk.css") == (int)(strlen(htmlHeadStyle) - strlen("<style></style>")));
+	SELFTEST_ASSERT(HTTP_Static_GetRawLength("obk.js") == (int)(strlen(pageScript) - strlen("<script type='text/javascript'></script>")));
+
+	// page refers to cached files instead of inline copy
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("obk.css?v=");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("obk.js?v=");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("var refreshMs=");
+	SELFTEST_ASSERT_HTML_REPLY_NOT_CONTAINS("<style>");
+	SELFTEST_ASSERT_HTML_REPLY_NOT_CONTAINS("function showState");
+
+	Test_FakeHTTPClientPacket_GET("obk.css?v=1");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTTPHeaders(), "HTTP/1.1 200"));
+	SELFTEST_ASSERT(strstr(Test_GetLastHTTPHeaders(), "Content-Encoding: gzip"));
+	SELFTEST_ASSERT(strstr(Test_GetLastHTTPHeaders(), "Cache-Control: max-age=31536000"));
+	SELFTEST_ASSERT(strstr(Test_GetLastHTTPHeaders(), "Vary: Accept-Encoding"));
+	body = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT((unsigned char)body[0] == 0x1f && (unsigned char)body[1] == 0x8b);
+	etag = strstr(Test_GetLastHTTPHeaders(), "ETag: ");
+	SELFTEST_ASSERT(etag);
+
+	// browser already has it
+	snprintf(header, sizeof(header), "If-None-Match: \"%s\"", HTTP_Static_GetHash("obk.css"));
+	Test_FakeHTTPClientPacket_GET_withHeader("obk.css?v=1", header);
+	SELFTEST_ASSERT(strstr(Test_GetLastHTTPHeaders(), "HTTP/1.1 304"));
+	SELFTEST_ASSERT(!strstr(Test_GetLastHTTPHeaders(), "Content-Encoding"));
+	Test_FakeHTTPClientPacket_GET_withHeader("obk.js", "If-None-Match: \"00000000\"");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTTPHeaders(), "HTTP/1.1 200"));
+
+	// LFS files get content hash as ETag
+	Test_FakeHTTPClientPacket_POST("api/lfs/test.css", "body{color:red}");
+	Test_FakeHTTPClientPacket_GET("api/lfs/test.css");
+	SELFTEST_ASSERT_HTML_REPLY("body{color:red}");
+	SELFTEST_ASSERT(!strstr(Test_GetLastHTTPHeaders(), "Content-Encoding"));
+	etag = strstr(Test_GetLastHTTPHeaders(), "ETag: ");
+	SELFTEST_ASSERT(etag);
+	strcpy(header, "If-None-Match: ");
+	strncat(header, etag + 6, strcspn(etag + 6, "\r\n"));
+	Test_FakeHTTPClientPacket_GET_withHeader("api/lfs/test.css", header);
+	SELFTEST_ASSERT(strstr(Test_GetLastHTTPHeaders(), "HTTP/1.1 304"));
+	SELFTEST_ASSERT_HTML_REPLY("");
+	// changed content, old ETag no longer matches
+	Test_FakeHTTPClientPacket_POST("api/lfs/test.css", "body{color:blue}");
+	Test_FakeHTTPClientPacket_GET_withHeader("api/lfs/test.css", header);
+	SELFTEST_ASSERT(strstr(Test_GetLastHTTPHeaders(), "HTTP/1.1 200"));
+	SELFTEST_ASSERT_HTML_REPLY("body{color:blue}");
+
+	// compressed copy next to file is sent to clients that accept gzip
+	Test_FakeHTTPClientPacket_POST("api/lfs/test.css.gz", "fakegz");
+	Test_FakeHTTPClientPacket_GET("api/lfs/test.css");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTTPHeaders(), "Content-Encoding: gzip"));
+	SELFTEST_ASSERT(strstr(Test_GetLastHTTPHeaders(), httpMimeTypeCSS));
+	SELFTEST_ASSERT_HTML_REPLY("fakegz");
+}
+
+#endif
@@ -20,7 +20,7 @@ void SelfTest_Failed(const char *file, const char *function, int line, const cha
 #define SELFTEST_ASSERT_FLOATCOMPARE(exp, res) SELFTEST_ASSERT(Float_Equals(exp, res));
 #define SELFTEST_ASSERT_INTCOMPARE(exp, res) SELFTEST_ASSERT((exp == res));
 #define SELFTEST_ASSERT_FLOATCOMPAREEPSILON(exp, res, eps) SELFTEST_ASSERT(Float_EqualsEpsilon(exp, res, eps));
-#define SELFTEST_ASSERT_EXPRESSION(exp, res) SELFTEST_ASSERT(Float_Equals(CMD_EvaluateExpression(exp, 0), res));
+#define SELFTEST_ASSERT_EXPRESSION(exp, res) SELFTEST_ASSERT(Float_Equals(CMD_EvaluateExpression(exp, 0), res) && Float_Equals(CMD_EvaluateCachedExpression(exp), res));
 // currently, channels are integers
 #define SELFTEST_ASSERT_CHANNEL(channelIndex, res) SELFTEST_ASSERT(CHANNEL_Get(channelIndex) == res);
 #define SELFTEST_ASSERT_CHANNELEPSILON(channelIndex, res, marg) SELFTEST_ASSERT(Float_EqualsEpsilon(CHANNEL_Get(channelIndex), res, marg));
@@ -83,6 +83,8 @@ void Test_Commands_Startup();
 void Test_TwoPWMsOneChannel();
 void Test_ClockEvents();
 void Test_Commands_Channels();
+void Test_ChannelSave();
+void Test_FlashVarsJournal();
 void Test_LEDDriver();
 void Test_TuyaMCU_Basic();
 void Test_TuyaMCU_Calib();
@@ -95,6 +97,7 @@ void Test_Command_If();
 void Test_Command_If_Else();
 void Test_LFS();
 void Test_Tokenizer();
+void Test_Logging();
 void Test_Commands_Alias();
 void Test_ExpandConstant();
 void Test_Scripting();
@@ -126,6 +129,7 @@ void Test_ChangeHandlers_MQTT();
 void Test_ChangeHandlers();
 void Test_ChangeHandlers2();
 void Test_ChangeHandlers_EnsureThatChannelVariableIsExpandedAtHandlerRunTime();
+void Test_ChangeHandlers_Stress();
 void Test_Commands_Calendar();
 void Test_CFG_Via_HTTP();
 void Test_Demo_ButtonScrollingChannelValues();
@@ -144,8 +148,23 @@ void Test_DoorSensor();
 void Test_Enums();
 void Test_Expressions_RunTests_Basic();
 void Test_Expressions_RunTests_Braces();
+void Test_Expressions_Cached();
 void Test_ButtonEvents();
 void Test_Http();
+void Test_Http_KeepAlive();
+void Test_Http_Concurrency();
+void Test_Http_Events();
+void Test_Http_Routes();
+void Test_Http_StaticAssets();
+void Test_Http_ZeroCopy();
+// timing only, not run with unit tests, see -runBenchmarks
+void Benchmark_Expressions();
+void Benchmark_ChangeHandlers();
+void Benchmark_Logging();
+void Benchmark_Http_KeepAlive();
+void Benchmark_Http_Concurrency();
+void Benchmark_Http_Routes();
+void Benchmark_WS2812B_Encoding();
 void Test_Demo_ConditionalRelay();
 void Test_PIR();
 void Test_Driver_TCL_AC();
@@ -156,10 +175,12 @@ void Test_Pins();
 
 void Test_GetJSONValue_Setup(const char *text);
 void Test_FakeHTTPClientPacket_GET(const char *tg);
+void Test_FakeHTTPClientPacket_GET_withHeader(const char *tg, const char *header);
 void Test_FakeHTTPClientPacket_POST(const char *tg, const char *data);
 void Test_FakeHTTPClientPacket_POST_withJSONReply(const char *tg, const char *data);
 void Test_FakeHTTPClientPacket_JSON(const char *tg);
 const char *Test_GetLastHTMLReply();
+const char *Test_GetLastHTTPHeaders();
 const char *Test_QueryHTMLReply(const char *url);
 
 bool SIM_HasHTTPTemperature();
@@ -183,12 +204,23 @@ int Test_GetJSONValue_IntFromArray(int index, const char *obj);
 const char *Test_GetJSONValue_StrFromArray(int index, const char *obj);
 const char *Test_GetJSONValue_StrFromNestedArray(const char *par, const char *key, int index);
 
+// number of flash vars writes since simulated device was cleared
+int SIM_GetFlashVarsWrites();
+void SIM_ClearFlashVars();
+// forget loaded flash vars, like after reboot
+void SIM_ReloadFlashVars();
 void SIM_SendFakeMQTT(const char *text, const char *arguments);
+void SIM_MQTT_IncomingFragmented(const char* topic, const char* data, int fragmentSize);
+void SIM_MQTT_IncomingStart(const char* topic, int totalLen);
+void SIM_MQTT_IncomingPart(const char* data, bool bLast);
+void SIM_MQTT_SetDeferPublishAcks(bool bDefer);
+int SIM_MQTT_AckPublishes();
 void SIM_SendFakeMQTTAndRunSimFrame_CMND(const char *command, const char *arguments);
 void SIM_SendFakeMQTTAndRunSimFrame_CMND_ViaGroupTopic(const char *command, const char *arguments);
 void SIM_SendFakeMQTTRawChannelSet(int channelIndex, const char *arguments);
 void SIM_SendFakeMQTTRawChannelSet_ViaGroupTopic(int channelIndex, const char *arguments);
 void SIM_ClearMQTTHistory();
+int SIM_CountMQTTHistoryForTopicPrefix(const char *topicPrefix);
 void SIM_DumpMQTTHistory();
 bool SIM_CheckMQTTHistoryForString(const char *topic, const char *value, bool bRetain);
 bool SIM_HasMQTTHistoryStringWithJSONPayload(const char *topic, bool bPrefixMode,
@@ -0,0 +1,176 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../logging/logging.h"
+#include <time.h>
+
+static void Test_Logging_DrainSink(int sink) {
+	char buffer[256];
+
+	while (LOG_ReadSink(sink, buffer, sizeof(buffer))) {
+
+	}
+}
+
+static char bigBuffer[8192];
+
+void Test_Logging() {
+	char buffer[512];
+	int i, len, total;
+	char *ptr;
+	bool bFound;
+	unsigned int dropped;
+#if ENABLE_DEFERRED_LOG
+	int deferredTotal;
+#endif
+
+	SIM_ClearOBK(0);
+	// no stdout printing, so only the ring is measured
+	CMD_ExecuteCommand("logtype none", 0);
+
+	Test_Logging_DrainSink(LOG_SINK_HTTP);
+	Test_Logging_DrainSink(LOG_SINK_TCP);
+
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "Hello %i", 123);
+	len = LOG_ReadSink(LOG_SINK_HTTP, buffer, sizeof(buffer));
+	SELFTEST_ASSERT_STRING(buffer, "Info:GEN:Hello 123\r\n");
+	SELFTEST_ASSERT(len == (int)strlen("Info:GEN:Hello 123\r\n"));
+	// already read
+	SELFTEST_ASSERT(LOG_ReadSink(LOG_SINK_HTTP, buffer, sizeof(buffer)) == 0);
+	// trailing newline is replaced, raw has no prefix
+	addLogAdv(LOG_INFO, LOG_FEATURE_RAW, "Raw line\n");
+	LOG_ReadSink(LOG_SINK_HTTP, buffer, sizeof(buffer));
+	SELFTEST_ASSERT_STRING(buffer, "Raw line\r\n");
+
+	// TCP sink has its own cursor and still has both lines
+	LOG_ReadSink(LOG_SINK_TCP, buffer, sizeof(buffer));
+	SELFTEST_ASSERT_STRING(buffer, "Info:GEN:Hello 123\r\nRaw line\r\n");
+
+	// small reads must not lose anything, also across the wrap
+	for (i = 0; i < 300; i++) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_RAW, "Line %i", i);
+		total = 0;
+		while ((len = LOG_ReadSink(LOG_SINK_HTTP, buffer + total, 4)) != 0) {
+			total += len;
+		}
+		sprintf(buffer + 256, "Line %i\r\n", i);
+		SELFTEST_ASSERT_STRING(buffer, buffer + 256);
+	}
+
+	// TCP sink is not read, it loses the oldest data, but not the newest line
+	dropped = LOG_GetSinkDropped(LOG_SINK_TCP);
+	for (i = 0; i < 1000; i++) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_RAW, "Overflow %i", i);
+	}
+	SELFTEST_ASSERT(LOG_GetSinkDropped(LOG_SINK_TCP) > dropped);
+	// whole ring in one read
+	total = LOG_ReadSink(LOG_SINK_TCP, bigBuffer, sizeof(bigBuffer));
+	SELFTEST_ASSERT(total > 3500 && total <= 4096);
+	// only whole entries
+	SELFTEST_ASSERT(!strncmp(bigBuffer, "Overflow ", 9));
+	SELFTEST_ASSERT(strstr(bigBuffer, "Overflow 999\r\n") != 0);
+	SELFTEST_ASSERT(LOG_ReadSink(LOG_SINK_TCP, bigBuffer, sizeof(bigBuffer)) == 0);
+
+#if ENABLE_DEFERRED_LOG
+	Test_Logging_DrainSink(LOG_SINK_HTTP);
+	// deferred entries are formatted when read
+	addLogDeferred(LOG_INFO, LOG_FEATURE_MQTT, "Publishing val %s to %s retain=%i", "abc", "obk/1/get", 0);
+	LOG_ReadSink(LOG_SINK_HTTP, buffer, sizeof(buffer));
+	SELFTEST_ASSERT_STRING(buffer, "Info:MQTT:Publishing val abc to obk/1/get retain=0\r\n");
+	addLogDeferred(LOG_INFO, LOG_FEATURE_RAW, "[%5i|%-4s|%x|%lu|%lld|%c|%%|%*d|%.2f|%s]\n",
+		12, "ab", 255, 7ul, -123456789012ll, 'z', 3, 9, 3.14159, (const char*)0);
+	LOG_ReadSink(LOG_SINK_HTTP, buffer, sizeof(buffer));
+	SELFTEST_ASSERT_STRING(buffer, "[   12|ab  |ff|7|-123456789012|z|%|  9|3.14|(null)]\r\n");
+	// text longer than deferred formatting allows is not truncated
+	addLogDeferred(LOG_INFO, LOG_FEATURE_GENERAL, "%-400s|", "wide");
+	len = LOG_ReadSink(LOG_SINK_HTTP, buffer, sizeof(buffer));
+	SELFTEST_ASSERT(len == (int)strlen("Info:GEN:") + 400 + 3);
+	SELFTEST_ASSERT(!strcmp(buffer + len - 3, "|\r\n"));
+	// deferred entry read in small parts
+	addLogDeferred(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_Set channel %i has changed to %i (flags %i)", 5, 100, 0);
+	total = 0;
+	while ((len = LOG_ReadSink(LOG_SINK_HTTP, buffer + total, 5)) != 0) {
+		total += len;
+	}
+	SELFTEST_ASSERT_STRING(buffer, "Info:GEN:CHANNEL_Set channel 5 has changed to 100 (flags 0)\r\n");
+	// the TCP sink formats it independently
+	LOG_ReadSink(LOG_SINK_TCP, bigBuffer, sizeof(bigBuffer));
+	SELFTEST_ASSERT(strstr(bigBuffer, "Info:GEN:CHANNEL_Set channel 5 has changed to 100 (flags 0)\r\n") != 0);
+
+	// deferred entries are smaller, so the ring keeps more of them
+	for (i = 0; i < 1000; i++) {
+		addLogDeferred(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_Set channel %i has changed to %i (flags %i)", i & 63, i, 0);
+	}
+	total = 0;
+	bFound = false;
+	while ((len = LOG_ReadSink(LOG_SINK_TCP, bigBuffer, sizeof(bigBuffer))) != 0) {
+		for (ptr = bigBuffer; (ptr = strstr(ptr, "\r\n")) != 0; ptr++) {
+			total++;
+		}
+		if (strstr(bigBuffer, "channel 39 has changed to 999 (flags 0)\r\n")) {
+			bFound = true;
+		}
+	}
+	SELFTEST_ASSERT(total > 100);
+	SELFTEST_ASSERT(bFound);
+	deferredTotal = total;
+	Test_Logging_DrainSink(LOG_SINK_HTTP);
+
+	// same, but immediate
+	for (i = 0; i < 1000; i++) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_Set channel %i has changed to %i (flags %i)", i & 63, i, 0);
+	}
+	total = 0;
+	while ((len = LOG_ReadSink(LOG_SINK_TCP, bigBuffer, sizeof(bigBuffer))) != 0) {
+		for (ptr = bigBuffer; (ptr = strstr(ptr, "\r\n")) != 0; ptr++) {
+			total++;
+		}
+	}
+	SELFTEST_ASSERT(total < deferredTotal);
+	Test_Logging_DrainSink(LOG_SINK_HTTP);
+#endif
+
+	CMD_ExecuteCommand("logtype thread", 0);
+}
+
+void Benchmark_Logging() {
+	int i;
+	clock_t start;
+	double seconds;
+
+	SIM_ClearOBK(0);
+	// no stdout printing, so only the ring is measured
+	CMD_ExecuteCommand("logtype none", 0);
+	Test_Logging_DrainSink(LOG_SINK_HTTP);
+	Test_Logging_DrainSink(LOG_SINK_TCP);
+
+#if ENABLE_DEFERRED_LOG
+	start = clock();
+	for (i = 0; i < 200000; i++) {
+		addLogDeferred(LOG_INFO, LOG_FEATURE_MQTT, "Publishing val %i to obk/%i/get retain=0", i, i & 63);
+	}
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("Deferred log benchmark: 200000 lines in %f s, %f lines/s\n",
+		seconds, seconds > 0 ? 200000 / seconds : 0);
+	Test_Logging_DrainSink(LOG_SINK_HTTP);
+	Test_Logging_DrainSink(LOG_SINK_TCP);
+#endif
+
+	start = clock();
+	for (i = 0; i < 200000; i++) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Publishing val %i to obk/%i/get retain=0", i, i & 63);
+		if ((i & 15) == 0) {
+			Test_Logging_DrainSink(LOG_SINK_HTTP);
+		}
+	}
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("Log ring benchmark: 200000 lines in %f s, %f lines/s, HTTP dropped %u, TCP dropped %u\n",
+		seconds, seconds > 0 ? 200000 / seconds : 0,
+		LOG_GetSinkDropped(LOG_SINK_HTTP), LOG_GetSinkDropped(LOG_SINK_TCP));
+
+	Test_Logging_DrainSink(LOG_SINK_HTTP);
+	Test_Logging_DrainSink(LOG_SINK_TCP);
+	CMD_ExecuteCommand("logtype thread", 0);
+}
+
+#endif
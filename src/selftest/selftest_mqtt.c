@@ -2,6 +2,8 @@
 
 #include "selftest_local.h"
 #include "../hal/hal_wifi.h"
+#include "../mqtt/new_mqtt.h"
+#include "../mqtt/new_mqtt_topicTrie.h"
 
 void SIM_ClearAndPrepareForMQTTTesting(const char *clientName, const char *groupName) {
 	SIM_ClearOBK(0);
@@ -53,24 +55,29 @@ void Test_MQTT_Channels() {
 
 	// This should trigger MQTT publish
 	CMD_ExecuteCommand("setChannel 1 1", 0);
+	// channel publishes go out on next quick tick
+	Sim_RunFrames(1, false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/1/get", "1", false);
 	// if assert has passed, we can clear SIM MQTT history, it's no longer needed
 	SIM_ClearMQTTHistory();
 
 	// This should trigger MQTT publish
 	CMD_ExecuteCommand("setChannel 1 0", 0);
+	Sim_RunFrames(1, false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/1/get", "0", false);
 	// if assert has passed, we can clear SIM MQTT history, it's no longer needed
 	SIM_ClearMQTTHistory();
 
 	// This should trigger MQTT publish
 	CMD_ExecuteCommand("setChannel 1 1", 0);
+	Sim_RunFrames(1, false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/1/get", "1", false);
 	// if assert has passed, we can clear SIM MQTT history, it's no longer needed
 	SIM_ClearMQTTHistory();
 
 	// This should trigger MQTT publish
 	CMD_ExecuteCommand("setChannel 1 0", 0);
+	Sim_RunFrames(1, false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/1/get", "0", false);
 	// if assert has passed, we can clear SIM MQTT history, it's no longer needed
 	SIM_ClearMQTTHistory();
@@ -95,6 +102,7 @@ void Test_MQTT_Channels() {
 
 	// This should trigger MQTT publish
 	CMD_ExecuteCommand("setChannel 1 0", 0);
+	Sim_RunFrames(1, false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/1/get", "0", false);
 	// if assert has passed, we can clear SIM MQTT history, it's no longer needed
 	SIM_ClearMQTTHistory();
@@ -650,12 +658,14 @@ void Test_MQTT_Topic_With_Slashes() {
 
 	// This should trigger MQTT publish
 	CMD_ExecuteCommand("setChannel 1 1", 0);
+	Sim_RunFrames(1, false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("obk/kitchen/mySwitch1/1/get", "1", false);
 	// if assert has passed, we can clear SIM MQTT history, it's no longer needed
 	SIM_ClearMQTTHistory();
 
 	// This should trigger MQTT publish
 	CMD_ExecuteCommand("setChannel 1 0", 0);
+	Sim_RunFrames(1, false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("obk/kitchen/mySwitch1/1/get", "0", false);
 	// if assert has passed, we can clear SIM MQTT history, it's no longer needed
 	SIM_ClearMQTTHistory();
@@ -753,12 +763,14 @@ void Test_MQTT_Topic_With_Slash() {
 
 	// This should trigger MQTT publish
 	CMD_ExecuteCommand("setChannel 1 1", 0);
+	Sim_RunFrames(1, false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("obk/08C65DE9/1/get", "1", false);
 	// if assert has passed, we can clear SIM MQTT history, it's no longer needed
 	SIM_ClearMQTTHistory();
 
 	// This should trigger MQTT publish
 	CMD_ExecuteCommand("setChannel 1 0", 0);
+	Sim_RunFrames(1, false);
 	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("obk/08C65DE9/1/get", "0", false);
 	// if assert has passed, we can clear SIM MQTT history, it's no longer needed
 	SIM_ClearMQTTHistory();
@@ -828,6 +840,427 @@ void Test_MQTT_Average() {
 	SIM_ClearMQTTHistory();
 }
 
+#if ENABLE_MQTT
+void Test_MQTT_PublishQueue() {
+	char value[MQTT_PUBLISH_ITEM_VALUE_LENGTH + 1];
+	char expected[MQTT_PUBLISH_ITEM_VALUE_LENGTH + 1];
+	char topic[64];
+	char channel[32];
+	int i, j, len, id;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("queueTester", "bekens");
+	SIM_ClearMQTTHistory();
+
+	// keep two items in flight, so the ring wraps with the head in the middle
+	MQTT_QueuePublish("queueTester", "warmup0", "0", 0);
+	MQTT_QueuePublish("queueTester", "warmup1", "1", 0);
+	for (i = 0; i < 60; i++) {
+		// varying sizes, so records wrap around the arena many times
+		for (j = 0; j < 3; j++) {
+			id = i * 3 + j;
+			len = (id * 397) % MQTT_PUBLISH_ITEM_VALUE_LENGTH;
+			memset(value, 'a' + id % 26, len);
+			value[len] = 0;
+			sprintf(channel, "q%i", id);
+			MQTT_QueuePublish("queueTester", channel, value, 0);
+		}
+		SELFTEST_ASSERT(PublishQueuedItems() == OBK_PUBLISH_OK);
+		// two items behind what was just queued were published, in order and unchanged
+		for (id = i * 3 - 2; id <= i * 3; id++) {
+			if (id < 0) {
+				continue;
+			}
+			len = (id * 397) % MQTT_PUBLISH_ITEM_VALUE_LENGTH;
+			memset(expected, 'a' + id % 26, len);
+			expected[len] = 0;
+			sprintf(topic, "queueTester/q%i", id);
+			SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR(topic, expected, false);
+		}
+		SIM_ClearMQTTHistory();
+	}
+	// drain the rest
+	PublishQueuedItems();
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("queueTester/q179", value, false);
+	SIM_ClearMQTTHistory();
+	// empty queue publishes nothing
+	SELFTEST_ASSERT(PublishQueuedItems() == OBK_PUBLISH_WAS_NOT_REQUIRED);
+
+	// arena is given back to heap when queue stays empty
+	SELFTEST_ASSERT(MQTT_IsPublishQueueAllocated());
+	Sim_RunSeconds(MQTT_PUBLISH_QUEUE_FREE_SECONDS + 2, false);
+	SELFTEST_ASSERT(!MQTT_IsPublishQueueAllocated());
+	MQTT_QueuePublish("queueTester", "again", "5", 0);
+	SELFTEST_ASSERT(MQTT_IsPublishQueueAllocated());
+	SELFTEST_ASSERT(PublishQueuedItems() == OBK_PUBLISH_OK);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("queueTester/again", "5", false);
+}
+void Test_MQTT_TopicTrie() {
+	mqttTopicTrie_t trie;
+
+	SELFTEST_ASSERT(MQTT_TopicMatch("a/b/c", "a/b/c"));
+	SELFTEST_ASSERT(MQTT_TopicMatch("a/b/c", "a/+/c"));
+	SELFTEST_ASSERT(MQTT_TopicMatch("a/b/c", "a/#"));
+	SELFTEST_ASSERT(MQTT_TopicMatch("a", "a/#"));
+	SELFTEST_ASSERT(MQTT_TopicMatch("a/b", "#"));
+	SELFTEST_ASSERT(MQTT_TopicMatch("a//c", "a/+/c"));
+	SELFTEST_ASSERT(!MQTT_TopicMatch("ab/c", "a/#"));
+	SELFTEST_ASSERT(!MQTT_TopicMatch("a/b/c", "a/+"));
+	SELFTEST_ASSERT(!MQTT_TopicMatch("a/b", "a/b/c"));
+	SELFTEST_ASSERT(!MQTT_TopicMatch("$SYS/x", "#"));
+	SELFTEST_ASSERT(!MQTT_TopicMatch("$SYS/x", "+/x"));
+	SELFTEST_ASSERT(MQTT_TopicMatch("$SYS/x", "$SYS/+"));
+
+	memset(&trie, 0, sizeof(trie));
+	SELFTEST_ASSERT(MQTT_TopicTrie_Add(&trie, "dev/+/set", 0));
+	SELFTEST_ASSERT(MQTT_TopicTrie_Add(&trie, "dev/#", 1));
+	SELFTEST_ASSERT(MQTT_TopicTrie_Add(&trie, "cmnd/dev/+", 2));
+	SELFTEST_ASSERT(MQTT_TopicTrie_Add(&trie, "+/dev/POWER", 3));
+	SELFTEST_ASSERT(MQTT_TopicTrie_Add(&trie, "dev/1/set", 4));
+	SELFTEST_ASSERT(MQTT_TopicTrie_Add(&trie, "#", 31));
+	SELFTEST_ASSERT(!MQTT_TopicTrie_Add(&trie, "dev/#/set", 5));
+	SELFTEST_ASSERT(!MQTT_TopicTrie_Add(&trie, "dev/a+", 5));
+	SELFTEST_ASSERT(!MQTT_TopicTrie_Add(&trie, "dev", 32));
+
+	SELFTEST_ASSERT(MQTT_TopicTrie_Match(&trie, "dev/1/set") == (0x13 | 0x80000000));
+	SELFTEST_ASSERT(MQTT_TopicTrie_Match(&trie, "dev/2/set") == (0x03 | 0x80000000));
+	SELFTEST_ASSERT(MQTT_TopicTrie_Match(&trie, "dev/2/get") == (0x02 | 0x80000000));
+	SELFTEST_ASSERT(MQTT_TopicTrie_Match(&trie, "dev") == (0x02 | 0x80000000));
+	SELFTEST_ASSERT(MQTT_TopicTrie_Match(&trie, "cmnd/dev/POWER") == (0x0C | 0x80000000));
+	SELFTEST_ASSERT(MQTT_TopicTrie_Match(&trie, "cmnd/dev/a/b") == 0x80000000);
+	SELFTEST_ASSERT(MQTT_TopicTrie_Match(&trie, "$SYS/dev/POWER") == 0);
+
+	MQTT_TopicTrie_Remove(&trie, "#", 31);
+	MQTT_TopicTrie_Remove(&trie, "dev/#", 1);
+	// not subscribed by owner 0, stays
+	MQTT_TopicTrie_Remove(&trie, "dev/1/set", 0);
+	SELFTEST_ASSERT(MQTT_TopicTrie_Match(&trie, "dev/1/set") == 0x11);
+	SELFTEST_ASSERT(MQTT_TopicTrie_Match(&trie, "dev/2/get") == 0);
+	MQTT_TopicTrie_Clear(&trie);
+	SELFTEST_ASSERT(trie.root == 0);
+	SELFTEST_ASSERT(MQTT_TopicTrie_Match(&trie, "dev/1/set") == 0);
+
+	// dispatch through callbacks registered for base topics
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("trieDevice", "trieGroup");
+	CMD_ExecuteCommand("setChannelType 1 Dimmer", 0);
+	SIM_SendFakeMQTT("trieDevice/1/set", "45");
+	SELFTEST_ASSERT_CHANNEL(1, 45);
+	SIM_SendFakeMQTT("trieGroup/1/set", "46");
+	SELFTEST_ASSERT_CHANNEL(1, 46);
+	SIM_SendFakeMQTT("cmnd/trieGroup/setChannel", "1 47");
+	SELFTEST_ASSERT_CHANNEL(1, 47);
+	// similar prefix, but a different level
+	SIM_SendFakeMQTT("trieDeviceX/1/set", "48");
+	SELFTEST_ASSERT_CHANNEL(1, 47);
+	SIM_ClearMQTTHistory();
+	SIM_SendFakeMQTT("trieDevice/1/get", "");
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("trieDevice/1/get", "47", false);
+}
+void Test_MQTT_PublishBatch() {
+	obk_mqtt_batchItem_t items[3];
+	OBK_Publish_Result result;
+	char cmd[64];
+	char topic[32];
+	int inFlight, windowSize, windowFull, windowFullBefore;
+	int i, n;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("batchDevice", "bekens");
+	MQTT_GetPublishWindowStats(&inFlight, &windowSize, &windowFullBefore);
+	SELFTEST_ASSERT(inFlight == 0);
+	SELFTEST_ASSERT(windowSize > 1 && windowSize < 48);
+
+	items[0].channel = "voltage";
+	items[0].value = "230";
+	items[0].flags = 0;
+	items[1].channel = "state";
+	items[1].value = "on";
+	items[1].flags = OBK_PUBLISH_FLAG_RETAIN;
+	items[2].channel = "custom/raw/topic";
+	items[2].value = "x";
+	items[2].flags = OBK_PUBLISH_FLAG_RAW_TOPIC_NAME;
+	SELFTEST_ASSERT(MQTT_PublishMain_Batch(items, 3, &result) == 3);
+	SELFTEST_ASSERT(result == OBK_PUBLISH_OK);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("batchDevice/voltage/get", "230", false);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("batchDevice/state/get", "on", true);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("custom/raw/topic", "x", false);
+	SELFTEST_ASSERT(MQTT_PublishBatch("stat/batchDevice", items, 1, &result) == 1);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("stat/batchDevice/voltage", "230", false);
+
+	// broker is slow now, burst of channel changes is more than the window
+	SIM_MQTT_SetDeferPublishAcks(true);
+	n = windowSize + 10;
+	for (i = 1; i <= n; i++) {
+		sprintf(cmd, "setChannelType %i ReadOnly", i);
+		CMD_ExecuteCommand(cmd, 0);
+	}
+	SIM_ClearMQTTHistory();
+	for (i = 1; i <= n; i++) {
+		CHANNEL_Set(i, 100 + i, 0);
+	}
+	Sim_RunFrames(1, false);
+	MQTT_GetPublishWindowStats(&inFlight, &windowSize, &windowFull);
+	SELFTEST_ASSERT(inFlight == windowSize);
+	SELFTEST_ASSERT(windowFull > windowFullBefore);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("batchDevice/1/get", "101", false);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("batchDevice/") == windowSize);
+	// nothing was lost, rest goes out when broker catches up
+	SELFTEST_ASSERT(SIM_MQTT_AckPublishes() == windowSize);
+	Sim_RunFrames(1, false);
+	SIM_MQTT_SetDeferPublishAcks(false);
+	SIM_MQTT_AckPublishes();
+	for (i = 1; i <= n; i++) {
+		sprintf(topic, "batchDevice/%i/get", i);
+		sprintf(cmd, "%i", 100 + i);
+		SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR(topic, cmd, false);
+	}
+	MQTT_GetPublishWindowStats(&inFlight, &windowSize, &windowFull);
+	SELFTEST_ASSERT(inFlight == 0);
+
+	// benchmark reports its rate
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("publishBenchmark 50", 0);
+	// several messages are sent per tick
+	Sim_RunFrames(7, false);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("batchDevice/benchmark") == 50);
+	SIM_ClearMQTTHistory();
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(strstr(SIM_GetMQTTHistoryString("batchDevice/benchmark", false), "Benchmark completed. 50 msg published") != 0);
+	Sim_RunFrames(90, false);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("batchDevice/benchmark") == 1);
+}
+void Test_MQTT_DedupCache() {
+	int lookups, hits, delayed;
+	int inFlight, windowSize, windowFull;
+	char topic[16];
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("dedupDevice", "bekens");
+	CMD_ExecuteCommand("mqtt_dedupClear", 0);
+
+	// by default, everything is sent
+	MQTT_PublishMain_StringString("temp", "21", 0);
+	MQTT_PublishMain_StringString("temp", "21", 0);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("dedupDevice/temp") == 2);
+
+	// unchanged value at most once per 60 seconds
+	CMD_ExecuteCommand("mqtt_dedup 60", 0);
+	SIM_ClearMQTTHistory();
+	for (i = 0; i < 3; i++) {
+		MQTT_PublishMain_StringString("temp", "21", 0);
+	}
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("dedupDevice/temp") == 1);
+	MQTT_PublishMain_StringString("temp", "22", 0);
+	MQTT_PublishMain_StringString("temp", "22", 0);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("dedupDevice/temp") == 2);
+	// other topics are separate
+	MQTT_PublishMain_StringString("humidity", "22", 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("dedupDevice/humidity/get", "22", false);
+	Sim_RunSeconds(61, false);
+	MQTT_PublishMain_StringString("temp", "22", 0);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("dedupDevice/temp") == 3);
+
+	// per topic policy overrides global one
+	CMD_ExecuteCommand("mqtt_dedupTopic dedupDevice/volt/# 0 0", 0);
+	MQTT_PublishMain_StringString("volt", "230", 0);
+	MQTT_PublishMain_StringString("volt", "230", 0);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("dedupDevice/volt") == 2);
+
+	// fast changes wait, only the latest one is sent
+	CMD_ExecuteCommand("mqtt_dedupTopic dedupDevice/power/get 60 5", 0);
+	MQTT_PublishMain_StringString("power", "100", 0);
+	MQTT_PublishMain_StringString("power", "101", 0);
+	MQTT_PublishMain_StringString("power", "102", 0);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("dedupDevice/power") == 1);
+	Sim_RunSeconds(6, false);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("dedupDevice/power") == 2);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("dedupDevice/power/get", "102", false);
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("dedupDevice/power/get", "101", false));
+	// change back to sent value cancels the waiting one
+	MQTT_PublishMain_StringString("power", "103", 0);
+	MQTT_PublishMain_StringString("power", "102", 0);
+	Sim_RunSeconds(6, false);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("dedupDevice/power") == 2);
+
+	MQTT_Dedup_GetStats(&lookups, &hits, &delayed);
+	// other periodic publishes may also hit the global policy
+	SELFTEST_ASSERT(hits >= 4);
+	SELFTEST_ASSERT(lookups > hits + delayed);
+	SELFTEST_ASSERT(delayed == 3);
+	SELFTEST_ASSERT_PAGE_CONTAINS("api/info", "\"mqttDedup\":{\"lookups\":");
+
+	// waiting value is dropped when a newer one is sent directly
+	MQTT_PublishMain_StringString("power", "104", 0);
+	MQTT_PublishMain_StringString("power", "105", 0);
+	// broker is slow, so the waiting one can't go out in time
+	SIM_MQTT_SetDeferPublishAcks(true);
+	for (i = 0; i < 64; i++) {
+		MQTT_GetPublishWindowStats(&inFlight, &windowSize, &windowFull);
+		if (inFlight >= windowSize) {
+			break;
+		}
+		sprintf(topic, "fill%i", i);
+		MQTT_PublishMain_StringString(topic, "1", 0);
+	}
+	Sim_RunSeconds(6, false);
+	SIM_MQTT_SetDeferPublishAcks(false);
+	SIM_MQTT_AckPublishes();
+	MQTT_PublishMain_StringString("power", "106", 0);
+	Sim_RunSeconds(7, false);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("dedupDevice/power/get", "106", false);
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("dedupDevice/power/get", "105", false));
+
+	CMD_ExecuteCommand("mqtt_dedupClear", 0);
+	MQTT_PublishMain_StringString("temp", "22", 0);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("dedupDevice/temp") == 4);
+
+	// explicit requests are always answered
+	CMD_ExecuteCommand("mqtt_dedup 60", 0);
+	CHANNEL_Set(5, 7, 0);
+	MQTT_ChannelPublish(5, 0);
+	MQTT_ChannelPublish(5, 0);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("dedupDevice/5/get") == 1);
+	SIM_SendFakeMQTT("dedupDevice/5/get", "");
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("dedupDevice/5/get") == 2);
+	// after Home Assistant restart everything is sent again
+	MQTT_PublishMain_StringString("humidity", "23", 0);
+	MQTT_PublishMain_StringString("humidity", "23", 0);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("dedupDevice/humidity") == 2);
+	SIM_SendFakeMQTT("homeassistant/status", "online");
+	MQTT_PublishMain_StringString("humidity", "23", 0);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("dedupDevice/humidity") == 3);
+	CMD_ExecuteCommand("mqtt_dedupClear", 0);
+}
+void Test_MQTT_Reassembly() {
+	char payload[3200];
+	char cmd[64];
+	char queued[512];
+	int reassembled, dropped;
+	int reassembledBefore, droppedBefore;
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("reasmDevice", "bekens");
+	MQTT_GetRxStats(&reassembledBefore, &droppedBefore);
+
+	// value split in two parts is still one message
+	SIM_MQTT_IncomingFragmented("reasmDevice/1/set", "123", 1);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(1, 123);
+	MQTT_GetRxStats(&reassembled, &dropped);
+	SELFTEST_ASSERT(reassembled == reassembledBefore + 1);
+
+	// long backlog, many parts
+	payload[0] = 0;
+	for (i = 0; strlen(payload) < 2900; i++) {
+		sprintf(cmd, "setChannel 2 %i; ", i);
+		strcat(payload, cmd);
+	}
+	strcat(payload, "setChannel 3 77");
+	// too large by default
+	SIM_MQTT_IncomingFragmented("cmnd/reasmDevice/backlog", payload, 500);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(3, 0);
+	MQTT_GetRxStats(&reassembled, &dropped);
+	SELFTEST_ASSERT(dropped == droppedBefore + 1);
+
+	CMD_ExecuteCommand("mqtt_rxMaxSize 3500", 0);
+	SIM_MQTT_IncomingFragmented("cmnd/reasmDevice/backlog", payload, 500);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(2, i - 1);
+	SELFTEST_ASSERT_CHANNEL(3, 77);
+	MQTT_GetRxStats(&reassembled, &dropped);
+	SELFTEST_ASSERT(reassembled == reassembledBefore + 2);
+
+	// several messages wait in the ring, wrapping around its end.
+	// Large backlog takes the start of the ring and is processed while
+	// next message is still incomplete, so ring is not reset when it empties
+	SIM_MQTT_IncomingFragmented("cmnd/reasmDevice/backlog", payload, 500);
+	SIM_MQTT_IncomingStart("reasmDevice/5/set", 3);
+	SIM_MQTT_IncomingPart("3", false);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(5, 0);
+	SIM_MQTT_IncomingPart("01", true);
+	// now queue messages without processing, first ones fill the end
+	// of the ring and the rest wraps to the space freed by backlog
+	for (i = 1; i <= 5; i++) {
+		if (i == 1) {
+			strcpy(queued, "setChannel 6 $CH5");
+		}
+		else {
+			sprintf(queued, "setChannel 6 $CH6*10+%i", i);
+		}
+		while (strlen(queued) < 400) {
+			strcat(queued, "; setChannel 7 1");
+		}
+		SIM_MQTT_IncomingFragmented("cmnd/reasmDevice/backlog", queued, 100);
+	}
+	Sim_RunFrames(1, false);
+	// each message sees result of the one before
+	SELFTEST_ASSERT_CHANNEL(5, 301);
+	SELFTEST_ASSERT_CHANNEL(6, 3012345);
+	MQTT_GetRxStats(&reassembled, &dropped);
+	SELFTEST_ASSERT(reassembled == reassembledBefore + 9);
+	SELFTEST_ASSERT(dropped == droppedBefore + 1);
+
+	CMD_ExecuteCommand("mqtt_rxMaxSize 2048", 0);
+}
+void Test_MQTT_ChannelPublishCoalescing() {
+	char buffer[64];
+	int published, coalesced, teleCoalesced;
+	int publishedBefore, coalescedBefore, teleCoalescedBefore;
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("batchDevice", "bekens");
+	CMD_ExecuteCommand("setChannelType 1 Dimmer", 0);
+	CMD_ExecuteCommand("setChannelType 2 ReadOnly", 0);
+	CMD_ExecuteCommand("setChannelType 3 ReadOnly", 0);
+	CFG_SetFlag(OBK_FLAG_DO_TASMOTA_TELE_PUBLISHES, 1);
+	MQTT_GetChannelPublishStats(&publishedBefore, &coalescedBefore, &teleCoalescedBefore);
+	SIM_ClearMQTTHistory();
+
+	// dimmer drag, only the last value goes out
+	for (i = 1; i <= 50; i++) {
+		sprintf(buffer, "setChannel 1 %i", i);
+		CMD_ExecuteCommand(buffer, 0);
+	}
+	CMD_ExecuteCommand("setChannel 2 7", 0);
+	CMD_ExecuteCommand("setChannel 3 8", 0);
+	Sim_RunFrames(1, false);
+	MQTT_GetChannelPublishStats(&published, &coalesced, &teleCoalesced);
+	SELFTEST_ASSERT(published - publishedBefore == 3);
+	SELFTEST_ASSERT(coalesced - coalescedBefore == 49);
+	// single tele broadcast for all three
+	SELFTEST_ASSERT(teleCoalesced - teleCoalescedBefore == 2);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("batchDevice/1/get") == 1);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("batchDevice/1/get", "50", false);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("batchDevice/2/get", "7", false);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("batchDevice/3/get", "8", false);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("tele/batchDevice/STATE") == 1);
+	SIM_ClearMQTTHistory();
+
+	// with interval, batch waits
+	CMD_ExecuteCommand("mqtt_channelPublishInterval 500", 0);
+	CMD_ExecuteCommand("setChannel 2 9", 0);
+	Sim_RunMiliseconds(200, false);
+	MQTT_GetChannelPublishStats(&publishedBefore, &coalesced, &teleCoalesced);
+	SELFTEST_ASSERT(publishedBefore == published);
+	CMD_ExecuteCommand("addChannel 2 1", 0);
+	Sim_RunMiliseconds(400, false);
+	MQTT_GetChannelPublishStats(&published, &coalesced, &teleCoalesced);
+	SELFTEST_ASSERT(published == publishedBefore + 1);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("batchDevice/2/get", "10", false);
+	SELFTEST_ASSERT(SIM_CountMQTTHistoryForTopicPrefix("batchDevice/2/get") == 1);
+
+	CMD_ExecuteCommand("mqtt_channelPublishInterval 0", 0);
+	CFG_SetFlag(OBK_FLAG_DO_TASMOTA_TELE_PUBLISHES, 0);
+	SIM_ClearMQTTHistory();
+}
+#endif
+
 void Test_MQTT(){
 	Test_MQTT_Misc();
 	Test_MQTT_Get_And_Reply();
@@ -840,6 +1273,14 @@ void Test_MQTT(){
 	Test_MQTT_Topic_With_Slash();
 	Test_MQTT_Topic_With_Slashes();
 	Test_MQTT_Average();
+#if ENABLE_MQTT
+	Test_MQTT_PublishQueue();
+	Test_MQTT_ChannelPublishCoalescing();
+	Test_MQTT_Reassembly();
+	Test_MQTT_TopicTrie();
+	Test_MQTT_PublishBatch();
+	Test_MQTT_DedupCache();
+#endif
 }
 
 #endif
@@ -58,6 +58,22 @@ const char *demo_startScript =
 "    return\r\n";
 
 
+const char *demo_compiled =
+"// comments and empty lines are not compiled\r\n"
+"\r\n"
+"setChannel 12 0\r\n"
+"goto second\r\n"
+"first:\r\n"
+"    setChannel 13 5\r\n"
+"    goto done\r\n"
+"second:\r\n"
+"\t// indented comment\r\n"
+"    addChannel 12 7   \r\n"
+"    goto first\r\n"
+"done:\r\n"
+"    alias lateCmd addChannel 12 100\r\n"
+"    lateCmd\r\n";
+
 const char *demo_waiting_for_smth =
 "setChannel 20 0\r\n"
 "setChannel 21 0\r\n"
@@ -247,6 +263,68 @@ void Test_Scripting_WaitingForSmth() {
 	SELFTEST_ASSERT_CHANNEL(21, 789);
 	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
 }
+void Test_Scripting_Compiled() {
+	// reset whole device
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	Test_FakeHTTPClientPacket_POST("api/lfs/compiled.txt", demo_compiled);
+
+	CMD_ExecuteCommand("startScript compiled.txt", 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 1);
+	Sim_RunFrames(5, false);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+	// lateCmd was not yet registered when file was compiled
+	SELFTEST_ASSERT_CHANNEL(12, 107);
+	SELFTEST_ASSERT_CHANNEL(13, 5);
+
+	// start in the middle, at label
+	CMD_ExecuteCommand("startScript compiled.txt first", 0);
+	Sim_RunFrames(5, false);
+	SELFTEST_ASSERT_CHANNEL(12, 207);
+}
+void Test_Scripting_LabelLookup() {
+	char buffer[4096];
+	char *p;
+	int i, scanned;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	// a lot of labels, jump to the last one
+	p = buffer;
+	p += sprintf(p, "goto label_number_59\r\n");
+	for (i = 0; i < 60; i++) {
+		p += sprintf(p, "label_number_%i:\r\n    setChannel 14 %i\r\n    return\r\n", i, i);
+	}
+	Test_FakeHTTPClientPacket_POST("api/lfs/labels.txt", buffer);
+
+	scanned = SVM_GetLabelBytesScanned();
+	CMD_ExecuteCommand("startScript labels.txt", 0);
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT_CHANNEL(14, 59);
+	// goto did only compare the matching label, not whole file
+	SELFTEST_ASSERT(SVM_GetLabelBytesScanned() - scanned <= 2 * (int)strlen("label_number_59"));
+
+	scanned = SVM_GetLabelBytesScanned();
+	CMD_ExecuteCommand("startScript labels.txt label_number_31", 0);
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT_CHANNEL(14, 31);
+	SELFTEST_ASSERT(SVM_GetLabelBytesScanned() - scanned <= 2 * (int)strlen("label_number_31"));
+
+	// rewrite file via REST - script must see new content
+	Test_FakeHTTPClientPacket_POST("api/lfs/labels.txt", "label_number_31:\r\n    setChannel 14 1031\r\n");
+	CMD_ExecuteCommand("startScript labels.txt label_number_31", 0);
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT_CHANNEL(14, 1031);
+
+	// and via lfs_write
+	CMD_ExecuteCommand("lfs_write labels.txt setChannel 14 2031", 0);
+	CMD_ExecuteCommand("startScript labels.txt", 0);
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT_CHANNEL(14, 2031);
+}
 void Test_Scripting_ClickEventAndBacklog() {
 	// reset whole device
 	SIM_ClearOBK(0);
@@ -287,6 +365,8 @@ void Test_Scripting() {
 	Test_Scripting_NestedLoop();
 	Test_Scripting_StartScript();
 	Test_Scripting_WaitingForSmth();
+	Test_Scripting_Compiled();
+	Test_Scripting_LabelLookup();
 	Test_Scripting_ClickEventAndBacklog();
 }
 
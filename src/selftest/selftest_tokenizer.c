@@ -3,6 +3,8 @@
 #include "selftest_local.h"
 
 void Test_Tokenizer() {
+	tokenizer_t *outside, *inside;
+
 	// reset whole device
 	SIM_ClearOBK(0);
 
@@ -153,6 +155,53 @@ void Test_Tokenizer() {
 	SELFTEST_ASSERT_ARGUMENT_FLOAT(7, 0.0f);	// invalid index: default 0.0
 	SELFTEST_ASSERT_ARGUMENT_FLOAT(1024, 0.0f);	// invalid index: default 0.0
 
+	// explicit contexts are independent from each other and from the global one
+	{
+		tokenizer_t a, b;
+
+		TokenizerCtx_TokenizeString(&a, "first 2 3", 0);
+		TokenizerCtx_TokenizeString(&b, "second $CH3", 0);
+		SELFTEST_ASSERT(TokenizerCtx_GetArgsCount(&a) == 3);
+		SELFTEST_ASSERT(TokenizerCtx_GetArgsCount(&b) == 2);
+		SELFTEST_ASSERT_STRING(TokenizerCtx_GetArg(&a, 0), "first");
+		SELFTEST_ASSERT_STRING(TokenizerCtx_GetArg(&b, 0), "second");
+		SELFTEST_ASSERT(TokenizerCtx_GetArgInteger(&a, 2) == 3);
+		SELFTEST_ASSERT(TokenizerCtx_GetArgInteger(&b, 1) == 55);
+		SELFTEST_ASSERT_STRING(TokenizerCtx_GetArgFrom(&a, 1), "2 3");
+		SELFTEST_ASSERT_ARGUMENTS_COUNT(7);
+		SELFTEST_ASSERT_ARGUMENT_INTEGER(0, 1);
+	}
+
+	// nested command must not clobber the arguments of its caller
+	outside = Tokenizer_GetCurrentContext();
+	Tokenizer_PushContext();
+	SELFTEST_ASSERT(Tokenizer_GetCurrentContext() != outside);
+	Tokenizer_TokenizeString("outer 10 20", 0);
+	Tokenizer_PushContext();
+	Tokenizer_TokenizeString("inner", 0);
+	SELFTEST_ASSERT_ARGUMENTS_COUNT(1);
+	SELFTEST_ASSERT_ARGUMENT(0, "inner");
+	Tokenizer_PopContext();
+	SELFTEST_ASSERT_ARGUMENTS_COUNT(3);
+	SELFTEST_ASSERT_ARGUMENT(0, "outer");
+	SELFTEST_ASSERT_ARGUMENT_INTEGER(2, 20);
+	Tokenizer_PopContext();
+	// back to the shared context once the outermost command is done
+	SELFTEST_ASSERT(Tokenizer_GetCurrentContext() == outside);
+	// next command on this thread reuses the context, nothing is allocated
+	Tokenizer_PushContext();
+	inside = Tokenizer_GetCurrentContext();
+	Tokenizer_PopContext();
+	Tokenizer_PushContext();
+	SELFTEST_ASSERT(Tokenizer_GetCurrentContext() == inside);
+	SELFTEST_ASSERT(inside != outside);
+	Tokenizer_PopContext();
+
+	// same, but with real commands - alias runs a backlog which runs 'if'
+	CMD_ExecuteCommand("setChannel 1 0", 0);
+	CMD_ExecuteCommand("alias nestTest backlog if $CH3==55 then \"addChannel 1 1\"; addChannel 1 10", 0);
+	CMD_ExecuteCommand("nestTest", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 11);
 }
 
 #endif
@@ -54,6 +54,19 @@ int history_tail = 0;
 void SIM_ClearMQTTHistory() {
 	history_head = history_tail = 0;
 }
+int SIM_CountMQTTHistoryForTopicPrefix(const char *topicPrefix) {
+	int cur = history_tail;
+	int count = 0;
+	int len = strlen(topicPrefix);
+	while (cur != history_head) {
+		if (!strncmp(mqtt_history[cur].topic, topicPrefix, len)) {
+			count++;
+		}
+		cur++;
+		cur %= MAX_MQTT_HISTORY;
+	}
+	return count;
+}
 bool SIM_CheckMQTTHistoryForString(const char *topic, const char *value, bool bRetain) {
 	mqttHistoryEntry_t *ne;
 	int cur = history_tail;
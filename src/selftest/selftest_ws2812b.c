@@ -70,6 +70,9 @@ void Test_DMX_RGB() {
 	{
 		byte ddpPacket[128];
 
+		// version 1, PUSH, offset 0
+		memset(ddpPacket, 0, sizeof(ddpPacket));
+		ddpPacket[0] = 0x41;
 		// data starts at offset 10
 		// pixel 0
 		ddpPacket[10] = 0xFF;
@@ -458,6 +461,9 @@ void Test_WS2812B() {
 	{
 		byte ddpPacket[128];
 
+		// version 1, PUSH, offset 0
+		memset(ddpPacket, 0, sizeof(ddpPacket));
+		ddpPacket[0] = 0x41;
 		// data starts at offset 10
 		// pixel 0
 		ddpPacket[10] = 0xFF;
@@ -503,6 +509,9 @@ void Test_WS2812B() {
 	{
 		byte ddpPacket[128];
 
+		// version 1, PUSH, offset 0
+		memset(ddpPacket, 0, sizeof(ddpPacket));
+		ddpPacket[0] = 0x41;
 		ddpPacket[2] = 0x1A;
 
 		// data starts at offset 10
@@ -630,6 +639,173 @@ void Test_WS2812B_misc() {
 
 }
 
+#include "../driver/drv_spiLED.h"
+
+// encoding like it was done before the table, for comparison
+static void Test_WS2812B_EncodeBy2Bits(uint8_t *dst, const byte *src, int numBytes) {
+	int i;
+
+	for (i = 0; i < numBytes; i++) {
+		*dst++ = translate_2bit((src[i] >> 6));
+		*dst++ = translate_2bit((src[i] >> 4));
+		*dst++ = translate_2bit((src[i] >> 2));
+		*dst++ = translate_2bit(src[i]);
+	}
+}
+void Test_WS2812B_Encoding() {
+	byte pixels[255 * 3];
+	byte expected[255 * 3 * 4];
+	byte code[4];
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	// table matches 2 bit encoding for every value
+	for (i = 0; i < 256; i++) {
+		byte b = i;
+		translate_byte(b, code);
+		Test_WS2812B_EncodeBy2Bits(expected, &b, 1);
+		SELFTEST_ASSERT(memcmp(code, expected, 4) == 0);
+		SELFTEST_ASSERT(reverse_translate_byte(code) == b);
+	}
+
+	for (i = 0; i < (int)sizeof(pixels); i++) {
+		pixels[i] = (i * 7) & 0xFF;
+	}
+	Test_WS2812B_EncodeBy2Bits(expected, pixels, sizeof(pixels));
+
+	// whole buffer at once, both with aligned and odd start
+	CMD_ExecuteCommand("startDriver SM16703P", 0);
+	CMD_ExecuteCommand("SM16703P_Init 255", 0);
+	Strip_setMultiplePixel(255, pixels, false);
+	SELFTEST_ASSERT(memcmp(spiLED.buf + spiLED.ofs, expected, sizeof(expected)) == 0);
+	SELFTEST_ASSERT_PIXEL(254, pixels[762], pixels[763], pixels[764]);
+	CMD_ExecuteCommand("SM16703P_Init 255 RGB 3", 0);
+	Strip_setMultiplePixel(255, pixels, false);
+	SELFTEST_ASSERT(memcmp(spiLED.buf + 3, expected, sizeof(expected)) == 0);
+	SELFTEST_ASSERT_PIXEL(1, pixels[3], pixels[4], pixels[5]);
+	// other color order still goes pixel by pixel
+	CMD_ExecuteCommand("SM16703P_Init 255 GRB", 0);
+	Strip_setMultiplePixel(255, pixels, false);
+	// stored in strip order
+	SELFTEST_ASSERT_PIXEL(1, pixels[4], pixels[3], pixels[5]);
+}
+
+void Benchmark_WS2812B_Encoding() {
+	byte pixels[255 * 3];
+	clock_t start;
+	double seconds, secondsOld;
+	int i, iterations;
+
+	SIM_ClearOBK(0);
+	for (i = 0; i < (int)sizeof(pixels); i++) {
+		pixels[i] = (i * 7) & 0xFF;
+	}
+	CMD_ExecuteCommand("startDriver SM16703P", 0);
+	CMD_ExecuteCommand("SM16703P_Init 255 RGB", 0);
+	iterations = 20000;
+	start = clock();
+	for (i = 0; i < iterations; i++) {
+		pixels[0] = i;
+		Test_WS2812B_EncodeBy2Bits(spiLED.buf + spiLED.ofs, pixels, sizeof(pixels));
+	}
+	secondsOld = (double)(clock() - start) / CLOCKS_PER_SEC;
+	start = clock();
+	for (i = 0; i < iterations; i++) {
+		pixels[0] = i;
+		Strip_setMultiplePixel(255, pixels, false);
+	}
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("WS2812B encoding benchmark: 2 bit encoding %.0f pixels/s, table %.0f pixels/s\n",
+		secondsOld > 0 ? 255 * iterations / secondsOld : 0,
+		seconds > 0 ? 255 * iterations / seconds : 0);
+}
+
+void DDP_GetStats(int *frames, int *dropped, int *fps);
+
+// DDP fragment with numPixels RGB pixels of same color, starting at pixel
+static void Test_DDP_SendFragment(int firstPixel, int numPixels, bool bPush, byte r, byte g, byte b) {
+	byte ddpPacket[10 + 200 * 3];
+	int offset = firstPixel * 3;
+	int i;
+
+	memset(ddpPacket, 0, 10);
+	ddpPacket[0] = bPush ? 0x41 : 0x40;
+	ddpPacket[2] = 0x0B;
+	ddpPacket[3] = 1;
+	ddpPacket[4] = (offset >> 24) & 0xFF;
+	ddpPacket[5] = (offset >> 16) & 0xFF;
+	ddpPacket[6] = (offset >> 8) & 0xFF;
+	ddpPacket[7] = offset & 0xFF;
+	ddpPacket[8] = ((numPixels * 3) >> 8) & 0xFF;
+	ddpPacket[9] = (numPixels * 3) & 0xFF;
+	for (i = 0; i < numPixels; i++) {
+		ddpPacket[10 + i * 3] = r;
+		ddpPacket[11 + i * 3] = g;
+		ddpPacket[12 + i * 3] = b;
+	}
+	DDP_Parse(ddpPacket, 10 + numPixels * 3);
+}
+void Test_DDP_Frames() {
+	int frames, dropped, fps;
+	int framesBefore, droppedBefore;
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	CMD_ExecuteCommand("startDriver SM16703P", 0);
+	CMD_ExecuteCommand("SM16703P_Init 250", 0);
+	CMD_ExecuteCommand("startDriver DDP", 0);
+	DDP_GetStats(&framesBefore, &droppedBefore, &fps);
+
+	// 250 pixels don't fit in default 512 byte DDP buffer, frame comes in three parts
+	Test_DDP_SendFragment(0, 100, false, 0xFF, 0, 0);
+	Test_DDP_SendFragment(100, 100, false, 0, 0xFF, 0);
+	DDP_GetStats(&frames, &dropped, &fps);
+	SELFTEST_ASSERT(frames == framesBefore);
+	Test_DDP_SendFragment(200, 50, true, 0, 0, 0xFF);
+	DDP_GetStats(&frames, &dropped, &fps);
+	SELFTEST_ASSERT(frames == framesBefore + 1);
+	SELFTEST_ASSERT(dropped == droppedBefore);
+	SELFTEST_ASSERT_PIXEL(0, 0xFF, 0, 0);
+	SELFTEST_ASSERT_PIXEL(99, 0xFF, 0, 0);
+	SELFTEST_ASSERT_PIXEL(100, 0, 0xFF, 0);
+	SELFTEST_ASSERT_PIXEL(199, 0, 0xFF, 0);
+	SELFTEST_ASSERT_PIXEL(200, 0, 0, 0xFF);
+	SELFTEST_ASSERT_PIXEL(249, 0, 0, 0xFF);
+
+	// middle part lost, rest of frame is still shown
+	Test_DDP_SendFragment(0, 100, false, 0x10, 0x10, 0x10);
+	Test_DDP_SendFragment(200, 50, true, 0x30, 0x30, 0x30);
+	DDP_GetStats(&frames, &dropped, &fps);
+	SELFTEST_ASSERT(frames == framesBefore + 2);
+	SELFTEST_ASSERT(dropped == droppedBefore + 1);
+	SELFTEST_ASSERT_PIXEL(0, 0x10, 0x10, 0x10);
+	SELFTEST_ASSERT_PIXEL(100, 0, 0xFF, 0);
+	SELFTEST_ASSERT_PIXEL(249, 0x30, 0x30, 0x30);
+
+	// fragments past the end of strip are ignored
+	Test_DDP_SendFragment(0, 100, false, 0x40, 0x40, 0x40);
+	Test_DDP_SendFragment(100, 100, false, 0x40, 0x40, 0x40);
+	Test_DDP_SendFragment(200, 100, true, 0x40, 0x40, 0x40);
+	SELFTEST_ASSERT_PIXEL(249, 0x40, 0x40, 0x40);
+
+	// frame rate
+	Sim_RunSeconds(1, false);
+	for (i = 0; i < 5; i++) {
+		Test_DDP_SendFragment(0, 100, false, i, i, i);
+		Test_DDP_SendFragment(100, 100, false, i, i, i);
+		Test_DDP_SendFragment(200, 50, true, i, i, i);
+	}
+	Sim_RunSeconds(1, false);
+	DDP_GetStats(&frames, &dropped, &fps);
+	SELFTEST_ASSERT(fps == 5);
+	SELFTEST_ASSERT(dropped == droppedBefore + 1);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index?state=1", "(5 FPS)");
+}
+
 void Test_LEDstrips() {
 	Test_WS2812B_misc();
 	Test_DMX_RGB();
@@ -639,6 +815,8 @@ void Test_LEDstrips() {
 	Test_WS2812B();
 	Test_WS2812B_and_PWM_CW();
 	Test_WS2812B_and_PWM_White();
+	Test_DDP_Frames();
+	Test_WS2812B_Encoding();
 }
 
 #endif
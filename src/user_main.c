@@ -143,6 +143,14 @@ void OTA_ResetProgress()
 
 void OTA_IncrementProgress(int value)
 {
+	if (ota_status == -1)
+	{
+		// flash is busy with OTA from now on, and device will reboot after it
+		Channel_FlushPendingSaves();
+#if ENABLE_MQTT
+		MQTT_FlushChannelPublishes();
+#endif
+	}
 	ota_status += value;
 }
 
@@ -822,6 +830,7 @@ void Main_OnEverySecond()
 	if (OTA_GetProgress() == -1)
 	{
 		CFG_Save_IfThereArePendingChanges();
+		Channel_RunPendingSaves();
 	}
 
 	// On Beken, do reboot if we ran into heap size problem
@@ -983,7 +992,7 @@ void Main_OnEverySecond()
 			g_doHomeAssistantDiscoveryIn--;
 			if (g_doHomeAssistantDiscoveryIn == 0) {
 				ADDLOGF_INFO("Will do request HA discovery now.");
-				doHomeAssistantDiscovery(0, 0);
+				doHomeAssistantDiscovery(0);
 			}
 			else {
 				ADDLOGF_INFO("Will scheduled HA discovery in %i seconds", g_doHomeAssistantDiscoveryIn);
@@ -993,6 +1002,8 @@ void Main_OnEverySecond()
 			ADDLOGF_INFO("HA discovery is scheduled, but MQTT connection is not present yet");
 		}
 	}
+	// continue discovery started earlier, if any
+	HASS_RunDiscoveryStep();
 #endif
 	if (g_openAP)
 	{
@@ -1066,6 +1077,10 @@ void Main_OnEverySecond()
 		if (!g_reset) {
 			// ensure any config changes are saved before reboot.
 			CFG_Save_IfThereArePendingChanges();
+			Channel_FlushPendingSaves();
+#if ENABLE_MQTT
+			MQTT_FlushChannelPublishes();
+#endif
 #if ENABLE_BL_SHARED
 			if (DRV_IsMeasuringPower())
 			{
@@ -1124,6 +1139,10 @@ void QuickTick(void* param)
 {
 	if (g_bWantPinDeepSleep) {
 		g_bWantPinDeepSleep = 0;
+		Channel_FlushPendingSaves();
+#if ENABLE_MQTT
+		MQTT_FlushChannelPublishes();
+#endif
 		HAL_DisconnectFromWifi();
 		PINS_BeginDeepSleepWithPinWakeUp(g_pinDeepSleepWakeUp);
 		return;
@@ -1169,6 +1188,9 @@ void QuickTick(void* param)
 #if ENABLE_MQTT
 	MQTT_RunQuickTick();
 #endif
+#if ENABLE_HTTP_EVENTS
+	HTTP_Events_RunQuickTick();
+#endif
 
 #if ENABLE_LED_BASIC
 	if (CFG_HasFlag(OBK_FLAG_LED_SMOOTH_TRANSITIONS) == true) {
@@ -1353,6 +1375,12 @@ void Main_Init_BeforeDelay_Unsafe(bool bAutoRunScripts) {
 
 	// initialise rest interface
 	init_rest();
+#if ENABLE_HTTP_EVENTS
+	HTTP_Events_Init();
+#endif
+#if ENABLE_HTTP_STATIC_ASSETS
+	HTTP_Static_Init();
+#endif
 
 	// add some commands...
 	taslike_commands_init();
@@ -1602,6 +1630,7 @@ void Main_Init_After_Delay()
 #if MQTT_USE_TLS
 	if (!CFG_GetDisableWebServer() || bSafeMode) {
 #endif		
+		HTTP_Init();
 		HTTPServer_Start();
 		ADDLOGF_DEBUG("Started http tcp server");
 #if MQTT_USE_TLS
@@ -931,6 +931,29 @@ err_t mqtt_sub_unsub(mqtt_client_t *client, const char *topic, u8_t qos, mqtt_re
 
 void SIM_OnMQTTPublish(const char *topic, const char *value, int len, int qos, bool bRetain);
 
+// by default, faked broker acknowledges publishes at once,
+// with deferred acks they wait for SIM_MQTT_AckPublishes like for a slow broker
+static bool g_sim_deferPublishAcks = false;
+static struct {
+	mqtt_request_cb_t cb;
+	void *arg;
+} g_sim_pendingAcks[MQTT_REQ_MAX_IN_FLIGHT];
+static int g_sim_numPendingAcks = 0;
+
+void SIM_MQTT_SetDeferPublishAcks(bool bDefer) {
+	g_sim_deferPublishAcks = bDefer;
+}
+int SIM_MQTT_AckPublishes() {
+	int i;
+	int count = g_sim_numPendingAcks;
+
+	g_sim_numPendingAcks = 0;
+	for (i = 0; i < count; i++) {
+		g_sim_pendingAcks[i].cb(g_sim_pendingAcks[i].arg, ERR_OK);
+	}
+	return count;
+}
+
 /** Publish data to topic */
 err_t mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_t payload_length, u8_t qos, u8_t retain,
 				   mqtt_request_cb_t cb, void *arg) {
@@ -944,8 +967,20 @@ err_t mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload
 	}
 #endif
 	if (MQTT_IsFakingOnlineMQTT()) {
+		if (g_sim_deferPublishAcks && cb) {
+			if (g_sim_numPendingAcks >= MQTT_REQ_MAX_IN_FLIGHT) {
+				// request queue full
+				return ERR_MEM;
+			}
+			g_sim_pendingAcks[g_sim_numPendingAcks].cb = cb;
+			g_sim_pendingAcks[g_sim_numPendingAcks].arg = arg;
+			g_sim_numPendingAcks++;
+		}
 		// on Windows simulator, forward MQTT publish for unit testing
 		SIM_OnMQTTPublish(topic, payload, payload_length, qos, retain);
+		if (!g_sim_deferPublishAcks && cb) {
+			cb(arg, ERR_OK);
+		}
 		return 0;
 	}
 
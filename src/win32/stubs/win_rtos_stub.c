@@ -104,7 +104,8 @@ void rtos_delete_thread(int i) {
 int lwip_fcntl(int s, int cmd, int val) {
 	int argp;
 
-	argp = 1;
+	// callers pass O_NONBLOCK or 0
+	argp = val ? 1 : 0;
 	if (ioctlsocket(s,
 		FIONBIO,
 		&argp) == SOCKET_ERROR)
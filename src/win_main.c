@@ -37,6 +37,7 @@
 #include "driver/drv_public.h"
 #include "cmnds/cmd_public.h"
 #include "httpserver/new_http.h"
+#include "httpserver/http_tcp_server.h"
 #include "quicktick.h"
 #include "hal/hal_flashVars.h"
 #include "selftest/selftest_local.h"
@@ -147,6 +148,7 @@ void Sim_RunFrames(int n, bool bApplyRealtimeWait)
 
 bool bObkStarted = false;
 void SIM_Hack_ClearSimulatedPinRoles();
+void SIM_ClearFlashVars();
 
 void CHANNEL_FreeLabels();
 
@@ -161,6 +163,9 @@ void SIM_ShutdownOBK()
 		SVM_FreeAllFiles();
 		SVM_StopAllScripts();
 		SIM_Hack_ClearSimulatedPinRoles();
+		// written to flash of previous run, then forgotten
+		Channel_FlushPendingSaves();
+		SIM_ClearFlashVars();
 		WIN_ResetMQTT();
 		SPILED_Shutdown(); // won't hurt
 		CHANNEL_FreeLabels();
@@ -221,6 +226,8 @@ void Win_DoUnitTests()
 	Test_MAX72XX();
 
 	Test_Commands_Channels();
+	Test_ChannelSave();
+	Test_FlashVarsJournal();
 
 	Test_Driver_TCL_AC();
 
@@ -235,6 +242,7 @@ void Win_DoUnitTests()
 	Test_Demo_ConditionalRelay();
 	Test_Expressions_RunTests_Braces();
 	Test_Expressions_RunTests_Basic();
+	Test_Expressions_Cached();
 	Test_Enums();
 	Test_Backlog();
 	Test_DoorSensor();
@@ -293,6 +301,7 @@ void Win_DoUnitTests()
 	Test_ChangeHandlers();
 	Test_ChangeHandlers2();
 	Test_ChangeHandlers_EnsureThatChannelVariableIsExpandedAtHandlerRunTime();
+	Test_ChangeHandlers_Stress();
 	Test_RepeatingEvents();
 	Test_Commands_Alias();
 	Test_Demo_SignAndValue();
@@ -300,8 +309,15 @@ void Win_DoUnitTests()
 	Test_LFS();
 	Test_Scripting();
 	Test_Tokenizer();
+	Test_Logging();
 	Test_Pins();
 	Test_Http();
+	Test_Http_KeepAlive();
+	Test_Http_Concurrency();
+	Test_Http_Events();
+	Test_Http_Routes();
+	Test_Http_StaticAssets();
+	Test_Http_ZeroCopy();
 	Test_Http_LED();
 	Test_DeviceGroups();
 
@@ -310,6 +326,19 @@ void Win_DoUnitTests()
 	// reset whole device
 	SIM_ClearOBK(0);
 }
+// speed comparisons, they print results, so they are not part of unit tests
+void Win_DoBenchmarks()
+{
+	Benchmark_Expressions();
+	Benchmark_ChangeHandlers();
+	Benchmark_Logging();
+	Benchmark_WS2812B_Encoding();
+	Benchmark_Http_Routes();
+	Benchmark_Http_KeepAlive();
+	Benchmark_Http_Concurrency();
+
+	SIM_ClearOBK(0);
+}
 long g_delta;
 float SIM_GetDeltaTimeSeconds()
 {
@@ -394,6 +423,7 @@ void SIM_GeneratePowerStateDesc(char *o, int outLen)
 int __cdecl main(int argc, char **argv)
 {
 	bool bWantsUnitTests = 1;
+	bool bWantsBenchmarks = 0;
 
 #ifndef LINUX
 	WSADATA wsaData;
@@ -448,6 +478,10 @@ int __cdecl main(int argc, char **argv)
 #endif
 					}
 				}
+				else if (wal_strnicmp(argv[i] + 1, "runBenchmarks", 13) == 0)
+				{
+					bWantsBenchmarks = 1;
+				}
 				else if (wal_strnicmp(argv[i] + 1, "runUnitTests", 12) == 0)
 				{
 					i++;
@@ -640,11 +674,19 @@ int __cdecl main(int argc, char **argv)
 		Win_DoUnitTests();
 		Sim_RunFrames(50, false);
 		g_bDoingUnitTestsNow = 0;
-		if (g_selfTestsMode > 1)
+		if (g_selfTestsMode > 1 && !bWantsBenchmarks)
 		{
 			return SelfTest_GetNumErrors();
 		}
 	}
+	if (bWantsBenchmarks)
+	{
+		g_bDoingUnitTestsNow = 1;
+		SIM_ClearOBK(0);
+		Win_DoBenchmarks();
+		g_bDoingUnitTestsNow = 0;
+		return SelfTest_GetNumErrors();
+	}
 
 #if ENABLE_SDL_WINDOW
 	SIM_CreateWindow(argc, argv);